@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+
+AnnotationSender is what JSONManager hands its finished messages to. The
+CommunicationManager implements it by queueing them for the JSON clients
+of the trainee being looked at.
+
+It is kept apart from CommunicationManager so that the code that only
+builds annotation messages (JSONManager, and the GUI through it) does not
+pull in the socket headers, and can be built without Winsock, e.g. for the
+benchmarks and checks on another platform.
+
+*/
+
+#include <vector>
+
+class AnnotationSender
+{
+public:
+	virtual ~AnnotationSender() {}
+
+	// Whether any client asked for the binary format (otherwise there is no need to encode it)
+	virtual bool hasBinaryClients() = 0;
+
+	// Sends a message (one line of JSON) to the clients of the focused trainee; binary-format
+	// clients get binaryMessage instead, if there is one. Past the high-water mark, it replaces
+	// the message still waiting with the same collapse key ("" = none)
+	virtual int sendAnnotationMessage(const char* message, const char* collapseKey, const char* binaryMessage, int binarySize) = 0;
+
+	// The same, but to the given clients only, whichever trainee they belong to
+	virtual int sendAnnotationMessageTo(const std::vector<unsigned int>& clients, const char* message, const char* collapseKey,
+		const char* binaryMessage, int binarySize) = 0;
+};
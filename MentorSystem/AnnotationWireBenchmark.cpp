@@ -0,0 +1,412 @@
+#include "AnnotationWireBenchmark.h"
+#include "CheckCommandLine.h"
+#include "AnnotationWireFormat.h"
+#include "JSONManager.h"
+#include "JSONDefinitions.h"
+#include "json.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+
+namespace {
+
+	// A synthetic stroke is sent this many times as it grows: created, then updated
+	const int SENDS_PER_STROKE = 5;
+
+	// Pixels between the points of a synthetic stroke, about what a finger leaves behind
+	const double STROKE_STEP_PIXELS = 4.0;
+
+	// A finished synthetic stroke is then moved, turned and zoomed this many times, one message each
+	const int GESTURE_STEPS_PER_STROKE = 10;
+
+	struct BenchmarkOptions
+	{
+		std::string input;
+		int strokes;
+		int points;
+		int repeats;
+	};
+
+	// Where a transform takes a point
+	void applyTransform(const double* transform, double x, double y, double& outX, double& outY)
+	{
+		outX = transform[0] * x + transform[1] * y + transform[2];
+		outY = transform[3] * x + transform[4] * y + transform[5];
+	}
+
+	// Strokes wandering across the screen, each moved around once finished, a virtual tool following them,
+	// and every other stroke erased again. The gestures are sent as transforms; fullUpdates gets the
+	// updates with every point that they replace
+	void makeSyntheticSession(const BenchmarkOptions& options, std::vector<AnnotationMessage>& session,
+		std::vector<AnnotationMessage>& fullUpdates)
+	{
+		std::mt19937 rng(12345);
+		std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+		int toolId = options.strokes;
+
+		for (int s = 0; s < options.strokes; s++) {
+			std::vector<double> stroke;
+
+			double x = 0.2 + 0.6 * unit(rng);
+			double y = 0.2 + 0.6 * unit(rng);
+			double heading = 2 * 3.14159265358979 * unit(rng);
+
+			for (int p = 0; p < options.points; p++) {
+				stroke.push_back(x);
+				stroke.push_back(y);
+
+				heading += 0.3 * (unit(rng) - 0.5);
+				x += cos(heading) * STROKE_STEP_PIXELS / RESOLUTION_X;
+				y += sin(heading) * STROKE_STEP_PIXELS / RESOLUTION_Y;
+			}
+
+			for (int send = 1; send <= SENDS_PER_STROKE; send++) {
+				AnnotationMessage message;
+				message.command = send == 1 ? WIRE_CREATE_ANNOTATION : WIRE_UPDATE_ANNOTATION;
+				message.id = s;
+				message.annotationType = WIRE_POLYLINE;
+				message.points.assign(stroke.begin(), stroke.begin() + 2 * (options.points * send / SENDS_PER_STROKE));
+				session.push_back(message);
+			}
+
+			// Turned and zoomed around the end of the stroke a little at a time, and dragged along
+			double angle = 0.0;
+			double scale = 1.0;
+			double dragX = 0.0;
+			double dragY = 0.0;
+
+			for (int step = 1; step <= GESTURE_STEPS_PER_STROKE; step++) {
+				angle += 0.035 * (unit(rng) - 0.5);
+				scale *= 1.0 + 0.04 * (unit(rng) - 0.5);
+				dragX += 0.01 * (unit(rng) - 0.5);
+				dragY += 0.01 * (unit(rng) - 0.5);
+
+				AnnotationMessage transform;
+				transform.command = WIRE_TRANSFORM_ANNOTATION;
+				transform.id = s;
+				transform.annotationType = WIRE_POLYLINE;
+				transform.transform[0] = scale * cos(angle);
+				transform.transform[1] = -scale * sin(angle);
+				transform.transform[2] = x - transform.transform[0] * x - transform.transform[1] * y + dragX;
+				transform.transform[3] = scale * sin(angle);
+				transform.transform[4] = scale * cos(angle);
+				transform.transform[5] = y - transform.transform[3] * x - transform.transform[4] * y + dragY;
+				session.push_back(transform);
+
+				AnnotationMessage update;
+				update.command = WIRE_UPDATE_ANNOTATION;
+				update.id = s;
+				update.annotationType = WIRE_POLYLINE;
+				update.points.resize(stroke.size());
+				for (size_t i = 0; i + 1 < stroke.size(); i += 2) {
+					applyTransform(transform.transform, stroke[i], stroke[i + 1], update.points[i], update.points[i + 1]);
+				}
+				fullUpdates.push_back(update);
+			}
+
+			AnnotationMessage tool;
+			tool.command = s == 0 ? WIRE_CREATE_ANNOTATION : WIRE_UPDATE_ANNOTATION;
+			tool.id = toolId;
+			tool.annotationType = WIRE_VIRTUAL_TOOL;
+			tool.points.push_back(x);
+			tool.points.push_back(y);
+			tool.rotation = -360.0 * unit(rng);
+			tool.scale = 0.09;
+			tool.toolType = SCALPEL;
+			tool.selectableColor = 0;
+			session.push_back(tool);
+
+			if (s % 2 == 1) {
+				AnnotationMessage erase;
+				erase.command = WIRE_DELETE_ANNOTATION;
+				erase.id = s;
+				erase.annotationType = WIRE_NO_ANNOTATION;
+				session.push_back(erase);
+			}
+		}
+	}
+
+	// The annotation messages of a recorded session; anything else in it (video feedback) is left out
+	bool readRecordedSession(const std::string& path, std::vector<AnnotationMessage>& session)
+	{
+		std::ifstream file(path.c_str());
+		if (!file) {
+			std::cout << "error: cannot open the session " << path << std::endl;
+			return false;
+		}
+
+		Json::CharReaderBuilder rbuilder;
+		std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+
+		std::string line;
+		while (std::getline(file, line)) {
+			Json::Value recorded;
+			std::string errors;
+
+			if (!reader->parse(line.data(), line.data() + line.size(), &recorded, &errors) || !recorded.isObject()) {
+				continue;
+			}
+
+			std::string command = recorded[COMMAND].isString() ? recorded[COMMAND].asString() : "";
+			if (command != CREATE_ANNOTATION_COMMAND && command != UPDATE_ANNOTATION_COMMAND && command != DELETE_ANNOTATION_COMMAND
+				&& command != TRANSFORM_ANNOTATION_COMMAND) {
+				continue;
+			}
+
+			AnnotationMessage message;
+			message.command = JSONManager::findWireCommand(command);
+			message.id = recorded[ID].asInt();
+			message.version = recorded[GEOMETRY_VERSION].asInt();
+
+			if (message.command == WIRE_TRANSFORM_ANNOTATION) {
+				message.annotationType = WIRE_POLYLINE;
+
+				const Json::Value& transform = recorded[TRANSFORM];
+				for (Json::ArrayIndex i = 0; i < transform.size() && i < (Json::ArrayIndex)AnnotationWireFormat::TRANSFORM_SIZE; i++) {
+					message.transform[i] = transform[i].asDouble();
+				}
+			}
+			else if (message.command != WIRE_DELETE_ANNOTATION) {
+				// Older clients got the annotation as currentAnnotation
+				const Json::Value& memory = recorded[ANNOTATION_MEMORY];
+				const Json::Value& annotation = memory.isMember("annotation") ? memory["annotation"] : memory[CURRENT_ANNOTATION];
+
+				const Json::Value& points = annotation[INITIAL_POINTS];
+				for (Json::ArrayIndex i = 0; i < points.size(); i++) {
+					message.points.push_back(points[i][X_COORDINATE].asDouble());
+					message.points.push_back(points[i][Y_COORDINATE].asDouble());
+				}
+
+				if (annotation[ANNOTATION_TYPE].asString() == VIRTUAL_TOOL_ANNOTATION) {
+					message.annotationType = WIRE_VIRTUAL_TOOL;
+					message.rotation = annotation[ROTATION].asDouble();
+					message.scale = annotation[SCALE].asDouble();
+					message.toolType = annotation[TOOL_TYPE].asString();
+					message.selectableColor = annotation[SELECTABLE_COLOR].asInt();
+				}
+				else {
+					message.annotationType = WIRE_POLYLINE;
+				}
+			}
+
+			session.push_back(message);
+		}
+
+		if (session.empty()) {
+			std::cout << "error: the session " << path << " holds no annotation messages" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	double microsecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+	{
+		std::chrono::duration<double, std::micro> elapsed = end - start;
+		return elapsed.count();
+	}
+
+}
+
+int runAnnotationWireBenchmark(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	options.strokes = 50;
+	options.points = 200;
+	options.repeats = 20;
+
+	CheckCommandLine commandLine("--benchmark-annotations");
+	commandLine.add("--input", "session", options.input);
+	commandLine.add("--strokes", "count", options.strokes);
+	commandLine.add("--points", "count", options.points);
+	commandLine.add("--repeats", "count", options.repeats);
+
+	if (!commandLine.parse(argc, argv)) {
+		return 1;
+	}
+
+	if (options.strokes <= 0 || options.points < SENDS_PER_STROKE || options.repeats <= 0) {
+		std::cout << "error: strokes and repeats must be positive, and a stroke needs at least " << SENDS_PER_STROKE << " points" << std::endl;
+		commandLine.printUsage();
+		return 1;
+	}
+
+	std::vector<AnnotationMessage> session;
+	std::vector<AnnotationMessage> fullUpdates;
+
+	if (options.input.empty()) {
+		makeSyntheticSession(options, session, fullUpdates);
+	}
+	else if (!readRecordedSession(options.input, session)) {
+		return 1;
+	}
+
+	size_t numMessages = session.size();
+	size_t numPoints = 0;
+	for (size_t m = 0; m < numMessages; m++) {
+		numPoints += session[m].points.size() / 2;
+	}
+
+	std::cout << "annotation wire benchmark: " << (options.input.empty() ? "synthetic session" : options.input) << ", "
+		<< numMessages << " messages, " << numPoints << " points" << std::endl;
+
+	// JSON, the way JSONManager builds and writes it, newline included
+	Json::StreamWriterBuilder wbuilder;
+	wbuilder[INDENTATION] = NO_INDENTATION;
+
+	size_t jsonBytes = 0;
+	size_t largestJSON = 0;
+
+	std::chrono::steady_clock::time_point jsonStart = std::chrono::steady_clock::now();
+	for (int r = 0; r < options.repeats; r++) {
+		for (size_t m = 0; m < numMessages; m++) {
+			std::string text = Json::writeString(wbuilder, JSONManager::buildJSONMessage(session[m])) + "\n";
+
+			if (r == 0) {
+				jsonBytes += text.size();
+				largestJSON = text.size() > largestJSON ? text.size() : largestJSON;
+			}
+		}
+	}
+	double jsonMicroseconds = microsecondsBetween(jsonStart, std::chrono::steady_clock::now()) / options.repeats / numMessages;
+
+	// Binary, into one buffer reused for every message, as JSONManager does
+	std::string encoded;
+	size_t binaryBytes = 0;
+	size_t largestBinary = 0;
+	unsigned long long encodedTotal = 0;
+
+	std::chrono::steady_clock::time_point binaryStart = std::chrono::steady_clock::now();
+	for (int r = 0; r < options.repeats; r++) {
+		for (size_t m = 0; m < numMessages; m++) {
+			encoded.clear();
+			AnnotationWireFormat::encode(session[m], encoded);
+			encodedTotal += encoded.size();
+
+			if (r == 0) {
+				binaryBytes += encoded.size();
+				largestBinary = encoded.size() > largestBinary ? encoded.size() : largestBinary;
+			}
+		}
+	}
+	double binaryMicroseconds = microsecondsBetween(binaryStart, std::chrono::steady_clock::now()) / options.repeats / numMessages;
+
+	// What the quantization costs: how far the decoded points are from the sent ones, in screen pixels
+	double largestErrorPixels = 0.0;
+	int mismatches = 0;
+
+	for (size_t m = 0; m < numMessages; m++) {
+		encoded.clear();
+		AnnotationWireFormat::encode(session[m], encoded);
+
+		AnnotationMessage decoded;
+		int size = AnnotationWireFormat::decode(encoded.data(), encoded.size(), decoded);
+
+		if (size != (int)encoded.size() || decoded.command != session[m].command || decoded.id != session[m].id
+			|| decoded.points.size() != session[m].points.size() || decoded.toolType != session[m].toolType
+			|| decoded.version != session[m].version) {
+			mismatches++;
+			continue;
+		}
+
+		// A transform's error is how far it takes the corners of the screen off
+		if (decoded.command == WIRE_TRANSFORM_ANNOTATION) {
+			for (int corner = 0; corner < 4; corner++) {
+				double sentX, sentY, decodedX, decodedY;
+				applyTransform(session[m].transform, corner % 2, corner / 2, sentX, sentY);
+				applyTransform(decoded.transform, corner % 2, corner / 2, decodedX, decodedY);
+
+				double errorX = fabs(decodedX - sentX) * RESOLUTION_X;
+				double errorY = fabs(decodedY - sentY) * RESOLUTION_Y;
+				largestErrorPixels = errorX > largestErrorPixels ? errorX : largestErrorPixels;
+				largestErrorPixels = errorY > largestErrorPixels ? errorY : largestErrorPixels;
+			}
+		}
+
+		for (size_t i = 0; i + 1 < decoded.points.size(); i += 2) {
+			double errorX = fabs(decoded.points[i] - session[m].points[i]) * RESOLUTION_X;
+			double errorY = fabs(decoded.points[i + 1] - session[m].points[i + 1]) * RESOLUTION_Y;
+			largestErrorPixels = errorX > largestErrorPixels ? errorX : largestErrorPixels;
+			largestErrorPixels = errorY > largestErrorPixels ? errorY : largestErrorPixels;
+		}
+	}
+
+	Json::Value results;
+	results["input"] = options.input.empty() ? "synthetic" : options.input;
+	results["messages"] = (Json::UInt64)numMessages;
+	results["points"] = (Json::UInt64)numPoints;
+	results["repeats"] = options.repeats;
+	results["json"]["bytes"] = (Json::UInt64)jsonBytes;
+	results["json"]["largest_message_bytes"] = (Json::UInt64)largestJSON;
+	results["json"]["encode_us_per_message"] = jsonMicroseconds;
+	results["binary"]["bytes"] = (Json::UInt64)binaryBytes;
+	results["binary"]["largest_message_bytes"] = (Json::UInt64)largestBinary;
+	results["binary"]["encode_us_per_message"] = binaryMicroseconds;
+	results["size_ratio"] = (double)binaryBytes / jsonBytes;
+	results["encode_speedup"] = binaryMicroseconds > 0.0 ? jsonMicroseconds / binaryMicroseconds : 0.0;
+	results["largest_error_pixels"] = largestErrorPixels;
+	results["mismatches"] = mismatches;
+
+	std::cout << "  json: " << jsonBytes << " bytes (" << ((double)jsonBytes / numMessages) << " per message, largest " << largestJSON
+		<< "), " << jsonMicroseconds << " us/message to encode" << std::endl;
+	std::cout << "  binary: " << binaryBytes << " bytes (" << ((double)binaryBytes / numMessages) << " per message, largest " << largestBinary
+		<< "), " << binaryMicroseconds << " us/message to encode" << std::endl;
+	std::cout << "  binary is " << (100.0 * binaryBytes / jsonBytes) << "% of the JSON, encoded " << results["encode_speedup"].asDouble()
+		<< " times as fast; points within " << largestErrorPixels << " pixels" << std::endl;
+
+	// What the gestures would have cost as updates with every point, as lines were sent before transforms
+	if (!fullUpdates.empty()) {
+		size_t transforms = 0;
+		size_t transformJSONBytes = 0;
+		size_t transformBinaryBytes = 0;
+
+		for (size_t m = 0; m < numMessages; m++) {
+			if (session[m].command != WIRE_TRANSFORM_ANNOTATION) {
+				continue;
+			}
+
+			encoded.clear();
+			AnnotationWireFormat::encode(session[m], encoded);
+
+			transforms++;
+			transformJSONBytes += Json::writeString(wbuilder, JSONManager::buildJSONMessage(session[m])).size() + 1;
+			transformBinaryBytes += encoded.size();
+		}
+
+		size_t fullJSONBytes = 0;
+		size_t fullBinaryBytes = 0;
+
+		for (size_t m = 0; m < fullUpdates.size(); m++) {
+			encoded.clear();
+			AnnotationWireFormat::encode(fullUpdates[m], encoded);
+
+			fullJSONBytes += Json::writeString(wbuilder, JSONManager::buildJSONMessage(fullUpdates[m])).size() + 1;
+			fullBinaryBytes += encoded.size();
+		}
+
+		results["gestures"]["messages"] = (Json::UInt64)transforms;
+		results["gestures"]["transform_json_bytes"] = (Json::UInt64)transformJSONBytes;
+		results["gestures"]["transform_binary_bytes"] = (Json::UInt64)transformBinaryBytes;
+		results["gestures"]["full_json_bytes"] = (Json::UInt64)fullJSONBytes;
+		results["gestures"]["full_binary_bytes"] = (Json::UInt64)fullBinaryBytes;
+
+		std::cout << "  gestures: " << transforms << " transforms, " << transformJSONBytes << " bytes as JSON and " << transformBinaryBytes
+			<< " as binary, instead of " << fullJSONBytes << " and " << fullBinaryBytes << " sending every point" << std::endl;
+	}
+
+	if (mismatches > 0) {
+		std::cout << "error: " << mismatches << " messages did not decode to what was encoded" << std::endl;
+	}
+
+	if (!commandLine.writeResults(results)) {
+		return 1;
+	}
+
+	// Keeps the timed encoding from being optimized away
+	return encodedTotal > 0 && mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+
+Compares the two formats the annotations can be sent in: the JSON messages
+(built and written with jsoncpp, as JSONManager does) and the binary ones
+of AnnotationWireFormat. For every message of a session it measures the
+bytes on the wire and the time to encode it both ways, and decodes the
+binary message again to check how far the quantized points moved.
+
+The session is either recorded, a file with the JSON messages a client
+got, one per line (what a client connected to the JSON port receives,
+e.g. saved with netcat), or synthetic: strokes drawn across the screen,
+each created, updated a few times as it grows, moved around with a few
+transforms and deleted again, with a virtual tool moved around in
+between. For a synthetic session it also tells what the transforms would
+have cost as updates with every point.
+
+Run the mentor with --benchmark-annotations, optionally followed by:
+
+  --input <file>        recorded session instead of a synthetic one
+  --strokes <count>     synthetic strokes (default 50)
+  --points <count>      points of a finished synthetic stroke (default 200)
+  --repeats <count>     times the session is encoded, for steadier timings (default 20)
+  --output <file>       also write the results there
+
+*/
+
+// Returns 0 (the process exit code), or 1 for bad options or input
+int runAnnotationWireBenchmark(int argc, char* argv[]);
@@ -0,0 +1,258 @@
+#include "AnnotationWireFormat.h"
+#include <math.h>
+#include <string.h>
+
+const int AnnotationWireFormat::HEADER_SIZE;
+const int AnnotationWireFormat::QUANTIZATION_STEPS;
+const int AnnotationWireFormat::TRANSFORM_SIZE;
+
+void AnnotationWireFormat::encode(const AnnotationMessage& message, std::string& out)
+{
+	size_t start = out.size();
+
+	out.push_back('A');
+	out.push_back('W');
+	out.push_back((char)message.command);
+	out.push_back((char)message.annotationType);
+	appendUInt32(out, (unsigned int)message.id);
+
+	// The payload size is filled in once the payload is written
+	appendUInt32(out, 0);
+	size_t payloadStart = out.size();
+
+	if (message.command == WIRE_JSON_MESSAGE) {
+		out.append(message.json);
+	}
+	else if (message.command == WIRE_TRANSFORM_ANNOTATION) {
+		appendVarint(out, (unsigned int)message.version);
+		for (int i = 0; i < TRANSFORM_SIZE; i++)
+		{
+			appendFloat(out, message.transform[i]);
+		}
+	}
+	else if (message.command != WIRE_DELETE_ANNOTATION && message.annotationType == WIRE_POLYLINE) {
+		int count = (int)(message.points.size() / 2);
+		appendVarint(out, (unsigned int)count);
+
+		int previousX = 0;
+		int previousY = 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			int x = quantize(message.points[2 * i]);
+			int y = quantize(message.points[2 * i + 1]);
+
+			appendSigned(out, x - previousX);
+			appendSigned(out, y - previousY);
+
+			previousX = x;
+			previousY = y;
+		}
+
+		appendVarint(out, (unsigned int)message.version);
+	}
+	else if (message.command != WIRE_DELETE_ANNOTATION && message.annotationType == WIRE_VIRTUAL_TOOL) {
+		appendSigned(out, message.points.size() >= 2 ? quantize(message.points[0]) : 0);
+		appendSigned(out, message.points.size() >= 2 ? quantize(message.points[1]) : 0);
+		appendFloat(out, message.rotation);
+		appendFloat(out, message.scale);
+		out.push_back((char)message.selectableColor);
+		appendVarint(out, (unsigned int)message.toolType.size());
+		out.append(message.toolType);
+	}
+
+	unsigned int payloadSize = (unsigned int)(out.size() - payloadStart);
+	for (int i = 0; i < 4; i++)
+	{
+		out[start + 8 + i] = (char)((payloadSize >> (8 * i)) & 0xFF);
+	}
+}
+
+void AnnotationWireFormat::encodeJSON(const char* json, size_t size, std::string& out)
+{
+	out.push_back('A');
+	out.push_back('W');
+	out.push_back((char)WIRE_JSON_MESSAGE);
+	out.push_back((char)WIRE_NO_ANNOTATION);
+	appendUInt32(out, 0);
+	appendUInt32(out, (unsigned int)size);
+	out.append(json, size);
+}
+
+int AnnotationWireFormat::decode(const char* data, size_t size, AnnotationMessage& message)
+{
+	if (size < (size_t)HEADER_SIZE) {
+		return 0;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)data;
+	if (bytes[0] != 'A' || bytes[1] != 'W') {
+		return -1;
+	}
+
+	unsigned int payloadSize = readUInt32(bytes + 8);
+	if (size - HEADER_SIZE < payloadSize) {
+		return 0;
+	}
+
+	message.command = bytes[2];
+	message.annotationType = bytes[3];
+	message.id = (int)readUInt32(bytes + 4);
+	message.points.clear();
+	message.toolType.clear();
+	message.rotation = 0.0;
+	message.scale = 0.0;
+	message.selectableColor = 0;
+	message.json.clear();
+	message.version = 0;
+	message.setIdentityTransform();
+
+	const unsigned char* payload = bytes + HEADER_SIZE;
+	const unsigned char* end = payload + payloadSize;
+
+	if (message.command == WIRE_JSON_MESSAGE) {
+		message.json.assign((const char*)payload, payloadSize);
+	}
+	else if (message.command == WIRE_TRANSFORM_ANNOTATION) {
+		unsigned int version;
+		if (!readVarint(payload, end, version) || end - payload < 4 * TRANSFORM_SIZE) {
+			return -1;
+		}
+		message.version = (int)version;
+
+		for (int i = 0; i < TRANSFORM_SIZE; i++)
+		{
+			message.transform[i] = readFloat(payload + 4 * i);
+		}
+	}
+	else if (message.command != WIRE_DELETE_ANNOTATION && message.annotationType == WIRE_POLYLINE) {
+		unsigned int count;
+		if (!readVarint(payload, end, count) || count > payloadSize) {
+			return -1;
+		}
+
+		int x = 0;
+		int y = 0;
+		message.points.reserve(2 * count);
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			int dx, dy;
+			if (!readSigned(payload, end, dx) || !readSigned(payload, end, dy)) {
+				return -1;
+			}
+
+			x += dx;
+			y += dy;
+			message.points.push_back((double)x / QUANTIZATION_STEPS);
+			message.points.push_back((double)y / QUANTIZATION_STEPS);
+		}
+
+		unsigned int version;
+		if (!readVarint(payload, end, version)) {
+			return -1;
+		}
+		message.version = (int)version;
+	}
+	else if (message.command != WIRE_DELETE_ANNOTATION && message.annotationType == WIRE_VIRTUAL_TOOL) {
+		int x, y;
+		unsigned int nameLength;
+
+		if (!readSigned(payload, end, x) || !readSigned(payload, end, y) || end - payload < 9) {
+			return -1;
+		}
+		message.points.push_back((double)x / QUANTIZATION_STEPS);
+		message.points.push_back((double)y / QUANTIZATION_STEPS);
+
+		message.rotation = readFloat(payload);
+		message.scale = readFloat(payload + 4);
+		message.selectableColor = payload[8];
+		payload += 9;
+
+		if (!readVarint(payload, end, nameLength) || (size_t)(end - payload) < nameLength) {
+			return -1;
+		}
+		message.toolType.assign((const char*)payload, nameLength);
+	}
+
+	return HEADER_SIZE + (int)payloadSize;
+}
+
+void AnnotationWireFormat::appendVarint(std::string& out, unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((char)((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+void AnnotationWireFormat::appendSigned(std::string& out, int value)
+{
+	appendVarint(out, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+}
+
+void AnnotationWireFormat::appendUInt32(std::string& out, unsigned int value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		out.push_back((char)((value >> (8 * i)) & 0xFF));
+	}
+}
+
+void AnnotationWireFormat::appendFloat(std::string& out, double value)
+{
+	float single = (float)value;
+	unsigned int bits;
+	memcpy(&bits, &single, sizeof(bits));
+
+	appendUInt32(out, bits);
+}
+
+bool AnnotationWireFormat::readVarint(const unsigned char*& data, const unsigned char* end, unsigned int& value)
+{
+	value = 0;
+
+	for (int shift = 0; shift < 35 && data < end; shift += 7)
+	{
+		unsigned char byte = *data++;
+		value |= (unsigned int)(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool AnnotationWireFormat::readSigned(const unsigned char*& data, const unsigned char* end, int& value)
+{
+	unsigned int zigzag;
+	if (!readVarint(data, end, zigzag)) {
+		return false;
+	}
+
+	value = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+	return true;
+}
+
+unsigned int AnnotationWireFormat::readUInt32(const unsigned char* data)
+{
+	return (unsigned int)data[0] | ((unsigned int)data[1] << 8) | ((unsigned int)data[2] << 16) | ((unsigned int)data[3] << 24);
+}
+
+float AnnotationWireFormat::readFloat(const unsigned char* data)
+{
+	unsigned int bits = readUInt32(data);
+	float single;
+	memcpy(&single, &bits, sizeof(single));
+
+	return single;
+}
+
+int AnnotationWireFormat::quantize(double coordinate)
+{
+	return (int)floor(coordinate * QUANTIZATION_STEPS + 0.5);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+/*
+
+AnnotationWireFormat is the compact binary encoding of the annotation
+messages, for JSON clients that ask for it (see the README). A long stroke
+sent as JSON is an {"x":...,"y":...} object with full double precision for
+every vertex; here it is a few bytes per vertex.
+
+Every message starts with a 12-byte header, little-endian:
+
+  magic 'A' 'W', command (1 byte), annotation type (1 byte),
+  annotation id (int32), payload size (uint32)
+
+and the payload depends on the two codes:
+
+  polyline      point count, then every point as the difference to the
+                one before (the first one to 0, 0), x then y, each a
+                zigzag varint, then the geometry version as a varint
+  transform     geometry version as a varint, then the six entries of the
+                transform as float32 (a polyline only)
+  virtual tool  x and y as zigzag varints, rotation and scale as float32,
+                selectable colour (1 byte), tool type as a varint length
+                and the name's bytes
+  delete        nothing
+  JSON          a JSON message as JSON clients get it, for the messages
+                that have no binary form (video feedback)
+
+A transform moves the points of the polyline as they were sent with that
+geometry version, to x' = t0 x + t1 y + t2, y' = t3 x + t4 y + t5. Each
+time the points are sent whole (a create, or an update when a client
+asked for the line again) the version goes up and the transform starts
+over, so a transform for another version than the one a client has does
+not apply to its points.
+
+Coordinates are the normalized ones of the JSON messages (0 to 1 across
+the screen), quantized to steps of 1/65535 of the screen, well below a
+pixel. Varints are unsigned LEB128: 7 bits per byte, low bits first, the
+top bit set on every byte but the last. Zigzag maps 0, -1, 1, -2, ... to
+0, 1, 2, 3, ... so small differences of either sign stay small.
+
+*/
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+enum AnnotationWireCommand
+{
+	WIRE_CREATE_ANNOTATION = 1,
+	WIRE_UPDATE_ANNOTATION = 2,
+	WIRE_DELETE_ANNOTATION = 3,
+	WIRE_JSON_MESSAGE = 4,
+	WIRE_TRANSFORM_ANNOTATION = 5
+};
+
+enum AnnotationWireType
+{
+	WIRE_NO_ANNOTATION = 0,
+	WIRE_POLYLINE = 1,
+	WIRE_VIRTUAL_TOOL = 2
+};
+
+// One annotation message, in the terms of the JSON ones
+struct AnnotationMessage
+{
+	int command;
+	int id;
+	int annotationType;
+
+	// Normalized x, y pairs: one for a virtual tool, every vertex of a polyline
+	std::vector<double> points;
+
+	// Polylines only: the geometry version, and for a transform the transform since it
+	int version;
+	double transform[6];
+
+	// Virtual tools only
+	std::string toolType;
+	double rotation;
+	double scale;
+	int selectableColor;
+
+	// WIRE_JSON_MESSAGE only
+	std::string json;
+
+	AnnotationMessage()
+		: command(WIRE_CREATE_ANNOTATION)
+		, id(0)
+		, annotationType(WIRE_NO_ANNOTATION)
+		, version(0)
+		, rotation(0.0)
+		, scale(0.0)
+		, selectableColor(0)
+	{
+		setIdentityTransform();
+	}
+
+	void setIdentityTransform()
+	{
+		transform[0] = 1.0;
+		transform[1] = 0.0;
+		transform[2] = 0.0;
+		transform[3] = 0.0;
+		transform[4] = 1.0;
+		transform[5] = 0.0;
+	}
+};
+
+class AnnotationWireFormat
+{
+public:
+	static const int HEADER_SIZE = 12;
+
+	// Coordinate steps across the screen
+	static const int QUANTIZATION_STEPS = 65535;
+
+	// Entries of a transform
+	static const int TRANSFORM_SIZE = 6;
+
+	// Appends the message to out
+	static void encode(const AnnotationMessage& message, std::string& out);
+
+	// Appends a JSON message (one without a binary form) to out
+	static void encodeJSON(const char* json, size_t size, std::string& out);
+
+	// Reads the message at the start of data. Returns its size, 0 if not all of it is there yet, -1 if it is not a message
+	static int decode(const char* data, size_t size, AnnotationMessage& message);
+
+private:
+	static void appendVarint(std::string& out, unsigned int value);
+	static void appendSigned(std::string& out, int value);
+	static void appendUInt32(std::string& out, unsigned int value);
+	static void appendFloat(std::string& out, double value);
+
+	static bool readVarint(const unsigned char*& data, const unsigned char* end, unsigned int& value);
+	static bool readSigned(const unsigned char*& data, const unsigned char* end, int& value);
+	static unsigned int readUInt32(const unsigned char* data);
+	static float readFloat(const unsigned char* data);
+
+	static int quantize(double coordinate);
+};
@@ -19,6 +19,7 @@
 //Include its header file
 #include "AnnotationsManager.h"
 #include <mutex>
+#include "StageTracer.h"
 
 
 //--------------------------Definitions--------------------------//
@@ -53,6 +54,9 @@ JSONManager* myJSON;
 //CameraManager instance
 CameraManager* myCamera;
 
+//CommunicationManager instance, which knows the trainee shown full screen
+CommunicationManager* myServer;
+
 //Stores all the lines that are going to be drawn by Bressenham
 map<int, LineAnnotation*> lines; 
 std::mutex linesMutex;  // protects lines
@@ -180,6 +184,9 @@ void translate(long double transX, long double transY)
 		(to_transf->getExtremePoints())[2] += transX;
 		(to_transf->getExtremePoints())[3] += transY;
 
+		//the clients get the transform, not the points
+		to_transf->addTranslation(transX, transY);
+
 		//calls the function to recalculate the center
 		to_transf->recalculateCenter();
     }
@@ -236,6 +243,9 @@ void zoom(long double scale)
 		(to_transf->getExtremePoints())[3] = (((to_transf->getExtremePoints())[3] - 
 			(general_center_Y))*scale)+(general_center_Y);
 
+		//the clients get the transform, not the points
+		to_transf->addZoom(scale, general_center_X, general_center_Y);
+
 		//calls the function to recalculate the center
 		to_transf->recalculateCenter();
     }
@@ -303,6 +313,9 @@ void rotate(long double degree)
 		(to_transf->getExtremePoints())[2] = rotated_values[0];
 		(to_transf->getExtremePoints())[3] = rotated_values[1];
 
+		//the clients get the transform, not the points
+		to_transf->addRotation(rad, general_center_X, general_center_Y);
+
 		//calls the function to recalculate the center
 		to_transf->recalculateCenter();
     }
@@ -436,6 +449,21 @@ void keyboard(unsigned char key, int x, int y)
 				TouchOverlayController::debugMessagesEnabled = true;
 			}
 			break;
+		case 't': case 'T':
+			std::cout << "dumping the stage trace" << std::endl;
+			StageTracer::requestDump();
+			break;
+		case '\t':
+			//Shows the next trainee full screen, and sends the annotations to it
+			if (myServer->getSessionCount() > 1) {
+				myServer->setFocusedSession((myServer->getFocusedSession() + 1) % myServer->getSessionCount());
+				std::cout << "showing trainee " << (myServer->getFocusedSession() + 1) << std::endl;
+			}
+			break;
+		case 'p': case 'P':
+			StageTracer::setEnabled(!StageTracer::isEnabled());
+			std::cout << (StageTracer::isEnabled() ? "enabling" : "disabling") << " stage tracing" << std::endl;
+			break;
 		case 'm': case 'M':
 			if (_usingMouseAndMotionCallbacks) {
 				std::cout << "disabling mouse/motion callbacks (using touchscreen instead)" << std::endl;
@@ -584,18 +612,135 @@ void checkAndInterpretCommand()
 		}
 		myCommander->setAnnotationCommandFlag(0);
 	}
+
+	answerLineRequests();
+}
+
+/*
+ * Method Overview: Answers what the clients asked for or acknowledged about the lines
+ * Parameters: None
+ * Return: None
+ */
+void answerLineRequests()
+{
+	vector<AnnotationRequest> requests;
+	int counter;
+
+	myServer->takeAnnotationRequests(requests);
+
+	if(requests.empty())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> linesLock(linesMutex);
+
+	for(counter = 0; counter < (int)requests.size(); counter++)
+	{
+		AnnotationRequest& request = requests.at(counter);
+		map<int, LineAnnotation*>::iterator found = lines.find(request.id);
+
+		//Not a line (or not anymore)
+		if(found == lines.end())
+		{
+			continue;
+		}
+
+		if(request.version < 0)
+		{
+			//The points as they are now, as a new geometry for the client that asked only; the
+			//others keep getting transforms for the version they acknowledged, which stays valid
+			vector<unsigned int> asking_client(1, request.client);
+
+			found->second->startNewGeometry();
+			createJSONLineMessage(UPDATE_ANNOTATION_COMMAND, found->second, &asking_client);
+		}
+		else
+		{
+			//The line may have moved while the points the client acknowledged were on their way
+			map<unsigned int, int> acknowledged_version;
+			acknowledged_version[request.client] = request.version;
+
+			sendLineTransforms(found->second, acknowledged_version);
+		}
+	}
 }
 
 /*
  * Method Overview: Uses the JSONManager to create a JSON Message
- * Parameters: Message command, annotation to make the massage from
+ * Parameters: Message command, annotation to make the massage from, clients to send it to (NULL = the focused trainee's)
  * Return: None
  */
-void createJSONLineMessage(string command, LineAnnotation* annotation)
+void createJSONLineMessage(string command, LineAnnotation* annotation, const vector<unsigned int>* clients)
 {
 	int null_int = 0;
-	vector<double> null_double_vector;
-	myJSON->createJSONable(annotation->getID(), command, annotation->getPoints(), NULL, null_double_vector, null_int);
+
+	//A new line: what the clients acknowledged under its id was of another one
+	if(command == CREATE_ANNOTATION_COMMAND)
+	{
+		myServer->forgetAnnotation(annotation->getID());
+	}
+
+	/*
+	 * The line_information structure contains:
+	 * line_information[0] = geometry version
+	 */
+	vector<double> line_information;
+	line_information.push_back((double)annotation->getGeometryVersion());
+
+	myJSON->createJSONable(annotation->getID(), command, annotation->getPoints(), NULL, line_information, null_int, clients);
+}
+
+/*
+ * Method Overview: Uses the JSONManager to create the JSON Transform Messages of a line
+ * Parameters: Line, geometry version every client acknowledged (by client id)
+ * Return: None
+ */
+void sendLineTransforms(LineAnnotation* annotation, const map<unsigned int, int>& acknowledged_versions)
+{
+	int null_int = 0;
+	vector<long double> null_long_vector;
+	long double transform[4];
+
+	//The clients that acknowledged the same version get the same message
+	map<int, vector<unsigned int> > clients_of_version;
+	map<unsigned int, int>::const_iterator client;
+
+	for(client = acknowledged_versions.begin(); client != acknowledged_versions.end(); client++)
+	{
+		clients_of_version[client->second].push_back(client->first);
+	}
+
+	map<int, vector<unsigned int> >::iterator version;
+
+	for(version = clients_of_version.begin(); version != clients_of_version.end(); version++)
+	{
+		//A version this line never had, or one it has not moved since
+		if(!annotation->getTransformSince(version->first, transform)
+			|| (transform[0] == 1.0 && transform[1] == 0.0 && transform[2] == 0.0 && transform[3] == 0.0))
+		{
+			continue;
+		}
+
+		/*
+		 * The line_information structure contains:
+		 * line_information[0] = geometry version
+		 * line_information[1] = scale
+		 * line_information[2] = rotation (radians)
+		 * line_information[3] = X translation
+		 * line_information[4] = Y translation
+		 */
+		vector<double> line_information;
+		line_information.push_back((double)version->first);
+		line_information.push_back((double)transform[0]);
+		line_information.push_back((double)transform[1]);
+		line_information.push_back((double)transform[2]);
+		line_information.push_back((double)transform[3]);
+
+		//A transform goes without the points
+		myJSON->createJSONable(annotation->getID(), TRANSFORM_ANNOTATION_COMMAND, &null_long_vector, NULL, line_information, null_int,
+			&version->second);
+	}
 }
 
 /*
@@ -606,15 +751,27 @@ void createJSONLineMessage(string command, LineAnnotation* annotation)
 void startJSONLineUpdate()
 {
 	int i;
+	map<unsigned int, int> acknowledged_versions;
+	vector<unsigned int> whole_line_clients;
 
 	std::lock_guard<std::mutex> linesLock(linesMutex);
 
+	//Clients that do not know transforms get every point, as they always did
+	myServer->getWholeLineClients(whole_line_clients);
+
 	//Loop through all the lines
 	for (i = 0; i < (int)selected_lines_id.size(); i++) 
 	{
 		LineAnnotation* selected = lines.find(selected_lines_id.at(i))->second;
 
-		createJSONLineMessage(UPDATE_ANNOTATION_COMMAND, selected);
+		if(!whole_line_clients.empty())
+		{
+			createJSONLineMessage(UPDATE_ANNOTATION_COMMAND, selected, &whole_line_clients);
+		}
+
+		//The others only the transform since the geometry each of them acknowledged
+		myServer->getAcknowledgedVersions(selected->getID(), acknowledged_versions);
+		sendLineTransforms(selected, acknowledged_versions);
 	}
 }
 
@@ -729,49 +886,225 @@ void OpenGLtouchControls(int command, int id, long double x, long double y)
 
 
 
-cv::Mat _currentBackgroundOpenCVImage;
-bool _readyToUpdateBackgroundImage = true;
-bool _hasReceivedBackgroundImage = false;
+// background frames go through a triple-buffered mailbox of pixel buffers, written by the video thread
+TextureUploader _backgroundUploader;
+
+cv::Mat _currentGUIOverlayImage;
+bool _guiOverlayImageChanged = false;
+std::mutex guiOverlayMutex;  // protects _currentGUIOverlayImage and _guiOverlayImageChanged
 
-bool _testTextureInitialized = false;
-GLuint _backgroundTextureId;
+bool _guiOverlayTextureInitialized = false;
+GLuint _guiOverlayTextureId;
 
 // updates current opencv image to be used for background
-void updateBackgroundOpenCVImage(cv::Mat image) {
-	if (_readyToUpdateBackgroundImage) {
-		//std::cout << "ready to update background image" << std::endl;
-		image.copyTo(_currentBackgroundOpenCVImage);
-		_readyToUpdateBackgroundImage = false;
-		_hasReceivedBackgroundImage = true;
+void updateBackgroundOpenCVImage(cv::Mat image, bool inWorldSpace) {
+	// copies straight into a mapped upload buffer; never waits for the render thread
+	cv::Mat uploadBuffer = _backgroundUploader.beginFrame(image.cols, image.rows);
+
+	if (uploadBuffer.empty()) {
+		//std::cout << "upload buffer not ready, skipping background image" << std::endl;
+		return;
 	}
-	else {
-		//std::cout << "not ready to update background image" << std::endl;
+
+	image.copyTo(uploadBuffer);
+
+	_backgroundUploader.endFrame(inWorldSpace);
+}
+
+// frames uploaded to the background texture so far, the time spent uploading them, and frames never uploaded
+void getBackgroundUploadStatistics(unsigned int& frames, unsigned long long& microseconds, unsigned int& overwrittenFrames) {
+	frames = _backgroundUploader.getUploadedFrameCount();
+	microseconds = _backgroundUploader.getUploadMicroseconds();
+	overwrittenFrames = _backgroundUploader.getOverwrittenFrameCount();
+}
+
+// whether the render thread has yet to take the last background frame
+bool isBackgroundFramePending() {
+	return _backgroundUploader.hasPendingFrame();
+}
+
+// thumbnails of the trainees not shown full screen, each written by its own session's video thread
+TextureUploader _thumbnailUploaders[MAX_VIDEO_SESSIONS];
+
+// thumbnails take a fifth of the screen width, so the three other trainees fit along the top
+const int THUMBNAIL_SCALE_DOWN = 5;
+const int THUMBNAIL_MARGIN = 8;
+
+// scales a session's frame straight into its upload buffer
+void updateSessionThumbnail(int session, cv::Mat image) {
+	cv::Mat uploadBuffer = _thumbnailUploaders[session].beginFrame(SERVER_RESOLUTION_X / THUMBNAIL_SCALE_DOWN, SERVER_RESOLUTION_Y / THUMBNAIL_SCALE_DOWN);
+
+	if (uploadBuffer.empty()) {
+		return;
 	}
+
+	cv::resize(image, uploadBuffer, uploadBuffer.size(), 0, 0, cv::INTER_AREA);
+
+	_thumbnailUploaders[session].endFrame(true);
+}
+
+// whether the render thread has yet to take the last thumbnail of a session
+bool isSessionThumbnailPending(int session) {
+	return _thumbnailUploaders[session].hasPendingFrame();
 }
 
-void init_test_texture() {
-	std::cout << "initing background texture" << std::endl;
+// updates the GUI drawn over world-space backgrounds; only called when the GUI changes
+void updateGUIOverlayImage(cv::Mat image) {
+	std::lock_guard<std::mutex> guiOverlayLock(guiOverlayMutex);
 
-	glEnable(GL_TEXTURE_2D);
+	image.copyTo(_currentGUIOverlayImage);
+	_guiOverlayImageChanged = true;
+}
 
-	glGenTextures(1, &_backgroundTextureId);
-	glBindTexture(GL_TEXTURE_2D, _backgroundTextureId);
+void init_gui_overlay_texture() {
+	std::cout << "initing GUI overlay texture" << std::endl;
 
+	glGenTextures(1, &_guiOverlayTextureId);
+	glBindTexture(GL_TEXTURE_2D, _guiOverlayTextureId);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-	int num_channels = _currentBackgroundOpenCVImage.channels();
-	int w = _currentBackgroundOpenCVImage.size().width;
-	int h = _currentBackgroundOpenCVImage.size().height;
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	_guiOverlayTextureInitialized = true;
+}
+
+/*
+ * Method Overview: Uploads the GUI overlay, if it changed
+ * Parameters: None
+ * Return: None
+ */
+void updateGUIOverlayTexture()
+{
+	std::lock_guard<std::mutex> guiOverlayLock(guiOverlayMutex);
+
+	if (!_guiOverlayImageChanged) {
+		return;
+	}
+
+	if (!_guiOverlayTextureInitialized) {
+		init_gui_overlay_texture();
+	}
+
+	glBindTexture(GL_TEXTURE_2D, _guiOverlayTextureId);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, _currentBackgroundOpenCVImage.data);
+	int w = _currentGUIOverlayImage.size().width;
+	int h = _currentGUIOverlayImage.size().height;
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, _currentGUIOverlayImage.data);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	_testTextureInitialized = true;
+	_guiOverlayImageChanged = false;
+}
+
+/*
+ * Method Overview: Draws a texture over a rectangle, row 0 of the texture at the bottom
+ * Parameters: Texture, left, bottom, right and top edges of the rectangle
+ * Return: None
+ */
+void drawTexturedRect(GLuint textureId, GLfloat left, GLfloat bottom, GLfloat right, GLfloat top)
+{
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, textureId);
+
+	glColor3f(1.0, 1.0, 1.0);
+	glBegin(GL_QUADS);
+
+	glTexCoord2f(0.0, 0.0);
+	glVertex2f(left, bottom);
+
+	glTexCoord2f(1.0, 0.0);
+	glVertex2f(right, bottom);
+
+	glTexCoord2f(1.0, 1.0);
+	glVertex2f(right, top);
+
+	glTexCoord2f(0.0, 1.0);
+	glVertex2f(left, top);
+	glEnd();
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*
+ * Method Overview: Draws a texture over a rectangle starting at the bottom left corner of the scene
+ * Parameters: Texture, right and top edges of the rectangle
+ * Return: None
+ */
+void drawTexturedQuad(GLuint textureId, GLfloat right, GLfloat top)
+{
+	drawTexturedRect(textureId, -0.5, -0.5, right, top);
+}
+
+/*
+ * Method Overview: Draws the trainees not shown full screen, right to left along the top
+ * Parameters: None
+ * Return: None
+ */
+void drawSessionThumbnails()
+{
+	int sessionCount = myServer->getSessionCount();
+
+	if (sessionCount < 2) {
+		return;
+	}
+
+	GLfloat width = (GLfloat)(resolutionX / THUMBNAIL_SCALE_DOWN);
+	GLfloat height = (GLfloat)(resolutionY / THUMBNAIL_SCALE_DOWN);
+	GLfloat right = resolutionX + 0.5f - THUMBNAIL_MARGIN;
+	GLfloat top = resolutionY + 0.5f - THUMBNAIL_MARGIN;
+
+	for (int session = 0; session < sessionCount; session++)
+	{
+		if (!_thumbnailUploaders[session].isInitialized()) {
+			_thumbnailUploaders[session].init(VIDEO_PIXEL_BUFFER_UPLOAD);
+		}
+
+		_thumbnailUploaders[session].upload();
+
+		if (session == myServer->getFocusedSession() || !_thumbnailUploaders[session].hasFrame()) {
+			continue;
+		}
+
+		drawTexturedRect(_thumbnailUploaders[session].getTextureId(), right - width, top - height, right, top);
+
+		right -= width + THUMBNAIL_MARGIN;
+	}
+
+	glDisable(GL_TEXTURE_2D);
+}
+
+/*
+ * Method Overview: Converts a 3x3 homography to an OpenGL (column-major) matrix
+ * Parameters: Homography (CV_64F), matrix to fill
+ * Return: None
+ */
+void homographyToGLMatrix(const cv::Mat& homography, GLdouble* matrix)
+{
+	//x and y go through the homography, z is left alone, and the third row becomes w
+	matrix[0] = homography.at<double>(0, 0);
+	matrix[1] = homography.at<double>(1, 0);
+	matrix[2] = 0.0;
+	matrix[3] = homography.at<double>(2, 0);
+
+	matrix[4] = homography.at<double>(0, 1);
+	matrix[5] = homography.at<double>(1, 1);
+	matrix[6] = 0.0;
+	matrix[7] = homography.at<double>(2, 1);
+
+	matrix[8] = 0.0;
+	matrix[9] = 0.0;
+	matrix[10] = 1.0;
+	matrix[11] = 0.0;
+
+	matrix[12] = homography.at<double>(0, 2);
+	matrix[13] = homography.at<double>(1, 2);
+	matrix[14] = 0.0;
+	matrix[15] = homography.at<double>(2, 2);
 }
 
 
@@ -912,53 +1245,69 @@ int pointInPolygon(vector<long double> roi_extremes)
  */
 void draw_scene()
 {
+	TRACE_ZONE("draw_scene");
+
 	checkAndInterpretCommand();
 
-	// clear framebuffer with white
-	glClear(GL_COLOR_BUFFER_BIT);
+	if (!_backgroundUploader.isInitialized()) {
+		_backgroundUploader.init(VIDEO_PIXEL_BUFFER_UPLOAD);
+	}
 
+	_backgroundUploader.upload();
 
-	if (_hasReceivedBackgroundImage) {
-		if (!_testTextureInitialized) {
-			init_test_texture();
-		}
+	bool hasBackground = _backgroundUploader.hasFrame();
 
-		glEnable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, _backgroundTextureId);
+	if (hasBackground) {
+		updateGUIOverlayTexture();
+	}
 
-		if (!_readyToUpdateBackgroundImage) {
+	bool backgroundInWorldSpace = hasBackground && _backgroundUploader.isFrameInWorldSpace();
 
-			int w = _currentBackgroundOpenCVImage.size().width;
-			int h = _currentBackgroundOpenCVImage.size().height;
+	// clear framebuffer with white, or with black around a transformed frame (like warpAffine's border)
+	if (backgroundInWorldSpace) {
+		glClearColor(0.0, 0.0, 0.0, 1.0);
+	}
+	else {
+		glClearColor(1.0, 1.0, 1.0, 1.0);
+	}
+	glClear(GL_COLOR_BUFFER_BIT);
 
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_BGR, GL_UNSIGNED_BYTE, _currentBackgroundOpenCVImage.data);
 
-			_readyToUpdateBackgroundImage = true;
-		}
+	if (hasBackground) {
+		if (backgroundInWorldSpace) {
+			//The frame fills world space (one unit per screen pixel before the camera moves),
+			//so the camera homography is applied on top of the projection
+			GLdouble cameraMatrix[16];
+			homographyToGLMatrix(myCamera->getHomography(), cameraMatrix);
 
-		
-		glColor3f(1.0, 1.0, 1.0);
-		// some testing about drawing polygons
-		glBegin(GL_QUADS);
+			glPushMatrix();
+			glMultMatrixd(cameraMatrix);
 
-		glTexCoord2f(0.0, 0.0);
-		glVertex2f(-0.5, -0.5);
+			drawTexturedQuad(_backgroundUploader.getTextureId(), resolutionX - 0.5, resolutionY - 0.5);
 
-		glTexCoord2f(1.0, 0.0);
-		glVertex2f(resolutionX + 0.5, -0.5);
+			glPopMatrix();
 
-		glTexCoord2f(1.0, 1.0);
-		glVertex2f(resolutionX + 0.5, resolutionY + 0.5);
+			//The GUI stays in screen space
+			if (_guiOverlayTextureInitialized) {
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-		glTexCoord2f(0.0, 1.0);
-		glVertex2f(-0.5, resolutionY + 0.5);
-		glEnd();
+				drawTexturedQuad(_guiOverlayTextureId, resolutionX + 0.5, resolutionY + 0.5);
+
+				glDisable(GL_BLEND);
+			}
+		}
+		else {
+			//The frame is already transformed and has the GUI in it
+			drawTexturedQuad(_backgroundUploader.getTextureId(), resolutionX + 0.5, resolutionY + 0.5);
+		}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+		glDisable(GL_TEXTURE_2D);
 	}
 
 	openGLDrawLines();
 
+	drawSessionThumbnails();
 
 
 	
@@ -1059,9 +1408,10 @@ void mouse(int button, int state, int x, int y) {
  * Parameters (1): Main values, scene-to-create resolution
  * Parameters (2): Instance of the Command Center
  * Parameters (3): Instance of the JSON Manager
+ * Parameters (4): Instances of the Camera Manager and the Communication Manager
  * Return: None
  */
-void initWindow(int argc, char* argv[], int resX, int resY, CommandCenter* pCommander, JSONManager* pJSON, CameraManager* pCamera)
+void initWindow(int argc, char* argv[], int resX, int resY, CommandCenter* pCommander, JSONManager* pJSON, CameraManager* pCamera, CommunicationManager* pServer)
 {
 	//Sets the CommandCenter instance as own
 	myCommander = pCommander;
@@ -1072,6 +1422,9 @@ void initWindow(int argc, char* argv[], int resX, int resY, CommandCenter* pComm
 	// Sets the CameraManager instance as own
 	myCamera = pCamera;
 
+	// Sets the CommunicationManager instance as own
+	myServer = pServer;
+
 	//Assigns the scene resolution
 	resolutionX = resX;
 	resolutionY = resY;
@@ -1087,6 +1440,13 @@ void initWindow(int argc, char* argv[], int resX, int resY, CommandCenter* pComm
 	glutInitDisplayMode(GLUT_RGB);
 	glutInitWindowSize(resolutionX,resolutionY);
 	glutCreateWindow("STAR Mentor System");
+
+	//Loads the OpenGL entry points past 1.1 (pixel buffers, fences)
+	GLenum glewStatus = glewInit();
+	if (glewStatus != GLEW_OK) {
+		std::cout << "glewInit failed: " << glewGetErrorString(glewStatus) << std::endl;
+	}
+
 	glutFullScreen();
 	glutIdleFunc(refresh);
 	glutDisplayFunc(draw_scene);
@@ -39,6 +39,9 @@
 #include "PQMTClient.h"//PQLabs Libraries
 #include "TouchOverlayController.h"
 #include "CameraManager.h"
+#include "TextureUploader.h"
+#include "CommunicationManager.h"//Which trainee is shown
+#include "communicationDefinitions.h"//Most video sessions
 
 using namespace std;//Standard Library
 
@@ -93,10 +96,16 @@ void endOpenGLContext();
 //Checks and interprets a command send by the CommandCenter
 void checkAndInterpretCommand();
 
-//Routine to start the JSON creation process
-void createJSONLineMessage(string command, LineAnnotation* annotation);
+//Sends a line whole again to the client that asked, and catches up the clients that acknowledged one
+void answerLineRequests();
 
-//Gives the signal to start the creation of JSON UpdateCommands
+//Routine to start the JSON creation process (for the clients given, or NULL for those of the focused trainee)
+void createJSONLineMessage(string command, LineAnnotation* annotation, const vector<unsigned int>* clients = NULL);
+
+//Sends every client the transform of a line since the geometry it acknowledged
+void sendLineTransforms(LineAnnotation* annotation, const map<unsigned int, int>& acknowledged_versions);
+
+//Gives the signal to start the creation of JSON Update and Transform Commands
 void startJSONLineUpdate();
 
 //Edit the frambuffer with touch events
@@ -115,6 +124,26 @@ void draw_scene();
 void refresh();
 
 //Inits framebuffer and the OpenGL environment
-void initWindow(int argc, char* argv[], int resX, int resY, CommandCenter* pCommander, JSONManager* pJSON, CameraManager* pCamera);
+void initWindow(int argc, char* argv[], int resX, int resY, CommandCenter* pCommander, JSONManager* pJSON, CameraManager* pCamera, CommunicationManager* pServer);
+
+//Sets the next background frame. A screen-space frame is drawn as it is; a
+//world-space frame (any size, flipped like the screen) is drawn through the camera homography
+void updateBackgroundOpenCVImage(cv::Mat image, bool inWorldSpace = false);
+
+//Sets the GUI drawn on top of world-space backgrounds (BGRA, screen resolution)
+void updateGUIOverlayImage(cv::Mat image);
+
+//Frames uploaded to the background texture so far, the time the render thread spent on them,
+//and the frames replaced by a newer one before the render thread took them
+void getBackgroundUploadStatistics(unsigned int& frames, unsigned long long& microseconds, unsigned int& overwrittenFrames);
+
+//Whether the last background frame has not been taken by the render thread yet (or it has not started),
+//so that a new one would not be shown any sooner
+bool isBackgroundFramePending();
+
+//Sets the next thumbnail frame of a trainee that is not shown full screen
+//(a world-space frame, scaled down to the thumbnail size)
+void updateSessionThumbnail(int session, cv::Mat image);
 
-void updateBackgroundOpenCVImage(cv::Mat image);
\ No newline at end of file
+//Like isBackgroundFramePending, for the thumbnail of a session
+bool isSessionThumbnailPending(int session);
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+/*
+
+BufferPool is a fixed set of buffers that are allocated once, up front, and
+then handed between threads by handle (an index into the pool) instead of
+being allocated, copied or freed per frame.
+
+A handle is taken with acquire(), filled, passed downstream through an
+SPSCQueue, and given back with release() by whoever consumes it last. Any
+thread may acquire and release: several stages give buffers back to the
+same pool (a packet is released by the receive stage when it is dropped
+and by the decode stage once it is decoded, a decoded frame by the decode
+stage on a failure and by the composite stage otherwise), so the free list
+is a stack under a mutex. It is locked once per buffer, never while a
+buffer is filled.
+
+The buffers themselves are default-constructed; the owner is expected to
+size them (via get()) before the pipeline starts.
+
+*/
+
+#include <mutex>
+#include <vector>
+
+template <typename T>
+class BufferPool
+{
+public:
+	static const int INVALID_HANDLE = -1;
+
+	explicit BufferPool(int numBuffers)
+		: _buffers(numBuffers)
+	{
+		_freeHandles.reserve(numBuffers);
+		for (int i = numBuffers - 1; i >= 0; i--) {
+			_freeHandles.push_back(i);
+		}
+	}
+
+	// Returns a free handle, or INVALID_HANDLE if every buffer is in use.
+	int acquire()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_freeHandles.empty()) {
+			return INVALID_HANDLE;
+		}
+
+		int handle = _freeHandles.back();
+		_freeHandles.pop_back();
+
+		return handle;
+	}
+
+	// Gives a handle obtained from acquire() back to the pool (from any thread).
+	void release(int handle)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// Never grows past the pool, so this does not allocate
+		_freeHandles.push_back(handle);
+	}
+
+	T& get(int handle)
+	{
+		return _buffers[handle];
+	}
+
+	int size() const
+	{
+		return (int)_buffers.size();
+	}
+
+	int numFree() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return (int)_freeHandles.size();
+	}
+
+private:
+	std::vector<T> _buffers;
+
+	std::vector<int> _freeHandles;
+	mutable std::mutex _mutex;
+
+	BufferPool(const BufferPool&);
+	BufferPool& operator=(const BufferPool&);
+};
+
+template <typename T>
+const int BufferPool<T>::INVALID_HANDLE;
@@ -0,0 +1,272 @@
+#include "CaptureRoundTripCheck.h"
+#include "CheckCommandLine.h"
+#include "PacketCapture.h"
+#include "PacketReplaySource.h"
+#include "communicationDefinitions.h"
+#include "json.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+	const int FRAME_INTERVAL_MICROSECONDS = 33333;
+
+	// Every so many packets is a keyframe, much bigger than the rest
+	const int KEYFRAME_INTERVAL = 30;
+	const int KEYFRAME_SIZE = 24000;
+
+	// How late a packet may be handed out in the timing pass (the sleep granularity of the system, and some)
+	const double LATENESS_TOLERANCE_MILLISECONDS = 20.0;
+
+	// How long the replay is given to hand out the next packet before it counts as missing
+	const int REPLAY_WAIT_MILLISECONDS = 1000;
+
+	struct CheckOptions
+	{
+		int packets;
+		double speed;
+		std::string file;
+	};
+
+	struct SyntheticPacket
+	{
+		CapturedPacketInfo info;
+		std::vector<char> data;
+	};
+
+	void makeStreamHeader(VideoStreamHeader& header)
+	{
+		header.codecId = AV_CODEC_ID_H264;
+		header.width = 1280;
+		header.height = 720;
+		header.flags = VIDEO_STREAM_FLAG_FRAMED | VIDEO_STREAM_FLAG_FRAME_HEADERS;
+
+		// Stands in for an SPS and a PPS
+		const unsigned char extradata[] = { 0, 0, 0, 1, 0x67, 0x42, 0xC0, 0x1F, 0xDA, 0, 0, 0, 1, 0x68, 0xCE, 0x3C, 0x80 };
+		header.extradata.assign(extradata, extradata + sizeof(extradata));
+	}
+
+	// Packets as the receive stage would have read them: arriving with some jitter, a few frames lost on the way,
+	// and now and then one without a capture time
+	void makePackets(int count, std::vector<SyntheticPacket>& packets)
+	{
+		packets.resize(count);
+
+		long long arrivalMicroseconds = 5000000000LL;
+		unsigned int sequence = 100;
+
+		for (int i = 0; i < count; i++) {
+			SyntheticPacket& packet = packets[i];
+			bool keyframe = i % KEYFRAME_INTERVAL == 0;
+
+			packet.info.arrivalMicroseconds = arrivalMicroseconds + (i * 7919) % 9000;
+			packet.info.captureMicroseconds = i % 17 == 5 ? -1 : 123456789LL + (long long)i * FRAME_INTERVAL_MICROSECONDS;
+			packet.info.sequence = sequence;
+			packet.info.keyframe = keyframe;
+			packet.info.size = keyframe ? KEYFRAME_SIZE : 800 + (i * 613) % 4000;
+
+			packet.data.resize(packet.info.size);
+			for (int k = 0; k < packet.info.size; k++) {
+				packet.data[k] = (char)(i * 31 + k * 7);
+			}
+
+			arrivalMicroseconds += FRAME_INTERVAL_MICROSECONDS;
+			sequence += i % 50 == 49 ? 3 : 1;
+		}
+	}
+
+	bool writeCapture(const std::string& path, const VideoStreamHeader& header, const std::vector<SyntheticPacket>& packets)
+	{
+		PacketCaptureWriter writer;
+		if (!writer.open(path, header)) {
+			return false;
+		}
+
+		for (size_t i = 0; i < packets.size(); i++) {
+			if (!writer.write(packets[i].info, &packets[i].data[0])) {
+				std::cout << "error: cannot write packet " << i << " to " << path << std::endl;
+				writer.close();
+				return false;
+			}
+		}
+
+		writer.close();
+		return true;
+	}
+
+	bool sameHeader(const VideoStreamHeader& a, const VideoStreamHeader& b)
+	{
+		return a.codecId == b.codecId && a.width == b.width && a.height == b.height && a.flags == b.flags && a.extradata == b.extradata;
+	}
+
+	// Replays as fast as possible, counting the packets that do not come back as written
+	bool checkContents(const CheckOptions& options, const VideoStreamHeader& header, const std::vector<SyntheticPacket>& packets,
+		int& replayed, int& mismatched)
+	{
+		PacketReplaySource replay;
+		VideoStreamHeader replayedHeader;
+
+		replayed = 0;
+		mismatched = 0;
+
+		if (!replay.open(options.file, 0.0, false, replayedHeader)) {
+			return false;
+		}
+
+		bool headerMatches = sameHeader(header, replayedHeader);
+		if (!headerMatches) {
+			std::cout << "error: the stream header did not come back as it was written" << std::endl;
+		}
+
+		std::vector<char> out(MAX_PACKET_SIZE);
+		CapturedPacketInfo info;
+
+		while (replay.nextPacket(&out[0], (int)out.size(), info, REPLAY_WAIT_MILLISECONDS)) {
+			if (replayed >= (int)packets.size()) {
+				mismatched++;
+				replayed++;
+				continue;
+			}
+
+			const SyntheticPacket& expected = packets[replayed];
+
+			bool match = info.arrivalMicroseconds == expected.info.arrivalMicroseconds
+				&& info.captureMicroseconds == expected.info.captureMicroseconds
+				&& info.sequence == expected.info.sequence
+				&& info.keyframe == expected.info.keyframe
+				&& info.size == expected.info.size
+				&& memcmp(&out[0], &expected.data[0], info.size) == 0;
+
+			if (!match) {
+				if (mismatched == 0) {
+					std::cout << "error: packet " << replayed << " did not come back as it was written" << std::endl;
+				}
+				mismatched++;
+			}
+
+			replayed++;
+		}
+
+		bool ended = replay.hasEnded();
+		replay.close();
+
+		return headerMatches && ended && replayed == (int)packets.size() && mismatched == 0;
+	}
+
+	// Replays at the set speed, measuring how far from its arrival time each packet is handed out
+	bool checkTiming(const CheckOptions& options, const std::vector<SyntheticPacket>& packets,
+		double& earliestMilliseconds, double& latestMilliseconds)
+	{
+		PacketReplaySource replay;
+		VideoStreamHeader header;
+
+		earliestMilliseconds = 0.0;
+		latestMilliseconds = 0.0;
+
+		if (!replay.open(options.file, options.speed, false, header)) {
+			return false;
+		}
+
+		std::vector<char> out(MAX_PACKET_SIZE);
+		CapturedPacketInfo info;
+		int replayed = 0;
+
+		std::chrono::steady_clock::time_point start;
+		long long firstArrivalMicroseconds = packets[0].info.arrivalMicroseconds;
+
+		while (replay.nextPacket(&out[0], (int)out.size(), info, REPLAY_WAIT_MILLISECONDS)) {
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+			// Timing starts with the first packet asked for
+			if (replayed == 0) {
+				start = now;
+			}
+
+			double dueMilliseconds = (info.arrivalMicroseconds - firstArrivalMicroseconds) / 1000.0 / options.speed;
+			double offsetMilliseconds = std::chrono::duration<double, std::milli>(now - start).count() - dueMilliseconds;
+
+			if (offsetMilliseconds < earliestMilliseconds) {
+				earliestMilliseconds = offsetMilliseconds;
+			}
+			if (offsetMilliseconds > latestMilliseconds) {
+				latestMilliseconds = offsetMilliseconds;
+			}
+
+			replayed++;
+		}
+
+		replay.close();
+
+		// Early by less than the clock can tell apart is still on time
+		return replayed == (int)packets.size() && earliestMilliseconds > -1.0 && latestMilliseconds <= LATENESS_TOLERANCE_MILLISECONDS;
+	}
+
+}
+
+int runCaptureRoundTripCheck(int argc, char* argv[])
+{
+	CheckOptions options;
+	options.packets = 300;
+	options.speed = 10.0;
+	options.file = "capture-check.vcap";
+
+	CheckCommandLine commandLine("--check-capture");
+	commandLine.add("--packets", "count", options.packets);
+	commandLine.add("--speed", "factor", options.speed);
+	commandLine.add("--file", "path", options.file);
+
+	if (!commandLine.parse(argc, argv)) {
+		return 1;
+	}
+
+	if (options.packets <= 0 || options.speed <= 0.0) {
+		std::cout << "error: the packets and the speed must be positive" << std::endl;
+		commandLine.printUsage();
+		return 1;
+	}
+
+	VideoStreamHeader header;
+	makeStreamHeader(header);
+
+	std::vector<SyntheticPacket> packets;
+	makePackets(options.packets, packets);
+
+	if (!writeCapture(options.file, header, packets)) {
+		return 1;
+	}
+
+	int replayed = 0;
+	int mismatched = 0;
+	bool contentsMatch = checkContents(options, header, packets, replayed, mismatched);
+
+	double earliestMilliseconds = 0.0;
+	double latestMilliseconds = 0.0;
+	bool timingMatches = checkTiming(options, packets, earliestMilliseconds, latestMilliseconds);
+
+	remove(options.file.c_str());
+
+	std::cout << "packet capture check: " << packets.size() << " packets written, " << replayed << " replayed, "
+		<< mismatched << " not as written" << (contentsMatch ? "" : " (does not match)") << std::endl;
+	std::cout << "  at " << options.speed << "x speed: handed out between " << earliestMilliseconds << " and "
+		<< latestMilliseconds << " ms from their arrival times" << (timingMatches ? "" : " (does not match)") << std::endl;
+
+	Json::Value results;
+	results["packets"] = options.packets;
+	results["replayed"] = replayed;
+	results["mismatched"] = mismatched;
+	results["contents_match"] = contentsMatch;
+	results["speed"] = options.speed;
+	results["earliest_ms"] = earliestMilliseconds;
+	results["latest_ms"] = latestMilliseconds;
+	results["timing_matches"] = timingMatches;
+
+	if (!commandLine.writeResults(results)) {
+		return 1;
+	}
+
+	return contentsMatch && timingMatches ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+
+Checks that a packet capture replays what was captured: a synthetic H.264
+stream (with extradata, frame headers, a gap in the frame numbers, packets
+without a capture time and keyframes of their own size) is written with
+PacketCaptureWriter, then played back through PacketReplaySource.
+
+- As fast as possible, every packet has to come back with the same bytes,
+  arrival and capture times, frame number and keyframe flag, in the same
+  order, and the stream header has to be the one written.
+- At a set speed, every packet has to be handed out no earlier than its
+  arrival time (relative to the first, divided by the speed), and not much
+  later either.
+
+The capture is written to a file in the current folder and deleted after.
+
+Run the mentor with --check-capture, optionally followed by:
+
+  --packets <count>     packets to capture (default 300, at 30 a second)
+  --speed <factor>      replay speed of the timing pass (default 10)
+  --file <path>         where to write the capture (default capture-check.vcap)
+  --output <file>       also write the results there
+
+*/
+
+// Returns 0 (the process exit code) if the capture replays as written, 1 otherwise or for bad options
+int runCaptureRoundTripCheck(int argc, char* argv[]);
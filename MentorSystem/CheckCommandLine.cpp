@@ -0,0 +1,105 @@
+#include "CheckCommandLine.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+CheckCommandLine::CheckCommandLine(const char* mode)
+	: _mode(mode)
+{
+	add("--output", "file", _output);
+}
+
+void CheckCommandLine::add(const char* name, const char* valueName, int& value)
+{
+	addOption(name, valueName, OPTION_INT, &value);
+}
+
+void CheckCommandLine::add(const char* name, const char* valueName, double& value)
+{
+	addOption(name, valueName, OPTION_DOUBLE, &value);
+}
+
+void CheckCommandLine::add(const char* name, const char* valueName, std::string& value)
+{
+	addOption(name, valueName, OPTION_STRING, &value);
+}
+
+void CheckCommandLine::addOption(const char* name, const char* valueName, OptionType type, void* value)
+{
+	Option option = { name, valueName, type, value };
+
+	// --output stays last in the usage line
+	_options.insert(_options.empty() ? _options.end() : _options.end() - 1, option);
+}
+
+bool CheckCommandLine::parse(int argc, char* argv[])
+{
+	for (int i = 0; i < argc; i += 2) {
+		if (i + 1 >= argc) {
+			std::cout << "error: " << argv[i] << " needs a value" << std::endl;
+			printUsage();
+			return false;
+		}
+
+		const char* name = argv[i];
+		const char* value = argv[i + 1];
+
+		size_t o = 0;
+		while (o < _options.size() && strcmp(name, _options[o].name) != 0) {
+			o++;
+		}
+
+		if (o == _options.size()) {
+			std::cout << "error: unknown option " << name << std::endl;
+			printUsage();
+			return false;
+		}
+
+		switch (_options[o].type) {
+		case OPTION_INT:
+			*(int*)_options[o].value = atoi(value);
+			break;
+		case OPTION_DOUBLE:
+			*(double*)_options[o].value = atof(value);
+			break;
+		case OPTION_STRING:
+			*(std::string*)_options[o].value = value;
+			break;
+		}
+	}
+
+	return true;
+}
+
+void CheckCommandLine::printUsage() const
+{
+	std::cout << "usage: " << _mode;
+	for (size_t o = 0; o < _options.size(); o++) {
+		std::cout << " [" << _options[o].name << " " << _options[o].valueName << "]";
+	}
+	std::cout << std::endl;
+}
+
+bool CheckCommandLine::writeResults(const Json::Value& results) const
+{
+	Json::StreamWriterBuilder wbuilder;
+	wbuilder["indentation"] = "";
+	std::string resultsLine = Json::writeString(wbuilder, results);
+
+	std::cout << resultsLine << std::endl;
+
+	if (_output.empty()) {
+		return true;
+	}
+
+	std::ofstream outputFile(_output.c_str());
+	outputFile << resultsLine << std::endl;
+	if (!outputFile) {
+		std::cout << "error: cannot write the results to " << _output << std::endl;
+		return false;
+	}
+
+	return true;
+}
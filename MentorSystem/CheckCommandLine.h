@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+
+CheckCommandLine reads the options of a check or benchmark mode (what
+follows e.g. --check-capture on the command line) and writes its results,
+so every mode takes its options and reports the same way.
+
+Options come in name/value pairs, each bound to a variable that holds its
+default until the command line says otherwise. Every mode also takes
+--output <file>. Anything else is an error, printed with the usage line.
+
+The results are printed as one line of JSON after whatever the mode
+printed along the way, and also written to the output file if there is one.
+
+*/
+
+#include "json.h"
+
+#include <string>
+#include <vector>
+
+class CheckCommandLine
+{
+public:
+	// mode: the command line option that runs the check, e.g. "--check-capture"
+	explicit CheckCommandLine(const char* mode);
+
+	// Binds an option to a variable; valueName is what the usage line calls the value
+	void add(const char* name, const char* valueName, int& value);
+	void add(const char* name, const char* valueName, double& value);
+	void add(const char* name, const char* valueName, std::string& value);
+
+	// Sets the variables from the options. Returns false, after printing what is
+	// wrong and the usage line, for an option that is unknown or has no value
+	bool parse(int argc, char* argv[]);
+
+	// Prints the options the mode takes
+	void printUsage() const;
+
+	// Prints the results as one line of JSON and writes it to the output file.
+	// Returns false if they could not be written there
+	bool writeResults(const Json::Value& results) const;
+
+private:
+	enum OptionType { OPTION_INT, OPTION_DOUBLE, OPTION_STRING };
+
+	struct Option
+	{
+		const char* name;
+		const char* valueName;
+		OptionType type;
+		void* value;
+	};
+
+	void addOption(const char* name, const char* valueName, OptionType type, void* value);
+
+	const char* _mode;
+	std::vector<Option> _options;
+
+	// Where to also write the results, "" for nowhere
+	std::string _output;
+};
@@ -44,8 +44,6 @@ CommandCenter::CommandCenter()
 
 	VirtualAnnotationSelected = 0;
 
-	JSONCreation = 0;
-
 	RealToolPlacedFlag = 0;
 }
 
@@ -269,26 +267,6 @@ void CommandCenter::setSelectedIDs(std::vector<int> pVectorID)
 	SelectedIDs = pVectorID;
 }
 
-/*
- * Method Overview: Retrieves the JSON creation flag
- * Parameters: None
- * Return: Value of the JSON creation flag
- */
-int CommandCenter::getJSONCreationFlag()
-{
-	return JSONCreation;
-}
-
-/*
- * Method Overview: Sets the JSON creation flag
- * Parameters: Value to set the flag to
- * Return: None
- */
-void CommandCenter::setJSONCreationFlag(int pFlag)
-{
-	JSONCreation = pFlag;
-}
-
 /*
 * Method Overview: Retrieves the Real Tool placement flag
 * Parameters: None
@@ -98,12 +98,6 @@ public:
 	//Sets a command to be performed by the AnnotationManager
 	void setSelectedIDs(std::vector<int> pVectorID);
 
-	//Gets the JSON creation flag
-	int getJSONCreationFlag();
-
-	//Changes the state of the JSON creation flag
-	void setJSONCreationFlag(int pFlag);
-
 	//Gets the JSON creation flag
 	int getRealToolPlacedFlag();
 
@@ -151,9 +145,6 @@ private:
 	//Contains the selected IDs at the moment
 	std::vector<int> SelectedIDs;
 
-	//JSON Creation flag
-	int JSONCreation;
-
 	//Real tool placement flag
 	int RealToolPlacedFlag;
 };
@@ -18,7 +18,15 @@
 
 //Include its header file
 #include "CommunicationManager.h"
+#include "AnnotationWireFormat.h"
+#include "JSONDefinitions.h"
+#include "json.h"
 #include <iostream>
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
 
 //---------------------------Variables---------------------------//
 unsigned int CommunicationManager::video_client_id;
@@ -41,6 +49,13 @@ CommunicationManager::CommunicationManager(void)
 	//Id's to assign gesture clients for our table
     gesture_client_id = 0;
 
+	//No trainee yet, and the first one is shown full screen
+	for(int session = 0; session < MAX_VIDEO_SESSIONS; session++)
+	{
+		sessionClients[session] = -1;
+	}
+	focusedSession = 0;
+
     //Set up the server network to listen 
     videoNetwork = new ServerNetwork(VIDEO_PORT);
 
@@ -49,6 +64,11 @@ CommunicationManager::CommunicationManager(void)
 
 	//Set up the server network to listen 
     gestureNetwork = new ServerNetwork(GESTURE_PORT);
+
+	//The video and gesture clients are read by the video threads; the reactor reads the json clients' requests
+	openChannel(videoChannel, videoNetwork, &video_client_id, "video", true);
+	openChannel(jsonChannel, jsonNetwork, &json_client_id, "json", false);
+	openChannel(gestureChannel, gestureNetwork, &gesture_client_id, "gesture", true);
 }
 
 /*
@@ -61,64 +81,595 @@ CommunicationManager::~CommunicationManager(void)
 }
 
 /*
- * Method Overview: Calls the method to accept new clients
+ * Method Overview: Runs the reactor, which accepts new clients and watches their sockets
  * Parameters: None
+ * Return: None (sleeps whenever no socket needs anything)
+ */
+void CommunicationManager::run()
+{
+	reactor.run();
+}
+
+/*
+ * Method Overview: Sets a channel up and has the reactor accept its clients
+ * Parameters (1): Channel to set up, its Socket Handling Object and client counter
+ * Parameters (2): Name to print, whether another thread reads its clients
+ * Return: None
+ */
+void CommunicationManager::openChannel(ClientChannel& channel, ServerNetwork* network, unsigned int* client_id, const char* name, bool readElsewhere)
+{
+	channel.network = network;
+	channel.client_id = client_id;
+	channel.name = name;
+	channel.readElsewhere = readElsewhere;
+	channel.events = 0;
+	channel.readySocket = INVALID_SOCKET;
+
+	ClientChannel* acceptingChannel = &channel;
+	reactor.watch(network->ListenSocket, [this, acceptingChannel](SOCKET) { acceptClients(*acceptingChannel); }, false);
+}
+
+/*
+ * Method Overview: Accepts every client waiting to connect to a channel
+ * Parameters: Channel whose listening socket can be read
  * Return: None
  */
-void CommunicationManager::update()
+void CommunicationManager::acceptClients(ClientChannel& channel)
 {
+	unsigned int id = *channel.client_id;
+
 	//If a new connection is accepted
-	if(videoNetwork->acceptNewClient(video_client_id))
+	while(channel.network->acceptNewClient(id))
 	{
-		printf("video client %d has been connected to the server\n",video_client_id);
+		printf("%s client %d has been connected to the server\n", channel.name, id);
+
+		if(&channel == &videoChannel)
+		{
+			assignVideoSession(id);
+		}
+
+		SOCKET clientSocket = channel.network->getSocket(id);
+		ClientChannel* clientChannel = &channel;
+
+		if(channel.readElsewhere)
+		{
+			//Reported once each time the reading thread arms it
+			reactor.watch(clientSocket, [this, clientChannel](SOCKET readySocket) { notifyChannel(*clientChannel, readySocket); }, true);
+		}
+		else
+		{
+			reactor.watch(clientSocket, [this, clientChannel, id](SOCKET) { readRequestsFromClient(*clientChannel, id); }, false);
+		}
+
+		//The clients the mentor sends to get a queue of their own
+		if(&channel == &jsonChannel)
+		{
+			std::lock_guard<std::mutex> lock(dispatchMutex);
+			channel.sendQueues.insert(std::make_pair(id, SendQueue((size_t)JSON_SEND_HIGH_WATER_BYTES)));
+		}
 
 		//Increase the client counter
-		video_client_id++;
+		id++;
+		*channel.client_id = id;
+
+		//A thread waiting on the previous client moves on to this one
+		notifyChannel(channel, INVALID_SOCKET);
+	}
+}
+
+/*
+ * Method Overview: Wakes up the thread waiting on a channel
+ * Parameters: Channel that has data or a new client, socket that can be read (if any)
+ * Return: None
+ */
+void CommunicationManager::notifyChannel(ClientChannel& channel, SOCKET readySocket)
+{
+	std::lock_guard<std::mutex> lock(channel.mutex);
+
+	channel.events++;
+	channel.readySocket = readySocket;
+	channel.changed.notify_all();
+}
+
+/*
+ * Method Overview: Reads what a client sent on a channel the mentor mostly sends on, and answers the requests in it
+ * Parameters: Channel and id of the client
+ * Return: None
+ */
+void CommunicationManager::readRequestsFromClient(ClientChannel& channel, unsigned int id)
+{
+	//Otherwise the socket would stay readable and wake the reactor over and over
+	int data_length = channel.network->receiveData(id, network_data, MAX_PACKET_SIZE);
+
+	if(connectionEnded(data_length))
+	{
+		closeClient(channel, id);
+		return;
 	}
-	if(jsonNetwork->acceptNewClient(json_client_id))
+	if(data_length <= 0)
 	{
-		printf("json client %d has been connected to the server\n",json_client_id);
+		return;
+	}
 
-		//Increase the client counter
-		json_client_id++;
+	bool connected = true;
+
+	{
+		std::lock_guard<std::mutex> lock(dispatchMutex);
+
+		//Requests are lines of JSON, like the messages the mentor sends, and can come in pieces
+		std::string& pending = channel.requestLines[id];
+		pending.append(network_data, data_length);
+
+		size_t lineEnd;
+		while(connected && (lineEnd = pending.find('\n')) != std::string::npos)
+		{
+			std::string line = pending.substr(0, lineEnd);
+			pending.erase(0, lineEnd + 1);
+
+			Json::CharReaderBuilder rbuilder;
+			std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+			Json::Value request;
+			std::string errors;
+
+			//Anything else a client sends is not meant for the mentor
+			if(!reader->parse(line.data(), line.data() + line.size(), &request, &errors) || !request.isObject()
+				|| !request[COMMAND].isString())
+			{
+				continue;
+			}
+
+			if(request[COMMAND].asString() == WIRE_FORMAT_COMMAND)
+			{
+				connected = setWireFormat(channel, id, request[WIRE_FORMAT].isString() && request[WIRE_FORMAT].asString() == WIRE_FORMAT_BINARY);
+			}
+			//A client without the geometry a transform is for asks for the annotation whole, which the GLUT thread sends
+			else if(request[COMMAND].asString() == REQUEST_ANNOTATION_COMMAND && request[ID].isInt())
+			{
+				AnnotationRequest asked = { id, request[ID].asInt(), -1 };
+				annotationRequests.push_back(asked);
+			}
+			//A client that knows transforms asks for them, and gets the lines it acknowledges moved that way instead of whole
+			else if(request[COMMAND].asString() == LINE_TRANSFORMS_COMMAND)
+			{
+				if(request[LINE_TRANSFORMS_ENABLED].isBool() && request[LINE_TRANSFORMS_ENABLED].asBool())
+				{
+					transformClients.insert(id);
+				}
+				else
+				{
+					transformClients.erase(id);
+					acknowledgedVersions.erase(id);
+				}
+			}
+			//A client that applied the points of a line gets its transforms relative to them from now on,
+			//and the GLUT thread catches it up on what moved while they were on their way
+			else if(request[COMMAND].asString() == ACKNOWLEDGE_ANNOTATION_COMMAND && request[ID].isInt()
+				&& request[GEOMETRY_VERSION].isInt() && request[GEOMETRY_VERSION].asInt() >= 0 && transformClients.count(id) > 0)
+			{
+				AnnotationRequest acknowledged = { id, request[ID].asInt(), request[GEOMETRY_VERSION].asInt() };
+				acknowledgedVersions[id][acknowledged.id] = acknowledged.version;
+				annotationRequests.push_back(acknowledged);
+			}
+		}
+
+		//A line that never ends is not a request either
+		if(pending.size() > MAX_PACKET_SIZE)
+		{
+			pending.clear();
+		}
 	}
-	if(gestureNetwork->acceptNewClient(gesture_client_id))
+
+	if(!connected)
 	{
-		printf("gesture client %d has been connected to the server\n",gesture_client_id);
+		closeClient(channel, id);
+	}
+}
 
-		//Increase the client counter
-		gesture_client_id++;
+/*
+ * Method Overview: Switches the format a client gets the messages in, and tells it so
+ * Parameters: Channel and id of the client, whether it gets the binary format from now on
+ * Return: Whether the client is still fine (dispatchMutex is held)
+ */
+bool CommunicationManager::setWireFormat(ClientChannel& channel, unsigned int id, bool binary)
+{
+	std::map<unsigned int, SendQueue>::iterator found = channel.sendQueues.find(id);
+	if(found == channel.sendQueues.end())
+	{
+		return true;
+	}
+
+	Json::Value answer;
+	answer[COMMAND] = WIRE_FORMAT_COMMAND;
+	answer[WIRE_FORMAT] = binary ? WIRE_FORMAT_BINARY : WIRE_FORMAT_JSON;
+
+	Json::StreamWriterBuilder wbuilder;
+	wbuilder[INDENTATION] = NO_INDENTATION;
+	std::string answerLine = Json::writeString(wbuilder, answer) + "\n";
+
+	//The answer is the last message in the old format, so the client knows where the new one starts
+	if(channel.binaryClients.count(id) > 0)
+	{
+		std::string wrapped;
+		AnnotationWireFormat::encodeJSON(answerLine.data(), answerLine.size(), wrapped);
+		found->second.push(wrapped, "");
+	}
+	else
+	{
+		found->second.push(answerLine, "");
+	}
+
+	if(binary)
+	{
+		channel.binaryClients.insert(id);
+	}
+	else
+	{
+		channel.binaryClients.erase(id);
+	}
+
+	printf("%s client %d gets the %s format\n", channel.name, id, binary ? WIRE_FORMAT_BINARY : WIRE_FORMAT_JSON);
+
+	return flushSendQueue(channel, id, found->second);
+}
+
+/*
+ * Method Overview: Waits for data from a client of a channel, or for a new client
+ * Parameters: Channel to wait on, client to wait for, longest time to wait
+ * Return: 1 if data or a client came, 0 if the time ran out
+ */
+int CommunicationManager::waitForChannel(ClientChannel& channel, unsigned int id, int timeoutMilliseconds)
+{
+	std::unique_lock<std::mutex> lock(channel.mutex);
+	unsigned long long eventsBefore = channel.events;
+
+	//Without a client, only a new connection ends the wait
+	SOCKET clientSocket = channel.network->getSocket(id);
+	bool armed = clientSocket != INVALID_SOCKET && reactor.arm(clientSocket);
+
+	bool changed = channel.changed.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [&channel, eventsBefore]() { return channel.events != eventsBefore; });
+	bool clientReady = changed && armed && channel.readySocket == clientSocket;
+
+	lock.unlock();
+
+	if(!changed && armed)
+	{
+		reactor.disarm(clientSocket);
+	}
+
+	//Readable with nothing to read means the client closed the connection; otherwise
+	//a reader that only checks what is available would be woken straight away, over and over
+	if(clientReady && NetworkServices::bytesAvailable(clientSocket) == 0)
+	{
+		closeClient(channel, id);
+	}
+
+	return changed ? 1 : 0;
+}
+
+/*
+ * Method Overview: Stops watching a client and closes its connection
+ * Parameters: Channel and id of the client
+ * Return: None
+ */
+void CommunicationManager::closeClient(ClientChannel& channel, unsigned int id)
+{
+	//Whatever still waited to be sent to it is dropped (never called with dispatchMutex held)
+	{
+		std::lock_guard<std::mutex> lock(dispatchMutex);
+		channel.sendQueues.erase(id);
+		channel.binaryClients.erase(id);
+		channel.requestLines.erase(id);
+
+		if(&channel == &jsonChannel)
+		{
+			transformClients.erase(id);
+			acknowledgedVersions.erase(id);
+		}
+	}
+
+	SOCKET clientSocket = channel.network->getSocket(id);
+
+	if(clientSocket != INVALID_SOCKET)
+	{
+		//The reactor must not wait on a closed socket
+		reactor.unwatch(clientSocket);
+		channel.network->closeClient(id);
+
+		printf("%s client %d has disconnected\n", channel.name, id);
+
+		//Its session is free for the next trainee
+		for(int session = 0; session < MAX_VIDEO_SESSIONS && &channel == &videoChannel; session++)
+		{
+			int expected = (int)id;
+			sessionClients[session].compare_exchange_strong(expected, -1);
+		}
+	}
+}
+
+/*
+ * Method Overview: Binds a newly connected video client to a session
+ * Parameters: Id of the video client
+ * Return: None
+ */
+void CommunicationManager::assignVideoSession(unsigned int id)
+{
+	int count = getSessionCount();
+	int chosen = -1;
+
+	//A free session first; client ids grow, so the smallest one connected first
+	for(int session = 0; session < count; session++)
+	{
+		if(sessionClients[session] < 0)
+		{
+			chosen = session;
+			break;
+		}
+		if(chosen < 0 || sessionClients[session] < sessionClients[chosen])
+		{
+			chosen = session;
+		}
+	}
+
+	int replaced = sessionClients[chosen].exchange((int)id);
+
+	if(replaced >= 0)
+	{
+		printf("video client %d replaces video client %d as trainee %d\n", id, replaced, chosen + 1);
+	}
+	else if(count > 1)
+	{
+		printf("video client %d is trainee %d\n", id, chosen + 1);
+	}
+}
+
+/*
+ * Method Overview: Gives the number of video sessions
+ * Parameters: None
+ * Return: VIDEO_SESSIONS, within 1 and MAX_VIDEO_SESSIONS
+ */
+int CommunicationManager::getSessionCount()
+{
+	if(VIDEO_SESSIONS < 1)
+	{
+		return 1;
+	}
+	if(VIDEO_SESSIONS > MAX_VIDEO_SESSIONS)
+	{
+		return MAX_VIDEO_SESSIONS;
+	}
+	return VIDEO_SESSIONS;
+}
+
+/*
+ * Method Overview: Gives the session shown full screen
+ * Parameters: None
+ * Return: Its number
+ */
+int CommunicationManager::getFocusedSession()
+{
+	return focusedSession;
+}
+
+/*
+ * Method Overview: Changes the session shown full screen
+ * Parameters: Its number
+ * Return: None
+ */
+void CommunicationManager::setFocusedSession(int session)
+{
+	if(session >= 0 && session < getSessionCount())
+	{
+		focusedSession = session;
+	}
+}
+
+/*
+ * Method Overview: Turns the focused-session code into a session
+ * Parameters: Session, or FOCUSED_VIDEO_SESSION
+ * Return: The session it stands for
+ */
+int CommunicationManager::resolveSession(int session)
+{
+	if(session < 0 || session >= MAX_VIDEO_SESSIONS)
+	{
+		return focusedSession;
+	}
+	return session;
+}
+
+/*
+ * Method Overview: Finds the client a read or wait is meant for
+ * Parameters: Type-of-client code, session (video only)
+ * Return: Id of the client, NO_CLIENT if there is none
+ */
+unsigned int CommunicationManager::clientFor(int networkType, int session)
+{
+	if(networkType == VIDEO_NETWORK_CODE)
+	{
+		int client = sessionClients[resolveSession(session)];
+		return client < 0 ? NO_CLIENT : (unsigned int)client;
+	}
+
+	ClientChannel* channel = channelFor(networkType);
+	if(channel == NULL || *channel->client_id == 0)
+	{
+		return NO_CLIENT;
+	}
+	return *channel->client_id - 1;
+}
+
+/*
+ * Method Overview: Counts the sessions with a trainee
+ * Parameters: None
+ * Return: Number of sessions that have a video client
+ */
+int CommunicationManager::connectedSessionCount()
+{
+	int connected = 0;
+
+	for(int session = 0; session < MAX_VIDEO_SESSIONS; session++)
+	{
+		if(sessionClients[session] >= 0)
+		{
+			connected++;
+		}
+	}
+
+	return connected;
+}
+
+/*
+ * Method Overview: Tells a closed or failed connection from one that has no data yet
+ * Parameters: What receiveData returned
+ * Return: Whether the connection is over
+ */
+bool CommunicationManager::connectionEnded(int data_length)
+{
+	return data_length == 0 || (data_length == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK);
+}
+
+/*
+ * Method Overview: Finds the channel of a type of client
+ * Parameters: Type-of-client code
+ * Return: Its channel, NULL if there is none
+ */
+CommunicationManager::ClientChannel* CommunicationManager::channelFor(int networkType)
+{
+	if(networkType == VIDEO_NETWORK_CODE)
+	{
+		return &videoChannel;
 	}
+	else if(networkType == JSON_NETWORK_CODE)
+	{
+		return &jsonChannel;
+	}
+	else if(networkType == GESTURE_NETWORK_CODE)
+	{
+		return &gestureChannel;
+	}
+
+	return NULL;
 }
 
 /*
  * Method Overview: Calls the method to receive data from clients
  * Parameters (1): Buffer and size of it to store the received data
- * Parameters (2): Type-of-client-to-send code
+ * Parameters (2): Type-of-client-to-send code (the video clients are read with receiveAvailableFromVideoClient)
  * Return: Length of the received data
  */
 int CommunicationManager::receiveFromClients(char * recvbuf, int bufSize, int networkType)
 {
 	int data_length = 0;
 
+	if(networkType == GESTURE_NETWORK_CODE)
+	{
+		data_length = startReceptionGesture(gestureNetwork, recvbuf, bufSize);
+	}
+
+	return data_length;
+}
+
+/*
+ * Method Overview: Checks how much data the clients have sent
+ * Parameters: Type-of-client-to-check code
+ * Return: Number of bytes that can be received without waiting
+ */
+int CommunicationManager::availableFromClients(int networkType, int session)
+{
+	int data_length = 0;
+
 	if(networkType == VIDEO_NETWORK_CODE)
 	{
-		data_length = startReception(videoNetwork, recvbuf, bufSize);
-	} 
+		data_length = videoNetwork->bytesAvailable(clientFor(networkType, session));
+	}
 	else if(networkType == GESTURE_NETWORK_CODE)
 	{
-		data_length = startReceptionGesture(gestureNetwork, recvbuf, bufSize);
+		data_length = gestureNetwork->bytesAvailable(clientFor(networkType, session));
 	}
 
 	return data_length;
 }
 
 /*
- * Method Overview: Calls the method to send data to all clients
- * Parameters: Message to send, type-of-client-to-send code
+ * Method Overview: Waits for data from clients
+ * Parameters: Type-of-client-to-wait-for code, longest time to wait, session (video only)
+ * Return: 1 if data came (or a new client connected), 0 if the time ran out, SOCKET_ERROR for a type nobody reads
+ */
+int CommunicationManager::waitForClients(int networkType, int timeoutMilliseconds, int session)
+{
+	ClientChannel* channel = channelFor(networkType);
+
+	if(channel == NULL || !channel->readElsewhere)
+	{
+		return SOCKET_ERROR;
+	}
+
+	return waitForChannel(*channel, clientFor(networkType, session), timeoutMilliseconds);
+}
+
+/*
+ * Method Overview: Gives the video client of a session
+ * Parameters: Session
+ * Return: Id of its client, NO_CLIENT if it has none
+ */
+unsigned int CommunicationManager::getVideoClient(int session)
+{
+	return clientFor(VIDEO_NETWORK_CODE, session);
+}
+
+/*
+ * Method Overview: Closes a video client, as if it had disconnected
+ * Parameters: Id of the video client
  * Return: None
  */
-int CommunicationManager::sendActionPackets(const char * message, int networkType)
+void CommunicationManager::closeVideoClient(unsigned int id)
+{
+	closeClient(videoChannel, id);
+}
+
+/*
+ * Method Overview: Tells where a video client connected from
+ * Parameters: Id of the video client
+ * Return: Its IPv4 address (network byte order), 0 if it is not known
+ */
+unsigned long CommunicationManager::getVideoClientAddress(unsigned int id)
+{
+	return videoNetwork->getPeerAddress(id);
+}
+
+/*
+ * Method Overview: Reads what a video client has sent so far, without waiting
+ * Parameters (1): Id of the video client
+ * Parameters (2): Buffers to store the data and their sizes (the second one is filled once the first is full)
+ * Return: Length of the received data, 0 if nothing had come
+ */
+int CommunicationManager::receiveAvailableFromVideoClient(unsigned int id, char * first, int firstSize, char * second, int secondSize)
+{
+	int data_length = videoNetwork->receiveScattered(id, first, firstSize, second, secondSize);
+
+	if(data_length > 0)
+	{
+		return data_length;
+	}
+
+	//Otherwise a closed connection would look readable to whoever waits on it, over and over
+	if(connectionEnded(data_length))
+	{
+		closeClient(videoChannel, id);
+	}
+
+	return 0;
+}
+
+/*
+ * Method Overview: Calls the method to send data to the clients of a session
+ * Parameters (1): Message to send, type-of-client-to-send code, session (the focused one unless given)
+ * Parameters (2): Collapse key: a newer message with the same one may replace it while it waits ("" = never)
+ * Parameters (3): The message in the binary format and its size, for the clients that asked for it (NULL if it has none)
+ * Return: Number of clients the message was queued for
+ */
+int CommunicationManager::sendActionPackets(const char * message, int networkType, int session, const char * collapseKey,
+	const char * binaryMessage, int binarySize)
 {
 	/*
 	std::cout << "=== sendActionPackets ===" << std::endl;
@@ -126,49 +677,144 @@ int CommunicationManager::sendActionPackets(const char * message, int networkTyp
 	std::cout << "=========================" << std::endl;
 	*/
 
-    int iResult;
+    int iResult = 0;
 
 	if(networkType == JSON_NETWORK_CODE)
 	{
-		iResult = startDispatch(jsonNetwork, message);
+		iResult = startDispatch(jsonChannel, message, session, collapseKey, binaryMessage, binarySize);
 	}
 
 	return iResult;
 }
 
 /*
- * Method Overview: Calls the method to receive data from clients
- * Parameters (1): Network to use to receive data from
- * Parameters (2): Buffer to store the received data and its size
- * Return: Length of the received data
+ * Method Overview: Tells how much the communication thread slept
+ * Parameters: Where to store the wake-ups and the time asleep
+ * Return: None
  */
-int CommunicationManager::startReception(ServerNetwork* network, char * recvbuf, int bufSize)
+void CommunicationManager::getReactorStatistics(unsigned long long & wakeUps, unsigned long long & idleMicroseconds)
 {
-	int data_length=0;
-	int i;
+	wakeUps = reactor.getWakeUps();
+	idleMicroseconds = (unsigned long long)reactor.getIdleMicroseconds();
+}
+
+/*
+ * Method Overview: Tells whether any json client gets the binary format
+ * Parameters: None
+ * Return: True if at least one does
+ */
+bool CommunicationManager::hasBinaryClients()
+{
+	std::lock_guard<std::mutex> lock(dispatchMutex);
+
+	return !jsonChannel.binaryClients.empty();
+}
+
+/*
+ * Method Overview: Sends an annotation message to the trainee being looked at
+ * Parameters (1): Message (a line of JSON), key of the messages it supersedes ("" = none)
+ * Parameters (2): Binary form of the message (NULL if it was not encoded) and its size
+ * Return: Result of sendActionPackets
+ */
+int CommunicationManager::sendAnnotationMessage(const char * message, const char * collapseKey, const char * binaryMessage, int binarySize)
+{
+	return sendActionPackets(message, JSON_NETWORK_CODE, FOCUSED_VIDEO_SESSION, collapseKey, binaryMessage, binarySize);
+}
+
+/*
+ * Method Overview: Sends an annotation message to some json clients only
+ * Parameters (1): Clients to send it to, message (a line of JSON), key of the messages it supersedes ("" = none)
+ * Parameters (2): Binary form of the message (NULL if it was not encoded) and its size
+ * Return: Number of clients the message was queued for
+ */
+int CommunicationManager::sendAnnotationMessageTo(const std::vector<unsigned int> & clients, const char * message, const char * collapseKey,
+	const char * binaryMessage, int binarySize)
+{
+	return startDispatch(jsonChannel, message, FOCUSED_VIDEO_SESSION, collapseKey, binaryMessage, binarySize, &clients);
+}
+
+/*
+ * Method Overview: Hands over what the json clients asked for or acknowledged about the lines
+ * Parameters: Where to store the requests
+ * Return: None
+ */
+void CommunicationManager::takeAnnotationRequests(std::vector<AnnotationRequest> & requests)
+{
+	std::lock_guard<std::mutex> lock(dispatchMutex);
+
+	requests.clear();
+	requests.swap(annotationRequests);
+}
+
+/*
+ * Method Overview: Tells which geometry of a line the json clients of the focused session acknowledged
+ * Parameters: Id of the line, where to store the version of every client that acknowledged one
+ * Return: None
+ */
+void CommunicationManager::getAcknowledgedVersions(int id, std::map<unsigned int, int> & versions)
+{
+	std::lock_guard<std::mutex> lock(dispatchMutex);
 
-	//Iterate until all the data from the socket is complete
-	for(i = 0; i<bufSize;)
+	versions.clear();
+	for(std::map<unsigned int, std::map<int, int> >::iterator it = acknowledgedVersions.begin(); it != acknowledgedVersions.end(); it++)
 	{
-		/*
-			* Sometimes, the data to be received is too big to be
-			* obtained in one iteration. This allows the socket to
-			* keep track of where exactly in the data stream the 
-			* buffer got fulled up so that, after its emptied, the
-			* data reception can continue from that specific point
-		*/
-		data_length = network->receiveData(video_client_id-1, recvbuf+i, bufSize-i);
+		std::map<int, int>::iterator found = it->second.find(id);
+
+		if(found != it->second.end() && isClientOfSession(jsonChannel, it->first, FOCUSED_VIDEO_SESSION))
+		{
+			versions[it->first] = found->second;
+		}
+	}
+}
 
+/*
+ * Method Overview: Tells which json clients of the focused session get moved lines whole
+ * Parameters: Where to store their ids
+ * Return: None
+ */
+void CommunicationManager::getWholeLineClients(std::vector<unsigned int> & clients)
+{
+	std::lock_guard<std::mutex> lock(dispatchMutex);
 
-		//If there is data to receive
-		if(data_length>=0)
+	clients.clear();
+	for(std::map<unsigned int, SendQueue>::iterator it = jsonChannel.sendQueues.begin(); it != jsonChannel.sendQueues.end(); it++)
+	{
+		if(transformClients.count(it->first) == 0 && isClientOfSession(jsonChannel, it->first, FOCUSED_VIDEO_SESSION))
 		{
-			//Update the data received counter with its lenght
-			i += data_length;
+			clients.push_back(it->first);
 		}
+	}
+}
+
+/*
+ * Method Overview: Forgets what the json clients acknowledged of a line
+ * Parameters: Id of the line
+ * Return: None
+ */
+void CommunicationManager::forgetAnnotation(int id)
+{
+	std::lock_guard<std::mutex> lock(dispatchMutex);
+
+	for(std::map<unsigned int, std::map<int, int> >::iterator it = acknowledgedVersions.begin(); it != acknowledgedVersions.end(); it++)
+	{
+		it->second.erase(id);
+	}
+}
 
+/*
+ * Method Overview: Tells how far behind every json client is
+ * Parameters: Where to store the statistics of every client, by id
+ * Return: None
+ */
+void CommunicationManager::getSendQueueStatistics(std::map<unsigned int, SendQueueStatistics> & statistics)
+{
+	std::lock_guard<std::mutex> lock(dispatchMutex);
+
+	statistics.clear();
+	for(std::map<unsigned int, SendQueue>::iterator it = jsonChannel.sendQueues.begin(); it != jsonChannel.sendQueues.end(); it++)
+	{
+		statistics[it->first] = it->second.getStatistics();
 	}
-	return i;
 }
 
 /*
@@ -183,20 +829,153 @@ int CommunicationManager::startReceptionGesture(ServerNetwork* network, char * r
 	
 	data_length = network->receiveData(gesture_client_id-1, recvbuf, bufSize);
 
+	//Stops watching a gesture client that is gone
+	if(connectionEnded(data_length))
+	{
+		closeClient(gestureChannel, gesture_client_id-1);
+	}
+
 	return data_length;
 }
 
 /*
- * Method Overview: Calls the method to send data to all clients
- * Parameters (1): Network to use to send data to
- * Parameters (2): Message to send, type-of-client-to-send code
+ * Method Overview: Queues a message for the clients of a session and sends what their sockets take
+ * Parameters (1): Channel of the clients to send to
+ * Parameters (2): Message to send, video session whose trainee it is for, collapse key
+ * Parameters (3): The message in the binary format and its size (NULL to wrap the message in a binary one)
+ * Parameters (4): Clients to send it to instead of those of the session (NULL = those of the session)
+ * Return: Number of clients the message was queued for
+ */
+int CommunicationManager::startDispatch(ClientChannel& channel, const char * message, int session, const char * collapseKey,
+	const char * binaryMessage, int binarySize, const std::vector<unsigned int> * clients)
+{
+	int queuedFor = 0;
+	std::vector<unsigned int> failedClients;
+
+	{
+		std::lock_guard<std::mutex> lock(dispatchMutex);
+
+		std::string data(message);
+		std::string key(collapseKey);
+
+		//What the clients of the binary format get instead
+		std::string binaryData;
+		if(!channel.binaryClients.empty())
+		{
+			if(binaryMessage != NULL)
+			{
+				binaryData.assign(binaryMessage, binarySize);
+			}
+			else
+			{
+				AnnotationWireFormat::encodeJSON(data.data(), data.size(), binaryData);
+			}
+		}
+
+		for(std::map<unsigned int, SendQueue>::iterator it = channel.sendQueues.begin(); it != channel.sendQueues.end(); it++)
+		{
+			bool addressed = clients != NULL ? std::find(clients->begin(), clients->end(), it->first) != clients->end()
+				: isClientOfSession(channel, it->first, session);
+
+			if(!addressed)
+			{
+				continue;
+			}
+
+			it->second.push(channel.binaryClients.count(it->first) > 0 ? binaryData : data, key);
+			queuedFor++;
+
+			if(!flushSendQueue(channel, it->first, it->second))
+			{
+				failedClients.push_back(it->first);
+			}
+		}
+	}
+
+	//Closing takes dispatchMutex itself
+	for(size_t i = 0; i < failedClients.size(); i++)
+	{
+		closeClient(channel, failedClients[i]);
+	}
+
+	return queuedFor;
+}
+
+/*
+ * Method Overview: Tells whether a client belongs to the trainee of a session
+ * Parameters: Channel and id of the client, video session
+ * Return: True if messages for the session's trainee go to the client
+ */
+bool CommunicationManager::isClientOfSession(ClientChannel& channel, unsigned int id, int session)
+{
+	//With one trainee (or none) there is nobody to tell apart, so every client is, as before
+	if(connectedSessionCount() <= 1)
+	{
+		return true;
+	}
+
+	//Otherwise only the clients of the trainee: its connections all come from its own machine
+	unsigned long address = videoNetwork->getPeerAddress(clientFor(VIDEO_NETWORK_CODE, session));
+
+	return address != 0 && channel.network->getPeerAddress(id) == address;
+}
+
+/*
+ * Method Overview: Sends as much of a client's queue as its socket takes, without waiting
+ * Parameters: Channel and id of the client, its queue (dispatchMutex is held)
+ * Return: Whether the client is still fine; false if its connection failed or it stopped reading
+ */
+bool CommunicationManager::flushSendQueue(ClientChannel& channel, unsigned int id, SendQueue& queue)
+{
+	ServerNetwork* network = channel.network;
+
+	bool connected = queue.flush([network, id](const char * data, int size) { return network->sendToClient(id, data, size); });
+
+	if(!connected)
+	{
+		return false;
+	}
+
+	//Collapsing only helps with updates; a client that reads nothing at all would pile up the rest forever
+	if(queue.queuedBytes() > (size_t)JSON_SEND_HIGH_WATER_BYTES * STALLED_CLIENT_HIGH_WATER_MULTIPLE)
+	{
+		printf("%s client %d stopped reading (%d KB waiting for it), disconnecting it\n", channel.name, id, (int)(queue.queuedBytes() / 1024));
+		return false;
+	}
+
+	//The rest goes once the socket has room again, sent by the reactor
+	if(!queue.empty())
+	{
+		ClientChannel* sendingChannel = &channel;
+		reactor.watchWritable(network->getSocket(id), [this, sendingChannel, id](SOCKET) { continueDispatch(*sendingChannel, id); });
+	}
+
+	return true;
+}
+
+/*
+ * Method Overview: Sends more of what waits for a client, now that its socket has room
+ * Parameters: Channel and id of the client
  * Return: None
  */
-int CommunicationManager::startDispatch(ServerNetwork* network, const char * message)
+void CommunicationManager::continueDispatch(ClientChannel& channel, unsigned int id)
 {
-    int iResult;
+	bool connected = true;
 
-	iResult = network->sendToAll(message);
+	{
+		std::lock_guard<std::mutex> lock(dispatchMutex);
 
-	return iResult;
+		std::map<unsigned int, SendQueue>::iterator found = channel.sendQueues.find(id);
+		if(found == channel.sendQueues.end())
+		{
+			return;
+		}
+
+		connected = flushSendQueue(channel, id, found->second);
+	}
+
+	if(!connected)
+	{
+		closeClient(channel, id);
+	}
 }
\ No newline at end of file
@@ -14,9 +14,18 @@
  *
  * Overview: This class coordinates the processes related to the
  * connection of the Mentor System with the Trainee System. By
- * itself, contains a loop to accept new clients, but it also 
- * has the required methods to notify the other classes when
- * they need to send or receive data from the available clients.
+ * itself, runs an I/O reactor that sleeps until a client connects,
+ * sends or disconnects, but it also has the required methods to
+ * notify the other classes when they need to send or receive data
+ * from the available clients.
+ * Every trainee the mentor watches has a video session, bound to
+ * its video connection. Video is read per session, and messages to
+ * a session go to the json clients connected from the same address.
+ * Every json client has its own queue of messages, which the reactor
+ * sends as fast as the client reads them, so that a slow client
+ * neither blocks the sender nor holds up the other clients. A json
+ * client can ask for the annotations in a compact binary format
+ * instead of JSON (see AnnotationWireFormat.h).
  * This code was adapted from the one posted on CODEPROJECT by 
  * the user "bshokati" on Apr 22, 2013: 
  * http://www.codeproject.com/Articles/412511/Simple-client-server-network-using-Cplusplus-and-W
@@ -27,22 +36,103 @@
 //---------------------------Includes----------------------------//
 #include "ServerNetwork.h"//Socket Handling
 #include "communicationDefinitions.h"//Socket-related definitions
+#include "IOReactor.h"//Waits on all the sockets at once
+#include "SendQueue.h"//Messages waiting for a json client
+#include "Config.h"//Number of video sessions
+#include "AnnotationSender.h"//What the JSONManager sends through
+#include <mutex>//Keeps messages from different threads whole
+#include <condition_variable>//Wakes the threads that read the clients
+#include <atomic>//Video sessions, changed by the reactor and read by the video threads
+#include <map>//Send queue of every json client
+#include <set>//Json clients that asked for the binary format, or for transforms
+#include <string>//Requests of the json clients, read a piece at a time
+#include <vector>//Lines the json clients asked for again
 
-class CommunicationManager
+//What a json client said about the geometry of a line, for the GLUT thread to answer
+struct AnnotationRequest
+{
+	unsigned int client;
+	int id;
+
+	//Version of the line's geometry the client acknowledged, or -1 if it asked for the line whole
+	int version;
+};
+
+class CommunicationManager : public AnnotationSender
 {
 public:
 	//-------------------------Methods---------------------------//
 	CommunicationManager(void);//Class Constructor
     ~CommunicationManager(void);//Class Destructor
 
-	//Accept new Clients
-    void update();
+	//Accept new clients and watch their sockets, until the program ends
+    void run();
 
-	//Notify Socket Handling Object to recieve a video message
+	//Notify Socket Handling Object to recieve a gesture message
 	int receiveFromClients(char * recvbuf, int bufSize, int networkType);
 
-	//Notify Socket Handling Object to send a message
-	int sendActionPackets(const char * message, int networkType);
+	//Amount of data already waiting to be received
+	int availableFromClients(int networkType, int session = 0);
+
+	//Client id standing for no client at all
+	static const unsigned int NO_CLIENT = 0xFFFFFFFF;
+
+	//Video client of a session, NO_CLIENT while it has none
+	unsigned int getVideoClient(int session);
+
+	//Closes a video client whose stream cannot be shown; its session waits for the next trainee
+	void closeVideoClient(unsigned int id);
+
+	//IPv4 address a video client connected from (network byte order), 0 if unknown
+	unsigned long getVideoClientAddress(unsigned int id);
+
+	//Reads whatever a video client has sent, up to two buffers' worth, in one call: 0 if nothing has come.
+	//A client that has gone is closed, and its session waits for the next one
+	int receiveAvailableFromVideoClient(unsigned int id, char * first, int firstSize, char * second, int secondSize);
+
+	//Waits until a client sends data or a new one connects: 1 if either happened, 0 if the time ran out
+	int waitForClients(int networkType, int timeoutMilliseconds, int session = 0);
+
+	//Notify Socket Handling Object to send a message (json messages go to the trainee of a session).
+	//Past the high-water mark, a message replaces the one still waiting with the same collapse key.
+	//Clients of the binary format get binaryMessage, or the message wrapped in a binary one if there is none
+	int sendActionPackets(const char * message, int networkType, int session = FOCUSED_VIDEO_SESSION, const char * collapseKey = "",
+		const char * binaryMessage = NULL, int binarySize = 0);
+
+	//Whether any json client asked for the binary format (otherwise there is no need to encode it)
+	bool hasBinaryClients();
+
+	//Sends an annotation message to the json clients of the focused session (see sendActionPackets)
+	int sendAnnotationMessage(const char * message, const char * collapseKey, const char * binaryMessage, int binarySize);
+
+	//Sends an annotation message to some json clients only, whichever session they belong to
+	int sendAnnotationMessageTo(const std::vector<unsigned int> & clients, const char * message, const char * collapseKey,
+		const char * binaryMessage, int binarySize);
+
+	//Moves what the json clients asked for or acknowledged about the lines into requests (empty if nothing)
+	void takeAnnotationRequests(std::vector<AnnotationRequest> & requests);
+
+	//Version of a line's geometry acknowledged by every json client of the focused session that acknowledged one, by client
+	void getAcknowledgedVersions(int id, std::map<unsigned int, int> & versions);
+
+	//Json clients of the focused session that did not ask for transforms, and get a moved line whole
+	void getWholeLineClients(std::vector<unsigned int> & clients);
+
+	//Forgets what the json clients acknowledged of a line (its id now stands for a new line)
+	void forgetAnnotation(int id);
+
+	//Number of video sessions (VIDEO_SESSIONS, kept within 1 to MAX_VIDEO_SESSIONS)
+	int getSessionCount();
+
+	//Session the mentor is looking at; annotations go to its trainee
+	int getFocusedSession();
+	void setFocusedSession(int session);
+
+	//Times the reactor woke up, and how long it slept in total
+	void getReactorStatistics(unsigned long long & wakeUps, unsigned long long & idleMicroseconds);
+
+	//Messages and bytes waiting for every json client, and how many were sent or collapsed
+	void getSendQueueStatistics(std::map<unsigned int, SendQueueStatistics> & statistics);
 
 	//------------------------Variables--------------------------//
 	//IDs for clients connecting to video clients table
@@ -55,14 +145,89 @@ public:
 	static unsigned int gesture_client_id;
 
 private:
+	//------------------------Structures-------------------------//
+	//One kind of client, and the thread waiting for it
+	struct ClientChannel
+	{
+		ServerNetwork* network;
+		unsigned int* client_id;
+		const char* name;
+
+		//Read by another thread, which arms the socket when it has to wait for it
+		bool readElsewhere;
+
+		//Counts the times the reactor found data or a new client, under the mutex
+		std::mutex mutex;
+		std::condition_variable changed;
+		unsigned long long events;
+
+		//Socket the reactor found readable last (INVALID_SOCKET for a new client)
+		SOCKET readySocket;
+
+		//Messages waiting for each client, under dispatchMutex (only the clients the mentor sends to have one)
+		std::map<unsigned int, SendQueue> sendQueues;
+
+		//Clients that get the binary format, and the start of a request line each client is still sending, under dispatchMutex
+		std::set<unsigned int> binaryClients;
+		std::map<unsigned int, std::string> requestLines;
+	};
+
 	//-------------------------Methods---------------------------//
-	//Actually starts the reception of a message
-	int startReception(ServerNetwork* network, char * recvbuf, int bufSize);
+	//Sets a channel up and starts watching its listening socket
+	void openChannel(ClientChannel& channel, ServerNetwork* network, unsigned int* client_id, const char* name, bool readElsewhere);
 
+	//Accepts the clients waiting on a channel (called by the reactor)
+	void acceptClients(ClientChannel& channel);
+
+	//Wakes the thread waiting on a channel (called by the reactor)
+	void notifyChannel(ClientChannel& channel, SOCKET readySocket);
+
+	//Reads what a client sent on a channel nobody else reads, and answers its requests (called by the reactor)
+	void readRequestsFromClient(ClientChannel& channel, unsigned int id);
+
+	//Switches a client to the binary format or back to JSON, once it asked for it (dispatchMutex is held)
+	bool setWireFormat(ClientChannel& channel, unsigned int id, bool binary);
+
+	//Waits for a client of a channel to send data, or for a new one
+	int waitForChannel(ClientChannel& channel, unsigned int id, int timeoutMilliseconds);
+
+	//Binds a new video client to a session: a free one, or else the one whose trainee connected first
+	void assignVideoSession(unsigned int id);
+
+	//Turns FOCUSED_VIDEO_SESSION into the session it stands for
+	int resolveSession(int session);
+
+	//Client a read is meant for: the video client of a session, or the newest client of another type
+	unsigned int clientFor(int networkType, int session);
+
+	//Number of sessions that have a trainee connected
+	int connectedSessionCount();
+
+	//Closes a client once it disconnected (or its connection failed)
+	void closeClient(ClientChannel& channel, unsigned int id);
+
+	//Result of a read that says the connection is over
+	bool connectionEnded(int data_length);
+
+	//Finds the channel of a type-of-client code
+	ClientChannel* channelFor(int networkType);
+
+	//Actually starts the reception of a message
 	int startReceptionGesture(ServerNetwork* network, char * recvbuf, int bufSize);
 
-	//Actually starts the dispatch of a message
-	int startDispatch(ServerNetwork* network, const char * message);
+	//Actually starts the dispatch of a message (to the given clients, or those of the session if NULL)
+	int startDispatch(ClientChannel& channel, const char * message, int session, const char * collapseKey, const char * binaryMessage, int binarySize,
+		const std::vector<unsigned int> * clients = NULL);
+
+	//Whether a client of a channel belongs to the trainee of a session (dispatchMutex is held)
+	bool isClientOfSession(ClientChannel& channel, unsigned int id, int session);
+
+	//Sends what a client's socket takes of its queue, and has the reactor send the rest later (under dispatchMutex).
+	//Returns false if the client has to be closed
+	bool flushSendQueue(ClientChannel& channel, unsigned int id, SendQueue& queue);
+
+	//Sends more of a client's queue once its socket has room (called by the reactor)
+	void continueDispatch(ClientChannel& channel, unsigned int id);
 
 	//------------------------Variables--------------------------//
     //The video Socket Handling Object
@@ -74,6 +239,39 @@ private:
 	//The gesture Socket Handling Object
     ServerNetwork* gestureNetwork;
 
-	//Data buffer to store the information sent through the socket
+	//Waits on the listening sockets and the clients' sockets
+	IOReactor reactor;
+
+	//The three kinds of clients
+	ClientChannel videoChannel;
+	ClientChannel jsonChannel;
+	ClientChannel gestureChannel;
+
+	//Video client of every session, -1 while it has none (set by the reactor thread)
+	std::atomic<int> sessionClients[MAX_VIDEO_SESSIONS];
+
+	//Session shown full screen
+	std::atomic<int> focusedSession;
+
+	//Held while a message is queued or sent, since annotations and video feedback are sent from different threads
+	std::mutex dispatchMutex;
+
+	//Lines the json clients asked for again or acknowledged, under dispatchMutex
+	std::vector<AnnotationRequest> annotationRequests;
+
+	//Json clients that asked for the transforms of moved lines instead of their points, under dispatchMutex
+	std::set<unsigned int> transformClients;
+
+	//Geometry version of every line each of them acknowledged last (client, then line id), under dispatchMutex
+	std::map<unsigned int, std::map<int, int> > acknowledgedVersions;
+
+	//Data buffer to store the information sent through the socket (used by the reactor to read requests)
     char network_data[MAX_PACKET_SIZE];
+
+	//Longest a reception waits at a time before it looks for a newer client
+	static const int RECEPTION_WAIT_MILLISECONDS = 100;
+
+	//A client with this many times JSON_SEND_HIGH_WATER_BYTES waiting has stopped reading
+	static const int STALLED_CLIENT_HIGH_WATER_MULTIPLE = 64;
+
 };
\ No newline at end of file
@@ -1,4 +1,33 @@
 #include "Config.h"
 
 int SERVER_RESOLUTION_X = 1920;
-int SERVER_RESOLUTION_Y = 1080;
\ No newline at end of file
+int SERVER_RESOLUTION_Y = 1080;
+
+bool VIDEO_LOW_LATENCY_MODE = true;
+
+int VIDEO_DECODER_THREAD_COUNT = 0;
+bool VIDEO_DECODER_FRAME_THREADS = false;
+bool VIDEO_DECODER_SLICE_THREADS = true;
+int VIDEO_PARALLEL_MJPEG_DECODERS = 1;
+int VIDEO_SESSIONS = 1;
+
+bool VIDEO_YUV_NATIVE_PATH = true;
+bool VIDEO_GL_HOMOGRAPHY = true;
+bool VIDEO_PIXEL_BUFFER_UPLOAD = true;
+
+int VIDEO_FEEDBACK_INTERVAL_MILLISECONDS = 500;
+int JSON_SEND_HIGH_WATER_BYTES = 65536;
+
+int VIDEO_JITTER_BUFFER_MILLISECONDS = 50;
+int VIDEO_DATAGRAM_INJECTED_LOSS_PERCENT = 0;
+
+const char* VIDEO_RECORDING_DIRECTORY = "";
+const char* VIDEO_RECORDING_CONTAINER = "mkv";
+
+const char* VIDEO_CAPTURE_DIRECTORY = "";
+const char* VIDEO_REPLAY_FILE = "";
+double VIDEO_REPLAY_SPEED = 1.0;
+bool VIDEO_REPLAY_LOOP = false;
+
+bool STAGE_TRACING_ENABLED = false;
+const char* STAGE_TRACE_DIRECTORY = "";
\ No newline at end of file
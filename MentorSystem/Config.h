@@ -1,4 +1,91 @@
 #pragma once
 
 extern int SERVER_RESOLUTION_X;
-extern int SERVER_RESOLUTION_Y;
\ No newline at end of file
+extern int SERVER_RESOLUTION_Y;
+
+// When true, the video pipeline drops stale packets under backlog and only
+// decodes/shows the newest frame, trading completeness for freshness.
+extern bool VIDEO_LOW_LATENCY_MODE;
+
+// Threads used by the video decoder (0 = one per core, 1 = no threading).
+extern int VIDEO_DECODER_THREAD_COUNT;
+
+// Let the decoder work on several frames at once. Raises throughput but
+// delays every frame by (thread count - 1) frames, so it is off by default.
+extern bool VIDEO_DECODER_FRAME_THREADS;
+
+// Let the decoder split a single frame across threads (no added delay).
+extern bool VIDEO_DECODER_SLICE_THREADS;
+
+// Number of independent decoders used for MJPEG, where every frame decodes
+// on its own. Frames are still shown in the order they arrived. 1 = off.
+extern int VIDEO_PARALLEL_MJPEG_DECODERS;
+
+// Trainees the mentor watches at once (up to MAX_VIDEO_SESSIONS), each with its
+// own video pipeline and decoder. The focused one fills the screen, under the
+// GUI and annotations; the others are shown as thumbnails along the top, and
+// Tab moves the focus. A trainee connecting when all are taken replaces the
+// one that connected first. 1 = only the newest trainee, as before.
+extern int VIDEO_SESSIONS;
+
+// Keep decoded frames in planar YUV and convert, flip and scale them for
+// display in one pass (YUVConverter), instead of RGB + flip() + resize().
+extern bool VIDEO_YUV_NATIVE_PATH;
+
+// Upload decoded frames to OpenGL at the trainee camera's resolution and let
+// OpenGL apply the camera homography when drawing, instead of resizing and
+// warping every frame to the screen resolution on the CPU.
+extern bool VIDEO_GL_HOMOGRAPHY;
+
+// Upload video frames to OpenGL through a ring of pixel buffer objects, so the
+// copy to the GPU runs in the background instead of stalling the render thread.
+// Falls back to uploading from client memory if the driver lacks support.
+extern bool VIDEO_PIXEL_BUFFER_UPLOAD;
+
+// How often the mentor tells the trainee, on the JSON channel, what throughput
+// and queueing delay it sees on the video link, so the trainee can adapt its
+// bitrate or frame rate. 0 = never.
+extern int VIDEO_FEEDBACK_INTERVAL_MILLISECONDS;
+
+// Bytes waiting to go out to one JSON client (one trainee's tablet) past which
+// it counts as falling behind: a new position of an annotation then replaces
+// the one still waiting instead of queueing behind it. A client with 64 times
+// as much waiting has stopped reading and is disconnected.
+extern int JSON_SEND_HIGH_WATER_BYTES;
+
+// Longest a video frame sent as datagrams is held back waiting for its missing
+// pieces (or for earlier frames) before it is given up on. Higher rides out more
+// network jitter, lower adds less delay.
+extern int VIDEO_JITTER_BUFFER_MILLISECONDS;
+
+// Percentage of the video datagrams dropped on purpose as they are read, to try
+// out how the video copes with packet loss. 0 = none.
+extern int VIDEO_DATAGRAM_INJECTED_LOSS_PERCENT;
+
+// Folder to record the video of every session into, as it comes from the
+// trainee (no re-encoding), in a file named after the time the session
+// started. "" = no recording.
+extern const char* VIDEO_RECORDING_DIRECTORY;
+
+// Container of the recordings, as a file extension ("mkv" or "mp4").
+extern const char* VIDEO_RECORDING_CONTAINER;
+
+// Folder to save a packet capture of every session into: the packets as they
+// arrived, with their arrival times, to replay them later. "" = no capture.
+extern const char* VIDEO_CAPTURE_DIRECTORY;
+
+// Packet capture to replay instead of receiving video from the trainee. "" = live.
+extern const char* VIDEO_REPLAY_FILE;
+
+// How fast to replay: 1 = as captured, 2 = twice as fast, 0 = as fast as possible.
+extern double VIDEO_REPLAY_SPEED;
+
+// Start the replay over when it reaches the end of the capture.
+extern bool VIDEO_REPLAY_LOOP;
+
+// Record how long each stage takes, on every thread, for dumping as a Chrome trace
+// ('t' in the mentor window, or Ctrl+Break in its console). 'p' switches it on and off.
+extern bool STAGE_TRACING_ENABLED;
+
+// Folder to save the traces into. "" = the working directory.
+extern const char* STAGE_TRACE_DIRECTORY;
\ No newline at end of file
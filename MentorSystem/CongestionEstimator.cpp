@@ -0,0 +1,149 @@
+#include "CongestionEstimator.h"
+
+const double CongestionEstimator::OVERUSE_DELAY_SECONDS = 0.1;
+const double CongestionEstimator::UNDERUSE_DELAY_SECONDS = 0.02;
+const double CongestionEstimator::DECREASE_FACTOR = 0.85;
+const double CongestionEstimator::INCREASE_FACTOR = 1.08;
+const double CongestionEstimator::BASE_DELAY_WINDOW_SECONDS = 10.0;
+
+// Weight of each new sample in the smoothed queueing delay
+static const double QUEUEING_DELAY_SMOOTHING = 0.1;
+
+CongestionEstimator::CongestionEstimator(double windowSeconds)
+	: _windowSeconds(windowSeconds)
+{
+	reset();
+}
+
+void CongestionEstimator::reset()
+{
+	_arrivals.clear();
+	_windowBytes = 0;
+	_firstArrivalSeconds = 0.0;
+	_hasArrivals = false;
+
+	_baseDelayCandidates.clear();
+	_queueingDelaySeconds = 0.0;
+	_hasQueueingDelay = false;
+
+	_receiveBacklogBytes = 0;
+}
+
+void CongestionEstimator::trimWindow(double nowSeconds)
+{
+	while (!_arrivals.empty() && _arrivals.front().seconds <= nowSeconds - _windowSeconds) {
+		_windowBytes -= _arrivals.front().bytes;
+		_arrivals.pop_front();
+	}
+}
+
+void CongestionEstimator::packetArrived(double arrivalSeconds, int bytes, long long captureMicroseconds, int backlogBytes)
+{
+	if (!_hasArrivals) {
+		_firstArrivalSeconds = arrivalSeconds;
+		_hasArrivals = true;
+	}
+
+	Arrival arrival;
+	arrival.seconds = arrivalSeconds;
+	arrival.bytes = bytes;
+	_arrivals.push_back(arrival);
+	_windowBytes += bytes;
+
+	trimWindow(arrivalSeconds);
+
+	_receiveBacklogBytes = backlogBytes;
+
+	if (captureMicroseconds < 0) {
+		return;
+	}
+
+	// includes the unknown offset between the clocks, which cancels out against the base delay
+	DelaySample sample;
+	sample.seconds = arrivalSeconds;
+	sample.oneWayDelay = arrivalSeconds - captureMicroseconds / 1000000.0;
+
+	// sliding minimum: a sample can never be the smallest while a later, smaller one is in the window
+	while (!_baseDelayCandidates.empty() && _baseDelayCandidates.back().oneWayDelay >= sample.oneWayDelay) {
+		_baseDelayCandidates.pop_back();
+	}
+	_baseDelayCandidates.push_back(sample);
+
+	while (_baseDelayCandidates.front().seconds <= arrivalSeconds - BASE_DELAY_WINDOW_SECONDS) {
+		_baseDelayCandidates.pop_front();
+	}
+
+	double queueingDelay = sample.oneWayDelay - _baseDelayCandidates.front().oneWayDelay;
+
+	if (_hasQueueingDelay) {
+		_queueingDelaySeconds += QUEUEING_DELAY_SMOOTHING * (queueingDelay - _queueingDelaySeconds);
+	}
+	else {
+		_queueingDelaySeconds = queueingDelay;
+		_hasQueueingDelay = true;
+	}
+}
+
+CongestionEstimator::Estimate CongestionEstimator::estimate(double nowSeconds)
+{
+	Estimate estimate;
+
+	estimate.valid = _hasArrivals;
+	estimate.throughputBitsPerSecond = 0.0;
+	estimate.packetsPerSecond = 0.0;
+	estimate.hasQueueingDelay = _hasQueueingDelay;
+	estimate.queueingDelaySeconds = _queueingDelaySeconds;
+	estimate.receiveBacklogBytes = _receiveBacklogBytes;
+	estimate.receiveBacklogSeconds = 0.0;
+	estimate.state = CONGESTION_NORMAL;
+	estimate.recommendedBitsPerSecond = 0.0;
+
+	if (!_hasArrivals) {
+		return estimate;
+	}
+
+	trimWindow(nowSeconds);
+
+	// nothing arrived lately (the trainee stopped sending): nothing to go on
+	if (_arrivals.empty()) {
+		estimate.valid = false;
+		return estimate;
+	}
+
+	// right after the first packet, only the time since then counts
+	double elapsed = nowSeconds - _firstArrivalSeconds;
+	if (elapsed > _windowSeconds) {
+		elapsed = _windowSeconds;
+	}
+	if (elapsed <= 0.0) {
+		estimate.valid = false;
+		return estimate;
+	}
+
+	estimate.throughputBitsPerSecond = _windowBytes * 8.0 / elapsed;
+	estimate.packetsPerSecond = _arrivals.size() / elapsed;
+
+	if (estimate.throughputBitsPerSecond > 0.0) {
+		estimate.receiveBacklogSeconds = _receiveBacklogBytes * 8.0 / estimate.throughputBitsPerSecond;
+	}
+
+	// the backlog in our own socket counts too: it builds up when the link is faster than we read
+	double delay = estimate.receiveBacklogSeconds;
+	if (_hasQueueingDelay && _queueingDelaySeconds > delay) {
+		delay = _queueingDelaySeconds;
+	}
+
+	if (delay > OVERUSE_DELAY_SECONDS) {
+		estimate.state = CONGESTION_OVERUSE;
+		estimate.recommendedBitsPerSecond = estimate.throughputBitsPerSecond * DECREASE_FACTOR;
+	}
+	else if (delay < UNDERUSE_DELAY_SECONDS) {
+		estimate.state = CONGESTION_UNDERUSE;
+		estimate.recommendedBitsPerSecond = estimate.throughputBitsPerSecond * INCREASE_FACTOR;
+	}
+	else {
+		estimate.recommendedBitsPerSecond = estimate.throughputBitsPerSecond;
+	}
+
+	return estimate;
+}
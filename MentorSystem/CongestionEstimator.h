@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+
+CongestionEstimator works out, from the arrival of video packets alone, how
+fast the link from the trainee delivers and whether data is piling up on the
+way, so the mentor can tell the trainee to send less (or more).
+
+- Throughput: bytes that arrived in the last window (one second by default).
+- Queueing delay: how much later than usual packets arrive, relative to when
+  they were captured. The trainee's clock is not synchronized with ours, so
+  the one-way delay (arrival - capture) is only known up to a constant; the
+  smallest one seen recently is taken as the delay through empty queues, and
+  anything above it as queueing. Needs capture timestamps (frame headers).
+- Receive backlog: bytes waiting in our own socket, i.e. data that has made
+  it across but that the mentor has not read yet, as time at the current
+  throughput.
+
+From these it says whether the link is overused (a queue is building: send
+less than what gets through now), underused (nothing is queued: the trainee
+may send more) or normal (keep the current bitrate).
+
+It does no I/O and never reads a clock: every time is passed in, so it can be
+fed a recorded trace of arrivals and its estimates checked against it.
+Not thread-safe.
+
+*/
+
+#include <deque>
+
+enum CongestionState
+{
+	CONGESTION_UNDERUSE,
+	CONGESTION_NORMAL,
+	CONGESTION_OVERUSE
+};
+
+class CongestionEstimator
+{
+public:
+	struct Estimate
+	{
+		// False until at least one packet has arrived
+		bool valid;
+
+		double throughputBitsPerSecond;
+		double packetsPerSecond;
+
+		// Whether packets carried capture timestamps, i.e. queueingDelaySeconds is known
+		bool hasQueueingDelay;
+		double queueingDelaySeconds;
+
+		// Data waiting in the receive socket, and how long it takes to arrive at the current throughput
+		int receiveBacklogBytes;
+		double receiveBacklogSeconds;
+
+		CongestionState state;
+
+		// What the trainee should aim for
+		double recommendedBitsPerSecond;
+	};
+
+	explicit CongestionEstimator(double windowSeconds = 1.0);
+
+	// Forgets everything, e.g. when a new trainee connects
+	void reset();
+
+	// A packet of the given size was read at arrivalSeconds (on any clock of ours that does not jump).
+	// captureMicroseconds is its capture time on the trainee's clock, or negative if unknown;
+	// backlogBytes is what was still waiting in the socket after it.
+	void packetArrived(double arrivalSeconds, int bytes, long long captureMicroseconds, int backlogBytes);
+
+	// Estimate as of nowSeconds (same clock as the arrivals)
+	Estimate estimate(double nowSeconds);
+
+	// Queueing (or receive backlog) above this means the link is overused, below the other underused
+	static const double OVERUSE_DELAY_SECONDS;
+	static const double UNDERUSE_DELAY_SECONDS;
+
+	// How far below / above the measured throughput the recommendation goes when over- / underused
+	static const double DECREASE_FACTOR;
+	static const double INCREASE_FACTOR;
+
+	// How long the smallest one-way delay is remembered for, as the delay through empty queues.
+	// Long enough to outlast a burst of queueing, short enough to follow drift between the clocks
+	static const double BASE_DELAY_WINDOW_SECONDS;
+
+private:
+	struct Arrival
+	{
+		double seconds;
+		int bytes;
+	};
+
+	struct DelaySample
+	{
+		double seconds;
+		double oneWayDelay;
+	};
+
+	// Drops arrivals that have left the throughput window
+	void trimWindow(double nowSeconds);
+
+	double _windowSeconds;
+
+	std::deque<Arrival> _arrivals;
+	long long _windowBytes;
+	double _firstArrivalSeconds;
+	bool _hasArrivals;
+
+	// Increasing one-way delays, the front being the smallest in the base delay window
+	std::deque<DelaySample> _baseDelayCandidates;
+
+	// Smoothed queueing delay
+	double _queueingDelaySeconds;
+	bool _hasQueueingDelay;
+
+	int _receiveBacklogBytes;
+};
@@ -0,0 +1,330 @@
+#include "CongestionTraceCheck.h"
+#include "CheckCommandLine.h"
+#include "CongestionEstimator.h"
+#include "PacketCapture.h"
+#include "Config.h"
+#include "json.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+	// The synthetic link: what it carries, and the delay through it with its queue empty
+	const double LINK_BITS_PER_SECOND = 1000000.0;
+	const double LINK_PROPAGATION_SECONDS = 0.02;
+
+	const double FRAMES_PER_SECOND = 30.0;
+
+	// Where the mentor's clock starts, and how far ahead of it each trainee's clock is
+	const double START_SECONDS = 50.0;
+	const double FIRST_TRAINEE_CLOCK_OFFSET_SECONDS = 1000.0;
+	const double SECOND_TRAINEE_CLOCK_OFFSET_SECONDS = 995.0;
+
+	// How far the throughput may be from what the link delivered
+	const double THROUGHPUT_TOLERANCE = 0.1;
+
+	struct TraceArrival
+	{
+		double arrivalSeconds;
+		int bytes;
+		long long captureMicroseconds;
+
+		// First packet of a trainee that took over the session
+		bool newTrainee;
+	};
+
+	// A stretch of the synthetic trace, and what the estimate has to say at its end
+	struct Phase
+	{
+		const char* name;
+		double seconds;
+		double sendBitsPerSecond;
+		bool newTrainee;
+		CongestionState expectedState;
+		double expectedThroughputBitsPerSecond;
+	};
+
+	const Phase PHASES[] = {
+		{ "below capacity", 4.0, 500000.0, false, CONGESTION_UNDERUSE, 500000.0 },
+		{ "above capacity", 3.0, 2000000.0, false, CONGESTION_OVERUSE, LINK_BITS_PER_SECOND },
+		{ "draining", 8.0, 300000.0, false, CONGESTION_UNDERUSE, 300000.0 },
+		{ "replaced trainee", 4.0, 500000.0, true, CONGESTION_UNDERUSE, 500000.0 },
+	};
+
+	const int NUM_PHASES = sizeof(PHASES) / sizeof(PHASES[0]);
+
+	struct TimedEstimate
+	{
+		double seconds;
+		CongestionEstimator::Estimate estimate;
+	};
+
+	const char* stateName(CongestionState state)
+	{
+		switch (state) {
+		case CONGESTION_OVERUSE:
+			return "overuse";
+		case CONGESTION_UNDERUSE:
+			return "underuse";
+		default:
+			return "normal";
+		}
+	}
+
+	// Frames sent at a steady rate through a queue in front of the link; phaseEnds gets the arrival of each phase's last packet
+	void makeSyntheticTrace(std::vector<TraceArrival>& trace, std::vector<double>& phaseEnds)
+	{
+		double linkFreeSeconds = START_SECONDS;
+		double captureSeconds = START_SECONDS;
+		double clockOffsetSeconds = FIRST_TRAINEE_CLOCK_OFFSET_SECONDS;
+
+		for (int p = 0; p < NUM_PHASES; p++) {
+			const Phase& phase = PHASES[p];
+			int frames = (int)(phase.seconds * FRAMES_PER_SECOND);
+			int bytes = (int)(phase.sendBitsPerSecond / FRAMES_PER_SECOND / 8.0);
+
+			if (phase.newTrainee) {
+				clockOffsetSeconds = SECOND_TRAINEE_CLOCK_OFFSET_SECONDS;
+			}
+
+			for (int f = 0; f < frames; f++) {
+				double sendSeconds = captureSeconds > linkFreeSeconds ? captureSeconds : linkFreeSeconds;
+				linkFreeSeconds = sendSeconds + bytes * 8.0 / LINK_BITS_PER_SECOND;
+
+				TraceArrival arrival;
+				arrival.arrivalSeconds = linkFreeSeconds + LINK_PROPAGATION_SECONDS;
+				arrival.bytes = bytes;
+				arrival.captureMicroseconds = (long long)((captureSeconds + clockOffsetSeconds) * 1000000.0);
+				arrival.newTrainee = phase.newTrainee && f == 0;
+				trace.push_back(arrival);
+
+				captureSeconds += 1.0 / FRAMES_PER_SECOND;
+			}
+
+			phaseEnds.push_back(trace.back().arrivalSeconds);
+		}
+	}
+
+	// A packet capture's arrivals, on its own clock
+	bool readCaptureTrace(const std::string& path, std::vector<TraceArrival>& trace)
+	{
+		PacketCaptureReader reader;
+		VideoStreamHeader header;
+		if (!reader.open(path, header)) {
+			return false;
+		}
+
+		CapturedPacketInfo info;
+		while (reader.readInfo(info)) {
+			if (!reader.readPacket(info, NULL)) {
+				break;
+			}
+
+			TraceArrival arrival;
+			arrival.arrivalSeconds = info.arrivalMicroseconds / 1000000.0;
+			arrival.bytes = info.size;
+			arrival.captureMicroseconds = info.captureMicroseconds;
+			arrival.newTrainee = false;
+			trace.push_back(arrival);
+		}
+
+		reader.close();
+		return true;
+	}
+
+	// Feeds the trace in order, taking an estimate every feedback interval, and once more after the last packet
+	void replayTrace(const std::vector<TraceArrival>& trace, bool resetForNewTrainee, std::vector<TimedEstimate>& estimates)
+	{
+		CongestionEstimator estimator;
+		double intervalSeconds = (VIDEO_FEEDBACK_INTERVAL_MILLISECONDS > 0 ? VIDEO_FEEDBACK_INTERVAL_MILLISECONDS : 500) / 1000.0;
+
+		if (trace.empty()) {
+			return;
+		}
+
+		double nextEstimateSeconds = trace[0].arrivalSeconds + intervalSeconds;
+
+		for (size_t i = 0; i < trace.size(); i++) {
+			const TraceArrival& arrival = trace[i];
+
+			while (nextEstimateSeconds <= arrival.arrivalSeconds) {
+				TimedEstimate timed;
+				timed.seconds = nextEstimateSeconds;
+				timed.estimate = estimator.estimate(nextEstimateSeconds);
+				estimates.push_back(timed);
+				nextEstimateSeconds += intervalSeconds;
+			}
+
+			// As VideoManager does when the video client changes
+			if (arrival.newTrainee && resetForNewTrainee) {
+				estimator.reset();
+			}
+
+			estimator.packetArrived(arrival.arrivalSeconds, arrival.bytes, arrival.captureMicroseconds, 0);
+		}
+
+		TimedEstimate last;
+		last.seconds = trace.back().arrivalSeconds;
+		last.estimate = estimator.estimate(last.seconds);
+		estimates.push_back(last);
+	}
+
+	// The last estimate taken by the given time
+	const CongestionEstimator::Estimate& estimateAt(const std::vector<TimedEstimate>& estimates, double seconds)
+	{
+		size_t i = 0;
+		while (i + 1 < estimates.size() && estimates[i + 1].seconds <= seconds) {
+			i++;
+		}
+		return estimates[i].estimate;
+	}
+
+	Json::Value estimateToJSON(const CongestionEstimator::Estimate& estimate)
+	{
+		Json::Value result;
+		result["state"] = stateName(estimate.state);
+		result["throughput_bps"] = estimate.throughputBitsPerSecond;
+		result["queueing_delay_ms"] = estimate.hasQueueingDelay ? estimate.queueingDelaySeconds * 1000.0 : -1.0;
+		result["recommended_bps"] = estimate.recommendedBitsPerSecond;
+		return result;
+	}
+
+	bool checkSyntheticTrace(Json::Value& results)
+	{
+		std::vector<TraceArrival> trace;
+		std::vector<double> phaseEnds;
+		makeSyntheticTrace(trace, phaseEnds);
+
+		std::vector<TimedEstimate> estimates;
+		replayTrace(trace, true, estimates);
+
+		std::vector<TimedEstimate> estimatesWithoutReset;
+		replayTrace(trace, false, estimatesWithoutReset);
+
+		std::cout << "congestion trace check: " << trace.size() << " packets over a " << (LINK_BITS_PER_SECOND / 1000000.0)
+			<< " Mbit/s link, " << estimates.size() << " estimates" << std::endl;
+
+		bool match = true;
+
+		for (int p = 0; p < NUM_PHASES; p++) {
+			const Phase& phase = PHASES[p];
+			const CongestionEstimator::Estimate& estimate = estimateAt(estimates, phaseEnds[p]);
+
+			bool phaseMatches = estimate.valid && estimate.state == phase.expectedState
+				&& fabs(estimate.throughputBitsPerSecond - phase.expectedThroughputBitsPerSecond) <= THROUGHPUT_TOLERANCE * phase.expectedThroughputBitsPerSecond;
+
+			// Asking for less than gets through when overused, more when underused
+			if (phase.expectedState == CONGESTION_OVERUSE) {
+				phaseMatches = phaseMatches && estimate.recommendedBitsPerSecond < estimate.throughputBitsPerSecond;
+			}
+			else if (phase.expectedState == CONGESTION_UNDERUSE) {
+				phaseMatches = phaseMatches && estimate.recommendedBitsPerSecond > estimate.throughputBitsPerSecond;
+			}
+
+			std::cout << "  " << phase.name << ": " << stateName(estimate.state) << " (" << stateName(phase.expectedState) << " expected), "
+				<< (estimate.throughputBitsPerSecond / 1000.0) << " kbit/s, queueing " << (estimate.queueingDelaySeconds * 1000.0)
+				<< " ms, recommends " << (estimate.recommendedBitsPerSecond / 1000.0) << " kbit/s"
+				<< (phaseMatches ? "" : " (does not match)") << std::endl;
+
+			Json::Value phaseResult = estimateToJSON(estimate);
+			phaseResult["name"] = phase.name;
+			phaseResult["expected_state"] = stateName(phase.expectedState);
+			phaseResult["expected_throughput_bps"] = phase.expectedThroughputBitsPerSecond;
+			phaseResult["match"] = phaseMatches;
+			results["phases"].append(phaseResult);
+
+			match = match && phaseMatches;
+		}
+
+		// The other trainee's clock has to show up as queueing when the estimator is not reset, or the trace proves nothing
+		const CongestionEstimator::Estimate& withoutReset = estimateAt(estimatesWithoutReset, phaseEnds[NUM_PHASES - 1]);
+		bool resetMatters = withoutReset.state == CONGESTION_OVERUSE;
+
+		std::cout << "  " << PHASES[NUM_PHASES - 1].name << " without a reset: " << stateName(withoutReset.state) << ", queueing "
+			<< (withoutReset.queueingDelaySeconds * 1000.0) << " ms" << (resetMatters ? "" : " (overuse expected)") << std::endl;
+
+		results["without_reset"] = estimateToJSON(withoutReset);
+		results["without_reset"]["match"] = resetMatters;
+		results["match"] = match && resetMatters;
+
+		return match && resetMatters;
+	}
+
+	bool reportCaptureTrace(const std::string& path, Json::Value& results)
+	{
+		std::vector<TraceArrival> trace;
+		if (!readCaptureTrace(path, trace)) {
+			return false;
+		}
+
+		std::vector<TimedEstimate> estimates;
+		replayTrace(trace, true, estimates);
+
+		int states[3] = { 0, 0, 0 };
+		int valid = 0;
+		double peakQueueingDelay = 0.0;
+		double throughputSum = 0.0;
+
+		for (size_t i = 0; i < estimates.size(); i++) {
+			const CongestionEstimator::Estimate& estimate = estimates[i].estimate;
+			if (!estimate.valid) {
+				continue;
+			}
+
+			valid++;
+			states[estimate.state]++;
+			throughputSum += estimate.throughputBitsPerSecond;
+			if (estimate.hasQueueingDelay && estimate.queueingDelaySeconds > peakQueueingDelay) {
+				peakQueueingDelay = estimate.queueingDelaySeconds;
+			}
+		}
+
+		double meanThroughput = valid > 0 ? throughputSum / valid : 0.0;
+
+		std::cout << "congestion trace of " << path << ": " << trace.size() << " packets, " << valid << " estimates: "
+			<< states[CONGESTION_UNDERUSE] << " underuse, " << states[CONGESTION_NORMAL] << " normal, " << states[CONGESTION_OVERUSE]
+			<< " overuse; mean throughput " << (meanThroughput / 1000.0) << " kbit/s, peak queueing " << (peakQueueingDelay * 1000.0) << " ms" << std::endl;
+
+		results["input"] = path;
+		results["packets"] = (Json::UInt64)trace.size();
+		results["estimates"] = valid;
+		results["underuse"] = states[CONGESTION_UNDERUSE];
+		results["normal"] = states[CONGESTION_NORMAL];
+		results["overuse"] = states[CONGESTION_OVERUSE];
+		results["mean_throughput_bps"] = meanThroughput;
+		results["peak_queueing_delay_ms"] = peakQueueingDelay * 1000.0;
+
+		return true;
+	}
+
+}
+
+int runCongestionTraceCheck(int argc, char* argv[])
+{
+	std::string input;
+
+	CheckCommandLine commandLine("--check-congestion");
+	commandLine.add("--input", "capture", input);
+
+	if (!commandLine.parse(argc, argv)) {
+		return 1;
+	}
+
+	Json::Value results;
+	bool passed;
+
+	if (input.empty()) {
+		passed = checkSyntheticTrace(results);
+	}
+	else {
+		passed = reportCaptureTrace(input, results);
+	}
+
+	if (!commandLine.writeResults(results)) {
+		return 1;
+	}
+
+	return passed ? 0 : 1;
+}
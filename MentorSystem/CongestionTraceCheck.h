@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+
+Feeds CongestionEstimator a trace of packet arrivals and checks what it
+makes of them, the way the receive stage and the video feedback use it:
+every packet is handed in as it arrives, and an estimate is taken every
+VIDEO_FEEDBACK_INTERVAL_MILLISECONDS.
+
+By default the trace is synthetic: a trainee sends 30 frames a second over
+a 1 Mbit/s link with a queue in front of it, first below what the link
+carries, then above it, then below again while the queue drains, and then
+another trainee with a clock of its own takes over the session. Every phase
+ends in a known state (underuse, overuse, underuse, underuse), which the
+estimates have to reach, with the throughput the link really delivered.
+The last phase runs twice, with and without the estimator being reset for
+the new trainee, to show that without the reset it reads the other clock
+as seconds of queueing.
+
+With --input naming a packet capture, the capture's own arrival times,
+sizes and capture times are the trace instead (a capture has no receive
+backlog, so that is taken as 0); it is only reported, as there is nothing
+to check it against.
+
+Run the mentor with --check-congestion, optionally followed by:
+
+  --input <capture>     a packet capture to use as the trace
+  --output <file>       also write the results there
+
+*/
+
+// Returns 0 (the process exit code) if the estimates match the synthetic trace (or a capture was read), 1 otherwise
+int runCongestionTraceCheck(int argc, char* argv[]);
@@ -0,0 +1,465 @@
+#include "DatagramLoopbackCheck.h"
+#include "CheckCommandLine.h"
+#include "DatagramVideoReceiver.h"
+#include "JitterBuffer.h"
+#include "communicationDefinitions.h"
+#include "json.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	const int FRAME_INTERVAL_MICROSECONDS = 33333;
+
+	// Four datagrams a frame
+	const int FRAME_SIZE = 5000;
+	const int MAX_DATAGRAM_SIZE = 1400;
+
+	const double LATENCY_TARGET_SECONDS = 0.05;
+
+	const uint32_t SSRC = 0x4D534331;
+
+	// Quiet time after the last frame before the loopback run stops waiting for more
+	const int LOOPBACK_SETTLE_MILLISECONDS = 500;
+
+	struct CheckOptions
+	{
+		int frames;
+		std::string port;
+	};
+
+	// What happens to the datagrams of a frame on the way
+	enum FrameFate
+	{
+		FRAME_ON_TIME,
+		FRAME_REVERSED,
+		FRAME_INCOMPLETE,
+		FRAME_OVERTAKEN,
+		FRAME_MISSING
+	};
+
+	// The datagrams sent at each frame time, and what has to come out of them
+	struct Schedule
+	{
+		std::vector<std::vector<std::vector<char> > > steps;
+
+		std::vector<unsigned int> deliveredFrames;
+		unsigned int datagramsLost;
+		unsigned int datagramsReordered;
+		unsigned int framesIncomplete;
+		unsigned int framesMissing;
+	};
+
+	// What came out of a run
+	struct Outcome
+	{
+		std::vector<unsigned int> deliveredFrames;
+		int corruptFrames;
+		JitterBufferStatistics statistics;
+	};
+
+	FrameFate fateOf(unsigned int frameNumber)
+	{
+		switch (frameNumber % 10) {
+		case 1:
+			return FRAME_REVERSED;
+		case 3:
+			return FRAME_INCOMPLETE;
+		case 5:
+			return FRAME_OVERTAKEN;
+		case 8:
+			return FRAME_MISSING;
+		default:
+			return FRAME_ON_TIME;
+		}
+	}
+
+	char frameByte(unsigned int frameNumber, int offset)
+	{
+		return (char)(frameNumber * 7 + offset);
+	}
+
+	void makeSchedule(int frames, Schedule& schedule)
+	{
+		schedule.steps.assign(frames, std::vector<std::vector<char> >());
+		schedule.datagramsLost = 0;
+		schedule.datagramsReordered = 0;
+		schedule.framesIncomplete = 0;
+		schedule.framesMissing = 0;
+
+		uint16_t sequence = 0;
+		std::vector<char> frame(FRAME_SIZE);
+
+		for (int f = 0; f < frames; f++) {
+			for (int i = 0; i < FRAME_SIZE; i++) {
+				frame[i] = frameByte(f, i);
+			}
+
+			std::vector<std::vector<char> > datagrams;
+			JitterBuffer::packetizeFrame(&frame[0], FRAME_SIZE, f, (long long)f * FRAME_INTERVAL_MICROSECONDS, SSRC,
+				MAX_DATAGRAM_SIZE, sequence, datagrams);
+
+			int count = (int)datagrams.size();
+			std::vector<std::vector<char> >& step = schedule.steps[f];
+
+			switch (fateOf(f)) {
+			case FRAME_ON_TIME:
+				step.insert(step.end(), datagrams.begin(), datagrams.end());
+				schedule.deliveredFrames.push_back(f);
+				break;
+
+			case FRAME_REVERSED:
+				// The last one raises the highest sequence number, so the others count as reordered
+				step.insert(step.end(), datagrams.rbegin(), datagrams.rend());
+				schedule.deliveredFrames.push_back(f);
+				schedule.datagramsReordered += count - 1;
+				break;
+
+			case FRAME_INCOMPLETE:
+				datagrams.erase(datagrams.begin() + 1);
+				step.insert(step.end(), datagrams.begin(), datagrams.end());
+				schedule.datagramsLost++;
+				schedule.framesIncomplete++;
+				break;
+
+			case FRAME_OVERTAKEN:
+				// Sent at the next frame's time, after it (see below)
+				schedule.deliveredFrames.push_back(f);
+				schedule.datagramsReordered += count;
+				break;
+
+			case FRAME_MISSING:
+				schedule.datagramsLost += count;
+				schedule.framesMissing++;
+				break;
+			}
+
+			if (f > 0 && fateOf(f - 1) == FRAME_OVERTAKEN) {
+				std::vector<char> previous(FRAME_SIZE);
+				for (int i = 0; i < FRAME_SIZE; i++) {
+					previous[i] = frameByte(f - 1, i);
+				}
+
+				// Numbered before this frame's datagrams, as it was sent first
+				uint16_t previousSequence = (uint16_t)(sequence - 2 * count);
+				datagrams.clear();
+				JitterBuffer::packetizeFrame(&previous[0], FRAME_SIZE, f - 1, (long long)(f - 1) * FRAME_INTERVAL_MICROSECONDS, SSRC,
+					MAX_DATAGRAM_SIZE, previousSequence, datagrams);
+				step.insert(step.end(), datagrams.begin(), datagrams.end());
+			}
+		}
+	}
+
+	void recordFrame(Outcome& outcome, const std::vector<char>& out, int size, unsigned int frameNumber)
+	{
+		outcome.deliveredFrames.push_back(frameNumber);
+
+		bool intact = size == FRAME_SIZE;
+		for (int i = 0; intact && i < size; i++) {
+			intact = out[i] == frameByte(frameNumber, i);
+		}
+
+		if (!intact) {
+			outcome.corruptFrames++;
+		}
+	}
+
+	// Every datagram straight into a jitter buffer, at the time it would arrive, taking out the frames due after each step
+	void runDirect(const Schedule& schedule, Outcome& outcome)
+	{
+		JitterBuffer jitterBuffer(LATENCY_TARGET_SECONDS);
+		std::vector<char> out(MAX_PACKET_SIZE);
+
+		int size;
+		unsigned int frameNumber;
+		long long captureMicroseconds;
+
+		outcome.corruptFrames = 0;
+
+		double now = 0.0;
+		for (size_t s = 0; s < schedule.steps.size(); s++) {
+			now = s * FRAME_INTERVAL_MICROSECONDS / 1000000.0;
+
+			for (size_t d = 0; d < schedule.steps[s].size(); d++) {
+				jitterBuffer.insert(&schedule.steps[s][d][0], (int)schedule.steps[s][d].size(), now);
+			}
+
+			while (jitterBuffer.pop(now, &out[0], (int)out.size(), size, frameNumber, captureMicroseconds)) {
+				recordFrame(outcome, out, size, frameNumber);
+			}
+		}
+
+		// Long after the last frame, whatever still waits is due or given up on
+		while (jitterBuffer.pop(now + 1.0, &out[0], (int)out.size(), size, frameNumber, captureMicroseconds)) {
+			recordFrame(outcome, out, size, frameNumber);
+		}
+
+		outcome.statistics = jitterBuffer.getStatistics();
+	}
+
+	// Every datagram over UDP on loopback at its time, into a DatagramVideoReceiver
+	bool runLoopback(const Schedule& schedule, const std::string& port, Outcome& outcome)
+	{
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+			std::cout << "error: could not start Winsock" << std::endl;
+			return false;
+		}
+
+		DatagramVideoReceiver receiver;
+		if (!receiver.open(port.c_str(), LATENCY_TARGET_SECONDS, 0)) {
+			WSACleanup();
+			return false;
+		}
+
+		// Like the trainee's, whose datagrams are the only ones taken
+		receiver.setSender(htonl(INADDR_LOOPBACK));
+
+		SOCKET sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (sender == INVALID_SOCKET) {
+			std::cout << "error: could not create the sending socket: " << WSAGetLastError() << std::endl;
+			receiver.close();
+			WSACleanup();
+			return false;
+		}
+
+		sockaddr_in destination;
+		memset(&destination, 0, sizeof(destination));
+		destination.sin_family = AF_INET;
+		destination.sin_port = htons((unsigned short)atoi(port.c_str()));
+		destination.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		std::atomic<bool> sending(true);
+
+		std::thread sendThread([&]() {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			for (size_t s = 0; s < schedule.steps.size(); s++) {
+				std::this_thread::sleep_until(start + std::chrono::microseconds((long long)s * FRAME_INTERVAL_MICROSECONDS));
+
+				for (size_t d = 0; d < schedule.steps[s].size(); d++) {
+					sendto(sender, &schedule.steps[s][d][0], (int)schedule.steps[s][d].size(), 0, (sockaddr*)&destination, sizeof(destination));
+				}
+			}
+
+			sending = false;
+		});
+
+		std::vector<char> out(MAX_PACKET_SIZE);
+		int size;
+		unsigned int frameNumber;
+		long long captureMicroseconds;
+
+		outcome.corruptFrames = 0;
+
+		// Until the sender is done and nothing more has come for a while
+		std::chrono::steady_clock::time_point lastActivity = std::chrono::steady_clock::now();
+		while (sending || std::chrono::steady_clock::now() - lastActivity < std::chrono::milliseconds(LOOPBACK_SETTLE_MILLISECONDS)) {
+			if (receiver.receiveFrame(&out[0], (int)out.size(), size, frameNumber, captureMicroseconds, 100)) {
+				recordFrame(outcome, out, size, frameNumber);
+				lastActivity = std::chrono::steady_clock::now();
+			}
+			else if (sending) {
+				lastActivity = std::chrono::steady_clock::now();
+			}
+		}
+
+		sendThread.join();
+
+		outcome.statistics = receiver.getStatistics();
+
+		closesocket(sender);
+		receiver.close();
+		WSACleanup();
+
+		return true;
+	}
+
+	// Compares an outcome with the schedule, saying what differs
+	bool matches(const char* name, const Schedule& schedule, const Outcome& outcome)
+	{
+		const JitterBufferStatistics& statistics = outcome.statistics;
+		bool match = true;
+
+		if (outcome.deliveredFrames != schedule.deliveredFrames) {
+			std::cout << "error: " << name << ": " << outcome.deliveredFrames.size() << " frames handed out, "
+				<< schedule.deliveredFrames.size() << " expected, or not the same ones" << std::endl;
+			match = false;
+		}
+
+		if (outcome.corruptFrames > 0) {
+			std::cout << "error: " << name << ": " << outcome.corruptFrames << " frames did not come out as they were sent" << std::endl;
+			match = false;
+		}
+
+		struct Count { const char* what; unsigned int got; unsigned int expected; } counts[] = {
+			{ "datagrams lost", statistics.datagramsLost, schedule.datagramsLost },
+			{ "datagrams reordered", statistics.datagramsReordered, schedule.datagramsReordered },
+			{ "frames incomplete", statistics.framesIncomplete, schedule.framesIncomplete },
+			{ "frames missing", statistics.framesMissing, schedule.framesMissing },
+			{ "frames delivered", statistics.framesDelivered, (unsigned int)schedule.deliveredFrames.size() },
+			{ "datagrams duplicated", statistics.datagramsDuplicated, 0 },
+			{ "datagrams invalid", statistics.datagramsInvalid, 0 },
+		};
+
+		for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+			if (counts[i].got != counts[i].expected) {
+				std::cout << "error: " << name << ": " << counts[i].got << " " << counts[i].what << ", " << counts[i].expected << " expected" << std::endl;
+				match = false;
+			}
+		}
+
+		std::cout << "  " << name << ": " << outcome.deliveredFrames.size() << " frames handed out, " << statistics.datagramsLost << " datagrams lost, "
+			<< statistics.datagramsReordered << " reordered, " << statistics.framesIncomplete << " frames incomplete, "
+			<< statistics.framesMissing << " missing" << (match ? "" : " (does not match)") << std::endl;
+
+		return match;
+	}
+
+	// One datagram carrying bytes [offset, offset + size) of a frame
+	std::vector<char> makePiece(unsigned int frameNumber, int offset, int size, uint16_t& sequence)
+	{
+		std::vector<char> frame(FRAME_SIZE);
+		for (int i = 0; i < FRAME_SIZE; i++) {
+			frame[i] = frameByte(frameNumber, i);
+		}
+
+		// A frame of its own as big as the piece, in a single datagram, then moved to where the piece goes
+		std::vector<std::vector<char> > datagrams;
+		JitterBuffer::packetizeFrame(&frame[offset], size, frameNumber, (long long)frameNumber * FRAME_INTERVAL_MICROSECONDS, SSRC,
+			JitterBuffer::DATAGRAM_HEADER_SIZE + size, sequence, datagrams);
+
+		unsigned char* bytes = (unsigned char*)&datagrams[0][0];
+		uint32_t fields[2] = { (uint32_t)offset, (uint32_t)FRAME_SIZE };
+		for (int f = 0; f < 2; f++) {
+			for (int b = 0; b < 4; b++) {
+				bytes[16 + 4 * f + b] = (unsigned char)(fields[f] >> (24 - 8 * b));
+			}
+		}
+
+		return datagrams[0];
+	}
+
+	// Overlapping pieces: frame 0 has a hole their sizes add up over, frame 1 is covered (one piece of it twice)
+	bool checkOverlappingPieces(Json::Value& result)
+	{
+		const int pieces[][3] = {
+			{ 0, 0, 2000 }, { 0, 1000, 2000 }, { 0, 3000, 1000 },
+			{ 1, 0, 2000 }, { 1, 1500, 2000 }, { 1, 1500, 2000 }, { 1, 3500, 1500 },
+		};
+
+		JitterBuffer jitterBuffer(LATENCY_TARGET_SECONDS);
+		uint16_t sequence = 0;
+
+		for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+			std::vector<char> piece = makePiece(pieces[p][0], pieces[p][1], pieces[p][2], sequence);
+			jitterBuffer.insert(&piece[0], (int)piece.size(), 0.0);
+		}
+
+		Outcome outcome;
+		outcome.corruptFrames = 0;
+
+		std::vector<char> out(MAX_PACKET_SIZE);
+		int size;
+		unsigned int frameNumber;
+		long long captureMicroseconds;
+
+		while (jitterBuffer.pop(1.0, &out[0], (int)out.size(), size, frameNumber, captureMicroseconds)) {
+			recordFrame(outcome, out, size, frameNumber);
+		}
+
+		outcome.statistics = jitterBuffer.getStatistics();
+
+		bool match = outcome.deliveredFrames == std::vector<unsigned int>(1, 1) && outcome.corruptFrames == 0
+			&& outcome.statistics.framesIncomplete == 1 && outcome.statistics.datagramsDuplicated == 1;
+
+		std::cout << "  overlapping pieces: " << outcome.deliveredFrames.size() << " frames handed out (" << outcome.corruptFrames << " not as sent), "
+			<< outcome.statistics.framesIncomplete << " incomplete, " << outcome.statistics.datagramsDuplicated << " datagrams duplicated"
+			<< (match ? "" : " (1 whole frame, 1 incomplete and 1 duplicate expected)") << std::endl;
+
+		result["frames_delivered"] = (Json::UInt64)outcome.deliveredFrames.size();
+		result["corrupt_frames"] = outcome.corruptFrames;
+		result["frames_incomplete"] = outcome.statistics.framesIncomplete;
+		result["datagrams_duplicated"] = outcome.statistics.datagramsDuplicated;
+		result["match"] = match;
+
+		return match;
+	}
+
+	Json::Value outcomeToJSON(const Outcome& outcome, bool match)
+	{
+		Json::Value result;
+		result["frames_delivered"] = (Json::UInt64)outcome.deliveredFrames.size();
+		result["corrupt_frames"] = outcome.corruptFrames;
+		result["datagrams_received"] = outcome.statistics.datagramsReceived;
+		result["datagrams_lost"] = outcome.statistics.datagramsLost;
+		result["datagrams_reordered"] = outcome.statistics.datagramsReordered;
+		result["frames_incomplete"] = outcome.statistics.framesIncomplete;
+		result["frames_missing"] = outcome.statistics.framesMissing;
+		result["jitter_ms"] = outcome.statistics.jitterMilliseconds;
+		result["match"] = match;
+		return result;
+	}
+
+}
+
+int runDatagramLoopbackCheck(int argc, char* argv[])
+{
+	CheckOptions options;
+	options.frames = 60;
+	options.port = "18986";
+
+	CheckCommandLine commandLine("--check-datagrams");
+	commandLine.add("--frames", "count", options.frames);
+	commandLine.add("--port", "port", options.port);
+
+	if (!commandLine.parse(argc, argv)) {
+		return 1;
+	}
+
+	if (options.frames <= 0 || options.frames % 10 != 0) {
+		std::cout << "error: the frames must be a positive multiple of ten" << std::endl;
+		commandLine.printUsage();
+		return 1;
+	}
+
+	Schedule schedule;
+	makeSchedule(options.frames, schedule);
+
+	std::cout << "datagram loopback check: " << options.frames << " frames, " << schedule.deliveredFrames.size() << " to hand out, "
+		<< schedule.datagramsLost << " datagrams lost and " << schedule.datagramsReordered << " reordered on purpose" << std::endl;
+
+	Outcome direct;
+	runDirect(schedule, direct);
+	bool directMatches = matches("jitter buffer", schedule, direct);
+
+	Outcome loopback;
+	bool loopbackRan = runLoopback(schedule, options.port, loopback);
+	bool loopbackMatches = loopbackRan && matches("loopback", schedule, loopback);
+
+	Json::Value results;
+	bool overlapsMatch = checkOverlappingPieces(results["overlapping_pieces"]);
+
+	results["frames"] = options.frames;
+	results["expected"]["frames_delivered"] = (Json::UInt64)schedule.deliveredFrames.size();
+	results["expected"]["datagrams_lost"] = schedule.datagramsLost;
+	results["expected"]["datagrams_reordered"] = schedule.datagramsReordered;
+	results["expected"]["frames_incomplete"] = schedule.framesIncomplete;
+	results["expected"]["frames_missing"] = schedule.framesMissing;
+	results["jitter_buffer"] = outcomeToJSON(direct, directMatches);
+	if (loopbackRan) {
+		results["loopback"] = outcomeToJSON(loopback, loopbackMatches);
+	}
+
+	if (!commandLine.writeResults(results)) {
+		return 1;
+	}
+
+	return directMatches && loopbackMatches && overlapsMatch ? 0 : 1;
+}
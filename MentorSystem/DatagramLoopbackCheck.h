@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+
+Checks the video datagram transport end to end: frames are split into
+datagrams with JitterBuffer::packetizeFrame, some of the datagrams are lost
+on purpose and some come out of order, and what comes out the other end is
+compared with what should: the frames handed out (and their bytes), and the
+loss, reordering, incomplete and missing frame counts.
+
+Every ten frames, one frame's datagrams come last to first, one frame loses
+a datagram (so it is dropped as incomplete), one frame is overtaken by the
+frame behind it, and one frame is lost entirely (so it is missing). Frames
+are sent at 30 per second.
+
+It runs twice: once feeding the datagrams straight into a JitterBuffer with
+the times they would arrive, which has to match exactly, and once sending
+them over UDP on loopback to a DatagramVideoReceiver, the way a trainee
+would, where the timing is the real one.
+
+Then pieces of two frames that overlap (as a retransmit split up another
+way would) go straight into a JitterBuffer: one frame whose pieces add up
+to its size but leave a hole has to be dropped as incomplete, and one whose
+pieces cover it has to come out whole, with the piece sent twice counted as
+a duplicate.
+
+Run the mentor with --check-datagrams, optionally followed by:
+
+  --frames <count>      frames to send, a multiple of ten (default 60)
+  --port <port>         loopback port for the second run (default 18986)
+  --output <file>       also write the results there
+
+*/
+
+// Returns 0 (the process exit code) if every run matches, 1 otherwise or for bad options
+int runDatagramLoopbackCheck(int argc, char* argv[]);
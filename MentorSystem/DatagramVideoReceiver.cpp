@@ -0,0 +1,218 @@
+#include "DatagramVideoReceiver.h"
+#include <chrono>
+#include <iostream>
+#include <string.h>
+
+DatagramVideoReceiver::DatagramVideoReceiver()
+	: _socket(INVALID_SOCKET)
+	, _senderAddress(0)
+	, _foreignSenderReported(false)
+	, _datagram(MAX_DATAGRAM_SIZE)
+	, _injectedLossPercent(0)
+	, _injectedLossCount(0)
+{
+	memset(&_statistics, 0, sizeof(_statistics));
+}
+
+DatagramVideoReceiver::~DatagramVideoReceiver()
+{
+	close();
+}
+
+bool DatagramVideoReceiver::open(const char* port, double latencyTargetSeconds, int injectedLossPercent)
+{
+	close();
+
+	struct addrinfo* result = NULL;
+	struct addrinfo hints;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	hints.ai_flags = AI_PASSIVE;
+
+	// Winsock is already started by the server that accepted the video connection
+	int error = getaddrinfo(NULL, port, &hints, &result);
+	if (error != 0) {
+		std::cout << "error: getaddrinfo for the video datagram port failed with error: " << error << std::endl;
+		return false;
+	}
+
+	_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (_socket == INVALID_SOCKET) {
+		std::cout << "error: could not create the video datagram socket: " << WSAGetLastError() << std::endl;
+		freeaddrinfo(result);
+		return false;
+	}
+
+	// Bursts of datagrams must not overflow the socket while the receive stage hands a frame on
+	int receiveBufferBytes = RECEIVE_BUFFER_BYTES;
+	setsockopt(_socket, SOL_SOCKET, SO_RCVBUF, (const char*)&receiveBufferBytes, sizeof(receiveBufferBytes));
+
+	u_long nonBlocking = 1;
+	if (ioctlsocket(_socket, FIONBIO, &nonBlocking) == SOCKET_ERROR
+		|| bind(_socket, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR) {
+		std::cout << "error: could not bind the video datagram socket to port " << port << ": " << WSAGetLastError() << std::endl;
+		freeaddrinfo(result);
+		close();
+		return false;
+	}
+
+	freeaddrinfo(result);
+
+	_jitterBuffer.reset();
+	_jitterBuffer.setLatencyTarget(latencyTargetSeconds);
+
+	_injectedLossPercent = injectedLossPercent;
+	_injectedLossCount = 0;
+
+	publishStatistics();
+
+	return true;
+}
+
+void DatagramVideoReceiver::close()
+{
+	if (_socket != INVALID_SOCKET) {
+		closesocket(_socket);
+		_socket = INVALID_SOCKET;
+	}
+}
+
+void DatagramVideoReceiver::restart()
+{
+	_jitterBuffer.restart();
+	publishStatistics();
+}
+
+void DatagramVideoReceiver::setSender(unsigned long address)
+{
+	_senderAddress = address;
+	_foreignSenderReported = false;
+}
+
+bool DatagramVideoReceiver::isOpen() const
+{
+	return _socket != INVALID_SOCKET;
+}
+
+double DatagramVideoReceiver::nowSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void DatagramVideoReceiver::readWaitingDatagrams()
+{
+	while (true)
+	{
+		sockaddr_in from;
+		socklen_t fromLength = sizeof(from);
+
+		int received = recvfrom(_socket, &_datagram[0], (int)_datagram.size(), 0, (sockaddr*)&from, &fromLength);
+
+		if (received == SOCKET_ERROR) {
+			int error = WSAGetLastError();
+
+			// Windows reports an earlier send that was refused here; it says nothing about what comes in
+			if (error == WSAECONNRESET) {
+				continue;
+			}
+
+			if (error != WSAEWOULDBLOCK) {
+				std::cout << "error: reading a video datagram failed with error: " << error << std::endl;
+			}
+			return;
+		}
+
+		// Not from the trainee: it is no part of the stream, whatever it claims to be
+		if (_senderAddress != 0 && (from.sin_family != AF_INET || from.sin_addr.s_addr != _senderAddress)) {
+			if (!_foreignSenderReported) {
+				const unsigned char* address = (const unsigned char*)&from.sin_addr.s_addr;
+				std::cout << "ignoring video datagrams from " << (int)address[0] << "." << (int)address[1] << "." << (int)address[2] << "."
+					<< (int)address[3] << ", which is not the trainee" << std::endl;
+				_foreignSenderReported = true;
+			}
+			continue;
+		}
+
+		if (_injectedLossPercent > 0 && (int)(_random() % 100) < _injectedLossPercent) {
+			_injectedLossCount++;
+			continue;
+		}
+
+		_jitterBuffer.insert(&_datagram[0], received, nowSeconds());
+	}
+}
+
+bool DatagramVideoReceiver::receiveFrame(char* out, int capacity, int& size, unsigned int& frameNumber, long long& captureMicroseconds, int maxWaitMilliseconds)
+{
+	if (_socket == INVALID_SOCKET) {
+		return false;
+	}
+
+	double giveUpSeconds = nowSeconds() + maxWaitMilliseconds / 1000.0;
+
+	while (true)
+	{
+		readWaitingDatagrams();
+
+		double now = nowSeconds();
+		if (_jitterBuffer.pop(now, out, capacity, size, frameNumber, captureMicroseconds)) {
+			publishStatistics();
+			return true;
+		}
+
+		if (now >= giveUpSeconds) {
+			publishStatistics();
+			return false;
+		}
+
+		// Sleeps until a datagram comes in, or the frame at the front is done waiting for its pieces
+		double wait = giveUpSeconds - now;
+		double frameDeadline = _jitterBuffer.nextDeadline();
+		if (frameDeadline >= 0.0 && frameDeadline - now < wait) {
+			wait = frameDeadline > now ? frameDeadline - now : 0.0;
+		}
+
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(_socket, &readable);
+
+		timeval timeout;
+		timeout.tv_sec = (long)wait;
+		timeout.tv_usec = (long)((wait - timeout.tv_sec) * 1000000.0);
+
+		select((int)_socket + 1, &readable, NULL, NULL, &timeout);
+	}
+}
+
+bool DatagramVideoReceiver::isFrameDue()
+{
+	if (_socket == INVALID_SOCKET) {
+		return false;
+	}
+
+	readWaitingDatagrams();
+
+	return _jitterBuffer.isFrameDue(nowSeconds());
+}
+
+void DatagramVideoReceiver::publishStatistics()
+{
+	JitterBufferStatistics statistics = _jitterBuffer.getStatistics();
+
+	std::lock_guard<std::mutex> lock(_statisticsMutex);
+	_statistics = statistics;
+}
+
+JitterBufferStatistics DatagramVideoReceiver::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(_statisticsMutex);
+	return _statistics;
+}
+
+unsigned int DatagramVideoReceiver::getInjectedLossCount() const
+{
+	return _injectedLossCount;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+
+DatagramVideoReceiver reads the video packets from a UDP socket instead of
+the TCP video connection, when the stream header sets
+VIDEO_STREAM_FLAG_DATAGRAMS. Over TCP a single lost segment holds up every
+frame behind it until it is sent again; over UDP a lost datagram only costs
+the frame it belongs to.
+
+The datagrams go through a JitterBuffer, which puts the frames back
+together and hands them out in order, waiting at most the latency target
+for pieces that are late. Frames it gives up on leave a gap in the frame
+numbers, which the receive stage handles like any other lost frame: it
+skips to the next keyframe and the last frame stays on screen meanwhile.
+
+Only the trainee that sent the stream header over the video connection
+may send the datagrams: those from any other host are dropped as they are
+read, so nobody else on the network can slip frames into the stream.
+
+To try out how the video copes with loss without a bad network at hand, a
+share of the datagrams can be dropped on purpose as they are read.
+
+Everything but getStatistics() runs on the receive stage thread.
+
+*/
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "JitterBuffer.h"
+
+class DatagramVideoReceiver
+{
+public:
+	DatagramVideoReceiver();
+	~DatagramVideoReceiver();
+
+	// Binds the UDP socket to the given port. Returns false (after saying why) if it cannot.
+	// injectedLossPercent of the datagrams are dropped on purpose (0 for none)
+	bool open(const char* port, double latencyTargetSeconds, int injectedLossPercent);
+
+	void close();
+
+	bool isOpen() const;
+
+	// Forgets the frames of the stream so far (a new trainee sends to the same port), keeping the statistics
+	void restart();
+
+	// Takes datagrams from this IPv4 address only (network byte order, as in sockaddr_in), or from anywhere if 0
+	void setSender(unsigned long address);
+
+	// Reads the datagrams waiting, then hands out the next frame due, waiting up to
+	// maxWaitMilliseconds for one (see JitterBuffer::pop). Returns false if none came
+	bool receiveFrame(char* out, int capacity, int& size, unsigned int& frameNumber, long long& captureMicroseconds, int maxWaitMilliseconds);
+
+	// Reads the datagrams waiting and says whether receiveFrame would hand out a frame right away
+	bool isFrameDue();
+
+	// Statistics as of the last receiveFrame or isFrameDue; safe to call from any thread
+	JitterBufferStatistics getStatistics();
+
+	// Datagrams dropped on purpose
+	unsigned int getInjectedLossCount() const;
+
+private:
+	// Hands every datagram waiting in the socket to the jitter buffer
+	void readWaitingDatagrams();
+
+	// Makes the statistics of the jitter buffer visible to getStatistics
+	void publishStatistics();
+
+	static double nowSeconds();
+
+	SOCKET _socket;
+
+	// Address the datagrams have to come from (0 = any), and whether one from elsewhere was reported yet
+	unsigned long _senderAddress;
+	bool _foreignSenderReported;
+
+	JitterBuffer _jitterBuffer;
+
+	// Room for the largest datagram UDP can carry
+	std::vector<char> _datagram;
+
+	int _injectedLossPercent;
+	std::mt19937 _random;
+	std::atomic<unsigned int> _injectedLossCount;
+
+	std::mutex _statisticsMutex;
+	JitterBufferStatistics _statistics;
+
+	// Socket receive buffer, enough for a few frames arriving while the receive stage is busy
+	static const int RECEIVE_BUFFER_BYTES = 4 * 1024 * 1024;
+
+	static const int MAX_DATAGRAM_SIZE = 65536;
+};
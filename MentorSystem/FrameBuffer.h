@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+
+fitFrameBuffer() resizes a pooled frame without giving up its memory when
+the new size fits, so a stream can change resolution (e.g. the trainee
+tablet rotating, or switching to a different capture device) without the
+pipeline reallocating its buffers on every switch back and forth.
+
+Every frame buffer is paired with a storage Mat: a single row of bytes
+that only ever grows. The frame is a view into the start of it, reshaped
+to the size and type asked for. Views are continuous, like a Mat made with
+create(), so they can be handed to code that assumes tightly packed rows
+(ffmpeg, the YUV converter, the texture uploader).
+
+Only 8-bit types are supported, which is all the video pipeline uses.
+
+*/
+
+#include <opencv2/opencv.hpp>
+
+// Makes frame a rows x cols image of the given 8-bit type backed by storage,
+// reallocating storage only if it is too small. Does nothing if frame already
+// has that size and type.
+inline void fitFrameBuffer(cv::Mat& frame, cv::Mat& storage, int rows, int cols, int type)
+{
+	CV_Assert(CV_MAT_DEPTH(type) == CV_8U);
+
+	if (frame.rows == rows && frame.cols == cols && frame.type() == type && frame.data != NULL) {
+		return;
+	}
+
+	int bytes = rows * cols * CV_MAT_CN(type);
+
+	if (storage.empty() || storage.cols < bytes) {
+		// drop the views of the old storage first, so it is freed before the new one is allocated
+		frame.release();
+		storage.create(1, bytes, CV_8UC1);
+	}
+
+	frame = storage.colRange(0, bytes).reshape(CV_MAT_CN(type), rows);
+}
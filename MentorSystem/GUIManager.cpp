@@ -41,6 +41,9 @@ GUIManager::GUIManager(int resX, int resY, CommandCenter* pCommander, JSONManage
 	//Sets the JSONManager instance as own
 	myJSON = pJSON;
 
+	//The GUI overlay has not been drawn yet
+	overlayState = -1;
+
 	//loads the required images
 	initImages();
 }
@@ -54,9 +57,26 @@ GUIManager::GUIManager(int resX, int resY, CommandCenter* pCommander, JSONManage
 */
 cv::Mat GUIManager::overlaySpriteAnnotations(cv::Mat inputImage)
 {
-	finalResult = overlayAnnotations(inputImage);
+	//Not stored in finalResult: this runs on the composite stage thread
+	//while createGUI uses finalResult on the hand-off stage thread
+	return overlayAnnotations(inputImage);
+}
 
-	return finalResult;
+/*
+ * Method Overview: Checks if there are sprite annotations to overlay
+ * Parameters: None
+ * Return: Whether any annotation (or the selection square) is shown
+ */
+bool GUIManager::hasSpriteAnnotations()
+{
+	if(myCommander->getVirtualAnnotationCreationFlag())
+	{
+		return true;
+	}
+
+	std::lock_guard<std::mutex> annotationsTableLock(annotationsTableMutex);	// mutex is auto-released when lock goes out of scope
+
+	return !annotationsTable.empty();
 }
 
 
@@ -127,6 +147,47 @@ cv::Mat GUIManager::createGUI(cv::Mat showImage)
 	return finalResult;
 }
 
+/*
+ * Method Overview: Draws the GUI on a transparent image, if it changed
+ * Parameters: BGRA image at screen resolution to draw the GUI in
+ * Return: Whether the image was redrawn
+ */
+bool GUIManager::createGUIOverlay(cv::Mat& guiOverlay)
+{
+	int panelShown = myCommander->getAnnotationPanelShownFlag() ? 1 : 0;
+	int pointsDrawable = myCommander->getPointsDrawableFlag() ? 1 : 0;
+	int linesDrawable = myCommander->getLinesDrawableFlag() ? 1 : 0;
+
+	int state = panelShown | (pointsDrawable << 1) | (linesDrawable << 2);
+
+	if(state == overlayState)
+	{
+		return false;
+	}
+	overlayState = state;
+
+	guiOverlay.create(resolutionY, resolutionX, CV_8UC4);
+	guiOverlay.setTo(cv::Scalar(0, 0, 0, 0));
+
+	//Same layout as createGUI
+	overlayImageWithAlpha(guiOverlay, panelShown ? AnnotationPanel : AnnotationPanelHidden,
+		cv::Point(SCREEN_ORIGIN,SCREEN_ORIGIN));
+
+	overlayImageWithAlpha(guiOverlay, pointsDrawable ? ButtonPointsOn : ButtonPointsOff,
+		cv::Point(SCREEN_ORIGIN+ERROR_MARGIN, resolutionY-BUTTON_SIZE));
+
+	overlayImageWithAlpha(guiOverlay, linesDrawable ? ButtonLinesOn : ButtonLinesOff,
+		cv::Point(SCREEN_ORIGIN+ERROR_MARGIN+BUTTON_SIZE, resolutionY-BUTTON_SIZE));
+
+	overlayImageWithAlpha(guiOverlay, ButtonClearAll, cv::Point(resolutionX-BUTTON_SIZE, SCREEN_ORIGIN));
+
+	overlayImageWithAlpha(guiOverlay, ButtonErase, cv::Point(resolutionX-BUTTON_SIZE, SCREEN_ORIGIN+BUTTON_SIZE));
+
+	overlayImageWithAlpha(guiOverlay, ButtonExit, cv::Point(resolutionX-BUTTON_SIZE, resolutionY-BUTTON_SIZE));
+
+	return true;
+}
+
 /*
  * Method Overview: Interprets a performed click event
  * Parameters: X and Y coordinates of the event
@@ -567,6 +628,49 @@ void GUIManager::overlayImage(const cv::Mat &background, const cv::Mat &foregrou
 	}
 }
 
+/*
+ * Method Overview: Overlays an .png on top of a transparent image
+ * Parameters (1): BGRA image to draw in, foreground image
+ * Parameters (2): Coordinates to place the foreground in
+ * Return: None
+ */
+void GUIManager::overlayImageWithAlpha(cv::Mat &output, const cv::Mat &foreground, cv::Point2i location)
+{
+	for(int y = max(location.y , 0); y < output.rows; ++y)
+	{
+		int fY = y - location.y;
+
+		if(fY >= foreground.rows)
+			break;
+
+		for(int x = max(location.x, 0); x < output.cols; ++x)
+		{
+			int fX = x - location.x;
+
+			if(fX >= foreground.cols)
+				break;
+
+			const unsigned char* foregroundPx = foreground.data + fY * foreground.step + fX * foreground.channels();
+			unsigned char* outputPx = output.data + y * output.step + x * 4;
+
+			double opacity = foregroundPx[3] / 255.;
+
+			if(opacity <= 0)
+				continue;
+
+			//Porter-Duff "over", so blending the result on a frame gives what overlayImage would
+			double backgroundOpacity = outputPx[3] / 255. * (1. - opacity);
+			double resultOpacity = opacity + backgroundOpacity;
+
+			for(int c = 0; c < 3; ++c)
+			{
+				outputPx[c] = (unsigned char)((foregroundPx[c] * opacity + outputPx[c] * backgroundOpacity) / resultOpacity + 0.5);
+			}
+			outputPx[3] = (unsigned char)(resultOpacity * 255. + 0.5);
+		}
+	}
+}
+
 /*
  * Method Overview: Overlays virtual annotations on top the GUI
  * Parameters: GUI image
@@ -47,8 +47,15 @@ public:
 	//Starts the GUI creation process
 	cv::Mat createGUI(cv::Mat showImage);
 
+	//Draws the GUI alone on a transparent BGRA image, for backgrounds that OpenGL transforms.
+	//Returns false (leaving guiOverlay untouched) when the GUI has not changed since the last call
+	bool createGUIOverlay(cv::Mat& guiOverlay);
+
 	cv::Mat overlaySpriteAnnotations(cv::Mat inputImage);
 
+	//Whether overlaySpriteAnnotations would draw anything
+	bool hasSpriteAnnotations();
+
 	//Interpretation of whereas or not a button was clicked 
 	int clickAnalysis(double posX, double posY);
 
@@ -80,6 +87,9 @@ private:
 
 	//Merges a .png with a .jpg image
 	void overlayImage(const cv::Mat &background, const cv::Mat &foreground, cv::Mat &output, cv::Point2i location);
+
+	//Merges a .png on top of a transparent (BGRA) image, keeping the alpha of both
+	void overlayImageWithAlpha(cv::Mat &output, const cv::Mat &foreground, cv::Point2i location);
 	
 	//Overlays all the virtual annotations on top of an image
 	cv::Mat overlayAnnotations(cv::Mat GUIImage);
@@ -119,6 +129,9 @@ private:
 	//Matrices to store the temporal and final results
 	cv::Mat tempResult, finalResult;
 
+	//Panel and button states the GUI overlay was last drawn with (-1 = never drawn)
+	int overlayState;
+
 	//Screen resolution
 	int resolutionX, resolutionY;
 
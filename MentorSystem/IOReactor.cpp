@@ -0,0 +1,309 @@
+#include "IOReactor.h"
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <vector>
+
+IOReactor::IOReactor()
+	: _wakeSocket(INVALID_SOCKET)
+	, _running(true)
+	, _wakeUps(0)
+	, _idleMicroseconds(0)
+{
+	// Winsock counts its users, so this does not get in the way of the servers starting it too
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+		std::cout << "error: the I/O reactor could not start Winsock" << std::endl;
+		return;
+	}
+
+	_wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (_wakeSocket == INVALID_SOCKET) {
+		std::cout << "error: could not create the I/O reactor's wake-up socket: " << WSAGetLastError() << std::endl;
+		return;
+	}
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	int addressLength = sizeof(address);
+
+	// Any free port will do; the socket sends to itself
+	u_long nonBlocking = 1;
+	if (bind(_wakeSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR
+		|| getsockname(_wakeSocket, (sockaddr*)&address, &addressLength) == SOCKET_ERROR
+		|| connect(_wakeSocket, (sockaddr*)&address, addressLength) == SOCKET_ERROR
+		|| ioctlsocket(_wakeSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+		std::cout << "error: could not set up the I/O reactor's wake-up socket: " << WSAGetLastError() << std::endl;
+		closesocket(_wakeSocket);
+		_wakeSocket = INVALID_SOCKET;
+	}
+}
+
+IOReactor::~IOReactor()
+{
+	if (_wakeSocket != INVALID_SOCKET) {
+		closesocket(_wakeSocket);
+	}
+	WSACleanup();
+}
+
+void IOReactor::watch(SOCKET socket, const ReadyHandler& handler, bool oneShot)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		Watch& watch = _watches[socket];
+		watch.handler = handler;
+		watch.oneShot = oneShot;
+		watch.armed = !oneShot;
+	}
+	wake();
+}
+
+void IOReactor::unwatch(SOCKET socket)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_watches.erase(socket);
+		_writeWatches.erase(socket);
+	}
+	wake();
+}
+
+bool IOReactor::arm(SOCKET socket)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		std::map<SOCKET, Watch>::iterator found = _watches.find(socket);
+		if (found == _watches.end()) {
+			return false;
+		}
+		if (found->second.armed) {
+			return true;
+		}
+		found->second.armed = true;
+	}
+	wake();
+
+	return true;
+}
+
+void IOReactor::disarm(SOCKET socket)
+{
+	// Only ever makes the reactor watch less, so the wait does not need to end for it
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	std::map<SOCKET, Watch>::iterator found = _watches.find(socket);
+	if (found != _watches.end() && found->second.oneShot) {
+		found->second.armed = false;
+	}
+}
+
+void IOReactor::watchWritable(SOCKET socket, const ReadyHandler& handler)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_writeWatches[socket] = handler;
+	}
+	wake();
+}
+
+void IOReactor::run()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_reactorThread = std::this_thread::get_id();
+	}
+
+	std::vector<SOCKET> waitedOn;
+	std::vector<SOCKET> waitedOnForWriting;
+
+	while (_running)
+	{
+		fd_set readable;
+		fd_set writable;
+		FD_ZERO(&readable);
+		FD_ZERO(&writable);
+		waitedOn.clear();
+		waitedOnForWriting.clear();
+
+		if (_wakeSocket != INVALID_SOCKET) {
+			FD_SET(_wakeSocket, &readable);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			for (std::map<SOCKET, Watch>::iterator it = _watches.begin(); it != _watches.end(); it++)
+			{
+				if (it->second.armed && readable.fd_count < FD_SETSIZE) {
+					FD_SET(it->first, &readable);
+					waitedOn.push_back(it->first);
+				}
+			}
+
+			for (std::map<SOCKET, ReadyHandler>::iterator it = _writeWatches.begin(); it != _writeWatches.end(); it++)
+			{
+				if (writable.fd_count < FD_SETSIZE) {
+					FD_SET(it->first, &writable);
+					waitedOnForWriting.push_back(it->first);
+				}
+			}
+		}
+
+		// Without a wake-up socket, changes are picked up by waking now and then
+		timeval fallbackTimeout;
+		fallbackTimeout.tv_sec = 0;
+		fallbackTimeout.tv_usec = 100000;
+
+		std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+
+		// The first argument is ignored by Winsock
+		int ready = select(0, &readable, waitedOnForWriting.empty() ? NULL : &writable, NULL, _wakeSocket == INVALID_SOCKET ? &fallbackTimeout : NULL);
+
+		_idleMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
+		_wakeUps++;
+
+		if (ready == SOCKET_ERROR) {
+			int error = WSAGetLastError();
+			if (error == WSAENOTSOCK) {
+				dropClosedSockets();
+			}
+			else {
+				std::cout << "error: the I/O reactor's wait failed with error: " << error << std::endl;
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			continue;
+		}
+
+		if (_wakeSocket != INVALID_SOCKET && FD_ISSET(_wakeSocket, &readable)) {
+			drainWakeSocket();
+		}
+
+		for (size_t i = 0; i < waitedOn.size(); i++)
+		{
+			if (!FD_ISSET(waitedOn[i], &readable)) {
+				continue;
+			}
+
+			ReadyHandler handler;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+
+				// A handler called before this one may have unwatched or disarmed it
+				std::map<SOCKET, Watch>::iterator found = _watches.find(waitedOn[i]);
+				if (found == _watches.end() || !found->second.armed) {
+					continue;
+				}
+				if (found->second.oneShot) {
+					found->second.armed = false;
+				}
+				handler = found->second.handler;
+			}
+
+			handler(waitedOn[i]);
+		}
+
+		for (size_t i = 0; i < waitedOnForWriting.size(); i++)
+		{
+			if (!FD_ISSET(waitedOnForWriting[i], &writable)) {
+				continue;
+			}
+
+			ReadyHandler handler;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+
+				// Reported once; the writer asks again if the socket fills up again
+				std::map<SOCKET, ReadyHandler>::iterator found = _writeWatches.find(waitedOnForWriting[i]);
+				if (found == _writeWatches.end()) {
+					continue;
+				}
+				handler = found->second;
+				_writeWatches.erase(found);
+			}
+
+			handler(waitedOnForWriting[i]);
+		}
+	}
+}
+
+void IOReactor::stop()
+{
+	_running = false;
+	wake();
+}
+
+unsigned long long IOReactor::getWakeUps() const
+{
+	return _wakeUps;
+}
+
+long long IOReactor::getIdleMicroseconds() const
+{
+	return _idleMicroseconds;
+}
+
+void IOReactor::wake()
+{
+	{
+		// The reactor thread picks its own changes up before it waits again
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (std::this_thread::get_id() == _reactorThread) {
+			return;
+		}
+	}
+
+	if (_wakeSocket != INVALID_SOCKET) {
+		char signal = 0;
+		send(_wakeSocket, &signal, 1, 0);
+	}
+}
+
+void IOReactor::drainWakeSocket()
+{
+	char signals[64];
+	while (recv(_wakeSocket, signals, sizeof(signals), 0) > 0)
+	{
+	}
+}
+
+void IOReactor::dropClosedSockets()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	std::map<SOCKET, Watch>::iterator it = _watches.begin();
+	while (it != _watches.end())
+	{
+		int type;
+		int typeLength = sizeof(type);
+
+		if (getsockopt(it->first, SOL_SOCKET, SO_TYPE, (char*)&type, &typeLength) == SOCKET_ERROR) {
+			std::cout << "error: a socket was closed while the I/O reactor watched it" << std::endl;
+			_writeWatches.erase(it->first);
+			it = _watches.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+
+	// Sockets only watched for writing
+	std::map<SOCKET, ReadyHandler>::iterator writeIt = _writeWatches.begin();
+	while (writeIt != _writeWatches.end())
+	{
+		int type;
+		int typeLength = sizeof(type);
+
+		if (getsockopt(writeIt->first, SOL_SOCKET, SO_TYPE, (char*)&type, &typeLength) == SOCKET_ERROR) {
+			writeIt = _writeWatches.erase(writeIt);
+		}
+		else {
+			writeIt++;
+		}
+	}
+}
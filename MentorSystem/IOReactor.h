@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+
+IOReactor waits on every socket of the mentor (the listening sockets and
+the client sessions) in one place, and calls a handler for each socket that
+becomes readable: a new connection to accept, data, or a connection that
+was closed. The thread that runs it sleeps in between, instead of polling
+accept and recv on non-blocking sockets.
+
+Sessions that are read by another thread (the video receive stage reads
+the video socket) are watched "one shot": the reactor reports the socket
+once and then stops watching it until the reader, having read all there
+was, arms it again. Otherwise a socket with data the reader has not got to
+yet would wake the reactor over and over.
+
+The backend is select(), which is what Winsock offers for this; the mentor
+only has a handful of sockets, well under FD_SETSIZE. A loopback datagram
+socket wakes the wait whenever another thread changes what is watched.
+
+A socket can also be watched for room to write, once: a sender that could
+not hand all of its data to the socket asks to be called back when the
+socket takes more, instead of blocking on send.
+
+Handlers run on the reactor thread, one at a time, and may watch, arm and
+unwatch sockets themselves. Everything else is safe to call from any thread.
+
+*/
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+class IOReactor
+{
+public:
+	// Called on the reactor thread with the socket that can be read
+	typedef std::function<void(SOCKET)> ReadyHandler;
+
+	IOReactor();
+	~IOReactor();
+
+	// Watches a socket until unwatch(). A one-shot socket starts disarmed,
+	// and is disarmed again every time it is reported
+	void watch(SOCKET socket, const ReadyHandler& handler, bool oneShot);
+
+	// Stops watching a socket (for reading and writing); do this before closing it
+	void unwatch(SOCKET socket);
+
+	// Reports a one-shot socket the next time it can be read. Returns false if it is not watched
+	bool arm(SOCKET socket);
+
+	void disarm(SOCKET socket);
+
+	// Calls the handler once, the next time the socket has room to write
+	void watchWritable(SOCKET socket, const ReadyHandler& handler);
+
+	// Waits for sockets and calls their handlers, until stop()
+	void run();
+
+	void stop();
+
+	// Times the reactor woke up, and how long it slept in total
+	unsigned long long getWakeUps() const;
+	long long getIdleMicroseconds() const;
+
+private:
+	struct Watch
+	{
+		ReadyHandler handler;
+		bool oneShot;
+		bool armed;
+	};
+
+	// Ends the current wait, so that a change made by another thread is picked up
+	void wake();
+
+	// Reads the wake-up datagrams
+	void drainWakeSocket();
+
+	// After select() failed: stops watching the sockets that were closed without unwatch()
+	void dropClosedSockets();
+
+	std::mutex _mutex;
+	std::map<SOCKET, Watch> _watches;
+	std::map<SOCKET, ReadyHandler> _writeWatches;
+
+	// Bound to loopback and connected to itself
+	SOCKET _wakeSocket;
+
+	std::atomic<bool> _running;
+	std::thread::id _reactorThread;
+
+	std::atomic<unsigned long long> _wakeUps;
+	std::atomic<long long> _idleMicroseconds;
+};
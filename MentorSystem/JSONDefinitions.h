@@ -144,6 +144,22 @@
 #define DELETE_ANNOTATION_COMMAND "DeleteAnnotationCommand"
 #endif
 
+#ifndef TRANSFORM_ANNOTATION_COMMAND
+#define TRANSFORM_ANNOTATION_COMMAND "TransformAnnotationCommand"
+#endif
+
+#ifndef REQUEST_ANNOTATION_COMMAND
+#define REQUEST_ANNOTATION_COMMAND "RequestAnnotationCommand"
+#endif
+
+#ifndef ACKNOWLEDGE_ANNOTATION_COMMAND
+#define ACKNOWLEDGE_ANNOTATION_COMMAND "AcknowledgeAnnotationCommand"
+#endif
+
+#ifndef LINE_TRANSFORMS_COMMAND
+#define LINE_TRANSFORMS_COMMAND "LineTransformsCommand"
+#endif
+
 #ifndef REQUEST_START_TRACKING_COMMAND
 #define REQUEST_START_TRACKING_COMMAND "RequestStartTrackingCommand"
 #endif
@@ -160,6 +176,69 @@
 #define REQUEST_STOP_SENDING_FRAMES_COMMAND "RequestStopSendingFramesCommand"
 #endif
 
+#ifndef VIDEO_FEEDBACK_COMMAND
+#define VIDEO_FEEDBACK_COMMAND "VideoFeedbackCommand"
+#endif
+
+#ifndef WIRE_FORMAT_COMMAND
+#define WIRE_FORMAT_COMMAND "WireFormatCommand"
+#endif
+
+//---------------------Video Feedback Keywords-------------------//
+#ifndef FEEDBACK_THROUGHPUT
+#define FEEDBACK_THROUGHPUT "throughput"
+#endif
+
+#ifndef FEEDBACK_FRAME_RATE
+#define FEEDBACK_FRAME_RATE "frameRate"
+#endif
+
+#ifndef FEEDBACK_QUEUEING_DELAY
+#define FEEDBACK_QUEUEING_DELAY "queueingDelay"
+#endif
+
+#ifndef FEEDBACK_RECEIVE_BACKLOG
+#define FEEDBACK_RECEIVE_BACKLOG "receiveBacklog"
+#endif
+
+#ifndef FEEDBACK_LOST_FRAMES
+#define FEEDBACK_LOST_FRAMES "lostFrames"
+#endif
+
+#ifndef FEEDBACK_CONGESTION
+#define FEEDBACK_CONGESTION "congestion"
+#endif
+
+#ifndef FEEDBACK_RECOMMENDED_BITRATE
+#define FEEDBACK_RECOMMENDED_BITRATE "recommendedBitrate"
+#endif
+
+//----------------------Wire Format Keywords---------------------//
+#ifndef WIRE_FORMAT
+#define WIRE_FORMAT "format"
+#endif
+
+#ifndef WIRE_FORMAT_JSON
+#define WIRE_FORMAT_JSON "json"
+#endif
+
+#ifndef WIRE_FORMAT_BINARY
+#define WIRE_FORMAT_BINARY "binary"
+#endif
+
+//--------------------Line Transform Keywords--------------------//
+#ifndef GEOMETRY_VERSION
+#define GEOMETRY_VERSION "version"
+#endif
+
+#ifndef TRANSFORM
+#define TRANSFORM "transform"
+#endif
+
+#ifndef LINE_TRANSFORMS_ENABLED
+#define LINE_TRANSFORMS_ENABLED "enabled"
+#endif
+
 //------------------------Annotation Types-----------------------//
 #ifndef POINT_ANNOTATION
 #define POINT_ANNOTATION "point"
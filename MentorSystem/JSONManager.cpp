@@ -18,13 +18,17 @@
 
 //Include its header file
 #include "JSONManager.h"
+#include "StageTracer.h"
+#include <math.h>//Enable the usage of math algorithms
+#include <string.h>//Compares the command names
 
 /*
  * Method Overview: Constructor of the class
  * Parameters: Instance of the Communication Manager server
  * Return: Instance of the class
  */
-JSONManager::JSONManager(CommunicationManager* pManager, CommandCenter* pCommander)
+JSONManager::JSONManager(AnnotationSender* pManager, CommandCenter* pCommander)
+	: JSONs_to_create(POOLED_MESSAGES)
 {
 	myCommunicationManager = pManager;
 
@@ -34,125 +38,158 @@ JSONManager::JSONManager(CommunicationManager* pManager, CommandCenter* pCommand
 /*
  * Method Overview: Infinite loop to start the JSON creation
  * Parameters: None
- * Return: None
+ * Return: None (sleeps while there is no message to create)
  */
 void JSONManager::constructGeneralJSON()
 {
+	JSONable to_create;
+
 	while(1)
 	{
-		if((int)(JSONs_to_create.size())>0)
+		//One message at a time, in the order they were queued
+		JSONs_to_create.pop(to_create);
+
 		{
-			if(!(myCommander->getJSONCreationFlag()))
-			{
-				myCommander->setJSONCreationFlag(1);
+			TRACE_ZONE("JSON build");
 
-				JSONable to_create = JSONs_to_create.front();
+			const char* command_char = (to_create.command).c_str();
 
-				const char* command_char = (to_create.command).c_str();
+			wire_clients.assign(to_create.clients.begin(), to_create.clients.end());
 
-				if(strcmp(CREATE_ANNOTATION_COMMAND, command_char) == 0)
+			if(strcmp(CREATE_ANNOTATION_COMMAND, command_char) == 0)
+			{
+				if(to_create.annotation_code==NULL)
 				{
-					if(to_create.annotation_code==NULL)
-					{
-						constructLineJSONMessage(to_create.id, to_create.command, to_create.myPoints);
-					}
-					else
-					{
-						constructVirtualAnnotationJSONMessage(to_create.id, to_create.command, to_create.annotation_code, to_create.annotation_information);
-					}
+					constructLineJSONMessage(to_create.id, to_create.command, &to_create.myPoints, to_create.annotation_information);
 				}
-				else if(strcmp(UPDATE_ANNOTATION_COMMAND, command_char) == 0)
+				else
+				{
+					constructVirtualAnnotationJSONMessage(to_create.id, to_create.command, to_create.annotation_code, to_create.annotation_information);
+				}
+			}
+			else if(strcmp(UPDATE_ANNOTATION_COMMAND, command_char) == 0)
+			{
+				if(to_create.annotation_code==NULL)
 				{
-					if(to_create.annotation_code==NULL)
-					{
-						constructLineJSONMessage(to_create.id, to_create.command, to_create.myPoints);
-					}
-					else
-					{
-						constructVirtualAnnotationJSONMessage(to_create.id, to_create.command, to_create.annotation_code, to_create.annotation_information);
-					}
+					constructLineJSONMessage(to_create.id, to_create.command, &to_create.myPoints, to_create.annotation_information);
 				}
-				else if(strcmp(DELETE_ANNOTATION_COMMAND, command_char) == 0)
+				else
 				{
-					constructDeleteJSONMessage(to_create.command, to_create.selected_annotation_id);
+					constructVirtualAnnotationJSONMessage(to_create.id, to_create.command, to_create.annotation_code, to_create.annotation_information);
 				}
-				JSONs_to_create.pop();
+			}
+			else if(strcmp(DELETE_ANNOTATION_COMMAND, command_char) == 0)
+			{
+				constructDeleteJSONMessage(to_create.command, to_create.selected_annotation_id);
+			}
+			else if(strcmp(TRANSFORM_ANNOTATION_COMMAND, command_char) == 0)
+			{
+				constructLineTransformJSONMessage(to_create.id, to_create.command, to_create.annotation_information);
 			}
 		}
+
+		//Back to the pool, so the next message reuses the memory of its points
+		JSONs_to_create.recycle(std::move(to_create));
 	}
 }
 
 /*
- * Method Overview: Constructs a JSON Value object of a line
- * Parameters: Required values of the object to create
+ * Method Overview: Queues the values of a message for the JSON thread to create
+ * Parameters: Required values of the object to create, clients to send it to (NULL = those of the focused trainee)
  * Return: None
  */
-void JSONManager::createJSONable(int id, string command, vector<long double>* myPoints, int annotation_code, 
-		vector<double> annotation_information, int selected_annotation_id)
+void JSONManager::createJSONable(int id, string command, const vector<long double>* myPoints, int annotation_code, 
+		const vector<double>& annotation_information, int selected_annotation_id, const vector<unsigned int>* clients)
 {
-	JSONable to_add;
+	//A message used before, if there is one, whose vectors already have room
+	JSONable to_add = JSONs_to_create.acquire();
 
 	to_add.id = id;
 	to_add.command = command;
-	to_add.myPoints = myPoints;
 	to_add.annotation_code = annotation_code;
 
+	//Copied now: the line keeps changing on the calling thread while the message waits
+	to_add.myPoints.assign(myPoints->begin(), myPoints->end());
 
-	to_add.annotation_information = annotation_information;
+	to_add.annotation_information.assign(annotation_information.begin(), annotation_information.end());
 	to_add.selected_annotation_id = selected_annotation_id;
 
-	JSONs_to_create.push(to_add);
+	to_add.clients.clear();
+	if(clients != NULL)
+	{
+		to_add.clients.assign(clients->begin(), clients->end());
+	}
 
+	JSONs_to_create.push(std::move(to_add));
 }
 
 /*
  * Method Overview: Constructs a JSON Value object of a line
  * Parameters (1): Line Id, message command, points of the line
- * Parameters (2): Vector of Ids of the lines to erase (if any)
+ * Parameters (2): Line information (its geometry version)
  * Return: None
  */
-void JSONManager::constructLineJSONMessage(int id, string command, vector<long double>* myPoints)
+void JSONManager::constructLineJSONMessage(int id, string command, const vector<long double>* myPoints, const vector<double>& line_information)
 {
-	/*
-	 * Json::arrayValue = empty array []
-	 * Json::objectValue = empty object {}
-	 */
-
-	Json::Value message;
-	Json::Value annotation_memory;
-	Json::Value initialAnnotation;
-	Json::Value annotationPoints;
-	
-	message["id"] = id;
-	message["command"] = command;
-
-	//annotation_memory["matches"] = Json::objectValue;//
-	//annotation_memory["initialKeyPoints"] = Json::arrayValue;//
-	//annotation_memory["initialDescriptors"] = Json::objectValue;//
+	wire_message.command = findWireCommand(command);
+	wire_message.id = id;
+	wire_message.annotationType = WIRE_POLYLINE;
+	wire_message.points.clear();
+	wire_message.version = line_information.empty() ? 0 : (int)line_information[0];
 
 	int counter;
 
+	//Normalized to the screen, from the bottom up
 	for(counter = 0; counter<(int)myPoints->size();counter=counter+2)
 	{
-		annotationPoints["x"] = (double)(myPoints->at(counter)/RESOLUTION_X);
-		annotationPoints["y"] = (double)((RESOLUTION_Y-(myPoints->at(counter+1)))/RESOLUTION_Y);
-
-		initialAnnotation["annotationPoints"].append(annotationPoints);
+		wire_message.points.push_back((double)(myPoints->at(counter)/RESOLUTION_X));
+		wire_message.points.push_back((double)((RESOLUTION_Y-(myPoints->at(counter+1)))/RESOLUTION_Y));
 	}
 
-	initialAnnotation["annotationType"] = POLYLINE_ANNOTATION;
+	//Writes JSON Value to a file
+	writeJSONonFile(buildJSONMessage(wire_message));
+}
 
-	annotation_memory["annotation"] = initialAnnotation;
-	/*annotation_memory["initialAnnotation"] = initialAnnotation;//delete
-	annotation_memory["currentAnnotation"] = initialAnnotation;//delete
-	annotation_memory["currentHomography"] = Json::objectValue;//
-	annotation_memory["initialRawKeyPoints"] = Json::arrayValue;//
-	annotation_memory["currentRawKeyPoints"] = Json::arrayValue;*///
+/*
+ * Method Overview: Constructs a JSON Value object of a line's transform
+ * Parameters (1): Line Id, message command
+ * Parameters (2): Line information (geometry version and transform)
+ * Return: None
+ */
+void JSONManager::constructLineTransformJSONMessage(int id, string command, const vector<double>& line_information)
+{
+	/*
+	 * The line_information structure contains:
+	 * line_information[0] = geometry version
+	 * line_information[1] = scale
+	 * line_information[2] = rotation (radians)
+	 * line_information[3] = X translation
+	 * line_information[4] = Y translation
+	 * in the coordinates the points of the line are kept in
+	 */
+	double scale_cos = line_information[1]*cos(line_information[2]);
+	double scale_sin = line_information[1]*sin(line_information[2]);
 
-	message["annotation_memory"] = annotation_memory;
+	wire_message.command = findWireCommand(command);
+	wire_message.id = id;
+	wire_message.annotationType = WIRE_POLYLINE;
+	wire_message.points.clear();
+	wire_message.version = (int)line_information[0];
+
+	/*
+	 * The same transform for the normalized points the clients have
+	 * (x/RESOLUTION_X, 1 - y/RESOLUTION_Y), so the clients apply it
+	 * as a matrix without knowing the mentor's screen
+	 */
+	wire_message.transform[0] = scale_cos;
+	wire_message.transform[1] = scale_sin*RESOLUTION_Y/RESOLUTION_X;
+	wire_message.transform[2] = (line_information[3] - scale_sin*RESOLUTION_Y)/RESOLUTION_X;
+	wire_message.transform[3] = -scale_sin*RESOLUTION_X/RESOLUTION_Y;
+	wire_message.transform[4] = scale_cos;
+	wire_message.transform[5] = 1.0 - scale_cos - line_information[4]/RESOLUTION_Y;
 
 	//Writes JSON Value to a file
-	writeJSONonFile(message);
+	writeJSONonFile(buildJSONMessage(wire_message));
 }
 
 /*
@@ -172,29 +209,107 @@ void JSONManager::constructVirtualAnnotationJSONMessage(int id, string command,
 	 * annotation_information[3] = annotation zoom value
 	 */	
 
-	string annotation_name = findAnnotationName(annotation_code);
+	wire_message.command = findWireCommand(command);
+	wire_message.id = id;
+	wire_message.annotationType = WIRE_VIRTUAL_TOOL;
+	wire_message.points.clear();
+
+	wire_message.points.push_back(annotation_information[0]/RESOLUTION_X);
+	wire_message.points.push_back(annotation_information[1]/RESOLUTION_Y);
+
+	wire_message.rotation = -1*(annotation_information[2]);
+	wire_message.scale = annotation_information[3];
+	wire_message.toolType = findAnnotationName(annotation_code);
+	wire_message.selectableColor = 0;
+
+	//Writes JSON Value to a file
+	writeJSONonFile(buildJSONMessage(wire_message));
+}
+
+/*
+ * Method Overview: Creates a JSON Message of a delete command
+ * Parameters: Command type, ID of the erased annotations
+ * Return: None
+ */
+void JSONManager::constructDeleteJSONMessage(string command, int selected_annotation_id)
+{
+	wire_message.command = findWireCommand(command);
+	wire_message.id = selected_annotation_id;
+	wire_message.annotationType = WIRE_NO_ANNOTATION;
+	wire_message.points.clear();
+
+	//Writes JSON Value to a file
+	writeJSONonFile(buildJSONMessage(wire_message));
+}
+
+/*
+ * Method Overview: Builds the JSON Value of an annotation message
+ * Parameters: The message (normalized points, as in the JSON)
+ * Return: JSON Value to send
+ */
+Json::Value JSONManager::buildJSONMessage(const AnnotationMessage& annotation)
+{
+	/*
+	 * Json::arrayValue = empty array []
+	 * Json::objectValue = empty object {}
+	 */
 
 	Json::Value message;
 	Json::Value annotation_memory;
-	Json::Value annotationPoints;
 	Json::Value initialAnnotation;
-	
-	message["id"] = id;
-	message["command"] = command;
+	Json::Value annotationPoints;
+
+	message["id"] = annotation.id;
+	message["command"] = findCommandName(annotation.command);
+
+	//A delete command only names the annotation
+	if(annotation.command == WIRE_DELETE_ANNOTATION)
+	{
+		return message;
+	}
+
+	//A transform names the geometry it applies to, x' = t0 x + t1 y + t2 and y' = t3 x + t4 y + t5
+	if(annotation.command == WIRE_TRANSFORM_ANNOTATION)
+	{
+		message["version"] = annotation.version;
+
+		for(int entry = 0; entry < AnnotationWireFormat::TRANSFORM_SIZE; entry++)
+		{
+			message["transform"].append(annotation.transform[entry]);
+		}
+
+		return message;
+	}
 
 	//annotation_memory["matches"] = Json::objectValue;//
 	//annotation_memory["initialKeyPoints"] = Json::arrayValue;//
 	//annotation_memory["initialDescriptors"] = Json::objectValue;//
 
-	annotationPoints["x"] = (annotation_information[0]/RESOLUTION_X);
-	annotationPoints["y"] = (annotation_information[1]/RESOLUTION_Y);
+	int counter;
 
-	initialAnnotation["annotationPoints"].append(annotationPoints);
-	initialAnnotation["rotation"] = -1*(annotation_information[2]);
-	initialAnnotation["scale"] = annotation_information[3];
-	initialAnnotation["annotationType"] = VIRTUAL_TOOL_ANNOTATION;
-	initialAnnotation["toolType"] = annotation_name;
-	initialAnnotation["selectableColor"] = 0;
+	for(counter = 0; counter + 1<(int)annotation.points.size();counter=counter+2)
+	{
+		annotationPoints["x"] = annotation.points[counter];
+		annotationPoints["y"] = annotation.points[counter+1];
+
+		initialAnnotation["annotationPoints"].append(annotationPoints);
+	}
+
+	if(annotation.annotationType == WIRE_VIRTUAL_TOOL)
+	{
+		initialAnnotation["rotation"] = annotation.rotation;
+		initialAnnotation["scale"] = annotation.scale;
+		initialAnnotation["annotationType"] = VIRTUAL_TOOL_ANNOTATION;
+		initialAnnotation["toolType"] = annotation.toolType;
+		initialAnnotation["selectableColor"] = annotation.selectableColor;
+	}
+	else
+	{
+		initialAnnotation["annotationType"] = POLYLINE_ANNOTATION;
+
+		//The geometry the next transforms apply to
+		message["version"] = annotation.version;
+	}
 
 	annotation_memory["annotation"] = initialAnnotation;
 	/*annotation_memory["initialAnnotation"] = initialAnnotation;//delete
@@ -205,25 +320,53 @@ void JSONManager::constructVirtualAnnotationJSONMessage(int id, string command,
 
 	message["annotation_memory"] = annotation_memory;
 
-	//Writes JSON Value to a file
-	writeJSONonFile(message);
+	return message;
 }
 
 /*
- * Method Overview: Creates a JSON Message of a delete command
- * Parameters: Command type, ID of the erased annotations
- * Return: None
+ * Method Overview: Finds the wire format code of a command
+ * Parameters: Command name
+ * Return: Its code
  */
-void JSONManager::constructDeleteJSONMessage(string command, int selected_annotation_id)
+int JSONManager::findWireCommand(string command)
 {
-	Json::Value message;
+	if(command == UPDATE_ANNOTATION_COMMAND)
+	{
+		return WIRE_UPDATE_ANNOTATION;
+	}
+	else if(command == DELETE_ANNOTATION_COMMAND)
+	{
+		return WIRE_DELETE_ANNOTATION;
+	}
+	else if(command == TRANSFORM_ANNOTATION_COMMAND)
+	{
+		return WIRE_TRANSFORM_ANNOTATION;
+	}
 
-	message["command"] = command;
+	return WIRE_CREATE_ANNOTATION;
+}
 
-	message["id"] = selected_annotation_id;
+/*
+ * Method Overview: Finds the name of a wire format command code
+ * Parameters: Command code
+ * Return: Its name
+ */
+string JSONManager::findCommandName(int command)
+{
+	if(command == WIRE_UPDATE_ANNOTATION)
+	{
+		return UPDATE_ANNOTATION_COMMAND;
+	}
+	else if(command == WIRE_DELETE_ANNOTATION)
+	{
+		return DELETE_ANNOTATION_COMMAND;
+	}
+	else if(command == WIRE_TRANSFORM_ANNOTATION)
+	{
+		return TRANSFORM_ANNOTATION_COMMAND;
+	}
 
-	//Writes JSON Value to a file
-	writeJSONonFile(message);
+	return CREATE_ANNOTATION_COMMAND;
 }
 
 /*
@@ -351,16 +494,28 @@ void JSONManager::writeJSONonFile(Json::Value to_text)
 	//Closes the writen file
     file_id.close();
 
+	//An update only matters until the next one of the same annotation, so a client that fell behind can skip it
+	string collapse_key = "";
+	if(to_text["command"].asString() == UPDATE_ANNOTATION_COMMAND)
+	{
+		collapse_key = "annotation:" + std::to_string(to_text["id"].asInt());
+	}
+	//A transform, until the next one of the same geometry (one of a newer geometry must not go out ahead of it)
+	else if(to_text["command"].asString() == TRANSFORM_ANNOTATION_COMMAND)
+	{
+		collapse_key = "transform:" + std::to_string(to_text["id"].asInt()) + ":" + std::to_string(to_text["version"].asInt());
+	}
+
 	//Starts the process of sending the value over the network
-	JSONtoNetwork(string_to_send);
+	JSONtoNetwork(string_to_send, collapse_key);
 }
 
 /*
  * Method Overview: Routines to send JSON strings over the network
- * Parameters: String containing the JSON Value
+ * Parameters: String containing the JSON Value, key of the messages it supersedes ("" = none)
  * Return: None
  */
-void JSONManager::JSONtoNetwork(string string_to_send)
+void JSONManager::JSONtoNetwork(string string_to_send, string collapse_key)
 {
 	//Makes a copy of the string and transform it into a char*
 	string my_string_to_send = string_to_send + "\n";
@@ -393,9 +548,26 @@ void JSONManager::JSONtoNetwork(string string_to_send)
 	*/
 	///////////////////////////////////////////////////////////////
 
+	//Clients that asked for the binary format get the same message (the one just built) encoded that way
+	const char* binary_to_send = NULL;
+	if(myCommunicationManager->hasBinaryClients())
+	{
+		TRACE_ZONE("binary encode");
+
+		wire_bytes.clear();
+		AnnotationWireFormat::encode(wire_message, wire_bytes);
+		binary_to_send = wire_bytes.data();
+	}
+
 	//Actually sends the message
-	int iResult = myCommunicationManager->sendActionPackets(message_to_send,JSON_NETWORK_CODE);
-	
-	//Let the CommanderCenter know that the message was sent
-	myCommander->setJSONCreationFlag(0);
+	TRACE_ZONE("JSON send");
+	int iResult;
+	if(wire_clients.empty())
+	{
+		iResult = myCommunicationManager->sendAnnotationMessage(message_to_send,collapse_key.c_str(),binary_to_send,(int)wire_bytes.size());
+	}
+	else
+	{
+		iResult = myCommunicationManager->sendAnnotationMessageTo(wire_clients,message_to_send,collapse_key.c_str(),binary_to_send,(int)wire_bytes.size());
+	}
 }
\ No newline at end of file
@@ -26,14 +26,19 @@
 #define JSONMANAGER_H
 
 //---------------------------Includes----------------------------//
-#include <queue>//Queue Data Structure
+#include "MPSCQueue.h"//Blocking queue of the messages to create
 #include <fstream>//Enables the code to read and write an file
+#include <string>//Enable the usage of the string class
+#include <vector>//Enable the usage of the vector class
 #include "json.h"//Baptiste Lepilleur's JSON c++ Library
 #include "CommandCenter.h"//General Program Flow Controller
-#include "CommunicationManager.h"//TCP-IP Socket Server
+#include "AnnotationSender.h"//Sends the messages, without the socket headers
 #include "JSONDefinitions.h"////General JSON definitions
 #include "virtualAnnotationDefinitions.h"//Virtual annotation codes
 #include "communicationDefinitions.h"//Socket-related definitions
+#include "AnnotationWireFormat.h"//Binary form of the messages
+
+using namespace std;//Standard Library
 
 class JSONManager
 {
@@ -43,21 +48,29 @@ public:
 	{
 		int id;
 		string command;
-		vector<long double>* myPoints;
+		vector<long double> myPoints;//A copy, taken when the message is queued
 		int annotation_code;
 		vector<double> annotation_information;
 		int selected_annotation_id;
+		vector<unsigned int> clients;//Clients to send it to (empty = those of the trainee being looked at)
 	};
 
 	//-------------------------Methods---------------------------//
-	JSONManager(CommunicationManager* pManager, CommandCenter* pCommand);//Class Constructor
+	JSONManager(AnnotationSender* pManager, CommandCenter* pCommand);//Class Constructor (the CommunicationManager sends the messages)
 
 	//loop to create the JSON messages
 	void constructGeneralJSON();
 
-	//create a object that will be transformed to a JSON later on
-	void createJSONable(int id, string command, vector<long double>* myPoints, int annotation_code, 
-		vector<double> annotation_information, int selected_annotation_id);
+	//create a object that will be transformed to a JSON later on (for the clients given, or NULL for those of the focused trainee)
+	void createJSONable(int id, string command, const vector<long double>* myPoints, int annotation_code, 
+		const vector<double>& annotation_information, int selected_annotation_id, const vector<unsigned int>* clients = NULL);
+
+	//Builds the Json Value of an annotation message, as the clients get it
+	static Json::Value buildJSONMessage(const AnnotationMessage& annotation);
+
+	//Translates between the command names and their wire format codes
+	static int findWireCommand(string command);
+	static string findCommandName(int command);
 
 	//------------------------Variables--------------------------//
 	//None
@@ -68,7 +81,10 @@ private:
 	string findAnnotationName(int code);
 
 	//Prepares a Json Value of a line to be sent
-	void constructLineJSONMessage(int id, string command, vector<long double>* myPoints);
+	void constructLineJSONMessage(int id, string command, const vector<long double>* myPoints, const vector<double>& line_information);
+
+	//Prepares a Json Value of a line's transform since its last geometry
+	void constructLineTransformJSONMessage(int id, string command, const vector<double>& line_information);
 
 	//Prepares a Json Value of a virtual annotation to be sent
 	void constructVirtualAnnotationJSONMessage(int id, string command, int annotation_code, vector<double> annotation_information);
@@ -80,19 +96,29 @@ private:
 	void JSONManager::writeJSONonFile(Json::Value to_text);
 
 	//Starts the process of sending a JSON string over the network
-	void JSONtoNetwork(string string_to_send);
+	void JSONtoNetwork(string string_to_send, string collapse_key);
 
 	//------------------------Variables--------------------------//
 	//Instance of the general program flow controller
 	CommandCenter* myCommander;
 	
-	//Instance of the Communication Manager
-	CommunicationManager* myCommunicationManager;
+	//Instance of the Communication Manager, as far as sending annotations goes
+	AnnotationSender* myCommunicationManager;
 
 	//Used to open and save the JSON Value in a file
 	std::ofstream file_id;
 
-	//Queue structure used to store the JSON-to-create information
-	std::queue<JSONable> JSONs_to_create;
+	//Queue structure used to store the JSON-to-create information, filled by several threads
+	MPSCQueue<JSONable> JSONs_to_create;
+
+	//Messages kept to be filled again, with the memory of their points
+	static const int POOLED_MESSAGES = 16;
+
+	//The message being sent, in the terms of both formats, and its binary form
+	AnnotationMessage wire_message;
+	std::string wire_bytes;
+
+	//Clients the message being sent is for (empty = those of the trainee being looked at)
+	vector<unsigned int> wire_clients;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include "JitterBuffer.h"
+#include "communicationDefinitions.h"
+#include <string.h>
+
+static uint16_t readBigEndian16(const unsigned char* bytes)
+{
+	return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t readBigEndian32(const unsigned char* bytes)
+{
+	return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static void writeBigEndian16(unsigned char* bytes, uint16_t value)
+{
+	bytes[0] = (unsigned char)(value >> 8);
+	bytes[1] = (unsigned char)value;
+}
+
+static void writeBigEndian32(unsigned char* bytes, uint32_t value)
+{
+	bytes[0] = (unsigned char)(value >> 24);
+	bytes[1] = (unsigned char)(value >> 16);
+	bytes[2] = (unsigned char)(value >> 8);
+	bytes[3] = (unsigned char)value;
+}
+
+JitterBuffer::JitterBuffer(double latencyTargetSeconds)
+	: _latencyTargetSeconds(latencyTargetSeconds)
+{
+	reset();
+}
+
+void JitterBuffer::reset()
+{
+	memset(&_statistics, 0, sizeof(_statistics));
+
+	restart();
+}
+
+void JitterBuffer::restart()
+{
+	while (!_frames.empty()) {
+		removeFront();
+	}
+
+	_started = false;
+	_ssrc = 0;
+	_nextFrameNumber = 0;
+
+	_sequenceStarted = false;
+	_firstSequence = 0;
+	_highestSequence = 0;
+
+	_streamDatagramsReceived = 0;
+	_earlierStreamsLost = _statistics.datagramsLost;
+
+	_timestampStarted = false;
+	_extendedTimestamp = 0;
+	_lastTimestamp = 0;
+
+	_jitterStarted = false;
+	_lastArrivalSeconds = 0.0;
+	_lastJitterTimestamp = 0;
+	_jitter = 0.0;
+}
+
+void JitterBuffer::setLatencyTarget(double latencyTargetSeconds)
+{
+	_latencyTargetSeconds = latencyTargetSeconds;
+}
+
+bool JitterBuffer::parseDatagramHeader(const char* datagram, int size, DatagramHeader& header)
+{
+	if (size <= DATAGRAM_HEADER_SIZE) {
+		return false;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)datagram;
+
+	// version 2, without padding, header extension or contributing sources
+	if (bytes[0] != 0x80 || (bytes[1] & 0x7F) != RTP_PAYLOAD_TYPE) {
+		return false;
+	}
+
+	header.marker = (bytes[1] & 0x80) != 0;
+	header.sequence = readBigEndian16(bytes + 2);
+	header.rtpTimestamp = readBigEndian32(bytes + 4);
+	header.ssrc = readBigEndian32(bytes + 8);
+
+	header.frameNumber = readBigEndian32(bytes + 12);
+	header.offset = readBigEndian32(bytes + 16);
+	header.frameSize = readBigEndian32(bytes + 20);
+
+	uint32_t payloadSize = (uint32_t)(size - DATAGRAM_HEADER_SIZE);
+	if (header.frameSize == 0 || header.offset >= header.frameSize || payloadSize > header.frameSize - header.offset) {
+		return false;
+	}
+
+	// The size comes from the network: a frame that could never be handed out is not allocated for either
+	if (header.frameSize > MAX_PACKET_SIZE) {
+		return false;
+	}
+
+	return true;
+}
+
+void JitterBuffer::packetizeFrame(const char* frame, int frameSize, uint32_t frameNumber, long long captureMicroseconds,
+	uint32_t ssrc, int maxDatagramSize, uint16_t& nextSequence, std::vector<std::vector<char> >& datagrams)
+{
+	int maxPayloadSize = maxDatagramSize - DATAGRAM_HEADER_SIZE;
+	uint32_t rtpTimestamp = (uint32_t)(captureMicroseconds * (RTP_CLOCK_RATE / 1000) / 1000);
+
+	for (int offset = 0; offset < frameSize; offset += maxPayloadSize) {
+		int payloadSize = frameSize - offset;
+		if (payloadSize > maxPayloadSize) {
+			payloadSize = maxPayloadSize;
+		}
+		bool last = offset + payloadSize == frameSize;
+
+		std::vector<char> datagram(DATAGRAM_HEADER_SIZE + payloadSize);
+		unsigned char* bytes = (unsigned char*)&datagram[0];
+
+		bytes[0] = 0x80;
+		bytes[1] = (unsigned char)(RTP_PAYLOAD_TYPE | (last ? 0x80 : 0));
+		writeBigEndian16(bytes + 2, nextSequence++);
+		writeBigEndian32(bytes + 4, rtpTimestamp);
+		writeBigEndian32(bytes + 8, ssrc);
+
+		writeBigEndian32(bytes + 12, frameNumber);
+		writeBigEndian32(bytes + 16, (uint32_t)offset);
+		writeBigEndian32(bytes + 20, (uint32_t)frameSize);
+
+		memcpy(bytes + DATAGRAM_HEADER_SIZE, frame + offset, payloadSize);
+
+		datagrams.push_back(std::vector<char>());
+		datagrams.back().swap(datagram);
+	}
+}
+
+long long JitterBuffer::captureMicroseconds(uint32_t rtpTimestamp)
+{
+	if (_timestampStarted) {
+		// signed difference: timestamps of frames arriving out of order go back a little
+		_extendedTimestamp += (int32_t)(rtpTimestamp - _lastTimestamp);
+	}
+	else {
+		_extendedTimestamp = rtpTimestamp;
+		_timestampStarted = true;
+	}
+	_lastTimestamp = rtpTimestamp;
+
+	return _extendedTimestamp * 1000 / (RTP_CLOCK_RATE / 1000);
+}
+
+void JitterBuffer::recordSequence(uint16_t sequence)
+{
+	_statistics.datagramsReceived++;
+	_streamDatagramsReceived++;
+
+	if (!_sequenceStarted) {
+		_firstSequence = sequence;
+		_highestSequence = sequence;
+		_sequenceStarted = true;
+		return;
+	}
+
+	int64_t extended = _highestSequence + (int16_t)(sequence - (uint16_t)_highestSequence);
+
+	if (extended > _highestSequence) {
+		_highestSequence = extended;
+	}
+	else {
+		_statistics.datagramsReordered++;
+	}
+
+	if (extended < _firstSequence) {
+		_firstSequence = extended;
+	}
+
+	int64_t expected = _highestSequence - _firstSequence + 1;
+	unsigned int lost = expected > _streamDatagramsReceived ? (unsigned int)(expected - _streamDatagramsReceived) : 0;
+	_statistics.datagramsLost = _earlierStreamsLost + lost;
+}
+
+void JitterBuffer::recordJitter(uint32_t rtpTimestamp, double arrivalSeconds)
+{
+	if (_jitterStarted) {
+		// difference in transit time between this datagram and the one before (RFC 3550 A.8)
+		double difference = (arrivalSeconds - _lastArrivalSeconds) * RTP_CLOCK_RATE - (int32_t)(rtpTimestamp - _lastJitterTimestamp);
+		if (difference < 0.0) {
+			difference = -difference;
+		}
+		_jitter += (difference - _jitter) / 16.0;
+		_statistics.jitterMilliseconds = _jitter * 1000.0 / RTP_CLOCK_RATE;
+	}
+	_jitterStarted = true;
+	_lastArrivalSeconds = arrivalSeconds;
+	_lastJitterTimestamp = rtpTimestamp;
+}
+
+void JitterBuffer::insert(const char* datagram, int size, double arrivalSeconds)
+{
+	DatagramHeader header;
+	if (!parseDatagramHeader(datagram, size, header)) {
+		_statistics.datagramsInvalid++;
+		return;
+	}
+
+	if (_started && header.ssrc != _ssrc) {
+		restart();
+	}
+
+	if (!_started) {
+		_ssrc = header.ssrc;
+		_nextFrameNumber = header.frameNumber;
+		_started = true;
+	}
+
+	FrameMap::iterator frame = _frames.find(header.frameNumber);
+
+	if (frame == _frames.end()) {
+		// too many frames waiting (e.g. one was never finished while a lot of small ones came in)
+		while ((int)_frames.size() >= MAX_PENDING_FRAMES) {
+			dropFront();
+		}
+
+		// already handed out or given up on (duplicates of it cannot be told apart, so it is not counted as received)
+		if ((int32_t)(header.frameNumber - _nextFrameNumber) < 0) {
+			_statistics.datagramsLate++;
+			return;
+		}
+
+		frame = _frames.insert(FrameMap::value_type(header.frameNumber, PendingFrame())).first;
+
+		if (!_spareBuffers.empty()) {
+			frame->second.data.swap(_spareBuffers.back());
+			_spareBuffers.pop_back();
+		}
+		frame->second.data.resize(header.frameSize);
+		frame->second.receivedBytes = 0;
+		frame->second.captureMicroseconds = captureMicroseconds(header.rtpTimestamp);
+		frame->second.firstArrivalSeconds = arrivalSeconds;
+	}
+	else if (frame->second.data.size() != header.frameSize) {
+		_statistics.datagramsInvalid++;
+		return;
+	}
+
+	PendingFrame& pending = frame->second;
+
+	// only the bytes no other piece brought count, so overlapping pieces cannot make up for a missing one
+	int payloadSize = size - DATAGRAM_HEADER_SIZE;
+	uint32_t newBytes = coverRange(pending.ranges, header.offset, header.offset + payloadSize);
+
+	if (newBytes == 0) {
+		_statistics.datagramsDuplicated++;
+		return;
+	}
+
+	recordSequence(header.sequence);
+	recordJitter(header.rtpTimestamp, arrivalSeconds);
+
+	memcpy(&pending.data[header.offset], datagram + DATAGRAM_HEADER_SIZE, payloadSize);
+	pending.receivedBytes += newBytes;
+}
+
+uint32_t JitterBuffer::coverRange(std::vector<ByteRange>& ranges, uint32_t start, uint32_t end)
+{
+	uint32_t newBytes = end - start;
+
+	// the ranges wholly before the piece stay as they are
+	size_t first = 0;
+	while (first < ranges.size() && ranges[first].second < start) {
+		first++;
+	}
+
+	// the ones it overlaps or touches are merged with it into one
+	ByteRange merged(start, end);
+	size_t last = first;
+
+	for (; last < ranges.size() && ranges[last].first <= end; last++) {
+		uint32_t overlapStart = ranges[last].first > start ? ranges[last].first : start;
+		uint32_t overlapEnd = ranges[last].second < end ? ranges[last].second : end;
+		if (overlapEnd > overlapStart) {
+			newBytes -= overlapEnd - overlapStart;
+		}
+
+		merged.first = ranges[last].first < merged.first ? ranges[last].first : merged.first;
+		merged.second = ranges[last].second > merged.second ? ranges[last].second : merged.second;
+	}
+
+	ranges.erase(ranges.begin() + first, ranges.begin() + last);
+	ranges.insert(ranges.begin() + first, merged);
+
+	return newBytes;
+}
+
+void JitterBuffer::skipTo(uint32_t frameNumber)
+{
+	_statistics.framesMissing += frameNumber - _nextFrameNumber;
+	_nextFrameNumber = frameNumber;
+}
+
+void JitterBuffer::removeFront()
+{
+	FrameMap::iterator front = _frames.begin();
+
+	if (_spareBuffers.size() < (size_t)MAX_PENDING_FRAMES) {
+		_spareBuffers.push_back(std::vector<char>());
+		_spareBuffers.back().swap(front->second.data);
+	}
+
+	_frames.erase(front);
+}
+
+void JitterBuffer::dropFront()
+{
+	uint32_t frameNumber = _frames.begin()->first;
+
+	skipTo(frameNumber);
+	_statistics.framesIncomplete++;
+	_nextFrameNumber = frameNumber + 1;
+
+	removeFront();
+}
+
+void JitterBuffer::dropExpiredFrames(double nowSeconds)
+{
+	while (!_frames.empty()) {
+		const PendingFrame& front = _frames.begin()->second;
+
+		if (front.receivedBytes == (int)front.data.size() || nowSeconds < front.firstArrivalSeconds + _latencyTargetSeconds) {
+			return;
+		}
+
+		dropFront();
+	}
+}
+
+bool JitterBuffer::isFrameDue(double nowSeconds)
+{
+	dropExpiredFrames(nowSeconds);
+
+	if (_frames.empty()) {
+		return false;
+	}
+
+	FrameMap::const_iterator front = _frames.begin();
+
+	if (front->second.receivedBytes != (int)front->second.data.size()) {
+		return false;
+	}
+
+	// complete: due right away if it is next, else once it has waited long enough for the ones before
+	return front->first == _nextFrameNumber || nowSeconds >= front->second.firstArrivalSeconds + _latencyTargetSeconds;
+}
+
+bool JitterBuffer::pop(double nowSeconds, char* out, int capacity, int& size, unsigned int& frameNumber, long long& captureMicroseconds)
+{
+	while (isFrameDue(nowSeconds)) {
+		FrameMap::iterator front = _frames.begin();
+		const PendingFrame& pending = front->second;
+
+		if ((int)pending.data.size() > capacity) {
+			dropFront();
+			continue;
+		}
+
+		skipTo(front->first);
+
+		size = (int)pending.data.size();
+		frameNumber = front->first;
+		captureMicroseconds = pending.captureMicroseconds;
+		memcpy(out, &pending.data[0], size);
+
+		_statistics.framesDelivered++;
+		_nextFrameNumber = front->first + 1;
+
+		removeFront();
+		return true;
+	}
+
+	return false;
+}
+
+double JitterBuffer::nextDeadline() const
+{
+	if (_frames.empty()) {
+		return -1.0;
+	}
+
+	return _frames.begin()->second.firstArrivalSeconds + _latencyTargetSeconds;
+}
+
+JitterBufferStatistics JitterBuffer::getStatistics() const
+{
+	return _statistics;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+/*
+
+JitterBuffer puts video frames back together from datagrams that may arrive
+late, out of order, twice or not at all, and hands them out in order.
+
+Every datagram carries an RTP fixed header (RFC 3550) followed by a payload
+header saying where its piece goes in which frame, all big-endian:
+
+  RTP:     V=2 | marker, payload type | sequence | timestamp | SSRC
+  payload: frame number | offset of this piece | size of the whole frame
+
+The RTP sequence number counts datagrams and is only used for statistics
+(loss, reordering, duplicates); the RTP timestamp is the capture time on a
+90 kHz clock; the marker bit is set on the last piece of a frame. Frames are
+numbered one after the other, so a gap means a frame that never arrived.
+A new SSRC means the trainee started a new stream, and numbering starts over.
+
+A piece that overlaps ones already received (a retransmit split up another
+way) only adds the bytes that were still missing; one that adds nothing
+counts as a duplicate. So a frame is complete once every byte of it came,
+however the pieces were cut.
+
+A frame is handed out as soon as it is complete and every frame before it
+has been handed out or given up on. Nothing waits longer than the latency
+target, counted from the first piece of the frame that is waiting:
+
+- a complete frame waiting for earlier ones that are missing entirely
+  gives up on them once its time is up (they count as missing);
+- an incomplete frame at the front is dropped once its time is up (it
+  counts as incomplete), and the frames behind it move up.
+
+So a lost datagram costs (at most) its own frame and a wait of the latency
+target, instead of holding up every later frame like a lost TCP segment.
+Frames that are not handed out leave a gap in the frame numbers, which the
+caller can treat like any other lost frame (e.g. skip to the next keyframe).
+
+It does no I/O and never reads a clock: every time is passed in, so it can
+be fed datagrams with injected loss and reordering and checked directly.
+Not thread-safe.
+
+*/
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+struct JitterBufferStatistics
+{
+	// Datagrams accepted, and the ones the RTP sequence numbers say never came (or came late)
+	unsigned int datagramsReceived;
+	unsigned int datagramsLost;
+
+	// Datagrams that came after one with a later sequence number, or a second time
+	unsigned int datagramsReordered;
+	unsigned int datagramsDuplicated;
+
+	// Datagrams for frames already handed out or given up on
+	unsigned int datagramsLate;
+
+	// Datagrams that were not valid video datagrams
+	unsigned int datagramsInvalid;
+
+	unsigned int framesDelivered;
+
+	// Frames dropped because pieces were still missing at their deadline
+	unsigned int framesIncomplete;
+
+	// Frames of which nothing arrived in time
+	unsigned int framesMissing;
+
+	// RFC 3550 interarrival jitter
+	double jitterMilliseconds;
+};
+
+class JitterBuffer
+{
+public:
+	// What the two headers at the start of every datagram say
+	struct DatagramHeader
+	{
+		bool marker;
+		uint16_t sequence;
+		uint32_t rtpTimestamp;
+		uint32_t ssrc;
+
+		uint32_t frameNumber;
+		uint32_t offset;
+		uint32_t frameSize;
+	};
+
+	// RTP fixed header and payload header
+	static const int DATAGRAM_HEADER_SIZE = 24;
+
+	// Dynamic RTP payload type used for the video
+	static const int RTP_PAYLOAD_TYPE = 96;
+
+	// RTP timestamps of video count at 90 kHz
+	static const int RTP_CLOCK_RATE = 90000;
+
+	explicit JitterBuffer(double latencyTargetSeconds = 0.05);
+
+	// Forgets every frame and statistic, e.g. when a new trainee starts sending
+	void reset();
+
+	// Forgets the frames and numbering of the stream so far, keeping the statistics
+	// (done on its own when the SSRC changes)
+	void restart();
+
+	void setLatencyTarget(double latencyTargetSeconds);
+
+	// Reads the headers of a datagram. Returns false if it is not a video datagram,
+	// or is one of a frame bigger than MAX_PACKET_SIZE
+	static bool parseDatagramHeader(const char* datagram, int size, DatagramHeader& header);
+
+	// Splits a frame into datagrams of at most maxDatagramSize bytes, for a sender
+	// (or a test). nextSequence is the RTP sequence number to use next, and is advanced.
+	static void packetizeFrame(const char* frame, int frameSize, uint32_t frameNumber, long long captureMicroseconds,
+		uint32_t ssrc, int maxDatagramSize, uint16_t& nextSequence, std::vector<std::vector<char> >& datagrams);
+
+	// Takes in a datagram that arrived at arrivalSeconds
+	void insert(const char* datagram, int size, double arrivalSeconds);
+
+	// Whether pop() would hand out a frame at nowSeconds
+	bool isFrameDue(double nowSeconds);
+
+	// Hands out the next frame due at nowSeconds, copied into out (frames bigger than
+	// capacity are dropped as incomplete). Returns false if no frame is due yet.
+	bool pop(double nowSeconds, char* out, int capacity, int& size, unsigned int& frameNumber, long long& captureMicroseconds);
+
+	// When the frame at the front gives up waiting, or a negative time if nothing is waiting
+	double nextDeadline() const;
+
+	JitterBufferStatistics getStatistics() const;
+
+	// Frames waiting at once, beyond which the oldest is given up on whatever its deadline
+	static const int MAX_PENDING_FRAMES = 64;
+
+private:
+	// Bytes [first, second) of a frame
+	typedef std::pair<uint32_t, uint32_t> ByteRange;
+
+	struct PendingFrame
+	{
+		std::vector<char> data;
+		int receivedBytes;
+
+		// What the pieces received cover, in order, merged where they overlap or touch
+		std::vector<ByteRange> ranges;
+
+		long long captureMicroseconds;
+		double firstArrivalSeconds;
+	};
+
+	// Ordered by frame number (which would take years of video to wrap around)
+	typedef std::map<uint32_t, PendingFrame> FrameMap;
+
+	// Drops the frames at the front whose time is up without being complete
+	void dropExpiredFrames(double nowSeconds);
+
+	// Gives up on the frames before the given one, or drops the front frame
+	void skipTo(uint32_t frameNumber);
+	void dropFront();
+
+	// Removes the front frame, keeping its buffer for a later one
+	void removeFront();
+
+	// Adds a piece to the ranges a frame has received. Returns how many of its bytes are new
+	static uint32_t coverRange(std::vector<ByteRange>& ranges, uint32_t start, uint32_t end);
+
+	// Extends the 32-bit RTP timestamp, which wraps around every 13 hours, to microseconds.
+	// Only the differences are meaningful: the capture clock is known up to a constant
+	long long captureMicroseconds(uint32_t rtpTimestamp);
+
+	void recordSequence(uint16_t sequence);
+	void recordJitter(uint32_t rtpTimestamp, double arrivalSeconds);
+
+	double _latencyTargetSeconds;
+
+	FrameMap _frames;
+
+	// Stream being received, and the frame number to hand out next
+	bool _started;
+	uint32_t _ssrc;
+	uint32_t _nextFrameNumber;
+
+	// Buffers of frames handed out, reused for the next ones
+	std::vector<std::vector<char> > _spareBuffers;
+
+	// RTP sequence numbers (extended past 16 bits) for the loss statistics
+	bool _sequenceStarted;
+	int64_t _firstSequence;
+	int64_t _highestSequence;
+
+	// Datagrams received of the current stream, and lost in the ones before
+	unsigned int _streamDatagramsReceived;
+	unsigned int _earlierStreamsLost;
+
+	// RTP timestamp extension
+	bool _timestampStarted;
+	int64_t _extendedTimestamp;
+	uint32_t _lastTimestamp;
+
+	// Interarrival jitter state, in RTP timestamp units
+	bool _jitterStarted;
+	double _lastArrivalSeconds;
+	uint32_t _lastJitterTimestamp;
+	double _jitter;
+
+	JitterBufferStatistics _statistics;
+};
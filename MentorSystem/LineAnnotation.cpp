@@ -18,6 +18,7 @@
 
 //Include its header file
 #include "LineAnnotation.h"
+#include <math.h>//Enable the usage of math algorithms
 
 //--------------------------Definitions--------------------------//
 #define BIG_VALUE 10000
@@ -35,6 +36,16 @@ LineAnnotation::LineAnnotation(int Id)
 	selected_state = 0;
 
 	setInitialExtremes();
+
+	//The create message sends version 0, with no transform yet
+	geometry_version = -1;
+
+	geometry_transform[0] = 1.0;
+	geometry_transform[1] = 0.0;
+	geometry_transform[2] = 0.0;
+	geometry_transform[3] = 0.0;
+
+	startNewGeometry();
 }
 
 /*
@@ -115,4 +126,97 @@ void LineAnnotation::addPoint(long double x, long double y)
 vector<long double>* LineAnnotation::getPoints()
 {
 	return &myPoints;
+}
+
+/*
+ * Method Overview: Return the version of the geometry last sent whole
+ * Parameters: None
+ * Return: Geometry version (0 = the one of the create message)
+ */
+int LineAnnotation::getGeometryVersion()
+{
+	return geometry_version;
+}
+
+/*
+ * Method Overview: Gives the transform since the geometry of a version
+ * Parameters: Geometry version, array to store the scale, rotation (radians) and X-Y translation
+ * Return: False if the line has no such version
+ */
+bool LineAnnotation::getTransformSince(int version, long double transform[4])
+{
+	if(version < 0 || version > geometry_version)
+	{
+		return false;
+	}
+
+	long double* start = &version_transforms[4*version];
+
+	/*
+	 * The points of the version are start applied to the points of
+	 * version 0, so undoing start and then applying the transform
+	 * since version 0 leads from them to the points as they are now
+	 */
+	long double angle = geometry_transform[1] - start[1];
+	long double scale = geometry_transform[0]/start[0];
+
+	transform[0] = scale;
+	transform[1] = angle;
+	transform[2] = geometry_transform[2] - scale*(cos(angle)*start[2] - sin(angle)*start[3]);
+	transform[3] = geometry_transform[3] - scale*(sin(angle)*start[2] + cos(angle)*start[3]);
+
+	return true;
+}
+
+/*
+ * Method Overview: Adds a translation to the transform
+ * Parameters: X and Y translation amounts
+ * Return: None
+ */
+void LineAnnotation::addTranslation(long double transX, long double transY)
+{
+	geometry_transform[2] += transX;
+	geometry_transform[3] += transY;
+}
+
+/*
+ * Method Overview: Adds a zoom around a point to the transform
+ * Parameters: Zoom amount, point to zoom around
+ * Return: None
+ */
+void LineAnnotation::addZoom(long double scale, long double centerX, long double centerY)
+{
+	//The translation is zoomed like a point, the scale multiplies
+	geometry_transform[0] *= scale;
+	geometry_transform[2] = ((geometry_transform[2] - centerX)*scale) + centerX;
+	geometry_transform[3] = ((geometry_transform[3] - centerY)*scale) + centerY;
+}
+
+/*
+ * Method Overview: Adds a rotation around a point to the transform
+ * Parameters: Angle to rotate (radians), point to rotate around
+ * Return: None
+ */
+void LineAnnotation::addRotation(long double angle, long double centerX, long double centerY)
+{
+	//The translation is rotated like a point, the angles add up
+	long double transX = geometry_transform[2] - centerX;
+	long double transY = geometry_transform[3] - centerY;
+
+	geometry_transform[1] += angle;
+	geometry_transform[2] = (cos(angle)*transX - sin(angle)*transY) + centerX;
+	geometry_transform[3] = (sin(angle)*transX + cos(angle)*transY) + centerY;
+}
+
+/*
+ * Method Overview: Makes the current points the geometry of a new version
+ * Parameters: None
+ * Return: None
+ */
+void LineAnnotation::startNewGeometry()
+{
+	geometry_version++;
+
+	//Kept, so the clients still on an older version keep getting transforms for it
+	version_transforms.insert(version_transforms.end(), geometry_transform, geometry_transform + 4);
 }
\ No newline at end of file
@@ -40,6 +40,21 @@ public:
 
 	//Return the points of the line
 	vector<long double>* getPoints();
+
+	//Return the version of the geometry last sent whole to a client
+	int getGeometryVersion();
+
+	//Gives the transform from the geometry of a version to the points as they are now:
+	//[0] scale, [1] rotation (radians), [2] X and [3] Y translation. False if the line has no such version
+	bool getTransformSince(int version, long double transform[4]);
+
+	//Add a geometrical transformation to the transform
+	void addTranslation(long double transX, long double transY);
+	void addZoom(long double scale, long double centerX, long double centerY);
+	void addRotation(long double angle, long double centerX, long double centerY);
+
+	//The points as they are now become the geometry of a new version (the older ones stay valid)
+	void startNewGeometry();
 	
 	//------------------------Variables--------------------------//
 	//None
@@ -52,7 +67,14 @@ private:
 	//Points of the line annotation
 	vector<long double> myPoints;
 
-	//add own geom transf values
+	//Version of the geometry last sent whole (by the create, or a resync to a client that asked)
+	int geometry_version;
+
+	//Similarity transform from the geometry of version 0 to the points as they are now
+	long double geometry_transform[4];
+
+	//The transform as it was when each version started, four values per version
+	vector<long double> version_transforms;
 };
 
 #endif
\ No newline at end of file
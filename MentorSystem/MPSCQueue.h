@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+
+MPSCQueue is an unbounded, blocking, multi-producer/single-consumer queue.
+It carries the annotation messages from the threads that create them (the
+GLUT thread, touch and gesture handling) to the one thread that turns them
+into JSON and sends them.
+
+Unlike SPSCQueue, pop() sleeps while the queue is empty and push() wakes
+it, so the consumer takes no CPU while nothing happens. A mutex guards the
+queue; pushes come at touch rate, so it is rarely contended.
+
+Items are moved in and out rather than copied. Items the consumer is done
+with can be given back with recycle(), and acquire() hands them out again
+to be filled, so that whatever memory they own (a line's points, say)
+keeps its capacity instead of being allocated for every message. At most
+maxPooled items are kept for reuse.
+
+*/
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class MPSCQueue
+{
+public:
+	explicit MPSCQueue(size_t maxPooled)
+		: _maxPooled(maxPooled)
+	{
+	}
+
+	// Any thread. An item to fill and push: a recycled one if there is one, a new one otherwise.
+	// A recycled item still holds its old contents, so the caller sets every field
+	T acquire()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_pool.empty()) {
+			return T();
+		}
+
+		T item(std::move(_pool.back()));
+		_pool.pop_back();
+
+		return item;
+	}
+
+	// Any thread. Never blocks, other than for the lock
+	void push(T&& item)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_items.push_back(std::move(item));
+		}
+		_pushed.notify_one();
+	}
+
+	// Consumer thread only. Sleeps until there is an item
+	void pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		_pushed.wait(lock, [this]() { return !_items.empty(); });
+
+		item = std::move(_items.front());
+		_items.pop_front();
+	}
+
+	// Gives an item back once the consumer is done with it, for acquire() to hand out again
+	void recycle(T&& item)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_pool.size() < _maxPooled) {
+			_pool.push_back(std::move(item));
+		}
+	}
+
+	// Items waiting (a snapshot)
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _items.size();
+	}
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _pushed;
+
+	std::deque<T> _items;
+
+	std::vector<T> _pool;
+	size_t _maxPooled;
+
+	MPSCQueue(const MPSCQueue&);
+	MPSCQueue& operator=(const MPSCQueue&);
+};
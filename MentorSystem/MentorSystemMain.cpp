@@ -31,6 +31,13 @@
 #include <process.h>//Windows Threads
 #include "Config.h"
 #include "CameraManager.h"
+#include "YUVConverterBenchmark.h"//Frame conversion micro-benchmark
+#include "PipelineBenchmark.h"//Headless video pipeline benchmark
+#include "AnnotationWireBenchmark.h"//JSON and binary annotation messages compared
+#include "DatagramLoopbackCheck.h"//Video datagrams through loss and reordering, checked
+#include "CongestionTraceCheck.h"//Congestion estimates of an arrival trace, checked
+#include "CaptureRoundTripCheck.h"//Packet captures replayed as written, checked
+#include "StageTracer.h"//Per-thread stage timings for Chrome traces
 
 using namespace std;//Standard Libraries
 
@@ -39,7 +46,7 @@ CommandCenter* commander;
 CommunicationManager* communicationMan;
 GUIManager* GUIMan;
 TouchOverlayController touchMan;
-VideoManager* videoMan;
+VideoManager* videoMans[MAX_VIDEO_SESSIONS];//One per trainee session
 JSONManager* JsonMan;
 CameraManager* cameraMan;
 
@@ -55,9 +62,44 @@ void JSONLoop(void *);
  */
 int main(int argc, char *argv[]) 
 {
+	//Only measures the frame conversion, without starting the system
+	if (argc > 1 && strcmp(argv[1], "--benchmark-yuv") == 0) {
+		return runYUVConverterBenchmark();
+	}
+
+	//Runs the video pipeline stages on synthetic or captured video, without a window or network
+	if (argc > 1 && strcmp(argv[1], "--benchmark-pipeline") == 0) {
+		return runPipelineBenchmark(argc - 2, argv + 2);
+	}
+
+	//Encodes a recorded or synthetic session of annotation messages as JSON and as binary
+	if (argc > 1 && strcmp(argv[1], "--benchmark-annotations") == 0) {
+		return runAnnotationWireBenchmark(argc - 2, argv + 2);
+	}
+
+	//Sends packetized frames with loss and reordering through the jitter buffer and over loopback, and checks what comes out
+	if (argc > 1 && strcmp(argv[1], "--check-datagrams") == 0) {
+		return runDatagramLoopbackCheck(argc - 2, argv + 2);
+	}
+
+	//Feeds the congestion estimator a synthetic (or captured) trace of packet arrivals, and checks its estimates
+	if (argc > 1 && strcmp(argv[1], "--check-congestion") == 0) {
+		return runCongestionTraceCheck(argc - 2, argv + 2);
+	}
+
+	//Writes a synthetic packet capture, replays it, and checks the packets and their timing against what was written
+	if (argc > 1 && strcmp(argv[1], "--check-capture") == 0) {
+		return runCaptureRoundTripCheck(argc - 2, argv + 2);
+	}
+
 	int resolutionX = SERVER_RESOLUTION_X;
 	int resolutionY = SERVER_RESOLUTION_Y;
 
+	//Stage timings are recorded from the start, and dumped on request
+	StageTracer::setEnabled(STAGE_TRACING_ENABLED);
+	StageTracer::installDumpSignal();
+	StageTracer::setThreadName("GLUT");
+
 	//init the CommandCenter
 	commander = new CommandCenter();
 
@@ -86,15 +128,17 @@ int main(int argc, char *argv[])
 	//JSONManager Thread Init
 	_beginthread( JSONLoop, 0, (void*)12);
 
-	//VideoManager Init
-	videoMan = new VideoManager(communicationMan,commander,GUIMan, cameraMan);
+	//VideoManagers Init and Threads Init, one per trainee watched at once
+	for(int session = 0; session < communicationMan->getSessionCount(); session++)
+	{
+		videoMans[session] = new VideoManager(communicationMan,commander,GUIMan, cameraMan, session);
 
-	//VideoManager Thread Init
-	_beginthread( videoLoop, 0, (void*)12);
+		_beginthread( videoLoop, 0, (void*)(intptr_t)session);
+	}
 
 	//AnnotationsManager Init
 	//TODO: Replace dims with .txt config file
-	initWindow(argc, argv, resolutionX, resolutionY,commander,JsonMan, cameraMan);
+	initWindow(argc, argv, resolutionX, resolutionY,commander,JsonMan, cameraMan, communicationMan);
 	
 	return 0;
 }
@@ -111,22 +155,32 @@ int main(int argc, char *argv[])
  */
 void communicationLoop(void * arg)
 {	
-	while(1) 
-    {
-		//update to accept new clients
-		communicationMan->update();
-    }
+	StageTracer::setThreadName("communication");
+
+	//accepts new clients and watches their sockets, sleeping in between
+	communicationMan->run();
 }
 
 /*
  * Method Overview: Inits the OpenCV video capture infinite loop
- * Parameters: Void array
+ * Parameters: Trainee session, as the void pointer
  * Return: None
  */
 void videoLoop(void * arg) 
 { 
+	int session = (int)(intptr_t)arg;
+
+	if(communicationMan->getSessionCount() > 1)
+	{
+		StageTracer::setThreadName(("video loop (trainee " + std::to_string(session + 1) + ")").c_str());
+	}
+	else
+	{
+		StageTracer::setThreadName("video loop");
+	}
+
 	//Init the video managing process
-	videoMan->initWindow();
+	videoMans[session]->initWindow();
 }
 
 /*
@@ -136,6 +190,8 @@ void videoLoop(void * arg)
  */
 void JSONLoop(void * arg) 
 { 
+	StageTracer::setThreadName("JSON");
+
 	//Start the process
 	JsonMan->constructGeneralJSON();
 }
\ No newline at end of file
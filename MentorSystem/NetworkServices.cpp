@@ -37,4 +37,45 @@ int NetworkServices::sendMessage(SOCKET curSocket, const char* message, int mess
 int NetworkServices::receiveMessage(SOCKET curSocket, char* buffer, int bufSize)
 {
     return recv(curSocket, buffer, bufSize, 0);
+}
+
+/*
+ * Method Overview: Receives a message into two buffers through a specified socket
+ * Parameters: Socket to recieve from, buffers and sizes to store at (the second one may be empty)
+ * Return: the number of bytes received (0 once the connection was closed), SOCKET_ERROR on error
+ */
+int NetworkServices::receiveScattered(SOCKET curSocket, char* first, int firstSize, char* second, int secondSize)
+{
+    WSABUF buffers[2];
+    buffers[0].buf = first;
+    buffers[0].len = (u_long)firstSize;
+    buffers[1].buf = second;
+    buffers[1].len = (u_long)secondSize;
+
+    DWORD numBytes = 0;
+    DWORD flags = 0;
+
+    if (WSARecv(curSocket, buffers, secondSize > 0 ? 2 : 1, &numBytes, &flags, NULL, NULL) == SOCKET_ERROR)
+    {
+        return SOCKET_ERROR;
+    }
+
+    return (int)numBytes;
+}
+
+/*
+ * Method Overview: Asks the socket how much data is already queued
+ * Parameters: Socket to ask
+ * Return: the number of bytes that can be read without blocking
+ */
+int NetworkServices::bytesAvailable(SOCKET curSocket)
+{
+    u_long numBytes = 0;
+
+    if (ioctlsocket(curSocket, FIONREAD, &numBytes) == SOCKET_ERROR)
+    {
+        return 0;
+    }
+
+    return (int)numBytes;
 }
\ No newline at end of file
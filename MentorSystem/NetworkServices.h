@@ -35,6 +35,12 @@ public:
 	//Receive message
 	static int receiveMessage(SOCKET curSocket, char* buffer, int bufSize);
 
+	//Receive message into two buffers in one call, the second one once the first is full
+	static int receiveScattered(SOCKET curSocket, char* first, int firstSize, char* second, int secondSize);
+
+	//Number of bytes that can be read without blocking
+	static int bytesAvailable(SOCKET curSocket);
+
 	//------------------------Variables--------------------------//
 	//None
 };
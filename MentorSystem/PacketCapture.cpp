@@ -0,0 +1,197 @@
+#include "PacketCapture.h"
+#include <iostream>
+#include <cstring>
+#include "communicationDefinitions.h"
+
+const char* PacketCaptureReader::MAGIC = "MSPC";
+
+static void writeLittleEndian32(unsigned char* bytes, unsigned int value)
+{
+	bytes[0] = (unsigned char)value;
+	bytes[1] = (unsigned char)(value >> 8);
+	bytes[2] = (unsigned char)(value >> 16);
+	bytes[3] = (unsigned char)(value >> 24);
+}
+
+static void writeLittleEndian64(unsigned char* bytes, long long value)
+{
+	writeLittleEndian32(bytes, (unsigned int)value);
+	writeLittleEndian32(bytes + 4, (unsigned int)((unsigned long long)value >> 32));
+}
+
+static unsigned int readLittleEndian32(const unsigned char* bytes)
+{
+	return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+static long long readLittleEndian64(const unsigned char* bytes)
+{
+	return (long long)(((unsigned long long)readLittleEndian32(bytes + 4) << 32) | readLittleEndian32(bytes));
+}
+
+PacketCaptureWriter::PacketCaptureWriter()
+	: _file(NULL)
+{
+}
+
+PacketCaptureWriter::~PacketCaptureWriter()
+{
+	close();
+}
+
+bool PacketCaptureWriter::open(const std::string& path, const VideoStreamHeader& header)
+{
+	close();
+
+	std::vector<char> streamHeader;
+	if (!VideoDecoder::writeStreamHeader(header, streamHeader)) {
+		std::cout << "error: cannot capture a stream of codec " << avcodec_get_name(header.codecId) << std::endl;
+		return false;
+	}
+
+	_file = fopen(path.c_str(), "wb");
+	if (_file == NULL) {
+		std::cout << "error: cannot create the packet capture " << path << std::endl;
+		return false;
+	}
+
+	unsigned char version[4];
+	writeLittleEndian32(version, PacketCaptureReader::VERSION);
+
+	if (fwrite(PacketCaptureReader::MAGIC, 1, 4, _file) != 4
+		|| fwrite(version, 1, 4, _file) != 4
+		|| fwrite(&streamHeader[0], 1, streamHeader.size(), _file) != streamHeader.size()) {
+		std::cout << "error: cannot write to the packet capture " << path << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool PacketCaptureWriter::write(const CapturedPacketInfo& info, const char* data)
+{
+	if (_file == NULL) {
+		return false;
+	}
+
+	unsigned char record[PacketCaptureReader::RECORD_HEADER_SIZE];
+	writeLittleEndian64(record, info.arrivalMicroseconds);
+	writeLittleEndian64(record + 8, info.captureMicroseconds);
+	writeLittleEndian32(record + 16, info.sequence);
+	writeLittleEndian32(record + 20, info.keyframe ? 1 : 0);
+	writeLittleEndian32(record + 24, (unsigned int)info.size);
+
+	return fwrite(record, 1, sizeof(record), _file) == sizeof(record)
+		&& fwrite(data, 1, info.size, _file) == (size_t)info.size;
+}
+
+void PacketCaptureWriter::close()
+{
+	if (_file != NULL) {
+		fclose(_file);
+		_file = NULL;
+	}
+}
+
+PacketCaptureReader::PacketCaptureReader()
+	: _file(NULL)
+	, _firstRecordOffset(0)
+{
+}
+
+PacketCaptureReader::~PacketCaptureReader()
+{
+	close();
+}
+
+bool PacketCaptureReader::open(const std::string& path, VideoStreamHeader& header)
+{
+	close();
+
+	_file = fopen(path.c_str(), "rb");
+	if (_file == NULL) {
+		std::cout << "error: cannot open the packet capture " << path << std::endl;
+		return false;
+	}
+
+	unsigned char start[8];
+	char streamHeader[VIDEO_STREAM_HEADER_SIZE];
+	int extradataSize = 0;
+
+	if (fread(start, 1, sizeof(start), _file) != sizeof(start) || memcmp(start, MAGIC, 4) != 0) {
+		std::cout << "error: " << path << " is not a packet capture" << std::endl;
+		close();
+		return false;
+	}
+
+	if (readLittleEndian32(start + 4) != VERSION) {
+		std::cout << "error: " << path << " is a packet capture of unknown version " << readLittleEndian32(start + 4) << std::endl;
+		close();
+		return false;
+	}
+
+	if (fread(streamHeader, 1, sizeof(streamHeader), _file) != sizeof(streamHeader)
+		|| !VideoDecoder::parseStreamHeader(streamHeader, sizeof(streamHeader), header, extradataSize)) {
+		std::cout << "error: the packet capture " << path << " has no valid stream header" << std::endl;
+		close();
+		return false;
+	}
+
+	header.extradata.resize(extradataSize);
+	if (extradataSize > 0 && fread(&header.extradata[0], 1, extradataSize, _file) != (size_t)extradataSize) {
+		std::cout << "error: the packet capture " << path << " ends in its stream header" << std::endl;
+		close();
+		return false;
+	}
+
+	_firstRecordOffset = ftell(_file);
+
+	return true;
+}
+
+bool PacketCaptureReader::readInfo(CapturedPacketInfo& info)
+{
+	unsigned char record[RECORD_HEADER_SIZE];
+
+	if (_file == NULL || fread(record, 1, sizeof(record), _file) != sizeof(record)) {
+		return false;
+	}
+
+	info.arrivalMicroseconds = readLittleEndian64(record);
+	info.captureMicroseconds = readLittleEndian64(record + 8);
+	info.sequence = readLittleEndian32(record + 16);
+	info.keyframe = (readLittleEndian32(record + 20) & 1) != 0;
+	info.size = (int)readLittleEndian32(record + 24);
+
+	// a record cut short or garbled is where the capture ends
+	return info.size > 0 && info.size <= MAX_PACKET_SIZE;
+}
+
+bool PacketCaptureReader::readPacket(const CapturedPacketInfo& info, char* out)
+{
+	if (_file == NULL) {
+		return false;
+	}
+
+	if (out == NULL) {
+		return fseek(_file, info.size, SEEK_CUR) == 0;
+	}
+
+	return fread(out, 1, info.size, _file) == (size_t)info.size;
+}
+
+void PacketCaptureReader::rewind()
+{
+	if (_file != NULL) {
+		fseek(_file, _firstRecordOffset, SEEK_SET);
+	}
+}
+
+void PacketCaptureReader::close()
+{
+	if (_file != NULL) {
+		fclose(_file);
+		_file = NULL;
+	}
+}
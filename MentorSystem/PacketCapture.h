@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+
+A packet capture keeps the video stream exactly as the receive stage got
+it: the stream header, then every packet with the time it arrived. Played
+back by PacketReplaySource, it feeds the pipeline the same input again, to
+reproduce a problem seen in the field or to measure decode and composite
+throughput offline.
+
+On disk (all integers little-endian, like the stream itself):
+
+  "MSPC" | version | stream header as sent by the trainee ("MSVH" ..., with extradata)
+
+followed by one record per packet:
+
+  arrival time | capture time | sequence | flags | size | packet
+
+- arrival time: 64-bit microseconds on the mentor's clock, when the receive
+  stage read the packet (only differences between packets matter);
+- capture time: 64-bit microseconds on the trainee's clock, -1 if unknown;
+- sequence: frame header (or datagram) frame number, 0 if unknown;
+- flags: bit 0 set for keyframes.
+
+Both classes do plain blocking file I/O; the receive stage writes captures
+through VideoRecorder, which keeps the disk off its thread.
+
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "VideoDecoder.h"
+
+// What a capture says about a packet, besides its bytes
+struct CapturedPacketInfo
+{
+	long long arrivalMicroseconds;
+	long long captureMicroseconds;
+	unsigned int sequence;
+	bool keyframe;
+	int size;
+};
+
+class PacketCaptureWriter
+{
+public:
+	PacketCaptureWriter();
+	~PacketCaptureWriter();
+
+	// Creates the file and writes the stream header. Returns false (after saying why) if it cannot
+	bool open(const std::string& path, const VideoStreamHeader& header);
+
+	bool write(const CapturedPacketInfo& info, const char* data);
+
+	void close();
+
+private:
+	FILE* _file;
+};
+
+class PacketCaptureReader
+{
+public:
+	PacketCaptureReader();
+	~PacketCaptureReader();
+
+	// Opens a capture and reads its stream header. Returns false (after saying why) if it cannot
+	bool open(const std::string& path, VideoStreamHeader& header);
+
+	// Reads what the next record says about its packet. Returns false at the end of the capture
+	bool readInfo(CapturedPacketInfo& info);
+
+	// Reads the packet of the record whose info was just read, or skips it if out is NULL
+	bool readPacket(const CapturedPacketInfo& info, char* out);
+
+	// Goes back to the first record
+	void rewind();
+
+	void close();
+
+	static const char* MAGIC;
+	static const int VERSION = 1;
+
+	// Size of a record before its packet
+	static const int RECORD_HEADER_SIZE = 28;
+
+private:
+	FILE* _file;
+
+	// Where the first record starts
+	long _firstRecordOffset;
+};
@@ -0,0 +1,153 @@
+#include "PacketReplaySource.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+PacketReplaySource::PacketReplaySource()
+	: _open(false)
+	, _speed(1.0)
+	, _loop(false)
+	, _hasNext(false)
+	, _timingStarted(false)
+	, _startSeconds(0.0)
+	, _firstArrivalMicroseconds(0)
+	, _replayedPackets(0)
+{
+}
+
+bool PacketReplaySource::open(const std::string& path, double speed, bool loop, VideoStreamHeader& header)
+{
+	close();
+
+	if (!_reader.open(path, header)) {
+		return false;
+	}
+
+	_open = true;
+	_speed = speed;
+	_loop = loop;
+	_timingStarted = false;
+	_replayedPackets = 0;
+
+	_hasNext = _reader.readInfo(_next);
+	if (!_hasNext) {
+		std::cout << "error: the packet capture " << path << " holds no packets" << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void PacketReplaySource::close()
+{
+	_reader.close();
+	_open = false;
+	_hasNext = false;
+}
+
+bool PacketReplaySource::isOpen() const
+{
+	return _open;
+}
+
+double PacketReplaySource::nowSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PacketReplaySource::readNextInfo()
+{
+	_hasNext = _reader.readInfo(_next);
+
+	if (!_hasNext && _loop) {
+		_reader.rewind();
+		_hasNext = _reader.readInfo(_next);
+
+		// the next pass starts from now, not from where the last one would have been
+		_timingStarted = false;
+	}
+
+	if (!_hasNext) {
+		std::cout << "packet capture replayed to the end: " << _replayedPackets << " packets" << std::endl;
+	}
+}
+
+double PacketReplaySource::nextDueSeconds()
+{
+	if (!_timingStarted) {
+		_startSeconds = nowSeconds();
+		_firstArrivalMicroseconds = _next.arrivalMicroseconds;
+		_timingStarted = true;
+	}
+
+	if (_speed <= 0.0) {
+		return _startSeconds;
+	}
+
+	return _startSeconds + (_next.arrivalMicroseconds - _firstArrivalMicroseconds) / 1000000.0 / _speed;
+}
+
+bool PacketReplaySource::nextPacket(char* out, int capacity, CapturedPacketInfo& info, int maxWaitMilliseconds)
+{
+	double giveUpSeconds = nowSeconds() + maxWaitMilliseconds / 1000.0;
+
+	while (_hasNext)
+	{
+		double dueSeconds = nextDueSeconds();
+		double now = nowSeconds();
+
+		if (dueSeconds <= now) {
+			info = _next;
+
+			bool fits = info.size <= capacity;
+			bool read = _reader.readPacket(info, fits ? out : NULL);
+
+			if (!fits) {
+				std::cout << "error: captured packet of " << info.size << " bytes does not fit in a packet buffer, skipping it" << std::endl;
+			}
+
+			// a packet cut short is where the capture ends
+			if (!read) {
+				_hasNext = false;
+				std::cout << "packet capture replayed to the end: " << _replayedPackets << " packets" << std::endl;
+				return false;
+			}
+
+			if (fits) {
+				_replayedPackets++;
+			}
+
+			readNextInfo();
+
+			if (fits) {
+				return true;
+			}
+			continue;
+		}
+
+		if (now >= giveUpSeconds) {
+			return false;
+		}
+
+		double sleepSeconds = (dueSeconds < giveUpSeconds ? dueSeconds : giveUpSeconds) - now;
+		std::this_thread::sleep_for(std::chrono::microseconds((long long)(sleepSeconds * 1000000.0)));
+	}
+
+	return false;
+}
+
+bool PacketReplaySource::isPacketDue()
+{
+	return _hasNext && nextDueSeconds() <= nowSeconds();
+}
+
+bool PacketReplaySource::hasEnded() const
+{
+	return _open && !_hasNext;
+}
+
+unsigned int PacketReplaySource::getReplayedPacketCount() const
+{
+	return _replayedPackets;
+}
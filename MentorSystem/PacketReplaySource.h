@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+
+PacketReplaySource plays a packet capture (see PacketCapture.h) back into
+the receive stage in place of the video connection, so the pipeline gets
+the same input every time.
+
+Packets are handed out at the times they arrived when captured, scaled by
+the speed: 1 replays in real time, 2 twice as fast, and 0 as fast as the
+pipeline takes them, e.g. to measure decode throughput. Timing starts with
+the first packet asked for. A packet that is due but not asked for yet
+counts as waiting, like data piling up in the socket, so low-latency mode
+drops stale frames during a replay just as it would live.
+
+Everything runs on the receive stage thread, except the packet count.
+
+*/
+
+#include <atomic>
+#include <string>
+#include "PacketCapture.h"
+
+class PacketReplaySource
+{
+public:
+	PacketReplaySource();
+
+	// Opens a capture and reads its stream header. loop starts the capture over at its end.
+	// Returns false (after saying why) if it cannot be replayed
+	bool open(const std::string& path, double speed, bool loop, VideoStreamHeader& header);
+
+	void close();
+
+	bool isOpen() const;
+
+	// Waits, at most maxWaitMilliseconds, until the next packet is due and reads it into out
+	// (packets bigger than capacity are skipped). Returns false if none came in that time
+	bool nextPacket(char* out, int capacity, CapturedPacketInfo& info, int maxWaitMilliseconds);
+
+	// Whether the next packet is due already
+	bool isPacketDue();
+
+	// Whether the whole capture has been handed out (never, when looping)
+	bool hasEnded() const;
+
+	// Packets handed out so far; safe to call from any thread
+	unsigned int getReplayedPacketCount() const;
+
+private:
+	// Reads the info of the packet after the one handed out, starting over at the end if looping
+	void readNextInfo();
+
+	// When the next packet is due, on the steady clock
+	double nextDueSeconds();
+
+	static double nowSeconds();
+
+	PacketCaptureReader _reader;
+	bool _open;
+
+	double _speed;
+	bool _loop;
+
+	// The packet to hand out next, if there is one
+	bool _hasNext;
+	CapturedPacketInfo _next;
+
+	// When the first packet (of this pass through the capture) was handed out, and when it had arrived
+	bool _timingStarted;
+	double _startSeconds;
+	long long _firstArrivalMicroseconds;
+
+	std::atomic<unsigned int> _replayedPackets;
+};
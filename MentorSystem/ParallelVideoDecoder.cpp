@@ -0,0 +1,153 @@
+#include "ParallelVideoDecoder.h"
+
+#include <iostream>
+#include <chrono>
+#include "StageTracer.h"
+
+ParallelVideoDecoder::ParallelVideoDecoder()
+	: _maxJobsPerDecoder(0)
+	, _nextSubmit(0)
+	, _nextCollect(0)
+	, _totalInFlight(0)
+	, _running(false)
+{
+}
+
+ParallelVideoDecoder::~ParallelVideoDecoder()
+{
+	stop();
+}
+
+void ParallelVideoDecoder::start(int numDecoders, int frameWidth, int frameHeight, int maxJobsPerDecoder, DecoderOutputFormat outputFormat)
+{
+	stop();
+
+	_maxJobsPerDecoder = maxJobsPerDecoder;
+	_nextSubmit = 0;
+	_nextCollect = 0;
+	_totalInFlight = 0;
+
+	// the parallelism comes from running several decoders, so each one stays single-threaded
+	DecoderThreadingConfig singleThreaded;
+	singleThreaded.threadCount = 1;
+
+	for (int i = 0; i < numDecoders; i++) {
+		Worker* worker = new Worker(maxJobsPerDecoder);
+		worker->decoder.setOutputFormat(outputFormat);
+
+		if (!worker->decoder.initDecoder(frameWidth, frameHeight, singleThreaded)) {
+			std::cout << "could not start the parallel decoders" << std::endl;
+			delete worker;
+
+			// none of the threads has started yet
+			for (int j = 0; j < (int)_workers.size(); j++) {
+				_workers[j]->decoder.destroyDecoder();
+				delete _workers[j];
+			}
+			_workers.clear();
+			return;
+		}
+
+		_workers.push_back(worker);
+	}
+
+	_running = true;
+
+	for (int i = 0; i < (int)_workers.size(); i++) {
+		_workers[i]->thread = std::thread(&ParallelVideoDecoder::workerLoop, this, _workers[i]);
+	}
+
+	std::cout << "started " << numDecoders << " parallel decoders" << std::endl;
+}
+
+void ParallelVideoDecoder::stop()
+{
+	if (_workers.empty()) {
+		return;
+	}
+
+	_running = false;
+
+	for (int i = 0; i < (int)_workers.size(); i++) {
+		_workers[i]->thread.join();
+		_workers[i]->decoder.destroyDecoder();
+		delete _workers[i];
+	}
+
+	_workers.clear();
+	_totalInFlight = 0;
+}
+
+int ParallelVideoDecoder::numDecoders() const
+{
+	return (int)_workers.size();
+}
+
+int ParallelVideoDecoder::numInFlight() const
+{
+	return _totalInFlight;
+}
+
+bool ParallelVideoDecoder::submit(const Job& job)
+{
+	if (_workers.empty()) {
+		return false;
+	}
+
+	Worker* worker = _workers[_nextSubmit];
+
+	// bounding the jobs in flight also guarantees the worker never finds its result queue full
+	if (worker->inFlight == _maxJobsPerDecoder || !worker->jobs.push(job)) {
+		return false;
+	}
+
+	worker->inFlight++;
+	_totalInFlight++;
+	_nextSubmit = (_nextSubmit + 1) % (int)_workers.size();
+
+	return true;
+}
+
+bool ParallelVideoDecoder::collect(Result& result)
+{
+	if (_totalInFlight == 0) {
+		return false;
+	}
+
+	Worker* worker = _workers[_nextCollect];
+
+	if (!worker->results.pop(result)) {
+		return false;
+	}
+
+	worker->inFlight--;
+	_totalInFlight--;
+	_nextCollect = (_nextCollect + 1) % (int)_workers.size();
+
+	return true;
+}
+
+void ParallelVideoDecoder::workerLoop(Worker* worker)
+{
+	Job job;
+
+	StageTracer::setThreadName("video decode worker");
+
+	while (_running) {
+		if (!worker->jobs.pop(job)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		TRACE_ZONE("decode");
+
+		Result result;
+		result.job = job;
+		worker->decoder.prepareOutput(job.out, job.storage);
+		result.gotFrame = worker->decoder.decode(job.data, job.size, job.out);
+		result.fullRange = worker->decoder.isLastFrameFullRange();
+		result.decodeMilliseconds = worker->decoder.getLastDecodeMilliseconds();
+
+		worker->results.push(result);
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+
+ParallelVideoDecoder runs several VideoDecoders side by side, each on its
+own worker thread, for streams where every packet decodes on its own
+(MJPEG). ffmpeg's MJPEG decoder has no frame threading of its own, so this
+is how decoding of such a stream scales past one core.
+
+Packets are handed to the workers round-robin with submit(), and results
+are taken back with collect() in the same round-robin order, so frames
+come out in the order they went in even if a later one finishes first.
+
+submit() and collect() must be called from the same single thread (the
+decode stage); every worker is linked to it by a pair of SPSCQueues. The
+worker sizes the output Mat of a job for its decoder's current resolution,
+as a view into the job's storage (see VideoDecoder::prepareOutput).
+
+*/
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include "VideoDecoder.h"
+#include "SPSCQueue.h"
+
+class ParallelVideoDecoder
+{
+public:
+	// A packet to decode and the frame to decode it into. The handles are
+	// not used here; they let the caller match results to its buffers.
+	struct Job
+	{
+		char* data;
+		int size;
+		cv::Mat* out;
+		cv::Mat* storage;
+		int packetHandle;
+		int frameHandle;
+	};
+
+	struct Result
+	{
+		Job job;
+		bool gotFrame;
+		bool fullRange;
+		double decodeMilliseconds;
+	};
+
+	ParallelVideoDecoder();
+	~ParallelVideoDecoder();
+
+	// Starts numDecoders workers, each allowed maxJobsPerDecoder jobs in flight
+	// (none if a decoder cannot be set up, which leaves numDecoders() at 0)
+	void start(int numDecoders, int frameWidth, int frameHeight, int maxJobsPerDecoder, DecoderOutputFormat outputFormat = DECODER_OUTPUT_RGB24);
+
+	// Stops the workers; jobs that were still in flight are abandoned
+	void stop();
+
+	int numDecoders() const;
+
+	// Number of jobs submitted but not collected yet
+	int numInFlight() const;
+
+	// Gives a job to the next worker in turn.
+	// Returns false (and keeps the turn) if that worker has no room.
+	bool submit(const Job& job);
+
+	// Takes back the oldest job if it has been decoded.
+	// Returns false if there is nothing in flight or it is not done yet.
+	bool collect(Result& result);
+
+private:
+	struct Worker
+	{
+		explicit Worker(int maxJobs)
+			: jobs(maxJobs)
+			, results(maxJobs)
+			, inFlight(0)
+		{
+		}
+
+		VideoDecoder decoder;
+		SPSCQueue<Job> jobs;
+		SPSCQueue<Result> results;
+		std::thread thread;
+
+		// Only touched by the submitting thread
+		int inFlight;
+	};
+
+	void workerLoop(Worker* worker);
+
+	std::vector<Worker*> _workers;
+
+	int _maxJobsPerDecoder;
+	int _nextSubmit;
+	int _nextCollect;
+	int _totalInFlight;
+
+	std::atomic<bool> _running;
+
+	ParallelVideoDecoder(const ParallelVideoDecoder&);
+	ParallelVideoDecoder& operator=(const ParallelVideoDecoder&);
+};
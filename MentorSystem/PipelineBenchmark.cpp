@@ -0,0 +1,294 @@
+#include "PipelineBenchmark.h"
+#include "CheckCommandLine.h"
+#include "PacketCapture.h"
+#include "VideoDecoder.h"
+#include "GUIManager.h"
+#include "Config.h"
+#include "json.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+	const int WARMUP_FRAMES = 10;
+
+	// Distinct synthetic frames, cycled through; enough that the decoder cannot just see the same one
+	const int SYNTHETIC_FRAMES = 30;
+	const int SYNTHETIC_JPEG_QUALITY = 80;
+
+	// Annotations the benchmark places, one of each in turn
+	const int ANNOTATION_CODES[] = { BVM_CODE, ETTUBE_CODE, HEMOSTAT_CODE, IODINE_SWAB_CODE, LONGHOOK_CODE,
+		RETRACTOR_CODE, SCALPEL_CODE, SCISSORS_CODE, STETHOSCOPE_CODE, SURGICAL_TAPE_CODE };
+
+	enum Stage { STAGE_DECODE, STAGE_FLIP_RESIZE, STAGE_SPRITES, STAGE_WARP, STAGE_GUI, STAGE_TOTAL, NUM_STAGES };
+
+	const char* STAGE_NAMES[NUM_STAGES] = { "decode", "flip_resize", "sprite_annotations", "warp", "gui", "total" };
+
+	struct BenchmarkOptions
+	{
+		std::string input;
+		int width;
+		int height;
+		int frames;
+		int annotations;
+		double zoom;
+		double rotationDegrees;
+	};
+
+	// Gradients, a moving disc and noise, so the JPEGs are neither trivial nor all alike
+	void makeSyntheticPackets(int width, int height, std::vector<std::vector<char> >& packets)
+	{
+		cv::RNG rng(12345);
+		cv::Mat frame(height, width, CV_8UC3);
+
+		std::vector<int> jpegParameters;
+		jpegParameters.push_back(cv::IMWRITE_JPEG_QUALITY);
+		jpegParameters.push_back(SYNTHETIC_JPEG_QUALITY);
+
+		for (int f = 0; f < SYNTHETIC_FRAMES; f++) {
+			for (int y = 0; y < height; y++) {
+				cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+				for (int x = 0; x < width; x++) {
+					row[x] = cv::Vec3b((uchar)((x * 255 / width + f * 4) & 0xFF), (uchar)(y * 255 / height), (uchar)(96 + rng.uniform(0, 32)));
+				}
+			}
+
+			cv::Point centre((int)(width * (0.5 + 0.3 * cos(f * 2 * CV_PI / SYNTHETIC_FRAMES))), height / 2);
+			cv::circle(frame, centre, height / 6, cv::Scalar(40, 40, 200), -1);
+
+			std::vector<uchar> jpeg;
+			cv::imencode(".jpg", frame, jpeg, jpegParameters);
+
+			packets.push_back(std::vector<char>(jpeg.begin(), jpeg.end()));
+		}
+	}
+
+	bool readCapturedPackets(const std::string& path, VideoStreamHeader& header, std::vector<std::vector<char> >& packets)
+	{
+		PacketCaptureReader reader;
+		if (!reader.open(path, header)) {
+			return false;
+		}
+
+		CapturedPacketInfo info;
+		while (reader.readInfo(info)) {
+			std::vector<char> packet(info.size);
+			if (!reader.readPacket(info, &packet[0])) {
+				break;
+			}
+			packets.push_back(packet);
+		}
+
+		if (packets.empty()) {
+			std::cout << "error: the packet capture " << path << " holds no packets" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	double millisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+	{
+		std::chrono::duration<double, std::milli> elapsed = end - start;
+		return elapsed.count();
+	}
+
+	// Nearest-rank percentile of sorted samples
+	double percentile(const std::vector<double>& sorted, double percent)
+	{
+		size_t rank = (size_t)ceil(percent / 100.0 * sorted.size());
+		return sorted[rank > 0 ? rank - 1 : 0];
+	}
+
+}
+
+int runPipelineBenchmark(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	options.width = 1280;
+	options.height = 720;
+	options.frames = 300;
+	options.annotations = 5;
+	options.zoom = 1.0;
+	options.rotationDegrees = 0.0;
+
+	CheckCommandLine commandLine("--benchmark-pipeline");
+	commandLine.add("--input", "capture", options.input);
+	commandLine.add("--width", "pixels", options.width);
+	commandLine.add("--height", "pixels", options.height);
+	commandLine.add("--frames", "count", options.frames);
+	commandLine.add("--annotations", "count", options.annotations);
+	commandLine.add("--zoom", "factor", options.zoom);
+	commandLine.add("--rotation", "degrees", options.rotationDegrees);
+
+	if (!commandLine.parse(argc, argv)) {
+		return 1;
+	}
+
+	// MJPEG is 4:2:0 here, so the synthetic size has to be even
+	if (options.width < 16 || options.height < 16 || (options.width | options.height) & 1
+		|| options.frames <= 0 || options.annotations < 0 || options.zoom <= 0.0) {
+		std::cout << "error: sizes must be even and at least 16, frames and zoom positive, annotations not negative" << std::endl;
+		commandLine.printUsage();
+		return 1;
+	}
+
+	int screenWidth = SERVER_RESOLUTION_X;
+	int screenHeight = SERVER_RESOLUTION_Y;
+
+	VideoStreamHeader header;
+	std::vector<std::vector<char> > packets;
+
+	if (options.input.empty()) {
+		header.codecId = AV_CODEC_ID_MJPEG;
+		header.width = options.width;
+		header.height = options.height;
+		makeSyntheticPackets(options.width, options.height, packets);
+	}
+	else if (!readCapturedPackets(options.input, header, packets)) {
+		return 1;
+	}
+
+	DecoderThreadingConfig threading;
+	threading.threadCount = VIDEO_DECODER_THREAD_COUNT;
+	threading.threadType = (VIDEO_DECODER_FRAME_THREADS ? FF_THREAD_FRAME : 0) | (VIDEO_DECODER_SLICE_THREADS ? FF_THREAD_SLICE : 0);
+
+	VideoDecoder decoder;
+	if (!decoder.initDecoder(header, threading)) {
+		std::cout << "error: cannot decode the " << avcodec_get_name(header.codecId) << " stream" << std::endl;
+		return 1;
+	}
+
+	// The GUI as the mentor starts it, with the annotations spread over the screen
+	CommandCenter commander;
+	JSONManager json(NULL, &commander);
+	GUIManager gui(screenWidth, screenHeight, &commander, &json);
+
+	int numCodes = sizeof(ANNOTATION_CODES) / sizeof(ANNOTATION_CODES[0]);
+	int columns = (int)ceil(sqrt((double)options.annotations));
+	for (int i = 0; i < options.annotations; i++) {
+		long double x = screenWidth * ((i % columns) + 0.5) / columns;
+		long double y = screenHeight * ((i / columns) + 0.5) / columns;
+		gui.createVirtualAnnotation(i, x, y, ANNOTATION_CODES[i % numCodes]);
+	}
+
+	// Camera zoom and rotation about the screen centre, as CameraManager builds the homography
+	cv::Mat homography = cv::getRotationMatrix2D(cv::Point2f(screenWidth / 2.0f, screenHeight / 2.0f), options.rotationDegrees, options.zoom);
+
+	cv::Mat decoded, decodedStorage;
+	cv::Mat flipped, flippedResized;
+	cv::Mat show(screenHeight, screenWidth, CV_8UC3);
+	cv::Size screenSize(screenWidth, screenHeight);
+
+	std::vector<double> samples[NUM_STAGES];
+	for (int s = 0; s < NUM_STAGES; s++) {
+		samples[s].reserve(options.frames);
+	}
+
+	std::cout << "pipeline benchmark: " << (options.input.empty() ? "synthetic MJPEG" : options.input) << ", "
+		<< avcodec_get_name(header.codecId) << " " << header.width << "x" << header.height << " to " << screenWidth << "x" << screenHeight
+		<< ", " << options.annotations << " annotations, zoom " << options.zoom << ", rotation " << options.rotationDegrees << std::endl;
+
+	std::chrono::steady_clock::time_point timedStart;
+	int framesDone = 0;
+	int undecodedPackets = 0;
+
+	for (size_t p = 0; framesDone < WARMUP_FRAMES + options.frames; p++) {
+		if (framesDone == WARMUP_FRAMES && samples[STAGE_TOTAL].empty()) {
+			timedStart = std::chrono::steady_clock::now();
+		}
+
+		std::vector<char>& packet = packets[p % packets.size()];
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+		decoder.prepareOutput(&decoded, &decodedStorage);
+		bool decodedFrame = decoder.decode(&packet[0], (int)packet.size(), &decoded);
+
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		// Packets that give no picture (yet) leave nothing for the other stages
+		if (!decodedFrame) {
+			if (++undecodedPackets > (int)packets.size() + WARMUP_FRAMES + options.frames) {
+				std::cout << "error: the decoder gives no pictures for this input" << std::endl;
+				return 1;
+			}
+			continue;
+		}
+
+		cv::flip(decoded, flipped, 0);
+		cv::resize(flipped, flippedResized, screenSize);
+
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+		cv::Mat withSprites = gui.overlaySpriteAnnotations(flippedResized);
+
+		std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+		cv::warpAffine(withSprites, show, homography, withSprites.size());
+
+		std::chrono::steady_clock::time_point t4 = std::chrono::steady_clock::now();
+
+		cv::Mat withGUI = gui.createGUI(show);
+
+		std::chrono::steady_clock::time_point t5 = std::chrono::steady_clock::now();
+
+		if (framesDone >= WARMUP_FRAMES) {
+			samples[STAGE_DECODE].push_back(millisecondsBetween(t0, t1));
+			samples[STAGE_FLIP_RESIZE].push_back(millisecondsBetween(t1, t2));
+			samples[STAGE_SPRITES].push_back(millisecondsBetween(t2, t3));
+			samples[STAGE_WARP].push_back(millisecondsBetween(t3, t4));
+			samples[STAGE_GUI].push_back(millisecondsBetween(t4, t5));
+			samples[STAGE_TOTAL].push_back(millisecondsBetween(t0, t5));
+		}
+		framesDone++;
+	}
+
+	double timedSeconds = millisecondsBetween(timedStart, std::chrono::steady_clock::now()) / 1000.0;
+	double framesPerSecond = options.frames / timedSeconds;
+
+	decoder.destroyDecoder();
+
+	Json::Value results;
+	results["input"] = options.input.empty() ? "synthetic" : options.input;
+	results["codec"] = avcodec_get_name(header.codecId);
+	results["source_width"] = header.width;
+	results["source_height"] = header.height;
+	results["screen_width"] = screenWidth;
+	results["screen_height"] = screenHeight;
+	results["annotations"] = options.annotations;
+	results["zoom"] = options.zoom;
+	results["rotation_degrees"] = options.rotationDegrees;
+	results["frames"] = options.frames;
+	results["frames_per_second"] = framesPerSecond;
+
+	for (int s = 0; s < NUM_STAGES; s++) {
+		std::vector<double>& stage = samples[s];
+		std::sort(stage.begin(), stage.end());
+
+		double sum = 0.0;
+		for (size_t i = 0; i < stage.size(); i++) {
+			sum += stage[i];
+		}
+
+		Json::Value& latency = results["stages"][STAGE_NAMES[s]];
+		latency["p50_ms"] = percentile(stage, 50.0);
+		latency["p95_ms"] = percentile(stage, 95.0);
+		latency["p99_ms"] = percentile(stage, 99.0);
+		latency["mean_ms"] = sum / stage.size();
+
+		std::cout << "  " << STAGE_NAMES[s] << ": p50 " << latency["p50_ms"].asDouble() << " ms, p95 " << latency["p95_ms"].asDouble()
+			<< " ms, p99 " << latency["p99_ms"].asDouble() << " ms" << std::endl;
+	}
+
+	std::cout << "  " << framesPerSecond << " frames/s" << std::endl;
+
+	if (!commandLine.writeResults(results)) {
+		return 1;
+	}
+
+	return 0;
+}
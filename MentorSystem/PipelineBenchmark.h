@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+
+End-to-end benchmark of the video pipeline, without a window, a network
+or a GPU. Each frame goes through the same calls the pipeline makes when
+sprite annotations are shown:
+
+  VideoDecoder::decode -> flip + resize -> GUIManager::overlaySpriteAnnotations
+  -> warpAffine (camera homography) -> GUIManager::createGUI
+
+one after the other on one thread, so every stage is timed on its own.
+The input is synthetic MJPEG (generated frames, JPEG-encoded) or the
+packets of a packet capture (see PacketCapture.h).
+
+Run the mentor with --benchmark-pipeline, optionally followed by:
+
+  --input <file>        packet capture to decode instead of synthetic frames
+  --width <pixels>      synthetic frame size (default 1280x720)
+  --height <pixels>
+  --frames <count>      frames to time, after a short warm-up (default 300)
+  --annotations <count> sprite annotations on screen (default 5)
+  --zoom <factor>       camera zoom (default 1)
+  --rotation <degrees>  camera rotation (default 0)
+  --output <file>       also write the results there
+
+Results end with one line of JSON: per-stage p50/p95/p99 and mean latency
+in milliseconds, and frames per second through the whole chain.
+
+*/
+
+// Returns 0 (the process exit code), or 1 for bad options or input
+int runPipelineBenchmark(int argc, char* argv[]);
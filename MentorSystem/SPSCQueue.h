@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+
+SPSCQueue is a bounded, lock-free, single-producer/single-consumer ring
+buffer. It is used to link the stages of the video pipeline, where every
+queue has exactly one thread pushing into it and exactly one thread
+popping from it.
+
+Items are copied in and out, so the queue is meant to carry small values
+(buffer handles, indices) rather than the frames themselves.
+
+push() and pop() never block: they return false when the queue is full or
+empty and leave it to the caller to decide whether to wait, retry or drop.
+
+size() may be called from any thread, e.g. to report how deep a queue is
+while the pipeline is running. The value is a snapshot and can be stale by
+the time it is read.
+
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <typename T>
+class SPSCQueue
+{
+public:
+	explicit SPSCQueue(size_t capacity)
+		: _slots(capacity + 1)
+		, _head(0)
+		, _tail(0)
+	{
+	}
+
+	// Called only by the producer thread.
+	// Returns false (and does not store the item) if the queue is full.
+	bool push(const T& item)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		size_t nextTail = increment(tail);
+
+		if (nextTail == _head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		_slots[tail] = item;
+		_tail.store(nextTail, std::memory_order_release);
+
+		return true;
+	}
+
+	// Called only by the consumer thread.
+	// Returns false (and leaves item untouched) if the queue is empty.
+	bool pop(T& item)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+
+		if (head == _tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = _slots[head];
+		_head.store(increment(head), std::memory_order_release);
+
+		return true;
+	}
+
+	// Number of items currently queued (approximate if read from a third thread).
+	size_t size() const
+	{
+		size_t head = _head.load(std::memory_order_acquire);
+		size_t tail = _tail.load(std::memory_order_acquire);
+
+		return (tail >= head) ? (tail - head) : (tail + _slots.size() - head);
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	size_t capacity() const
+	{
+		return _slots.size() - 1;
+	}
+
+private:
+	size_t increment(size_t index) const
+	{
+		return (index + 1 == _slots.size()) ? 0 : index + 1;
+	}
+
+	std::vector<T> _slots;
+
+	// head and tail are written by different threads; keep them on separate cache lines
+	char _padding0[64];
+	std::atomic<size_t> _head;	// next slot to pop, owned by the consumer
+	char _padding1[64];
+	std::atomic<size_t> _tail;	// next slot to push, owned by the producer
+	char _padding2[64];
+
+	SPSCQueue(const SPSCQueue&);
+	SPSCQueue& operator=(const SPSCQueue&);
+};
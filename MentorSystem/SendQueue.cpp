@@ -0,0 +1,92 @@
+#include "SendQueue.h"
+
+SendQueue::SendQueue(size_t highWaterBytes)
+	: _frontSent(0)
+	, _highWaterBytes(highWaterBytes)
+	, _queuedBytes(0)
+	, _peakQueuedBytes(0)
+	, _sentMessages(0)
+	, _collapsedMessages(0)
+{
+}
+
+void SendQueue::push(const std::string& message, const std::string& collapseKey)
+{
+	if (!collapseKey.empty() && _queuedBytes + message.size() > _highWaterBytes) {
+		// Replaces the newest one with the key, so older ones still go out first
+		// (the first message is left alone once part of it is out)
+		size_t oldest = _frontSent > 0 ? 1 : 0;
+
+		for (size_t i = _messages.size(); i > oldest; i--)
+		{
+			Message& queued = _messages[i - 1];
+
+			if (queued.collapseKey == collapseKey) {
+				_queuedBytes = _queuedBytes - queued.data.size() + message.size();
+				queued.data = message;
+				_collapsedMessages++;
+				return;
+			}
+		}
+	}
+
+	Message queued;
+	queued.data = message;
+	queued.collapseKey = collapseKey;
+	_messages.push_back(queued);
+
+	_queuedBytes += message.size();
+	if (_queuedBytes > _peakQueuedBytes) {
+		_peakQueuedBytes = _queuedBytes;
+	}
+}
+
+bool SendQueue::flush(const Write& write)
+{
+	while (!_messages.empty())
+	{
+		Message& front = _messages.front();
+
+		int sent = write(front.data.data() + _frontSent, (int)(front.data.size() - _frontSent));
+		if (sent < 0) {
+			return false;
+		}
+		if (sent == 0) {
+			return true;
+		}
+
+		_frontSent += sent;
+		_queuedBytes -= sent;
+
+		if (_frontSent == front.data.size()) {
+			_messages.pop_front();
+			_frontSent = 0;
+			_sentMessages++;
+		}
+	}
+
+	return true;
+}
+
+bool SendQueue::empty() const
+{
+	return _messages.empty();
+}
+
+size_t SendQueue::queuedBytes() const
+{
+	return _queuedBytes;
+}
+
+SendQueueStatistics SendQueue::getStatistics() const
+{
+	SendQueueStatistics statistics;
+
+	statistics.queuedMessages = (int)_messages.size();
+	statistics.queuedBytes = _queuedBytes;
+	statistics.sentMessages = _sentMessages;
+	statistics.collapsedMessages = _collapsedMessages;
+	statistics.peakQueuedBytes = _peakQueuedBytes;
+
+	return statistics;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+
+SendQueue holds the messages waiting to go out to one client, so that a
+client that reads slowly (or not at all) only holds up its own messages.
+flush() hands the socket as much as it takes without blocking and keeps
+the rest, including the unsent end of a message the socket only took part
+of, for the next flush.
+
+Past the high-water mark the client is falling behind, and messages that
+only bring something up to date (an annotation moved again) replace the
+queued message with the same collapse key instead of queueing behind it.
+The replaced message keeps its place in the queue, so it still goes out
+after the messages queued before it. A message the socket has already
+taken part of is never replaced. Messages without a key (creating and
+deleting annotations) are always queued.
+
+Not thread safe: the owner locks around it.
+
+*/
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <stddef.h>
+
+struct SendQueueStatistics
+{
+	// Messages and bytes waiting, the start of one possibly already sent
+	int queuedMessages;
+	size_t queuedBytes;
+
+	// Messages sent in full, and messages replaced by a newer one with the same key
+	unsigned long long sentMessages;
+	unsigned long long collapsedMessages;
+
+	// Most bytes that were ever waiting at once
+	size_t peakQueuedBytes;
+};
+
+class SendQueue
+{
+public:
+	// Hands data to the socket. Returns the bytes it took, 0 if it is full, -1 if the connection failed
+	typedef std::function<int(const char* data, int size)> Write;
+
+	explicit SendQueue(size_t highWaterBytes);
+
+	// Queues a message, or past the high-water mark replaces a waiting one with the same key ("" = never)
+	void push(const std::string& message, const std::string& collapseKey);
+
+	// Sends what the socket takes. Returns false if the connection failed
+	bool flush(const Write& write);
+
+	bool empty() const;
+	size_t queuedBytes() const;
+
+	SendQueueStatistics getStatistics() const;
+
+private:
+	struct Message
+	{
+		std::string data;
+		std::string collapseKey;
+	};
+
+	std::deque<Message> _messages;
+
+	// Bytes of the first message the socket has taken already
+	size_t _frontSent;
+
+	size_t _highWaterBytes;
+	size_t _queuedBytes;
+	size_t _peakQueuedBytes;
+
+	unsigned long long _sentMessages;
+	unsigned long long _collapsedMessages;
+};
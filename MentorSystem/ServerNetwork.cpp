@@ -122,8 +122,10 @@ ServerNetwork::~ServerNetwork(void)
  */
 bool ServerNetwork::acceptNewClient(unsigned int & id)
 {
-    // Accept the connection and save the socket
-    ClientSocket = accept(ListenSocket,NULL,NULL);
+    // Accept the connection and save the socket, and where it comes from
+    sockaddr_in peer;
+    int peerLength = sizeof(peer);
+    ClientSocket = accept(ListenSocket,(sockaddr*)&peer,&peerLength);
 
     if (ClientSocket != INVALID_SOCKET) 
     {
@@ -132,7 +134,9 @@ bool ServerNetwork::acceptNewClient(unsigned int & id)
         setsockopt( ClientSocket, IPPROTO_TCP, TCP_NODELAY, &value, sizeof( value ) );
 
         // Insert new client into session ID table
+        std::lock_guard<std::mutex> lock(sessionsMutex);
         sessions.insert( pair<unsigned int, SOCKET>(id, ClientSocket) );
+        peerAddresses[id] = peer.sin_family == AF_INET ? peer.sin_addr.s_addr : 0;
 
         return true;
     }
@@ -140,60 +144,137 @@ bool ServerNetwork::acceptNewClient(unsigned int & id)
     return false;
 }
 
+/*
+ * Method Overview: Method to get the socket of a client
+ * Parameters: Id of the client
+ * Return: Its socket, INVALID_SOCKET if it is not in the table
+ */
+SOCKET ServerNetwork::getSocket(unsigned int client_id)
+{
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+
+    std::map<unsigned int, SOCKET>::iterator found = sessions.find(client_id);
+    if( found != sessions.end() )
+    {
+        return found->second;
+    }
+
+    return INVALID_SOCKET;
+}
+
+/*
+ * Method Overview: Method to close the connection of a client
+ * Parameters: Id of the client to remove from the table
+ * Return: None
+ */
+void ServerNetwork::closeClient(unsigned int client_id)
+{
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+
+    std::map<unsigned int, SOCKET>::iterator found = sessions.find(client_id);
+    if( found != sessions.end() )
+    {
+        closesocket(found->second);
+        sessions.erase(found);
+        peerAddresses.erase(client_id);
+    }
+}
+
+/*
+ * Method Overview: Method to get the address a client connected from
+ * Parameters: Id of the client
+ * Return: Its IPv4 address (network byte order), 0 if it is not in the table
+ */
+unsigned long ServerNetwork::getPeerAddress(unsigned int client_id)
+{
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+
+    std::map<unsigned int, unsigned long>::iterator found = peerAddresses.find(client_id);
+    if( found != peerAddresses.end() )
+    {
+        return found->second;
+    }
+
+    return 0;
+}
+
 /*
  * Method Overview: Method to receive incoming data from a client
  * Parameters: Id of client from, buffer to store data and its size
- * Return: the number of bytes received
+ * Return: the number of bytes received (0 once the client closed the connection, which is then left to closeClient)
  */
 int ServerNetwork::receiveData(unsigned int client_id, char * recvbuf, int bufSize)
 {
+	//get the socket in which the specific client if connected
+    SOCKET currentSocket = getSocket(client_id);
+
 	//If the client ID exists in the table
-    if( sessions.find(client_id) != sessions.end() )
+    if( currentSocket != INVALID_SOCKET )
     {
-		//get the socket in which the specific client if connected
-        SOCKET currentSocket = sessions[client_id];
-	
 		//call NetworkServices to receive the message
-        iResult = NetworkServices::receiveMessage(currentSocket, recvbuf, bufSize);
+        return NetworkServices::receiveMessage(currentSocket, recvbuf, bufSize);
+    }
 
-		//Close connection if client is no longer logged
-        if (iResult == 0)
-        {
-            printf("Connection closed\n");
-            closesocket(currentSocket);
-        }
+    return 0;
+}
 
-        return iResult;
+/*
+ * Method Overview: Method to receive incoming data from a client into two buffers in one call
+ * Parameters: Id of client from, buffers to store data and their sizes
+ * Return: the number of bytes received (0 once the client closed the connection, which is then left to closeClient)
+ */
+int ServerNetwork::receiveScattered(unsigned int client_id, char * first, int firstSize, char * second, int secondSize)
+{
+    SOCKET currentSocket = getSocket(client_id);
+
+	//If the client ID exists in the table
+    if( currentSocket != INVALID_SOCKET )
+    {
+        return NetworkServices::receiveScattered(currentSocket, first, firstSize, second, secondSize);
     }
 
     return 0;
 }
 
-
 /*
- * Method Overview: Method to send a message to the logged clients
- * Parameters: Message to send to all the clients
- * Return: Result of the message
+ * Method Overview: Method to check how much data a client has sent
+ * Parameters: Id of client to check
+ * Return: the number of bytes that can be read without blocking
  */
-int ServerNetwork::sendToAll(const char * message)
+int ServerNetwork::bytesAvailable(unsigned int client_id)
 {
-	//Socket to send the data
-    SOCKET currentSocket;
+    SOCKET currentSocket = getSocket(client_id);
+
+	//If the client ID exists in the table
+    if( currentSocket != INVALID_SOCKET )
+    {
+        return NetworkServices::bytesAvailable(currentSocket);
+    }
 
-	//Iterator to go through the map
-    std::map<unsigned int, SOCKET>::iterator iter;
+    return 0;
+}
 
-    int iSendResult;
-	
-	//Go through all the clients on the map
-    for (iter = sessions.begin(); iter != sessions.end(); iter++)
+/*
+ * Method Overview: Method to send data to one client, without waiting for room in its socket
+ * Parameters: Id of the client, data to send and its size
+ * Return: the number of bytes sent, 0 if the socket is full, SOCKET_ERROR if the connection failed (or there is no such client)
+ */
+int ServerNetwork::sendToClient(unsigned int client_id, const char * data, int size)
+{
+    SOCKET currentSocket = getSocket(client_id);
+
+    if( currentSocket == INVALID_SOCKET )
     {
-		//assign the correct socket to send to
-        currentSocket = iter->second;
+        return SOCKET_ERROR;
+    }
 
-		//call NetworkServices to send the message
-        iSendResult = NetworkServices::sendMessage(currentSocket, message, strlen(message));
+	//The clients' sockets are nonblocking (like the listening socket they come from), so a full one says so
+    int iSendResult = NetworkServices::sendMessage(currentSocket, data, size);
+
+    if( iSendResult == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK )
+    {
+        return 0;
     }
-	
+
 	return iSendResult;
 }
\ No newline at end of file
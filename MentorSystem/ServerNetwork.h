@@ -28,6 +28,7 @@
 #include "NetworkServices.h"//Methods to communicate with clients
 #include <ws2tcpip.h>//Windows TCP/IP Macros
 #include <map>//Map Library
+#include <mutex>//Sessions are added, used and removed by different threads
 
 using namespace std;//Standard Libraries
 
@@ -43,15 +44,30 @@ public:
 	ServerNetwork(char* port_number);//Class Constructor
     ~ServerNetwork(void);//Class Destructor
 
-	//Send data to all clients
-    int sendToAll(const char * packets);
+	//Send as much of some data to a client as its socket takes without waiting
+    int sendToClient(unsigned int client_id, const char * data, int size);
 	
 	//Receive incoming data
     int receiveData(unsigned int client_id, char * recvbuf, int bufSize);
 
+	//Receive incoming data into two buffers at once
+    int receiveScattered(unsigned int client_id, char * first, int firstSize, char * second, int secondSize);
+
+	//Amount of incoming data already waiting in the socket
+    int bytesAvailable(unsigned int client_id);
+
 	//Accept new connections
     bool acceptNewClient(unsigned int & id);
 
+	//Socket of a client, INVALID_SOCKET if there is no such client
+    SOCKET getSocket(unsigned int client_id);
+
+	//Closes the connection of a client and forgets it
+    void closeClient(unsigned int client_id);
+
+	//IPv4 address a client connected from, 0 if there is no such client
+    unsigned long getPeerAddress(unsigned int client_id);
+
 
 	//------------------------Variables--------------------------//
     //Socket to listen for new connections
@@ -65,5 +81,11 @@ public:
 
     //Table to keep track of each client's socket
     std::map<unsigned int, SOCKET> sessions; 
+
+    //Address each client connected from, to tell which connections belong to the same trainee
+    std::map<unsigned int, unsigned long> peerAddresses;
+
+    //Held while the tables are used
+    std::mutex sessionsMutex;
 };
 
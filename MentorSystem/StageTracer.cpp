@@ -0,0 +1,281 @@
+#include "StageTracer.h"
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> StageTracer::_enabled(false);
+std::atomic<bool> StageTracer::_dumpRequested(false);
+
+namespace {
+
+	// Fields are atomic so that a dump can read a buffer while its thread writes to it;
+	// relaxed stores of them cost no more than plain ones
+	struct TraceEvent
+	{
+		std::atomic<const char*> name;
+		std::atomic<long long> startNanoseconds;
+		std::atomic<long long> endNanoseconds;
+	};
+
+	struct TraceBuffer
+	{
+		int threadId;
+		std::string threadName;
+
+		// Whether a thread writes to it, under buffersMutex; one whose thread has ended goes to the next of its name
+		bool inUse;
+
+		// Zones written so far; the newest TRACE_BUFFER_EVENTS of them are in events
+		std::atomic<unsigned long long> written;
+		TraceEvent events[TRACE_BUFFER_EVENTS];
+	};
+
+	// Every buffer there is, for dumps and for threads to come
+	std::mutex buffersMutex;
+	std::vector<TraceBuffer*> buffers;
+
+	// What record() looks at, kept apart from ThreadTrace so that it costs no more than a plain pointer
+	thread_local TraceBuffer* threadBuffer = NULL;
+
+	// The calling thread's name until it has a buffer, and the buffer to give back when the thread ends
+	struct ThreadTrace
+	{
+		std::string name;
+		TraceBuffer* buffer;
+
+		ThreadTrace()
+			: buffer(NULL)
+		{
+		}
+
+		~ThreadTrace()
+		{
+			if (buffer != NULL) {
+				std::lock_guard<std::mutex> lock(buffersMutex);
+				buffer->inUse = false;
+			}
+		}
+	};
+
+	thread_local ThreadTrace threadTrace;
+
+	TraceBuffer* getThreadBuffer()
+	{
+		if (threadBuffer != NULL) {
+			return threadBuffer;
+		}
+
+		std::lock_guard<std::mutex> lock(buffersMutex);
+
+		// the one an ended thread of the same name left behind, so that restarted threads take no more memory
+		TraceBuffer* buffer = NULL;
+		for (size_t b = 0; b < buffers.size() && buffer == NULL; b++) {
+			if (!buffers[b]->inUse && buffers[b]->threadName == threadTrace.name) {
+				buffer = buffers[b];
+			}
+		}
+
+		if (buffer == NULL) {
+			buffer = new TraceBuffer();
+			buffer->written = 0;
+			buffer->threadId = (int)buffers.size() + 1;
+			buffer->threadName = threadTrace.name;
+			buffers.push_back(buffer);
+		}
+
+		buffer->inUse = true;
+
+		threadTrace.buffer = buffer;
+		threadBuffer = buffer;
+		return buffer;
+	}
+
+	void onDumpSignal(int signalNumber)
+	{
+		StageTracer::requestDump();
+
+		// some platforms reset the handler once it has run
+		signal(signalNumber, onDumpSignal);
+	}
+
+	// A copy of a zone, taken for a dump
+	struct DumpedEvent
+	{
+		const char* name;
+		long long startNanoseconds;
+		long long endNanoseconds;
+	};
+
+}
+
+void StageTracer::setEnabled(bool enabled)
+{
+	_enabled = enabled;
+}
+
+void StageTracer::setThreadName(const char* name)
+{
+	// the buffer is picked by the name, once the thread records its first zone
+	threadTrace.name = name;
+
+	if (threadBuffer != NULL) {
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		threadBuffer->threadName = name;
+	}
+}
+
+void StageTracer::record(const char* name, long long startNanoseconds, long long endNanoseconds)
+{
+	TraceBuffer* buffer = getThreadBuffer();
+
+	unsigned long long index = buffer->written.load(std::memory_order_relaxed);
+	TraceEvent& event = buffer->events[index & (TRACE_BUFFER_EVENTS - 1)];
+
+	event.name.store(name, std::memory_order_relaxed);
+	event.startNanoseconds.store(startNanoseconds, std::memory_order_relaxed);
+	event.endNanoseconds.store(endNanoseconds, std::memory_order_relaxed);
+
+	// publishes the event to a dump
+	buffer->written.store(index + 1, std::memory_order_release);
+}
+
+long long StageTracer::nowNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void StageTracer::requestDump()
+{
+	_dumpRequested = true;
+}
+
+bool StageTracer::dumpIfRequested(const char* directory)
+{
+	if (!_dumpRequested.exchange(false)) {
+		return false;
+	}
+
+	//One file per dump, named after when it was asked for
+	time_t now = time(NULL);
+	struct tm localTime;
+	localtime_s(&localTime, &now);
+
+	char fileName[64];
+	strftime(fileName, sizeof(fileName), "trace-%Y%m%d-%H%M%S.json", &localTime);
+
+	std::string path = fileName;
+	if (directory != NULL && directory[0] != '\0') {
+		path = std::string(directory) + "\\" + fileName;
+	}
+
+	return dump(path);
+}
+
+bool StageTracer::dump(const std::string& path)
+{
+	std::vector<TraceBuffer*> dumpedBuffers;
+	std::vector<std::string> threadNames;
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		dumpedBuffers = buffers;
+		for (size_t b = 0; b < buffers.size(); b++) {
+			threadNames.push_back(buffers[b]->threadName);
+		}
+	}
+
+	// copies first, so the file is not written while threads overwrite what is being read
+	std::vector<std::vector<DumpedEvent> > events(dumpedBuffers.size());
+	long long firstNanoseconds = -1;
+
+	for (size_t b = 0; b < dumpedBuffers.size(); b++) {
+		TraceBuffer* buffer = dumpedBuffers[b];
+
+		unsigned long long written = buffer->written.load(std::memory_order_acquire);
+		unsigned long long first = written > TRACE_BUFFER_EVENTS ? written - TRACE_BUFFER_EVENTS : 0;
+
+		for (unsigned long long i = first; i < written; i++) {
+			const TraceEvent& event = buffer->events[i & (TRACE_BUFFER_EVENTS - 1)];
+
+			DumpedEvent copy;
+			copy.name = event.name.load(std::memory_order_relaxed);
+			copy.startNanoseconds = event.startNanoseconds.load(std::memory_order_relaxed);
+			copy.endNanoseconds = event.endNanoseconds.load(std::memory_order_relaxed);
+			events[b].push_back(copy);
+		}
+
+		// the thread kept going while this was read: the oldest zones may have been overwritten since,
+		// including the one its next zone (not counted in written yet) may be halfway through
+		std::atomic_thread_fence(std::memory_order_acquire);
+		unsigned long long writtenAfter = buffer->written.load(std::memory_order_relaxed) + 1;
+		unsigned long long overwritten = writtenAfter > TRACE_BUFFER_EVENTS ? writtenAfter - TRACE_BUFFER_EVENTS : 0;
+		if (overwritten > first) {
+			unsigned long long stale = overwritten - first;
+			events[b].erase(events[b].begin(), events[b].begin() + (size_t)(stale < events[b].size() ? stale : events[b].size()));
+		}
+
+		for (size_t i = 0; i < events[b].size(); i++) {
+			if (firstNanoseconds < 0 || events[b][i].startNanoseconds < firstNanoseconds) {
+				firstNanoseconds = events[b][i].startNanoseconds;
+			}
+		}
+	}
+
+	std::ofstream file(path.c_str());
+	if (!file) {
+		std::cout << "error: cannot create the trace " << path << std::endl;
+		return false;
+	}
+
+	// microseconds with decimals, as the trace viewers read them
+	file.setf(std::ios::fixed);
+	file.precision(3);
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	size_t zones = 0;
+	bool firstEntry = true;
+
+	for (size_t b = 0; b < dumpedBuffers.size(); b++) {
+		int threadId = dumpedBuffers[b]->threadId;
+
+		if (!threadNames[b].empty()) {
+			file << (firstEntry ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+				<< ",\"args\":{\"name\":\"" << threadNames[b] << "\"}}";
+			firstEntry = false;
+		}
+
+		for (size_t i = 0; i < events[b].size(); i++) {
+			const DumpedEvent& event = events[b][i];
+
+			file << (firstEntry ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+				<< ",\"ts\":" << (event.startNanoseconds - firstNanoseconds) / 1000.0
+				<< ",\"dur\":" << (event.endNanoseconds - event.startNanoseconds) / 1000.0 << "}";
+			firstEntry = false;
+		}
+		zones += events[b].size();
+	}
+
+	file << "\n]}\n";
+
+	if (!file) {
+		std::cout << "error: cannot write the trace " << path << std::endl;
+		return false;
+	}
+
+	std::cout << "trace of " << zones << " zones on " << dumpedBuffers.size() << " threads saved to " << path << std::endl;
+
+	return true;
+}
+
+void StageTracer::installDumpSignal()
+{
+#ifdef SIGBREAK
+	signal(SIGBREAK, onDumpSignal);
+#else
+	signal(SIGUSR1, onDumpSignal);
+#endif
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+
+StageTracer records how long each stage of the mentor takes, on every
+thread, cheaply enough to leave on while looking into a problem, and writes what it has on
+request as a Chrome trace (open it in chrome://tracing or ui.perfetto.dev)
+to see the video, JSON and GLUT threads side by side on one timeline.
+
+Code marks a stage with a scoped zone:
+
+	{
+		TRACE_ZONE("decode");
+		...
+	}
+
+Each thread writes into a ring buffer of its own, so recording takes no
+lock: two clock reads and three relaxed stores, or a single relaxed load
+while tracing is switched off. Only the newest TRACE_BUFFER_EVENTS zones of
+a thread are kept. A thread gets its buffer with its first zone, and when it
+ends, the buffer goes to the next thread of the same name (the video stages
+start new threads for every trainee), so a dump still shows threads that
+have finished, and there are only ever as many buffers as threads that
+traced at the same time.
+
+A dump can be asked for from any thread, or from a signal handler
+(Ctrl+Break on Windows, SIGUSR1 elsewhere); it is written by whichever
+thread next calls dumpIfRequested(), so that the one asking is not held up
+by the file.
+
+*/
+
+#include <atomic>
+#include <string>
+
+// Zones kept per thread (a power of two)
+#define TRACE_BUFFER_EVENTS 16384
+
+class StageTracer
+{
+public:
+	// Tracing can be switched on and off at any time; zones are kept either way
+	static void setEnabled(bool enabled);
+
+	static bool isEnabled()
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+
+	// Names the calling thread in the trace, and picks the buffer of an earlier thread of that name
+	static void setThreadName(const char* name);
+
+	// Records a zone of the calling thread. name must stay valid (a string literal)
+	static void record(const char* name, long long startNanoseconds, long long endNanoseconds);
+
+	// Steady clock, as used for the zones
+	static long long nowNanoseconds();
+
+	// Asks for a dump, which the next dumpIfRequested() writes; safe in a signal handler
+	static void requestDump();
+
+	// Writes the trace if one was asked for. Returns whether it wrote one
+	static bool dumpIfRequested(const char* directory);
+
+	// Writes everything recorded so far as a Chrome trace. Returns false (after saying why) if it cannot
+	static bool dump(const std::string& path);
+
+	// Makes the dump signal call requestDump()
+	static void installDumpSignal();
+
+private:
+	static std::atomic<bool> _enabled;
+	static std::atomic<bool> _dumpRequested;
+};
+
+// Times the enclosing scope as a zone, unless cancelled (e.g. when there turned out to be nothing to do)
+class TraceZone
+{
+public:
+	explicit TraceZone(const char* name)
+		: _name(name)
+		, _startNanoseconds(StageTracer::isEnabled() ? StageTracer::nowNanoseconds() : -1)
+	{
+	}
+
+	~TraceZone()
+	{
+		if (_startNanoseconds >= 0) {
+			StageTracer::record(_name, _startNanoseconds, StageTracer::nowNanoseconds());
+		}
+	}
+
+	void cancel()
+	{
+		_startNanoseconds = -1;
+	}
+
+private:
+	const char* _name;
+	long long _startNanoseconds;
+};
+
+#define TRACE_ZONE_NAME(line) traceZone##line
+#define TRACE_ZONE_AT(name, line) TraceZone TRACE_ZONE_NAME(line)(name)
+#define TRACE_ZONE(name) TRACE_ZONE_AT(name, __LINE__)
@@ -0,0 +1,118 @@
+#include "StreamReader.h"
+#include <string.h>
+
+StreamReader::StreamReader(int capacity)
+	: _ring(capacity)
+	, _start(0)
+	, _size(0)
+	, _readCount(0)
+	, _bytesRead(0)
+	, _wrappedViewCount(0)
+{
+}
+
+int StreamReader::fill(const ScatterRead& read)
+{
+	int capacity = (int)_ring.size();
+	int free = capacity - _size;
+
+	if (free == 0) {
+		return 0;
+	}
+
+	// Starting over at the front keeps the next packets from wrapping
+	if (_size == 0) {
+		_start = 0;
+	}
+
+	// The free space runs from the end of the buffered bytes, possibly around the end of the ring
+	int end = (_start + _size) % capacity;
+	int firstSize = capacity - end < free ? capacity - end : free;
+	int secondSize = free - firstSize;
+
+	int numBytesRead = read(&_ring[end], firstSize, secondSize > 0 ? &_ring[0] : NULL, secondSize);
+
+	_readCount++;
+
+	if (numBytesRead <= 0) {
+		return 0;
+	}
+
+	_size += numBytesRead;
+	_bytesRead += numBytesRead;
+
+	return numBytesRead;
+}
+
+int StreamReader::size() const
+{
+	return _size;
+}
+
+int StreamReader::capacity() const
+{
+	return (int)_ring.size();
+}
+
+const char* StreamReader::view(int offset, int n)
+{
+	int capacity = (int)_ring.size();
+	int position = (_start + offset) % capacity;
+
+	if (position + n <= capacity) {
+		return &_ring[position];
+	}
+
+	// Wraps around the end of the ring
+	int firstPart = capacity - position;
+
+	_wrapped.resize(n);
+	memcpy(&_wrapped[0], &_ring[position], firstPart);
+	memcpy(&_wrapped[firstPart], &_ring[0], n - firstPart);
+	_wrappedViewCount++;
+
+	return &_wrapped[0];
+}
+
+const char* StreamReader::view(int n)
+{
+	return view(0, n);
+}
+
+void StreamReader::copyOut(char* out, int n) const
+{
+	int capacity = (int)_ring.size();
+	int firstPart = capacity - _start < n ? capacity - _start : n;
+
+	memcpy(out, &_ring[_start], firstPart);
+	if (n > firstPart) {
+		memcpy(out + firstPart, &_ring[0], n - firstPart);
+	}
+}
+
+void StreamReader::consume(int n)
+{
+	_start = (_start + n) % (int)_ring.size();
+	_size -= n;
+}
+
+void StreamReader::clear()
+{
+	_start = 0;
+	_size = 0;
+}
+
+unsigned long long StreamReader::getReadCount() const
+{
+	return _readCount;
+}
+
+unsigned long long StreamReader::getBytesRead() const
+{
+	return _bytesRead;
+}
+
+unsigned long long StreamReader::getWrappedViewCount() const
+{
+	return _wrappedViewCount;
+}
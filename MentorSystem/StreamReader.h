@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+
+StreamReader buffers a byte stream (the trainee's video connection) in a
+ring, filled by reads as large as the free space allows, so that a whole
+burst of packets usually comes in with a single recv instead of one call
+for every length prefix, header and payload.
+
+The free space of the ring can wrap around its end, so every fill hands
+the read function two buffers, which WSARecv fills in one call (a scatter
+read). Whatever came in is parsed where it lies: view() points straight
+into the ring, and only a region that wraps around the end is copied
+together into a side buffer first. When the ring runs empty it starts
+over at the front, so wrapped regions stay rare.
+
+A packet is only consumed once all of it is buffered, so a parser can
+look at a header, find the rest is still on its way, and come back to it
+unchanged later. The ring has to hold the largest packet plus its header.
+
+Not thread safe: one thread reads the stream.
+
+*/
+
+#include <functional>
+#include <vector>
+
+class StreamReader
+{
+public:
+	// Reads into the first buffer and then the second, in one call. Returns the
+	// bytes read, 0 if nothing has come (or the connection is gone)
+	typedef std::function<int(char* first, int firstSize, char* second, int secondSize)> ScatterRead;
+
+	explicit StreamReader(int capacity);
+
+	// Reads as much as fits. Returns the bytes read, 0 if nothing had come or the ring is full
+	int fill(const ScatterRead& read);
+
+	// Bytes buffered and not consumed yet
+	int size() const;
+	int capacity() const;
+
+	// The n buffered bytes starting offset bytes in (offset + n <= size()). Points into
+	// the ring, unless they wrap around its end; either way, valid until the next call
+	const char* view(int offset, int n);
+	const char* view(int n);
+
+	// Copies out the first n buffered bytes, without consuming them
+	void copyOut(char* out, int n) const;
+
+	void consume(int n);
+
+	// Drops everything buffered, e.g. when the connection changes
+	void clear();
+
+	// Read calls made so far, bytes they brought in, and views that had to be copied together
+	unsigned long long getReadCount() const;
+	unsigned long long getBytesRead() const;
+	unsigned long long getWrappedViewCount() const;
+
+private:
+	std::vector<char> _ring;
+
+	// Where the buffered bytes start, and how many there are
+	int _start;
+	int _size;
+
+	// A view that wraps around the end of the ring is copied together here
+	std::vector<char> _wrapped;
+
+	unsigned long long _readCount;
+	unsigned long long _bytesRead;
+	unsigned long long _wrappedViewCount;
+};
@@ -0,0 +1,277 @@
+#include "TextureUploader.h"
+
+#include <iostream>
+#include <chrono>
+#include "StageTracer.h"
+
+TextureUploader::TextureUploader()
+	: _initialized(false)
+	, _usePixelBuffers(false)
+	, _textureId(0)
+	, _textureWidth(0)
+	, _textureHeight(0)
+	, _hasFrame(false)
+	, _frameInWorldSpace(false)
+	, _consuming(false)
+	, _handingOverSlot(false)
+	, _requestedCapacity(0)
+	, _uploadedFrameCount(0)
+	, _uploadMicroseconds(0)
+	, _overwrittenFrameCount(0)
+{
+	for (int i = 0; i < NUM_SLOTS; i++) {
+		_slots[i].buffer = 0;
+		_slots[i].fence = 0;
+		_slots[i].data = NULL;
+		_slots[i].capacity = 0;
+		_slots[i].width = 0;
+		_slots[i].height = 0;
+		_slots[i].inWorldSpace = false;
+	}
+}
+
+TextureUploader::~TextureUploader()
+{
+	// the OpenGL objects go with the context, which is gone by the time this runs
+}
+
+void TextureUploader::init(bool usePixelBuffers)
+{
+	// PBOs are core in 2.1, fences in 3.2
+	bool pixelBuffersSupported = GLEW_VERSION_2_1 && (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+
+	_usePixelBuffers = usePixelBuffers && pixelBuffersSupported;
+
+	if (usePixelBuffers && !pixelBuffersSupported) {
+		std::cout << "pixel buffer objects or fences not supported, uploading video frames from client memory" << std::endl;
+	}
+
+	glGenTextures(1, &_textureId);
+	glBindTexture(GL_TEXTURE_2D, _textureId);
+
+	// clamp so the edges of a magnified frame do not blend with the opposite edge
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (_usePixelBuffers) {
+		for (int i = 0; i < NUM_SLOTS; i++) {
+			glGenBuffers(1, &_slots[i].buffer);
+		}
+	}
+
+	_initialized = true;
+	_consuming = true;
+
+	std::cout << "video frames are uploaded " << (_usePixelBuffers ? "through pixel buffer objects" : "from client memory") << std::endl;
+}
+
+bool TextureUploader::isInitialized() const
+{
+	return _initialized;
+}
+
+bool TextureUploader::usesPixelBuffers() const
+{
+	return _usePixelBuffers;
+}
+
+cv::Mat TextureUploader::beginFrame(int width, int height)
+{
+	size_t bytes = (size_t)width * height * 3;
+
+	// lets the OpenGL thread grow the slots before the next frame
+	size_t requested = _requestedCapacity.load();
+	while (bytes > requested && !_requestedCapacity.compare_exchange_weak(requested, bytes)) {
+	}
+
+	// a slot handed over to be grown is still waiting for the OpenGL thread; publishing
+	// a frame now would overwrite it and give the small slot straight back
+	if (_handingOverSlot) {
+		if (_mailbox.hasPendingFrame()) {
+			return cv::Mat();
+		}
+		_handingOverSlot = false;
+	}
+
+	Slot* slot = &_slots[_mailbox.backIndex()];
+
+	// too small (or not mapped yet): only the OpenGL thread can grow it, so hand it over
+	if (slot->capacity < bytes || slot->data == NULL) {
+		slot->width = 0;
+
+		if (_mailbox.publishIfIdle()) {
+			_handingOverSlot = true;
+		}
+
+		return cv::Mat();
+	}
+
+	slot->width = width;
+	slot->height = height;
+
+	return cv::Mat(height, width, CV_8UC3, slot->data);
+}
+
+void TextureUploader::endFrame(bool inWorldSpace)
+{
+	_slots[_mailbox.backIndex()].inWorldSpace = inWorldSpace;
+
+	if (_mailbox.publish()) {
+		_overwrittenFrameCount++;
+	}
+}
+
+bool TextureUploader::hasPendingFrame() const
+{
+	return !_consuming || _mailbox.hasPendingFrame();
+}
+
+void TextureUploader::prepareSlot(Slot& slot)
+{
+	// the previous copy out of this slot must be done before it is written again
+	if (slot.fence != 0) {
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NANOSECONDS);
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+	}
+
+	size_t requested = _requestedCapacity.load();
+	if (requested == 0 || (slot.data != NULL && slot.capacity >= requested)) {
+		return;
+	}
+
+	bool grow = slot.capacity < requested;
+	if (grow) {
+		slot.capacity = requested;
+	}
+
+	if (_usePixelBuffers) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		if (slot.data != NULL) {
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		if (grow) {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.capacity, NULL, GL_STREAM_DRAW);
+		}
+		slot.data = (uint8_t*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (slot.data == NULL) {
+			std::cout << "could not map pixel buffer object" << std::endl;
+		}
+	}
+	else {
+		slot.memory.resize(slot.capacity);
+		slot.data = &slot.memory[0];
+	}
+}
+
+void TextureUploader::uploadSlot(Slot& slot)
+{
+	const GLvoid* pixels = slot.data;
+
+	if (_usePixelBuffers) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		slot.data = NULL;
+
+		// with a PBO bound, the pixel pointer is an offset into it
+		pixels = 0;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, _textureId);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (slot.width != _textureWidth || slot.height != _textureHeight) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, slot.width, slot.height, 0, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+
+		_textureWidth = slot.width;
+		_textureHeight = slot.height;
+	}
+	else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, slot.width, slot.height, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (_usePixelBuffers) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+bool TextureUploader::upload()
+{
+	if (!_initialized) {
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	bool uploaded = false;
+
+	if (_mailbox.hasPendingFrame()) {
+		TRACE_ZONE("texture upload");
+
+		// the front slot is about to go to the producer
+		prepareSlot(_slots[_mailbox.frontIndex()]);
+
+		_mailbox.consume();
+
+		Slot& slot = _slots[_mailbox.frontIndex()];
+
+		// a slot without a frame was only handed over to be grown, which happens before it goes back
+		if (slot.width > 0) {
+			_frameInWorldSpace = slot.inWorldSpace;
+			_hasFrame = true;
+
+			uploadSlot(slot);
+
+			uploaded = true;
+		}
+	}
+
+	if (uploaded) {
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+		_uploadedFrameCount++;
+		_uploadMicroseconds += (unsigned long long)elapsed.count();
+	}
+
+	return uploaded;
+}
+
+bool TextureUploader::hasFrame() const
+{
+	return _hasFrame;
+}
+
+bool TextureUploader::isFrameInWorldSpace() const
+{
+	return _frameInWorldSpace;
+}
+
+GLuint TextureUploader::getTextureId() const
+{
+	return _textureId;
+}
+
+unsigned int TextureUploader::getUploadedFrameCount() const
+{
+	return _uploadedFrameCount;
+}
+
+unsigned long long TextureUploader::getUploadMicroseconds() const
+{
+	return _uploadMicroseconds;
+}
+
+unsigned int TextureUploader::getOverwrittenFrameCount() const
+{
+	return _overwrittenFrameCount;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+/*
+
+TextureUploader feeds a video frame texture through three pixel buffer
+objects (PBOs), handed between the thread producing frames and the OpenGL
+thread by a TripleBuffer mailbox. Neither thread waits for the other, and
+the copy to the GPU runs in the background.
+
+The producer always owns one mapped PBO. beginFrame() returns it, the
+frame is written straight into the mapped memory, and endFrame() publishes
+it. If the OpenGL thread has not taken the previous frame yet, it is
+overwritten (and counted), so only the newest frame is ever uploaded.
+
+On the OpenGL thread, upload() takes the published PBO, unmaps it and
+starts the texture update from it, then fences the copy. The PBO it gave
+up in exchange is handed to the producer next, so before that it waits
+for that PBO's fence (issued a frame earlier, so normally long done) and
+maps it again.
+
+Only the OpenGL thread can grow a PBO. When bigger frames arrive, the
+producer publishes its slot without a frame, and the OpenGL thread grows
+it before handing it back. Until the producer has a big enough slot,
+beginFrame() returns an empty Mat and the frame is skipped.
+
+Without PBOs and fences (OpenGL 2.1 and ARB_sync), or when asked not to use
+them, the three slots are plain memory and upload() copies from them
+synchronously, like glTexSubImage2D from client memory always did.
+
+Frames are tightly packed BGR, drawn with row 0 at the bottom. beginFrame(),
+endFrame() and hasPendingFrame() may be called from one other thread;
+everything else runs on the OpenGL thread.
+
+*/
+
+#include <GL\glew.h>
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include "TripleBuffer.h"
+
+class TextureUploader
+{
+public:
+	TextureUploader();
+	~TextureUploader();
+
+	// Creates the texture and the buffers. Needs a current context (after glewInit).
+	// Falls back to plain memory if usePixelBuffers is false or not supported.
+	void init(bool usePixelBuffers);
+
+	bool isInitialized() const;
+	bool usesPixelBuffers() const;
+
+	// Producer: returns a width x height BGR image backed by the producer's slot,
+	// or an empty Mat if it is not big enough yet (the frame is then skipped)
+	cv::Mat beginFrame(int width, int height);
+
+	// Producer: publishes the frame written since beginFrame
+	void endFrame(bool inWorldSpace);
+
+	// Whether a published frame has not been taken by the OpenGL thread yet
+	// (or the OpenGL thread has not started), i.e. whether a new frame would not be shown sooner
+	bool hasPendingFrame() const;
+
+	// Uploads the newest published frame, if any. Returns true if the texture changed
+	bool upload();
+
+	// Whether the texture holds a frame yet, and what kind (see updateBackgroundOpenCVImage)
+	bool hasFrame() const;
+	bool isFrameInWorldSpace() const;
+
+	GLuint getTextureId() const;
+
+	// Frames uploaded so far, and the time upload() spent starting their copies
+	unsigned int getUploadedFrameCount() const;
+	unsigned long long getUploadMicroseconds() const;
+
+	// Frames replaced by a newer one before the OpenGL thread took them
+	unsigned int getOverwrittenFrameCount() const;
+
+	static const int NUM_SLOTS = 3;
+
+private:
+	struct Slot
+	{
+		GLuint buffer;
+
+		// Set when the slot's copy to the texture starts, cleared once it is known to be done
+		GLsync fence;
+
+		// Mapped PBO (or memory below) and its size in bytes
+		uint8_t* data;
+		size_t capacity;
+
+		// Backing store when PBOs are not used
+		std::vector<uint8_t> memory;
+
+		// Frame written into the slot, set by the producer
+		int width;
+		int height;
+		bool inWorldSpace;
+	};
+
+	// Makes the OpenGL thread's slot writable and big enough before it goes to the producer
+	void prepareSlot(Slot& slot);
+
+	// Starts copying the slot just taken from the producer into the texture
+	void uploadSlot(Slot& slot);
+
+	Slot _slots[NUM_SLOTS];
+	TripleBuffer _mailbox;
+
+	bool _initialized;
+	bool _usePixelBuffers;
+
+	GLuint _textureId;
+	int _textureWidth;
+	int _textureHeight;
+	bool _hasFrame;
+	bool _frameInWorldSpace;
+
+	// Set by the OpenGL thread once it takes frames, read by the producer
+	std::atomic<bool> _consuming;
+
+	// Producer side: a slot too small for the frames has been published (without a frame) to be grown
+	bool _handingOverSlot;
+
+	// Largest frame the producer has asked for, in bytes
+	std::atomic<size_t> _requestedCapacity;
+
+	std::atomic<unsigned int> _uploadedFrameCount;
+	std::atomic<unsigned long long> _uploadMicroseconds;
+	std::atomic<unsigned int> _overwrittenFrameCount;
+
+	// Longest the OpenGL thread waits for a copy before mapping its buffer again
+	static const GLuint64 FENCE_TIMEOUT_NANOSECONDS = 100000000;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+
+TripleBuffer is a lock-free mailbox that hands the newest of a stream of
+frames from one producer thread to one consumer thread. It only tracks
+which of three slots (0, 1, 2) each side owns; the slots themselves are
+kept by the caller, indexed by these numbers.
+
+The producer always owns the back slot and the consumer the front slot.
+The third (middle) slot is shared through a single atomic that also says
+whether it holds a frame the consumer has not taken yet:
+
+- publish() swaps back and middle: the frame just written becomes the
+  pending one, and the producer continues in whatever slot was there.
+  If that was an unconsumed frame, it is overwritten (and publish()
+  says so), so the consumer only ever sees the newest frame.
+- consume() swaps front and middle if a frame is pending.
+- publishIfIdle() is publish() that gives up instead of overwriting a
+  pending frame, for handing a slot to the consumer without losing one.
+
+Nothing ever blocks or waits: each side always has a slot of its own.
+
+*/
+
+#include <atomic>
+
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: _middle(1)
+		, _back(0)
+		, _front(2)
+	{
+	}
+
+	// Called only by the producer thread.
+	int backIndex() const
+	{
+		return _back;
+	}
+
+	// Called only by the producer thread. Makes the back slot the pending frame.
+	// Returns true if a pending frame was overwritten before the consumer took it.
+	bool publish()
+	{
+		int previous = _middle.exchange(_back | NEW_FRAME, std::memory_order_acq_rel);
+
+		_back = previous & INDEX_MASK;
+
+		return (previous & NEW_FRAME) != 0;
+	}
+
+	// Called only by the producer thread. Same as publish, but only if no frame is pending;
+	// returns false (and keeps the back slot) otherwise.
+	bool publishIfIdle()
+	{
+		int expected = _middle.load(std::memory_order_acquire);
+
+		if ((expected & NEW_FRAME) != 0) {
+			return false;
+		}
+
+		if (!_middle.compare_exchange_strong(expected, _back | NEW_FRAME, std::memory_order_acq_rel)) {
+			return false;
+		}
+
+		_back = expected & INDEX_MASK;
+
+		return true;
+	}
+
+	// Called only by the consumer thread.
+	int frontIndex() const
+	{
+		return _front;
+	}
+
+	// Called only by the consumer thread. Takes the pending frame, if any.
+	// Returns false (and keeps the front slot) if nothing was published since the last call.
+	bool consume()
+	{
+		if ((_middle.load(std::memory_order_acquire) & NEW_FRAME) == 0) {
+			return false;
+		}
+
+		int previous = _middle.exchange(_front, std::memory_order_acq_rel);
+
+		_front = previous & INDEX_MASK;
+
+		return true;
+	}
+
+	// Whether a published frame is waiting for the consumer (may be stale if read from another thread)
+	bool hasPendingFrame() const
+	{
+		return (_middle.load(std::memory_order_acquire) & NEW_FRAME) != 0;
+	}
+
+private:
+	static const int INDEX_MASK = 0x3;
+	static const int NEW_FRAME = 0x4;
+
+	// middle slot index, plus NEW_FRAME while it holds an unconsumed frame
+	std::atomic<int> _middle;
+
+	int _back;	// owned by the producer
+	char _padding[64];
+	int _front;	// owned by the consumer
+
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+};
@@ -1,119 +1,526 @@
 #include "VideoDecoder.h"
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include "communicationDefinitions.h"
 
 VideoDecoder::VideoDecoder(void)
 {
 	std::cout << "TODO: initialize VideoDecoder" << std::endl;
+
+	this->_codecId = AV_CODEC_ID_NONE;
+	this->_lastDecodeMilliseconds = 0.0;
+	this->_decoder_c = NULL;
+	this->_decoder_frame = NULL;
+	this->_decoder_sws = NULL;
+	this->_decoder_parser = NULL;
+	this->_outputFormat = DECODER_OUTPUT_RGB24;
+	this->_lastFrameFullRange = true;
 }
 
 bool VideoDecoder::decode(char* in_buffer, int in_buffer_size, cv::Mat* out_mat) {
 	bool returnValue = false;
 
-	char* bytesToDecode = in_buffer;
+	std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+
+	uint8_t* bytesToDecode = (uint8_t*) in_buffer;
 	int lengthOfArray = in_buffer_size;
 
 	if (lengthOfArray > 0) {
 
-		this->_decoder_pkt.size = lengthOfArray;
-		this->_decoder_pkt.data = (uint8_t*) bytesToDecode;
+		if (this->_decoder_parser) {
+			// the packet is an arbitrary piece of the elementary stream; let the parser find the frames in it
+			while (lengthOfArray > 0) {
+				uint8_t* parsedData = NULL;
+				int parsedSize = 0;
+
+				int len = av_parser_parse2(this->_decoder_parser, this->_decoder_c, &parsedData, &parsedSize, bytesToDecode, lengthOfArray, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
 
-		int len;
-		int got_frame;
+				if (len < 0) {
+					std::cout << "error while parsing stream" << std::endl;
+					break;
+				}
 
-		len = avcodec_decode_video2(this->_decoder_c, this->_decoder_frame, &got_frame, &this->_decoder_pkt);
+				bytesToDecode += len;
+				lengthOfArray -= len;
 
-		if (len < 0) {
-			std::cout << "error while decoding frame" << std::endl;
-			returnValue = false;
+				if (parsedSize > 0 && decodePacket(parsedData, parsedSize, out_mat)) {
+					returnValue = true;
+				}
+			}
 		}
+		else {
+			returnValue = decodePacket(bytesToDecode, lengthOfArray, out_mat);
+		}
+
+	} else {
+		std::cout << "bytes to decode were empty, doing nothing" << std::endl;
+	}
+
+	std::chrono::duration<double, std::milli> decodeDuration = std::chrono::steady_clock::now() - decodeStart;
+	this->_lastDecodeMilliseconds = decodeDuration.count();
+
+	return returnValue;
+}
+
+bool VideoDecoder::decodePacket(uint8_t* data, int size, cv::Mat* out_mat) {
+	this->_decoder_pkt.size = size;
+	this->_decoder_pkt.data = data;
+
+	int len;
+	int got_frame = 0;
+
+	len = avcodec_decode_video2(this->_decoder_c, this->_decoder_frame, &got_frame, &this->_decoder_pkt);
 
-		if (got_frame) {
+	if (len < 0) {
+		std::cout << "error while decoding frame" << std::endl;
+		return false;
+	}
+
+	if (!got_frame) {
+		return false;
+	}
+
+	// the trainee switched resolution; out_mat is still sized for the old one, so this frame
+	// is scaled to fit, and prepareOutput sizes the next output for the new one
+	if (this->_decoder_frame->width != this->_decoderWidthPixels || this->_decoder_frame->height != this->_decoderHeightPixels) {
+		std::cout << "video stream resolution changed from " << this->_decoderWidthPixels << "x" << this->_decoderHeightPixels
+			<< " to " << this->_decoder_frame->width << "x" << this->_decoder_frame->height << std::endl;
+
+		this->_decoderWidthPixels = this->_decoder_frame->width;
+		this->_decoderHeightPixels = this->_decoder_frame->height;
+	}
+
+	if (this->_outputFormat == DECODER_OUTPUT_I420) {
+		return copyFrameToI420(out_mat);
+	}
 
-			cv::Mat* decodedMat = out_mat;
+	// the source format and size come from the stream (e.g. YUVJ420P for MJPEG, YUV420P for H.264)
+	this->_decoder_sws = sws_getCachedContext(this->_decoder_sws,
+		this->_decoder_frame->width, this->_decoder_frame->height, (AVPixelFormat)this->_decoder_frame->format,
+		out_mat->cols, out_mat->rows, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR, 0, 0, 0);
 
-			uint8_t* rgb24Data = decodedMat->data;
-			uint8_t * outData[1] = { rgb24Data };	// rgb24 has one plane
-			int outLinesize[1] = { 3*this->_decoderWidthPixels };	// rgb stride
+	if (!this->_decoder_sws) {
+		std::cout << "could not convert frame of format " << this->_decoder_frame->format << std::endl;
+		return false;
+	}
+
+	cv::Mat* decodedMat = out_mat;
+
+	uint8_t* rgb24Data = decodedMat->data;
+	uint8_t * outData[1] = { rgb24Data };	// rgb24 has one plane
+	int outLinesize[1] = { 3*out_mat->cols };	// rgb stride
+
+	sws_scale(this->_decoder_sws, this->_decoder_frame->data, this->_decoder_frame->linesize, 0, this->_decoder_frame->height, outData, outLinesize);
 
-			std::cout << "decodedMatColsnRows: " << decodedMat->cols << "," << decodedMat->rows << std::endl;
-			std::cout << "outLinesize[0]: " << outLinesize[0] << std::endl;
-			std::cout << "_decoder_frame->height: " << this->_decoder_frame->height << std::endl;
-			std::cout << "_decoder_frame->linesize: " << this->_decoder_frame->linesize << std::endl;
-			std::cout << "_decoderHeightPixels: " << this->_decoderHeightPixels << std::endl;
-				//this->_decoder_frame->linesize
-				//this->_decoderHeightPixels
+	return true;
+}
+
+bool VideoDecoder::isKeyframe(const char* in_buffer, int in_buffer_size) const {
+	return isKeyframe(this->_codecId, this->_decoder_parser ? 0 : VIDEO_STREAM_FLAG_FRAMED, in_buffer, in_buffer_size);
+}
 
-			sws_scale(this->_decoder_sws, this->_decoder_frame->data, this->_decoder_frame->linesize, 0, this->_decoderHeightPixels, outData, outLinesize);
+bool VideoDecoder::isKeyframe(AVCodecID codecId, int streamFlags, const char* in_buffer, int in_buffer_size) {
+	if (in_buffer_size < 2) {
+		return false;
+	}
 
-			returnValue = true;
+	// packets of an unframed stream are arbitrary pieces of it, so skipping any of them could corrupt the parser
+	if (!(streamFlags & VIDEO_STREAM_FLAG_FRAMED)) {
+		return false;
+	}
 
+	const unsigned char* bytes = (const unsigned char*)in_buffer;
+
+	switch (codecId) {
+	case AV_CODEC_ID_MJPEG:
+		// every MJPEG packet is a complete JPEG image, starting with the SOI marker
+		return bytes[0] == 0xFF && bytes[1] == 0xD8;
+	case AV_CODEC_ID_VP8:
+		// bit 0 of the frame tag is 0 for key frames, which also carry a start code
+		return in_buffer_size >= 6 && (bytes[0] & 0x01) == 0 && bytes[3] == 0x9D && bytes[4] == 0x01 && bytes[5] == 0x2A;
+	case AV_CODEC_ID_H264:
+	case AV_CODEC_ID_HEVC:
+	case AV_CODEC_ID_MPEG4:
+		// Annex-B/MPEG-4 start codes: look for a unit that starts an intra picture
+		for (int i = 0; i + 3 < in_buffer_size; i++) {
+			if (bytes[i] != 0 || bytes[i + 1] != 0 || bytes[i + 2] != 1) {
+				continue;
+			}
+
+			unsigned char unitHeader = bytes[i + 3];
+
+			if (codecId == AV_CODEC_ID_H264) {
+				// IDR slice
+				if ((unitHeader & 0x1F) == 5) {
+					return true;
+				}
+			}
+			else if (codecId == AV_CODEC_ID_HEVC) {
+				// IRAP picture (BLA, IDR or CRA)
+				int nalType = (unitHeader >> 1) & 0x3F;
+				if (nalType >= 16 && nalType <= 21) {
+					return true;
+				}
+			}
+			else if (unitHeader == 0xB6 && i + 4 < in_buffer_size) {
+				// VOP start code, coded as an I-VOP
+				return (bytes[i + 4] >> 6) == 0;
+			}
 		}
+		return false;
+	default:
+		// unknown inter-frame structure: never skip, always decode in order
+		return false;
+	}
+}
 
-	} else {
-		std::cout << "bytes to decode were empty, doing nothing" << std::endl;
+bool VideoDecoder::canDetectKeyframes() const {
+	return canDetectKeyframes(this->_codecId, this->_decoder_parser ? 0 : VIDEO_STREAM_FLAG_FRAMED);
+}
+
+bool VideoDecoder::canDetectKeyframes(AVCodecID codecId, int streamFlags) {
+	if (!(streamFlags & VIDEO_STREAM_FLAG_FRAMED)) {
+		return false;
 	}
 
-	return returnValue;
+	switch (codecId) {
+	case AV_CODEC_ID_MJPEG:
+	case AV_CODEC_ID_VP8:
+	case AV_CODEC_ID_H264:
+	case AV_CODEC_ID_HEVC:
+	case AV_CODEC_ID_MPEG4:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool VideoDecoder::parseStreamHeader(const char* in_buffer, int in_buffer_size, VideoStreamHeader& header, int& extradataSize) {
+	if (in_buffer_size < VIDEO_STREAM_HEADER_SIZE || memcmp(in_buffer, VIDEO_STREAM_HEADER_MAGIC, 4) != 0) {
+		return false;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)in_buffer;
+	int fields[5];
+
+	for (int i = 0; i < 5; i++) {
+		const unsigned char* field = bytes + 4 + 4*i;
+		fields[i] = (field[3] << 24) | (field[2] << 16) | (field[1] << 8) | field[0];
+	}
+
+	header.codecId = codecFromStream(fields[0]);
+	header.width = fields[1];
+	header.height = fields[2];
+	header.flags = fields[3];
+	extradataSize = fields[4];
+
+	if (header.codecId == AV_CODEC_ID_NONE) {
+		std::cout << "stream header names unknown codec " << fields[0] << std::endl;
+		return false;
+	}
+
+	if (header.width <= 0 || header.height <= 0 || header.width > VIDEO_STREAM_MAX_DIMENSION || header.height > VIDEO_STREAM_MAX_DIMENSION
+		|| extradataSize < 0 || extradataSize > VIDEO_STREAM_MAX_EXTRADATA_SIZE) {
+		std::cout << "stream header is invalid: " << header.width << "x" << header.height << ", " << extradataSize << " bytes of extradata" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool VideoDecoder::writeStreamHeader(const VideoStreamHeader& header, std::vector<char>& out_buffer) {
+	int streamCodec = codecToStream(header.codecId);
+	if (streamCodec < 0) {
+		return false;
+	}
+
+	int fields[5] = { streamCodec, header.width, header.height, header.flags, (int)header.extradata.size() };
+
+	out_buffer.resize(VIDEO_STREAM_HEADER_SIZE + header.extradata.size());
+	memcpy(&out_buffer[0], VIDEO_STREAM_HEADER_MAGIC, 4);
+
+	for (int i = 0; i < 5; i++) {
+		unsigned char* field = (unsigned char*)&out_buffer[4 + 4*i];
+		field[0] = (unsigned char)fields[i];
+		field[1] = (unsigned char)(fields[i] >> 8);
+		field[2] = (unsigned char)(fields[i] >> 16);
+		field[3] = (unsigned char)(fields[i] >> 24);
+	}
+
+	if (!header.extradata.empty()) {
+		memcpy(&out_buffer[VIDEO_STREAM_HEADER_SIZE], &header.extradata[0], header.extradata.size());
+	}
+
+	return true;
+}
+
+bool VideoDecoder::parseFrameHeader(const char* in_buffer, int in_buffer_size, VideoFrameHeader& header) {
+	if (in_buffer_size < VIDEO_FRAME_HEADER_SIZE || memcmp(in_buffer, VIDEO_FRAME_HEADER_MAGIC, 4) != 0) {
+		return false;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)in_buffer;
+	unsigned int fields[6];
+
+	for (int i = 0; i < 6; i++) {
+		const unsigned char* field = bytes + 4 + 4*i;
+		fields[i] = ((unsigned int)field[3] << 24) | (field[2] << 16) | (field[1] << 8) | field[0];
+	}
+
+	header.version = (int)fields[0];
+	header.sequence = fields[1];
+	header.captureTimestamp = (long long)(((unsigned long long)fields[3] << 32) | fields[2]);
+	header.payloadSize = (int)fields[4];
+	header.checksum = fields[5];
+
+	// the magic can also turn up by chance inside a payload, so anything odd means "not a header"
+	return header.version == VIDEO_FRAME_HEADER_VERSION && header.payloadSize > 0 && header.payloadSize <= MAX_PACKET_SIZE;
+}
+
+namespace {
+	// Lookup table for the reflected CRC-32 polynomial used by zlib, Ethernet and PNG
+	struct Crc32Table
+	{
+		unsigned int entries[256];
+
+		Crc32Table()
+		{
+			for (unsigned int i = 0; i < 256; i++) {
+				unsigned int crc = i;
+				for (int bit = 0; bit < 8; bit++) {
+					crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+				}
+				entries[i] = crc;
+			}
+		}
+	};
+}
+
+unsigned int VideoDecoder::frameChecksum(const char* in_buffer, int in_buffer_size) {
+	static const Crc32Table table;
+
+	const unsigned char* bytes = (const unsigned char*)in_buffer;
+	unsigned int crc = 0xFFFFFFFFu;
+
+	for (int i = 0; i < in_buffer_size; i++) {
+		crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc ^ 0xFFFFFFFFu;
+}
+
+AVCodecID VideoDecoder::codecFromStream(int streamCodec) {
+	switch (streamCodec) {
+	case VIDEO_STREAM_CODEC_MJPEG:
+		return AV_CODEC_ID_MJPEG;
+	case VIDEO_STREAM_CODEC_H264:
+		return AV_CODEC_ID_H264;
+	case VIDEO_STREAM_CODEC_HEVC:
+		return AV_CODEC_ID_HEVC;
+	case VIDEO_STREAM_CODEC_VP8:
+		return AV_CODEC_ID_VP8;
+	case VIDEO_STREAM_CODEC_MPEG4:
+		return AV_CODEC_ID_MPEG4;
+	default:
+		return AV_CODEC_ID_NONE;
+	}
+}
+
+int VideoDecoder::codecToStream(AVCodecID codecId) {
+	switch (codecId) {
+	case AV_CODEC_ID_MJPEG:
+		return VIDEO_STREAM_CODEC_MJPEG;
+	case AV_CODEC_ID_H264:
+		return VIDEO_STREAM_CODEC_H264;
+	case AV_CODEC_ID_HEVC:
+		return VIDEO_STREAM_CODEC_HEVC;
+	case AV_CODEC_ID_VP8:
+		return VIDEO_STREAM_CODEC_VP8;
+	case AV_CODEC_ID_MPEG4:
+		return VIDEO_STREAM_CODEC_MPEG4;
+	default:
+		return -1;
+	}
+}
+
+bool VideoDecoder::copyFrameToI420(cv::Mat* out_mat) {
+	AVFrame* frame = this->_decoder_frame;
+	AVPixelFormat format = (AVPixelFormat)frame->format;
+
+	int width = out_mat->cols;
+	int height = out_mat->rows * 2 / 3;
+
+	uint8_t* planes[3];
+	planes[0] = out_mat->data;
+	planes[1] = planes[0] + width * height;
+	planes[2] = planes[1] + (width / 2) * (height / 2);
+	int linesizes[3] = { width, width / 2, width / 2 };
+
+	this->_lastFrameFullRange = format == AV_PIX_FMT_YUVJ420P || format == AV_PIX_FMT_YUVJ422P || format == AV_PIX_FMT_YUVJ444P
+		|| frame->color_range == AVCOL_RANGE_JPEG;
+
+	if ((format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P) && frame->width == width && frame->height == height) {
+		// already I420: only the padding at the end of each line has to go
+		for (int plane = 0; plane < 3; plane++) {
+			int planeHeight = (plane == 0) ? height : height / 2;
+			for (int row = 0; row < planeHeight; row++) {
+				memcpy(planes[plane] + row * linesizes[plane], frame->data[plane] + row * frame->linesize[plane], linesizes[plane]);
+			}
+		}
+		return true;
+	}
+
+	// other layouts (e.g. 4:2:2 MJPEG) or sizes are converted, keeping their colour range
+	this->_decoder_sws = sws_getCachedContext(this->_decoder_sws,
+		frame->width, frame->height, format,
+		width, height, this->_lastFrameFullRange ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, 0, 0, 0);
+
+	if (!this->_decoder_sws) {
+		std::cout << "could not convert frame of format " << frame->format << std::endl;
+		return false;
+	}
+
+	sws_scale(this->_decoder_sws, frame->data, frame->linesize, 0, frame->height, planes, linesizes);
+
+	return true;
+}
+
+void VideoDecoder::prepareOutput(cv::Mat* out_mat, cv::Mat* storage) const {
+	if (this->_outputFormat == DECODER_OUTPUT_I420) {
+		fitFrameBuffer(*out_mat, *storage, this->_decoderHeightPixels * 3 / 2, this->_decoderWidthPixels, CV_8UC1);
+	}
+	else {
+		fitFrameBuffer(*out_mat, *storage, this->_decoderHeightPixels, this->_decoderWidthPixels, CV_8UC3);
+	}
+}
+
+int VideoDecoder::getFrameWidth() const {
+	return this->_decoderWidthPixels;
+}
+
+int VideoDecoder::getFrameHeight() const {
+	return this->_decoderHeightPixels;
+}
+
+void VideoDecoder::setOutputFormat(DecoderOutputFormat format) {
+	this->_outputFormat = format;
+}
+
+bool VideoDecoder::isLastFrameFullRange() const {
+	return this->_lastFrameFullRange;
+}
+
+AVCodecID VideoDecoder::getCodecId() const {
+	return this->_codecId;
+}
+
+double VideoDecoder::getLastDecodeMilliseconds() const {
+	return this->_lastDecodeMilliseconds;
 }
 
 void VideoDecoder::destroyDecoder() {
 	std::cout << "destroyDecoder" << std::endl;
 
-	avcodec_close(this->_decoder_c);
-	av_free(this->_decoder_c);
+	if (this->_decoder_parser) {
+		av_parser_close(this->_decoder_parser);
+		this->_decoder_parser = NULL;
+	}
+
+	// also called on what a failed initDecoder left, which may not have a context yet
+	if (this->_decoder_c) {
+		avcodec_close(this->_decoder_c);
+		av_free(this->_decoder_c);
+		this->_decoder_c = NULL;
+	}
 	av_frame_free(&this->_decoder_frame);
+	sws_freeContext(this->_decoder_sws);
+	this->_decoder_sws = NULL;
 	printf("\n");
 }
 
-void VideoDecoder::initDecoder(int width, int height) {
+bool VideoDecoder::initDecoder(int width, int height, const DecoderThreadingConfig& threading) {
+	VideoStreamHeader header;
+	header.codecId = AV_CODEC_ID_MJPEG;
+	header.width = width;
+	header.height = height;
+	header.flags = VIDEO_STREAM_FLAG_FRAMED;
+
+	return initDecoder(header, threading);
+}
+
+bool VideoDecoder::initDecoder(const VideoStreamHeader& header, const DecoderThreadingConfig& threading) {
 	std::cout << "in initDecoder" << std::endl;
 
 	this->_decoder_c = NULL;
+	this->_decoder_frame = NULL;
+	this->_decoder_sws = NULL;
+	this->_decoder_parser = NULL;
 
-	this->_decoderWidthPixels = width;
-	this->_decoderHeightPixels = height;
+	this->_decoderWidthPixels = header.width;
+	this->_decoderHeightPixels = header.height;
 
 	/* register all the codecs */
 	avcodec_register_all();
 
-	//enum AVCodecID codec_id = AV_CODEC_ID_MPEG4;
-	enum AVCodecID codec_id = AV_CODEC_ID_MJPEG;
+	enum AVCodecID codec_id = header.codecId;
 
 	AVCodec *decoder_codec;
 
-	uint8_t inbuf[INBUF_SIZE + FF_INPUT_BUFFER_PADDING_SIZE];
+	this->_codecId = codec_id;
 
 	av_init_packet(&_decoder_pkt);
 
-	/* set end of buffer to 0 (this ensures that no overreading happens for damaged mpeg streams) */
-	memset(inbuf + INBUF_SIZE, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-
-	/* find the mpeg1 video decoder */
+	/* find the decoder the stream asks for */
 	decoder_codec = avcodec_find_decoder(codec_id);
 	if (!decoder_codec) {
 		std::cout << "Codec not found" << std::endl;
-		exit(1);
+		return false;
 	}
 
 	_decoder_c = avcodec_alloc_context3(decoder_codec);
 	if (!_decoder_c) {
 		std::cout << "Could not allocate video codec context" << std::endl;
-		exit(1);
-	}
-
-	if(decoder_codec->capabilities&CODEC_CAP_TRUNCATED) {
-		_decoder_c->flags|= CODEC_FLAG_TRUNCATED; /* we do not send complete frames */
+		return false;
 	}
 
 	/* For some codecs, such as msmpeg4 and mpeg4, width and height
 		   MUST be initialized there because this information is not
 		   available in the bitstream. */
+	_decoder_c->width = header.width;
+	_decoder_c->height = header.height;
+
+	/* out-of-band setup such as H.264 SPS/PPS; ffmpeg wants it padded like packet data */
+	if (!header.extradata.empty()) {
+		_decoder_c->extradata = (uint8_t*) av_mallocz(header.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+		if (!_decoder_c->extradata) {
+			std::cout << "Could not allocate codec extradata" << std::endl;
+			destroyDecoder();
+			return false;
+		}
+		memcpy(_decoder_c->extradata, &header.extradata[0], header.extradata.size());
+		_decoder_c->extradata_size = (int) header.extradata.size();
+	}
+
+	/* unframed elementary streams (e.g. Annex-B H.264) are split into frames by the parser */
+	if (!(header.flags & VIDEO_STREAM_FLAG_FRAMED)) {
+		_decoder_parser = av_parser_init(codec_id);
+		if (!_decoder_parser) {
+			std::cout << "No parser for codec, expecting whole frames per packet" << std::endl;
+		}
+	}
+
+	/* threading has to be set up before the codec is opened; ffmpeg falls
+	   back to a single thread for types the codec does not support */
+	_decoder_c->thread_count = threading.threadCount;
+	_decoder_c->thread_type = threading.threadType;
 
 	/* open it */
 	if (avcodec_open2(_decoder_c, decoder_codec, NULL) < 0) {
 		std::cout << "Could not open codec" << std::endl;
-		exit(1);
+		destroyDecoder();
+		return false;
 	}
 
 	// here is where we would open the file from a filename, but we aren't reading from a file
@@ -121,14 +528,21 @@ void VideoDecoder::initDecoder(int width, int height) {
 	_decoder_frame = av_frame_alloc();
 	if (!_decoder_frame) {
 		std::cout << "Could not allocate video frame" << std::endl;
-		exit(1);
+		destroyDecoder();
+		return false;
 	}
 
-	_decoder_sws = sws_getContext(this->_decoderWidthPixels, this->_decoderHeightPixels, AV_PIX_FMT_YUVJ420P, this->_decoderWidthPixels, this->_decoderHeightPixels, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR, 0, 0, 0);
+	// the colour converter is created for the first decoded frame, once its pixel format is known
+
+	std::cout << "decoder: " << avcodec_get_name(codec_id) << " " << header.width << "x" << header.height
+		<< ", " << header.extradata.size() << " bytes of extradata, " << (_decoder_parser ? "parsed" : "framed") << std::endl;
+	std::cout << "decoder threads: " << _decoder_c->thread_count << " (type " << _decoder_c->active_thread_type << ")" << std::endl;
 
 	// here is where we would decode each frame
 
 	std::cout << "done initing decoder" << std::endl;
+
+	return true;
 }
 
 VideoDecoder::~VideoDecoder(void)
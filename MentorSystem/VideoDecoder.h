@@ -26,30 +26,221 @@ extern "C" {
 #endif
 
 #include <opencv2/opencv.hpp>
+#include <vector>
+#include "FrameBuffer.h"
 #define INBUF_SIZE 4096
 
+// Codec ids as sent in the stream header. These are fixed on the wire,
+// unlike AVCodecID, whose values change between ffmpeg versions.
+enum VideoStreamCodec
+{
+	VIDEO_STREAM_CODEC_MJPEG = 0,
+	VIDEO_STREAM_CODEC_H264 = 1,
+	VIDEO_STREAM_CODEC_HEVC = 2,
+	VIDEO_STREAM_CODEC_VP8 = 3,
+	VIDEO_STREAM_CODEC_MPEG4 = 4
+};
+
+// Stream header flag: every packet holds whole frames, so the bitstream
+// parser can be skipped (it would otherwise hold each frame back until
+// the start of the next one arrives).
+#define VIDEO_STREAM_FLAG_FRAMED 0x1
+
+// Stream header flag: every packet starts with a VideoFrameHeader instead
+// of the bare length, so the receiver can find its way back to the next
+// packet after a short read or corrupted data.
+#define VIDEO_STREAM_FLAG_FRAME_HEADERS 0x2
+
+// Stream header flag: after the stream header, the packets come as UDP
+// datagrams on VIDEO_DATAGRAM_PORT (see JitterBuffer for their format)
+// instead of over the video connection.
+#define VIDEO_STREAM_FLAG_DATAGRAMS 0x4
+
+// What the trainee sends before the first packet, so the decoder can be
+// set up for the stream instead of assuming MJPEG. On the wire (all
+// integers 32-bit little-endian, like the packet length prefix):
+//   "MSVH" | codec | width | height | flags | extradata size | extradata
+struct VideoStreamHeader
+{
+	AVCodecID codecId;
+	int width;
+	int height;
+	int flags;
+
+	// Out-of-band codec setup, e.g. H.264 SPS/PPS; may be empty
+	std::vector<uint8_t> extradata;
+
+	VideoStreamHeader()
+		: codecId(AV_CODEC_ID_MJPEG)
+		, width(0)
+		, height(0)
+		, flags(VIDEO_STREAM_FLAG_FRAMED)
+	{
+	}
+};
+
+// What the trainee sends before every packet when the stream header sets
+// VIDEO_STREAM_FLAG_FRAME_HEADERS. On the wire (32-bit little-endian, the
+// timestamp as two words, low word first):
+//   "MSVF" | version | sequence | timestamp low | timestamp high | payload size | checksum
+struct VideoFrameHeader
+{
+	int version;
+
+	// Counts up by one per packet, so gaps show packets lost on the way
+	unsigned int sequence;
+
+	// When the frame was captured, in microseconds on the trainee's clock
+	long long captureTimestamp;
+
+	int payloadSize;
+
+	// CRC-32 (as in zlib) of the payload
+	unsigned int checksum;
+
+	VideoFrameHeader()
+		: version(0)
+		, sequence(0)
+		, captureTimestamp(0)
+		, payloadSize(0)
+		, checksum(0)
+	{
+	}
+};
+
+// How ffmpeg may spread the decoding of one stream over several threads.
+// Frame threading decodes consecutive frames at once but delays the output
+// by (threadCount - 1) frames; slice threading splits a single frame and
+// adds no delay, but only helps codecs/streams that have multiple slices.
+struct DecoderThreadingConfig
+{
+	// 0 lets ffmpeg pick one thread per core, 1 disables threading
+	int threadCount;
+
+	// Combination of FF_THREAD_FRAME and FF_THREAD_SLICE
+	int threadType;
+
+	DecoderThreadingConfig()
+		: threadCount(0)
+		, threadType(FF_THREAD_SLICE)
+	{
+	}
+};
+
+// What decode() writes into its output Mat
+enum DecoderOutputFormat
+{
+	// Packed RGB at the decoder resolution (CV_8UC3)
+	DECODER_OUTPUT_RGB24,
+
+	// Planar YUV 4:2:0 (CV_8UC1, height * 3/2 rows), left for YUVConverter
+	DECODER_OUTPUT_I420
+};
+
 class VideoDecoder
 {
 public:
 	VideoDecoder(void);
 	~VideoDecoder(void);
 
-	void initDecoder(int frameWidth, int frameHeight);
+	// Sets up an MJPEG decoder, for streams that come without a header
+	bool initDecoder(int frameWidth, int frameHeight, const DecoderThreadingConfig& threading = DecoderThreadingConfig());
+
+	// Sets up the decoder the stream header asks for. Frames come out at the
+	// header's width and height until the stream itself changes resolution.
+	// Returns false (after saying why, and with nothing left set up) if ffmpeg
+	// cannot decode the stream, e.g. for extradata it does not accept.
+	bool initDecoder(const VideoStreamHeader& header, const DecoderThreadingConfig& threading = DecoderThreadingConfig());
+
+	// Reads the fixed-size part of a stream header (VIDEO_STREAM_HEADER_SIZE
+	// bytes). Returns false if it is not a header, names an unknown codec or
+	// has a width or height of 0 or above VIDEO_STREAM_MAX_DIMENSION; otherwise
+	// the extradata that follows still has to be read into header.
+	static bool parseStreamHeader(const char* in_buffer, int in_buffer_size, VideoStreamHeader& header, int& extradataSize);
+
+	// Writes a stream header as the trainee sends it, extradata included, e.g. to
+	// keep it with a capture of the stream. Returns false if the codec has no id on the wire
+	static bool writeStreamHeader(const VideoStreamHeader& header, std::vector<char>& out_buffer);
 
+	// Reads a frame header (VIDEO_FRAME_HEADER_SIZE bytes). Returns false if
+	// it is not one, has an unknown version or a payload too big for a packet.
+	static bool parseFrameHeader(const char* in_buffer, int in_buffer_size, VideoFrameHeader& header);
+
+	// CRC-32 of a payload, to compare with VideoFrameHeader::checksum
+	static unsigned int frameChecksum(const char* in_buffer, int in_buffer_size);
+
+	// Decodes a packet into out_mat, converting the picture to the size out_mat
+	// already has (see prepareOutput)
 	bool decode(char* in_buffer, int in_buffer_size, cv::Mat* out_mat);
 
+	// Sizes out_mat for the stream's current resolution and the output format,
+	// as a view into storage (see fitFrameBuffer). Called before every decode(),
+	// it makes frames follow the stream when its resolution changes: the frame
+	// that brings the change is still scaled to the old size, the next ones are not.
+	void prepareOutput(cv::Mat* out_mat, cv::Mat* storage) const;
+
+	// Resolution of the stream as last decoded (the header's until the first frame)
+	int getFrameWidth() const;
+	int getFrameHeight() const;
+
+	// Picks what decode() produces; RGB24 unless set otherwise
+	void setOutputFormat(DecoderOutputFormat format);
+
+	// Whether the last I420 frame uses the full 0-255 range (JPEG) rather than 16-235
+	bool isLastFrameFullRange() const;
+
+	// Returns true if the packet can be decoded without any of the packets
+	// before it, i.e. it is safe to skip straight to it under backlog.
+	bool isKeyframe(const char* in_buffer, int in_buffer_size) const;
+
+	// The same for a packet of a stream with the given codec and header flags,
+	// without a decoder (e.g. while another thread sets it up)
+	static bool isKeyframe(AVCodecID codecId, int streamFlags, const char* in_buffer, int in_buffer_size);
+
+	// Whether isKeyframe() can ever say true for this stream: not for unframed
+	// streams, nor for codecs whose keyframes it does not know
+	bool canDetectKeyframes() const;
+	static bool canDetectKeyframes(AVCodecID codecId, int streamFlags);
+
+	// Codec of the stream, e.g. to check whether frames can be decoded independently
+	AVCodecID getCodecId() const;
+
+	// Wall time of the last decode() call, including the colour conversion
+	double getLastDecodeMilliseconds() const;
+
 	void destroyDecoder();
 
 private:
 
+	// Decodes one complete packet and converts the picture, if any, into out_mat
+	bool decodePacket(uint8_t* data, int size, cv::Mat* out_mat);
+
+	// Copies (or converts) the decoded picture into an I420 Mat
+	bool copyFrameToI420(cv::Mat* out_mat);
+
+	// Maps a codec id from the stream header to the ffmpeg one, and back (-1 if it has none)
+	static AVCodecID codecFromStream(int streamCodec);
+	static int codecToStream(AVCodecID codecId);
+
+	// Resolution of the stream, updated when a decoded frame has a different one
 	int _decoderWidthPixels;
 	int _decoderHeightPixels;
 
+	AVCodecID _codecId;
+
+	double _lastDecodeMilliseconds;
+
+	DecoderOutputFormat _outputFormat;
+	bool _lastFrameFullRange;
+
 	AVCodecContext *_decoder_c;
 	AVFrame *_decoder_frame;
 	AVPacket _decoder_pkt;
 	SwsContext* _decoder_sws;
 
+	// Splits an unframed elementary stream into packets; NULL for framed streams
+	AVCodecParserContext* _decoder_parser;
+
 
 
 	
@@ -19,276 +19,1916 @@
 //Include its header file
 #include "VideoManager.h"
 #include <bitset>
+#include <chrono>
+#include <ctime>
+
+std::mutex VideoManager::_focusedHandOffMutex;
+
+/*
+ * Method Overview: Constructor of the class
+ * Parameters (1): Instance of the Communication Manager server
+ * Parameters (2): Instance of the Command Center
+ * Parameters (3): Trainee session to show
+ * Return: Instance of the class
+ */
+VideoManager::VideoManager(CommunicationManager* server, CommandCenter* pCommander, GUIManager* pGUI, CameraManager* pCamera, int session) 
+	: _packetPool(NUM_PACKET_BUFFERS)
+	, _decodedFramePool(NUM_DECODED_FRAME_BUFFERS)
+	, _compositedFramePool(NUM_COMPOSITED_FRAME_BUFFERS)
+	, _packetQueue(NUM_PACKET_BUFFERS)
+	, _decodedFrameQueue(NUM_DECODED_FRAME_BUFFERS)
+	, _compositedFrameQueue(NUM_COMPOSITED_FRAME_BUFFERS)
+	, _pipelineRunning(false)
+	, _lowLatencyMode(VIDEO_LOW_LATENCY_MODE)
+	, _droppedFrameCount(0)
+	, _networkDropCount(0)
+	, _resyncCount(0)
+	, _decodedFrameCount(0)
+	, _decodeMicroseconds(0)
+	, _decodedFramesFullRange(true)
+	, _loopWakeUps(0)
+	, _loopGestureWakeUps(0)
+	, _loopIdleMicroseconds(0)
+	, _streamReader(STREAM_BUFFER_SIZE)
+	, _streamClient(CommunicationManager::NO_CLIENT)
+	, _streamRestarted(false)
+	, _streamHeaderClient(CommunicationManager::NO_CLIENT)
+	, _decoderReady(true)
+	, _receivedCodecId(AV_CODEC_ID_NONE)
+	, _receivedStreamFlags(0)
+	, _decoderRestartPending(false)
+	, _receivedPacketCount(0)
+	, _streamReadCount(0)
+	, _streamBytesRead(0)
+{
+	//Sets the given instance as the one that will be used
+	myServer = server;
+
+	_session = session;
+
+	myCamera = pCamera;
+
+	//Image constants, until the stream header (or the stream itself) says otherwise
+	rescamX = 640;
+	rescamY = 400; //Tablet resolution
+	//rescamY = 480; //Webcam resolution
+
+	this->_usingVideoDecoder = true;
+
+	//Set from the stream header once the trainee connects
+	this->_frameHeaders = false;
+	this->_datagramTransport = false;
+	this->_packetsNumbered = false;
+	this->_replaying = false;
+	this->_frameSyncLost = false;
+	this->_frameSequenceKnown = false;
+	this->_expectedFrameSequence = 0;
+	this->_waitingForKeyframe = false;
+
+	//Decoded frames stay in YUV until the composite stage converts them
+	this->_yuvNativePath = VIDEO_YUV_NATIVE_PATH && this->_usingVideoDecoder;
+
+	//OpenGL draws frames at camera resolution through the homography, unless sprites need them at screen resolution
+	this->_glHomography = VIDEO_GL_HOMOGRAPHY;
+
+	//Screen constants
+	rescompX = 1920;
+	rescompY = 1080;
+
+	//determined by the resolution of the camera
+	aspectRatioX = 16;
+	aspectRatioY = 9;
+
+	//determined by the user
+	panStep = 10;
+	zoomScale = 2;
+	rotationDegree = 0.0;
+
+	//Create the region of interest
+	tl = Point(0,0);
+	br = Point(rescamX,rescamY);
+	roi= Rect(tl,br);
+
+	//Inits the GUI Manager
+	GUIcreator = pGUI;
+}
+
+/*
+ * Method Overview: Starts the video pipeline and handles user input
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::initWindow()
+{
+	//Character where we will store the message sent from the gesture client
+	char gestureData;
+	//Buffer size of message from gesture client
+	int gestureBuffSize = 1;
+
+	if (this->_usingVideoDecoder) {
+		DecoderThreadingConfig& threading = _decoderThreading;
+		threading.threadCount = VIDEO_DECODER_THREAD_COUNT;
+
+		//One per core would have every session's decoder compete for all of them, so they share the cores out
+		if (threading.threadCount == 0 && myServer->getSessionCount() > 1) {
+			threading.threadCount = (int)std::thread::hardware_concurrency() / myServer->getSessionCount();
+			if (threading.threadCount < 1) {
+				threading.threadCount = 1;
+			}
+		}
+		threading.threadType = (VIDEO_DECODER_FRAME_THREADS ? FF_THREAD_FRAME : 0) | (VIDEO_DECODER_SLICE_THREADS ? FF_THREAD_SLICE : 0);
+
+		//The trainee says which codec and resolution it streams before the first packet
+		//(a packet capture starts with the header it was captured with)
+		VideoStreamHeader header;
+		//Only the first session replays; the others still show live trainees
+		this->_replaying = strlen(VIDEO_REPLAY_FILE) > 0 && _session == 0;
+
+		DecoderOutputFormat outputFormat = this->_yuvNativePath ? DECODER_OUTPUT_I420 : DECODER_OUTPUT_RGB24;
+
+		_videoDecoder.setOutputFormat(outputFormat);
+
+		//A trainee whose stream cannot be decoded (or received) is turned away, and the session waits for the next one
+		while (1)
+		{
+			if (this->_replaying) {
+				if (!_replaySource.open(VIDEO_REPLAY_FILE, VIDEO_REPLAY_SPEED, VIDEO_REPLAY_LOOP, header)) {
+					std::cout << "error: could not replay " << VIDEO_REPLAY_FILE << ", exiting" << std::endl;
+					exit(1);
+				}
+			}
+			else {
+				receiveStreamHeader(header);
+			}
+
+			if (useStreamTransport(header) && _videoDecoder.initDecoder(header, threading)) {
+				break;
+			}
+
+			//The capture the mentor was told to replay will not get any better
+			if (this->_replaying) {
+				std::cout << "error: could not decode " << VIDEO_REPLAY_FILE << ", exiting" << std::endl;
+				exit(1);
+			}
+
+			rejectVideoClient(_streamClient);
+		}
+
+		rescamX = header.width;
+		rescamY = header.height;
+
+		_receivedCodecId = header.codecId;
+		_receivedStreamFlags = header.flags;
+
+		tl = Point(0,0);
+		br = Point(rescamX,rescamY);
+		roi = Rect(tl,br);
+
+		//MJPEG frames do not depend on each other, so they can be decoded side by side
+		if (VIDEO_PARALLEL_MJPEG_DECODERS > 1 && _videoDecoder.getCodecId() == AV_CODEC_ID_MJPEG) {
+			_parallelDecoder.start(VIDEO_PARALLEL_MJPEG_DECODERS, rescamX, rescamY, NUM_DECODED_FRAME_BUFFERS, outputFormat);
+		}
+
+		if (this->_yuvNativePath) {
+			std::cout << "video frames are converted from YUV using " << YUVConverter::simdLevelName(_yuvConverter.getSimdLevel()) << std::endl;
+		}
+
+		startRecording(header);
+	}
+
+	startPipeline();
+
+	std::chrono::steady_clock::time_point lastStatusReport = std::chrono::steady_clock::now();
+	VideoPipelineStatus lastStatus = getPipelineStatus();
+
+	std::chrono::steady_clock::time_point lastFeedback = lastStatusReport;
+	unsigned int lastFeedbackNetworkDrops = 0;
+
+	//Infinite loop to handle the user input while the stages run
+	//(keys come through the GLUT window; frames through the stage threads)
+	while(1)
+	{	
+		//Sleeps until the gesture client sends something or the next periodic task is due
+		std::chrono::steady_clock::time_point nextTask = lastStatusReport + std::chrono::seconds(PIPELINE_STATUS_INTERVAL_SECONDS);
+		std::chrono::steady_clock::time_point nextFeedback = lastFeedback + std::chrono::milliseconds(VIDEO_FEEDBACK_INTERVAL_MILLISECONDS);
+		if (VIDEO_FEEDBACK_INTERVAL_MILLISECONDS > 0 && !this->_replaying && nextFeedback < nextTask) {
+			nextTask = nextFeedback;
+		}
+		waitForLoopEvent(nextTask);
+
+		//Written here rather than by the thread that asked, which may be the render thread
+		StageTracer::dumpIfRequested(STAGE_TRACE_DIRECTORY);
+
+		//Periodically reports where frames are piling up
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		//Lets the trainee adapt its bitrate to what the link actually delivers (a replay has no trainee to tell)
+		if (VIDEO_FEEDBACK_INTERVAL_MILLISECONDS > 0 && !this->_replaying && now - lastFeedback >= std::chrono::milliseconds(VIDEO_FEEDBACK_INTERVAL_MILLISECONDS)) {
+			unsigned int networkDrops = _networkDropCount;
+			sendCongestionFeedback(networkDrops - lastFeedbackNetworkDrops);
+
+			lastFeedback = now;
+			lastFeedbackNetworkDrops = networkDrops;
+		}
+		if (now - lastStatusReport >= std::chrono::seconds(PIPELINE_STATUS_INTERVAL_SECONDS)) {
+			VideoPipelineStatus status = getPipelineStatus();
+
+			//Every session reports on its own
+			if (myServer->getSessionCount() > 1) {
+				std::cout << "trainee " << (_session + 1) << (myServer->getFocusedSession() == _session ? " (shown):" : ":") << std::endl;
+			}
+
+			std::cout << "video pipeline queue depths: receive->decode " << status.receiveToDecode
+				<< ", decode->composite " << status.decodeToComposite
+				<< ", composite->hand-off " << status.compositeToHandOff
+				<< "; dropped frames: " << status.droppedFrames << std::endl;
+
+			//Frames that never arrived intact, as opposed to the ones dropped above to keep up
+			if (this->_packetsNumbered) {
+				std::cout << "video network: " << (status.networkDroppedFrames - lastStatus.networkDroppedFrames) << " frames lost, "
+					<< (status.resyncs - lastStatus.resyncs) << " resyncs" << std::endl;
+			}
+
+			//What the jitter buffer made of the datagrams: lost and late pieces cost whole frames
+			if (this->_datagramTransport) {
+				const JitterBufferStatistics& datagrams = status.datagrams;
+				const JitterBufferStatistics& lastDatagrams = lastStatus.datagrams;
+				std::cout << "video datagrams: " << (datagrams.datagramsReceived - lastDatagrams.datagramsReceived) << " received, "
+					<< (datagrams.datagramsLost - lastDatagrams.datagramsLost) << " lost, "
+					<< (datagrams.datagramsReordered - lastDatagrams.datagramsReordered) << " reordered, "
+					<< (datagrams.datagramsLate - lastDatagrams.datagramsLate) << " too late; frames "
+					<< (datagrams.framesIncomplete - lastDatagrams.framesIncomplete) << " incomplete, "
+					<< (datagrams.framesMissing - lastDatagrams.framesMissing) << " missing; jitter "
+					<< datagrams.jitterMilliseconds << " ms" << std::endl;
+			}
+
+			//Decode throughput over the last interval, to check how it scales with decoder threads
+			std::chrono::duration<double> elapsed = now - lastStatusReport;
+			unsigned int framesDecoded = status.decodedFrames - lastStatus.decodedFrames;
+			unsigned long long decodeMicroseconds = status.decodeMicroseconds - lastStatus.decodeMicroseconds;
+			if (framesDecoded > 0) {
+				std::cout << "video decode: " << (framesDecoded / elapsed.count()) << " frames/s, "
+					<< (decodeMicroseconds / 1000.0 / framesDecoded) << " ms/frame" << std::endl;
+			}
+
+			//Reads of the video connection per packet (about one when packets come in bursts), and their size
+			unsigned int packetsReceived = status.receivedPackets - lastStatus.receivedPackets;
+			unsigned long long streamReads = status.streamReads - lastStatus.streamReads;
+			if (!this->_datagramTransport && !this->_replaying && packetsReceived > 0 && streamReads > 0) {
+				std::cout << "video connection: " << ((double)streamReads / packetsReceived) << " reads/packet, "
+					<< ((status.streamBytesRead - lastStatus.streamBytesRead) / 1024.0 / streamReads) << " KB/read" << std::endl;
+			}
+
+			//Render thread time per background upload (small when the copy runs through pixel buffers)
+			unsigned int framesUploaded = status.uploadedFrames - lastStatus.uploadedFrames;
+			unsigned long long uploadMicroseconds = status.uploadMicroseconds - lastStatus.uploadMicroseconds;
+			if (framesUploaded > 0) {
+				std::cout << "texture upload: " << (framesUploaded / elapsed.count()) << " frames/s, "
+					<< (uploadMicroseconds / 1000.0 / framesUploaded) << " ms/frame" << std::endl;
+			}
+
+			//Frames composited but replaced before the render thread took them
+			std::cout << "frames overwritten before display: " << (status.overwrittenFrames - lastStatus.overwrittenFrames) << std::endl;
+
+			//How often this loop woke up, and how much of the time it slept, to confirm it idles when there is nothing to do
+			unsigned long long loopIdleMicroseconds = status.loopIdleMicroseconds - lastStatus.loopIdleMicroseconds;
+			std::cout << "video loop: " << (status.loopWakeUps - lastStatus.loopWakeUps) << " wake-ups ("
+				<< (status.loopGestureWakeUps - lastStatus.loopGestureWakeUps) << " for gestures), idle "
+				<< (100.0 * loopIdleMicroseconds / 1000000.0 / elapsed.count()) << "%" << std::endl;
+
+			//Likewise for the thread that accepts the clients and watches their sockets (shared by the sessions)
+			if (_session == 0) {
+				unsigned long long communicationIdleMicroseconds = status.communicationIdleMicroseconds - lastStatus.communicationIdleMicroseconds;
+				std::cout << "communication: " << (status.communicationWakeUps - lastStatus.communicationWakeUps) << " wake-ups, idle "
+					<< (100.0 * communicationIdleMicroseconds / 1000000.0 / elapsed.count()) << "%" << std::endl;
+
+				//What waits for every tablet; a trainee whose queue keeps growing reads too slowly
+				std::map<unsigned int, SendQueueStatistics> sendQueues;
+				myServer->getSendQueueStatistics(sendQueues);
+				for (std::map<unsigned int, SendQueueStatistics>::iterator it = sendQueues.begin(); it != sendQueues.end(); it++) {
+					std::cout << "json client " << it->first << ": " << it->second.queuedMessages << " messages ("
+						<< (it->second.queuedBytes / 1024.0) << " KB) waiting, " << it->second.sentMessages << " sent, "
+						<< it->second.collapsedMessages << " collapsed" << std::endl;
+				}
+			}
+
+			//Packets the recording could not keep up with; the live video is not held up by them
+			if (_recorder.isRecording()) {
+				std::cout << "recording: " << (status.recording.recordedPackets - lastStatus.recording.recordedPackets) << " packets written, "
+					<< (status.recording.droppedPackets - lastStatus.recording.droppedPackets) << " dropped, longest write "
+					<< status.recording.longestWriteMilliseconds << " ms" << std::endl;
+			}
+			if (_capture.isRecording()) {
+				std::cout << "packet capture: " << (status.capture.recordedPackets - lastStatus.capture.recordedPackets) << " packets written, "
+					<< (status.capture.droppedPackets - lastStatus.capture.droppedPackets) << " dropped, longest write "
+					<< status.capture.longestWriteMilliseconds << " ms" << std::endl;
+			}
+
+			lastStatusReport = now;
+			lastStatus = status;
+		}
+
+		//// Read Gesture client data
+		//Everything it sent since the last wake-up, until there is nodata or incomplete data
+		//(there is one gesture client, read by the first session's loop)
+		while (_session == 0 && myServer->receiveFromClients(&gestureData, gestureBuffSize, GESTURE_NETWORK_CODE) > 0)
+		{
+			myCamera->handleKey(gestureData);
+		}
+
+	}
+
+	_pipelineRunning = false;
+	_receiveThread.join();
+	_decodeThread.join();
+	_compositeThread.join();
+	_handOffThread.join();
+
+	if (this->_usingVideoDecoder) {
+		_parallelDecoder.stop();
+		_videoDecoder.destroyDecoder();
+		_datagramReceiver.close();
+		_recorder.stop();
+		_capture.stop();
+		_replaySource.close();
+	}
+}
+
+/*
+ * Method Overview: Returns the depth of each pipeline queue
+ * Parameters: None
+ * Return: Number of handles waiting in front of each stage
+ */
+VideoPipelineStatus VideoManager::getPipelineStatus()
+{
+	VideoPipelineStatus status;
+
+	status.receiveToDecode = (int)_packetQueue.size();
+	status.decodeToComposite = (int)_decodedFrameQueue.size();
+	status.compositeToHandOff = (int)_compositedFrameQueue.size();
+	status.droppedFrames = _droppedFrameCount;
+	status.networkDroppedFrames = _networkDropCount;
+	status.resyncs = _resyncCount;
+	status.datagrams = _datagramReceiver.getStatistics();
+	status.recording = _recorder.getStatistics();
+	status.capture = _capture.getStatistics();
+	status.decodedFrames = _decodedFrameCount;
+	status.decodeMicroseconds = _decodeMicroseconds;
+	status.loopWakeUps = _loopWakeUps;
+	status.loopGestureWakeUps = _loopGestureWakeUps;
+	status.loopIdleMicroseconds = _loopIdleMicroseconds;
+	status.receivedPackets = _receivedPacketCount;
+	status.streamReads = _streamReadCount;
+	status.streamBytesRead = _streamBytesRead;
+	myServer->getReactorStatistics(status.communicationWakeUps, status.communicationIdleMicroseconds);
+	getBackgroundUploadStatistics(status.uploadedFrames, status.uploadMicroseconds, status.overwrittenFrames);
+
+	return status;
+}
+
+/*
+ * Method Overview: Turns the latest-frame-wins behaviour on or off
+ * Parameters: Whether stale frames should be dropped
+ * Return: None
+ */
+void VideoManager::setLowLatencyMode(bool enabled)
+{
+	_lowLatencyMode = enabled;
+}
+
+/*
+ * Method Overview: Returns the number of frames dropped for freshness
+ * Parameters: None
+ * Return: Number of frames that were received but never shown
+ */
+unsigned int VideoManager::getDroppedFrameCount()
+{
+	return _droppedFrameCount;
+}
+
+/*
+ * Method Overview: Allocates the buffer pools and starts the stages
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::startPipeline()
+{
+	int i;
+
+	//Packets are sized for the largest message plus the padding ffmpeg reads past the end
+	for (i = 0; i < _packetPool.size(); i++)
+	{
+		_packetPool.get(i).data.resize(MAX_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+		_packetPool.get(i).size = 0;
+		_packetPool.get(i).sequence = 0;
+		_packetPool.get(i).captureTimestamp = 0;
+		_packetPool.get(i).startsStream = false;
+	}
+
+	//Decoded frames are at the resolution of the trainee camera, either I420 or packed colour.
+	//They are resized (reusing their storage when it fits) whenever the stream changes resolution
+	for (i = 0; i < _decodedFramePool.size(); i++)
+	{
+		if (this->_usingVideoDecoder) {
+			_videoDecoder.prepareOutput(&_decodedFramePool.get(i), &_decodedFrameStorage[i]);
+		}
+		else {
+			fitFrameBuffer(_decodedFramePool.get(i), _decodedFrameStorage[i], rescamY, rescamX, CV_8UC3);
+		}
+	}
+
+	//Composited frames are at the resolution of the screen, or of the camera when OpenGL transforms them
+	for (i = 0; i < _compositedFramePool.size(); i++)
+	{
+		if (this->_glHomography) {
+			fitFrameBuffer(_compositedFramePool.get(i), _compositedFrameStorage[i], rescamY, rescamX, CV_8UC3);
+		}
+		else {
+			fitFrameBuffer(_compositedFramePool.get(i), _compositedFrameStorage[i], rescompY, rescompX, CV_8UC3);
+		}
+		_compositedFrameInWorldSpace[i] = false;
+	}
+
+	_flippedImage.create(rescamY, rescamX, CV_8UC3);
+	_flippedResizedImage.create(rescompY, rescompX, CV_8UC3);
+
+	_pipelineRunning = true;
+
+	_receiveThread = std::thread(&VideoManager::receiveStage, this);
+	if (_parallelDecoder.numDecoders() > 0) {
+		_decodeThread = std::thread(&VideoManager::parallelDecodeStage, this);
+	}
+	else {
+		_decodeThread = std::thread(&VideoManager::decodeStage, this);
+	}
+	_compositeThread = std::thread(&VideoManager::compositeStage, this);
+	_handOffThread = std::thread(&VideoManager::handOffStage, this);
+}
+
+/*
+ * Method Overview: Backs off when a stage has no input or no buffer
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::idleWait()
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+/*
+ * Method Overview: Waits for more of the video stream
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::waitForVideoData()
+{
+	//Only called once a read found nothing, so the socket is not readable yet
+	//Sleeps until the trainee sends something (or connects)
+	myServer->waitForClients(VIDEO_NETWORK_CODE, RECEIVE_WAIT_MILLISECONDS, _session);
+}
+
+/*
+ * Method Overview: Sleeps until the video loop has something to do
+ * Parameters: When the next periodic task is due
+ * Return: None
+ */
+void VideoManager::waitForLoopEvent(std::chrono::steady_clock::time_point deadline)
+{
+	std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+
+	//Trace requests do not wake the loop, so it looks for them now and then
+	//Rounded up, so it does not wake just before the deadline and spin until it passes
+	long long timeoutMilliseconds = (std::chrono::duration_cast<std::chrono::microseconds>(deadline - waitStart).count() + 999) / 1000;
+	if (timeoutMilliseconds > LOOP_MAX_WAIT_MILLISECONDS) {
+		timeoutMilliseconds = LOOP_MAX_WAIT_MILLISECONDS;
+	}
+	if (timeoutMilliseconds < 0) {
+		timeoutMilliseconds = 0;
+	}
+
+	//Without a gesture client, this waits for one to connect; the other sessions only have the deadline to wait for
+	int result = 0;
+	if (_session == 0) {
+		result = myServer->waitForClients(GESTURE_NETWORK_CODE, (int)timeoutMilliseconds);
+	}
+	else {
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMilliseconds));
+	}
+
+	_loopWakeUps++;
+	if (result > 0) {
+		_loopGestureWakeUps++;
+	}
+	_loopIdleMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
+}
+
+/*
+ * Method Overview: Names a stage thread for the stage trace
+ * Parameters: Name of the stage
+ * Return: The name, with the trainee's number when there are several
+ */
+std::string VideoManager::stageThreadName(const char* stage)
+{
+	if (myServer->getSessionCount() > 1) {
+		return std::string(stage) + " (trainee " + std::to_string(_session + 1) + ")";
+	}
+	return stage;
+}
+
+/*
+ * Method Overview: Receive stage, reads packets from the video socket
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::receiveStage()
+{
+	//Packets read but not queued yet, oldest first
+	std::vector<int> heldHandles;
+
+	StageTracer::setThreadName(stageThreadName("video receive").c_str());
+
+	while (_pipelineRunning)
+	{
+		//Waits for a free packet buffer; the decode stage gives them back
+		int packetHandle = _packetPool.acquire();
+		if (packetHandle == BufferPool<VideoPacket>::INVALID_HANDLE) {
+			idleWait();
+			continue;
+		}
+
+		TraceZone receiveZone("receive");
+
+		if (!receivePacket(_packetPool.get(packetHandle))) {
+			//nodata or incomplete data (not worth a zone)
+			receiveZone.cancel();
+			_packetPool.release(packetHandle);
+			continue;
+		}
+
+		//Decoded after what is left of the last trainee's stream, and waited for before reading the new one
+		if (_packetPool.get(packetHandle).startsStream) {
+			receiveZone.cancel();
+			_packetQueue.push(packetHandle);
+
+			while (_decoderRestartPending && _pipelineRunning)
+			{
+				idleWait();
+			}
+			continue;
+		}
+
+		recordPacketArrival(_packetPool.get(packetHandle));
+		teePacketToRecording(_packetPool.get(packetHandle));
+
+		if (waitsForKeyframe(_packetPool.get(packetHandle))) {
+			_packetPool.release(packetHandle);
+			_networkDropCount++;
+			continue;
+		}
+
+		heldHandles.push_back(packetHandle);
+
+		if (_lowLatencyMode && this->_usingVideoDecoder) {
+			/*
+			 * If we have fallen behind, more packets are already sitting
+			 * in the socket. Read all of them now and only keep the run
+			 * that starts at the newest keyframe: anything before it is
+			 * stale and not needed to decode the newest frame.
+			 */
+			while (completePacketWaiting())
+			{
+				int newerHandle = _packetPool.acquire();
+				if (newerHandle == BufferPool<VideoPacket>::INVALID_HANDLE) {
+					break;
+				}
+
+				VideoPacket& newer = _packetPool.get(newerHandle);
+				if (!receivePacket(newer)) {
+					_packetPool.release(newerHandle);
+					break;
+				}
+
+				recordPacketArrival(newer);
+				teePacketToRecording(newer);
+
+				//A frame lost among the newer packets makes them wait for a keyframe too
+				if (waitsForKeyframe(newer)) {
+					_packetPool.release(newerHandle);
+					_networkDropCount++;
+					continue;
+				}
+
+				if (VideoDecoder::isKeyframe(_receivedCodecId, _receivedStreamFlags, &newer.data[0], newer.size)) {
+					dropPackets(heldHandles);
+				}
+
+				heldHandles.push_back(newerHandle);
+			}
+		}
+
+		//The queue holds as many handles as the pool has buffers, so this cannot fail
+		for (int i = 0; i < (int)heldHandles.size(); i++)
+		{
+			_packetQueue.push(heldHandles[i]);
+		}
+		heldHandles.clear();
+	}
+}
+
+/*
+ * Method Overview: Reads the header at the start of the video stream
+ * Parameters: Header to fill in
+ * Return: None
+ */
+void VideoManager::receiveStreamHeader(VideoStreamHeader& header)
+{
+	//Waits until the trainee has connected and sent all of it
+	while (!takeStreamHeader(header))
+	{
+	}
+}
+
+/*
+ * Method Overview: Reads the header at the start of the video stream, if all of it has come
+ * Parameters: Header to fill in
+ * Return: Whether the header was read (false after waiting for more of it otherwise)
+ */
+bool VideoManager::takeStreamHeader(VideoStreamHeader& header)
+{
+	//The header stays in the stream until all of it has come, so a trainee replaced halfway
+	//through just leaves the next one's header to read from the start
+	if (!bufferStream(BYTES_FOR_LENGTH_MESSAGE)) {
+		waitForVideoData();
+		return false;
+	}
+
+	int extradataSize = 0;
+
+	//Older trainees send packets straight away: keep the MJPEG defaults and leave the data alone
+	if (memcmp(_streamReader.view(BYTES_FOR_LENGTH_MESSAGE), VIDEO_STREAM_HEADER_MAGIC, BYTES_FOR_LENGTH_MESSAGE) != 0)
+	{
+		std::cout << "video stream has no header, assuming MJPEG at " << rescamX << "x" << rescamY << std::endl;
+		header.codecId = AV_CODEC_ID_MJPEG;
+		header.width = rescamX;
+		header.height = rescamY;
+		header.flags = VIDEO_STREAM_FLAG_FRAMED;
+		header.extradata.clear();
+		_streamRestarted = false;
+		return true;
+	}
+
+	if (!bufferStream(VIDEO_STREAM_HEADER_SIZE)) {
+		waitForVideoData();
+		return false;
+	}
+
+	//The header comes from the trainee: one that makes no sense only ends that trainee's session
+	if (!VideoDecoder::parseStreamHeader(_streamReader.view(VIDEO_STREAM_HEADER_SIZE), VIDEO_STREAM_HEADER_SIZE, header, extradataSize)) {
+		std::cout << "error: could not use the video stream header" << std::endl;
+		rejectVideoClient(_streamClient);
+		return false;
+	}
+
+	if (!bufferStream(VIDEO_STREAM_HEADER_SIZE + extradataSize)) {
+		waitForVideoData();
+		return false;
+	}
+
+	header.extradata.resize(extradataSize);
+	if (extradataSize > 0) {
+		memcpy(&header.extradata[0], _streamReader.view(VIDEO_STREAM_HEADER_SIZE, extradataSize), extradataSize);
+	}
+
+	_streamReader.consume(VIDEO_STREAM_HEADER_SIZE + extradataSize);
+	_streamRestarted = false;
+
+	return true;
+}
+
+/*
+ * Method Overview: Reads packets the way the stream header says they are sent
+ * Parameters: Header of the stream
+ * Return: Whether they can be read that way (false if the datagram port cannot be opened)
+ */
+bool VideoManager::useStreamTransport(const VideoStreamHeader& header)
+{
+	//Packets come with sequence numbers and checksums, and the receiver can resync on them
+	this->_frameHeaders = (header.flags & VIDEO_STREAM_FLAG_FRAME_HEADERS) != 0 && !this->_replaying;
+
+	//Packets come as datagrams on their own port instead, put back together by a jitter buffer
+	this->_datagramTransport = (header.flags & VIDEO_STREAM_FLAG_DATAGRAMS) != 0 && !this->_replaying;
+
+	//Either way (and in a capture of either) packets have frame numbers and capture times
+	this->_packetsNumbered = (header.flags & (VIDEO_STREAM_FLAG_FRAME_HEADERS | VIDEO_STREAM_FLAG_DATAGRAMS)) != 0;
+
+	if (this->_replaying) {
+		std::cout << "replaying video packets from " << VIDEO_REPLAY_FILE << " at "
+			<< (VIDEO_REPLAY_SPEED > 0.0 ? VIDEO_REPLAY_SPEED : 0.0) << "x speed (0 = as fast as possible)"
+			<< (VIDEO_REPLAY_LOOP ? ", looping" : "") << std::endl;
+	}
+	else if (this->_datagramTransport) {
+		//Every session has its own port, counting down from VIDEO_DATAGRAM_PORT like the other ports
+		std::string datagramPort = std::to_string(atoi(VIDEO_DATAGRAM_PORT) - _session);
+
+		//A trainee that replaced one sending datagrams too keeps the port, but not the frames the last one left
+		if (_datagramReceiver.isOpen()) {
+			_datagramReceiver.restart();
+		}
+		else if (!_datagramReceiver.open(datagramPort.c_str(), VIDEO_JITTER_BUFFER_MILLISECONDS / 1000.0, VIDEO_DATAGRAM_INJECTED_LOSS_PERCENT)) {
+			std::cout << "error: could not receive video datagrams on port " << datagramPort << std::endl;
+			return false;
+		}
+
+		//From the trainee's own machine only
+		_datagramReceiver.setSender(myServer->getVideoClientAddress(_streamClient));
+
+		std::cout << "video packets are sent as datagrams to port " << datagramPort
+			<< ", waiting up to " << VIDEO_JITTER_BUFFER_MILLISECONDS << " ms for late ones" << std::endl;
+	}
+	else {
+		//Nothing reads the port any more (its statistics stay, for the status report)
+		_datagramReceiver.close();
+
+		std::cout << "video packets are " << (this->_frameHeaders ? "sent with frame headers" : "length-prefixed") << std::endl;
+	}
+
+	return true;
+}
+
+/*
+ * Method Overview: Turns away a trainee whose stream cannot be shown
+ * Parameters: Video client of the trainee
+ * Return: None
+ */
+void VideoManager::rejectVideoClient(unsigned int client)
+{
+	if (client == CommunicationManager::NO_CLIENT) {
+		return;
+	}
+
+	//Only this session is affected: it goes back to waiting, as if the trainee had disconnected
+	std::cout << "closing video client " << client << " of session " << (_session + 1) << ", waiting for another trainee" << std::endl;
+	myServer->closeVideoClient(client);
+}
+
+/*
+ * Method Overview: Starts the stream of a trainee that replaced the last one
+ * Parameters: Packet buffer to turn into the start of the stream
+ * Return: Whether the new trainee's header was read (false after waiting for more of it otherwise)
+ */
+bool VideoManager::restartStream(VideoPacket& packet)
+{
+	VideoStreamHeader header;
+	if (!takeStreamHeader(header)) {
+		return false;
+	}
+
+	std::cout << "new video client: " << avcodec_get_name(header.codecId) << " at " << header.width << "x" << header.height << std::endl;
+
+	//Nothing of the last trainee's session carries over: it may have sent its packets another way,
+	if (!useStreamTransport(header)) {
+		rejectVideoClient(_streamClient);
+		return false;
+	}
+
+	//its sequence numbers, and any keyframe its stream was waiting for, mean nothing for this one,
+	_frameSyncLost = false;
+	_frameSequenceKnown = false;
+	_waitingForKeyframe = false;
+
+	//the link estimate is of the last one's link and clock (its capture times would read as seconds of queueing),
+	{
+		std::lock_guard<std::mutex> lock(_congestionMutex);
+		_congestionEstimator.reset();
+	}
+
+	//and it gets recorded (and captured) into files of its own, with its own header
+	startRecording(header);
+
+	//Its keyframes are told apart by its own codec, while the decode stage sets the decoder up for it
+	_receivedCodecId = header.codecId;
+	_receivedStreamFlags = header.flags;
+
+	//Picked up by the decode stage when it gets to this packet
+	_streamHeader = header;
+	_streamHeaderClient = _streamClient;
+	_decoderRestartPending = true;
+
+	packet.startsStream = true;
+
+	return true;
+}
+
+/*
+ * Method Overview: Reads one packet from the video socket
+ * Parameters: Packet buffer to fill
+ * Return: Whether a complete packet was read
+ */
+bool VideoManager::receivePacket(VideoPacket& packet)
+{
+	packet.size = 0;
+	packet.startsStream = false;
+
+	//A new trainee sends its stream header before its first packet
+	if (this->_usingVideoDecoder && !this->_replaying && _streamRestarted) {
+		return restartStream(packet);
+	}
+
+	/*
+	LARGE_INTEGER time_start_receive_frame;
+	QueryPerformanceCounter(&time_start_receive_frame);
+	*/
+
+	if (this->_usingVideoDecoder && this->_replaying) {
+		receiveReplayPacket(packet);
+	}
+	else if (this->_usingVideoDecoder && this->_datagramTransport) {
+		receiveDatagramPacket(packet);
+	}
+	else if (this->_usingVideoDecoder && this->_frameHeaders) {
+		receiveFramedPacket(packet);
+	}
+	else if (this->_usingVideoDecoder) {
+		receiveLengthPrefixedPacket(packet);
+	}
+	else {
+		// original method of sending frames -- uncompressed bitmaps
+		int imageFromTraineeSize = rescamX * rescamY * 3;
+
+		//Waits until the whole image has come, then takes it out of the stream
+		if (bufferStream(imageFromTraineeSize))
+		{
+			_streamReader.copyOut(&packet.data[0], imageFromTraineeSize);
+			_streamReader.consume(imageFromTraineeSize);
+			packet.size = imageFromTraineeSize;
+		}
+		else {
+			waitForVideoData();
+		}
+	}
+
+	/*
+	LARGE_INTEGER time_end_receive_frame;
+	QueryPerformanceCounter(&time_end_receive_frame);
+	{
+		auto durationSeconds = ((time_end_receive_frame.QuadPart - time_start_receive_frame.QuadPart) / (double)freq.QuadPart);
+		std::cout << "receive_frame duration: " << durationSeconds << " sec" << std::endl;
+	}
+	*/
+
+	return packet.size > 0 || packet.startsStream;
+}
+
+/*
+ * Method Overview: Reads one packet sent after its length
+ * Parameters: Packet buffer to fill
+ * Return: Whether a whole packet was read (false after waiting for more of it otherwise)
+ */
+bool VideoManager::receiveLengthPrefixedPacket(VideoPacket& packet)
+{
+	// first, get the size of the packet (sent as a 4-byte int before the packet)
+	if (!bufferStream(BYTES_FOR_LENGTH_MESSAGE)) {
+		waitForVideoData();
+		return false;
+	}
+
+	const unsigned char* lengthBytes = (const unsigned char*)_streamReader.view(BYTES_FOR_LENGTH_MESSAGE);
+	int packetSizeInBytes = (lengthBytes[3] << 24) | (lengthBytes[2] << 16) | (lengthBytes[1] << 8) | lengthBytes[0]; // little-endian
+
+	//std::cout << "packetSizeInBytes: " << packetSizeInBytes << std::endl;
+
+	if (packetSizeInBytes <= 0 || packetSizeInBytes > MAX_PACKET_SIZE) {
+		std::cout << "error: packet of " << packetSizeInBytes << " bytes does not fit in a packet buffer, skipping it" << std::endl;
+		_streamReader.consume(BYTES_FOR_LENGTH_MESSAGE);
+		skipPacket(packetSizeInBytes);
+		return false;
+	}
+
+	// then, the packet itself: the length stays in the stream until all of it has come
+	if (!bufferStream(BYTES_FOR_LENGTH_MESSAGE + packetSizeInBytes)) {
+		waitForVideoData();
+		return false;
+	}
+
+	_streamReader.consume(BYTES_FOR_LENGTH_MESSAGE);
+	_streamReader.copyOut(&packet.data[0], packetSizeInBytes);
+	_streamReader.consume(packetSizeInBytes);
+
+	packet.size = packetSizeInBytes;
+
+	return true;
+}
+
+/*
+ * Method Overview: Reads one packet sent with a frame header
+ * Parameters: Packet buffer to fill
+ * Return: Whether an intact packet was read
+ */
+bool VideoManager::receiveFramedPacket(VideoPacket& packet)
+{
+	VideoFrameHeader frameHeader;
+	if (!findFrameHeader(frameHeader)) {
+		return false;
+	}
+
+	//The header stays in the stream until the whole payload has come
+	int frameSize = VIDEO_FRAME_HEADER_SIZE + frameHeader.payloadSize;
+	if (!bufferStream(frameSize)) {
+		waitForVideoData();
+		return false;
+	}
+
+	//Checked where it lies, before it is copied out
+	const char* payload = _streamReader.view(VIDEO_FRAME_HEADER_SIZE, frameHeader.payloadSize);
+
+	//Also catches a header that was really just its magic turning up inside a payload.
+	//The frame is not counted here: the gap it leaves in the sequence numbers counts it
+	if (VideoDecoder::frameChecksum(payload, frameHeader.payloadSize) != frameHeader.checksum) {
+		std::cout << "error: frame " << frameHeader.sequence << " failed its checksum, dropping it" << std::endl;
+		_streamReader.consume(frameSize);
+		return false;
+	}
+
+	memcpy(&packet.data[0], payload, frameHeader.payloadSize);
+	_streamReader.consume(frameSize);
+
+	recordFrameSequence(frameHeader.sequence);
+
+	packet.size = frameHeader.payloadSize;
+	packet.sequence = frameHeader.sequence;
+	packet.captureTimestamp = frameHeader.captureTimestamp;
+
+	return true;
+}
+
+/*
+ * Method Overview: Finds the next frame header, at the front of the stream
+ * Parameters: Header to fill in
+ * Return: Whether a header was found (false once the pipeline stops)
+ */
+bool VideoManager::findFrameHeader(VideoFrameHeader& frameHeader)
+{
+	while (_pipelineRunning && !_streamRestarted)
+	{
+		if (!bufferStream(VIDEO_FRAME_HEADER_SIZE)) {
+			waitForVideoData();
+			continue;
+		}
+
+		//In sync, the header is right at the front
+		if (VideoDecoder::parseFrameHeader(_streamReader.view(VIDEO_FRAME_HEADER_SIZE), VIDEO_FRAME_HEADER_SIZE, frameHeader)) {
+			if (_frameSyncLost) {
+				std::cout << "video stream back in sync at frame " << frameHeader.sequence << std::endl;
+				_frameSyncLost = false;
+			}
+			return true;
+		}
+
+		if (!_frameSyncLost) {
+			std::cout << "error: no frame header where one was expected, scanning for the next one" << std::endl;
+			_frameSyncLost = true;
+			_resyncCount++;
+		}
+
+		//Skips to the next place the magic starts (the first byte being a false match), keeping
+		//the last few bytes in case the magic is cut off at the end of what was looked at
+		int scanned = min(_streamReader.size(), FRAME_RESYNC_WINDOW);
+		const char* bytes = _streamReader.view(scanned);
+		int magicSize = (int)strlen(VIDEO_FRAME_HEADER_MAGIC);
+		int skip = scanned - (magicSize - 1);
+
+		for (int i = 1; i + magicSize <= scanned; i++)
+		{
+			if (memcmp(&bytes[i], VIDEO_FRAME_HEADER_MAGIC, magicSize) == 0) {
+				skip = i;
+				break;
+			}
+		}
+
+		_streamReader.consume(skip);
+	}
+
+	return false;
+}
+
+/*
+ * Method Overview: Reads what the trainee has sent into the stream buffer
+ * Parameters: None
+ * Return: Number of bytes read, 0 if nothing had come (or the buffer is full)
+ */
+int VideoManager::fillStreamReader()
+{
+	unsigned int client = myServer->getVideoClient(_session);
+
+	//A new trainee starts a stream of its own; a packet the last one left half sent is no use.
+	//Nothing is read from it here: whatever was reading the last one's packets stops, and its header is read first
+	if (client != _streamClient) {
+		if (_streamReader.size() > 0) {
+			std::cout << "dropping " << _streamReader.size() << " bytes left by the previous video client" << std::endl;
+		}
+		_streamReader.clear();
+		_streamClient = client;
+		_streamRestarted = client != CommunicationManager::NO_CLIENT;
+		return 0;
+	}
+
+	if (client == CommunicationManager::NO_CLIENT) {
+		return 0;
+	}
+
+	//As much as has come, in one call
+	int numBytesRead = _streamReader.fill([this, client](char* first, int firstSize, char* second, int secondSize) {
+		return myServer->receiveAvailableFromVideoClient(client, first, firstSize, second, secondSize);
+	});
+
+	_streamReadCount = _streamReader.getReadCount();
+	_streamBytesRead = _streamReader.getBytesRead();
+
+	return numBytesRead;
+}
+
+/*
+ * Method Overview: Makes sure part of the stream is buffered, without waiting for it
+ * Parameters: Number of bytes needed at the front of the stream
+ * Return: Whether they are buffered
+ */
+bool VideoManager::bufferStream(int bytes)
+{
+	while (_streamReader.size() < bytes)
+	{
+		if (fillStreamReader() == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Method Overview: Reads one packet sent as datagrams
+ * Parameters: Packet buffer to fill
+ * Return: Whether a frame was due (false after a short wait otherwise)
+ */
+bool VideoManager::receiveDatagramPacket(VideoPacket& packet)
+{
+	int size = 0;
+	unsigned int frameNumber = 0;
+	long long captureMicroseconds = 0;
+
+	//The video connection only carried the header, but a trainee that replaces this one starts on it too
+	if (fillStreamReader() == 0 && _streamRestarted) {
+		return false;
+	}
+
+	if (!_datagramReceiver.receiveFrame(&packet.data[0], MAX_PACKET_SIZE, size, frameNumber, captureMicroseconds, DATAGRAM_WAIT_MILLISECONDS)) {
+		return false;
+	}
+
+	//Frames the jitter buffer gave up on leave a gap, just like frames lost with frame headers
+	recordFrameSequence(frameNumber);
+
+	packet.size = size;
+	packet.sequence = frameNumber;
+	packet.captureTimestamp = captureMicroseconds;
+
+	return true;
+}
+
+/*
+ * Method Overview: Reads the next packet of the capture being replayed
+ * Parameters: Packet to read into
+ * Return: Whether a packet was due (false after a short wait otherwise, and for good once the capture has ended)
+ */
+bool VideoManager::receiveReplayPacket(VideoPacket& packet)
+{
+	CapturedPacketInfo info;
+
+	if (!_replaySource.nextPacket(&packet.data[0], MAX_PACKET_SIZE, info, DATAGRAM_WAIT_MILLISECONDS)) {
+		return false;
+	}
+
+	//Frames missing from the capture count as lost, as they did when it was made
+	if (this->_packetsNumbered) {
+		recordFrameSequence(info.sequence);
+	}
+
+	packet.size = info.size;
+	packet.sequence = info.sequence;
+	packet.captureTimestamp = info.captureMicroseconds;
+
+	return true;
+}
+
+/*
+ * Method Overview: Counts frames missing from the sequence
+ * Parameters: Sequence number of the frame just received
+ * Return: None
+ */
+void VideoManager::recordFrameSequence(unsigned int sequence)
+{
+	if (_frameSequenceKnown && sequence != _expectedFrameSequence) {
+		unsigned int missing = sequence - _expectedFrameSequence;
+
+		//A number from the past means the trainee started counting again; that loses nothing
+		if (missing < 0x80000000u) {
+			_networkDropCount += missing;
+
+			//Streams whose keyframes cannot be told apart go on decoding, and the decoder recovers on its own
+			if (VideoDecoder::canDetectKeyframes(_receivedCodecId, _receivedStreamFlags)) {
+				_waitingForKeyframe = true;
+			}
+		}
+	}
+
+	_expectedFrameSequence = sequence + 1;
+	_frameSequenceKnown = true;
+}
+
+/*
+ * Method Overview: Records when a packet arrived, for the feedback
+ * Parameters: Packet just read
+ * Return: None
+ */
+void VideoManager::recordPacketArrival(const VideoPacket& packet)
+{
+	double arrivalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	//Capture times are only known from frame headers or datagrams
+	long long captureMicroseconds = this->_packetsNumbered ? packet.captureTimestamp : -1;
+
+	//What is still waiting in the socket, and buffered but not parsed yet, shows how far behind the reading is
+	//(datagrams are read as they come, so there any delay shows in the capture times; a replay has no socket)
+	int backlogBytes = (this->_datagramTransport || this->_replaying) ? 0 : myServer->availableFromClients(VIDEO_NETWORK_CODE, _session) + _streamReader.size();
+
+	_receivedPacketCount++;
+
+	std::lock_guard<std::mutex> lock(_congestionMutex);
+	_congestionEstimator.packetArrived(arrivalSeconds, packet.size, captureMicroseconds, backlogBytes);
+}
+
+/*
+ * Method Overview: Starts the session recording and packet capture, if configured
+ * Parameters: Header of the stream to record
+ * Return: None
+ */
+void VideoManager::startRecording(const VideoStreamHeader& header)
+{
+	//The files are opened on the recorders' own threads; failures are reported from there
+	if (strlen(VIDEO_RECORDING_DIRECTORY) > 0) {
+		_recorder.start(sessionFilePath(VIDEO_RECORDING_DIRECTORY, VIDEO_RECORDING_CONTAINER), header);
+	}
+
+	if (strlen(VIDEO_CAPTURE_DIRECTORY) > 0) {
+		_capture.start(sessionFilePath(VIDEO_CAPTURE_DIRECTORY, "vcap"), header, RECORDING_FORMAT_CAPTURE);
+	}
+}
+
+/*
+ * Method Overview: Names a file after when the session started (and the trainee, past the first)
+ * Parameters: Folder to put it in, file extension
+ * Return: Path of the file
+ */
+std::string VideoManager::sessionFilePath(const char* directory, const char* extension)
+{
+	time_t now = time(NULL);
+	struct tm localTime;
+	localtime_s(&localTime, &now);
+
+	char fileName[64];
+	strftime(fileName, sizeof(fileName), "session-%Y%m%d-%H%M%S", &localTime);
+
+	//Trainees connecting in the same second still get files of their own
+	std::string trainee = _session > 0 ? "-trainee" + std::to_string(_session + 1) : "";
+
+	return std::string(directory) + "\\" + fileName + trainee + "." + extension;
+}
+
+/*
+ * Method Overview: Copies a packet into the session recording and packet capture
+ * Parameters: Packet just read
+ * Return: None
+ */
+void VideoManager::teePacketToRecording(const VideoPacket& packet)
+{
+	if (!_recorder.isRecording() && !_capture.isRecording()) {
+		return;
+	}
+
+	CapturedPacketInfo info;
+
+	//Capture times when the stream has them, so the recording keeps the trainee's timing
+	info.arrivalMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	info.captureMicroseconds = this->_packetsNumbered ? packet.captureTimestamp : -1;
+	info.sequence = this->_packetsNumbered ? packet.sequence : 0;
+	info.keyframe = VideoDecoder::isKeyframe(_receivedCodecId, _receivedStreamFlags, &packet.data[0], packet.size);
+	info.size = packet.size;
+
+	_recorder.writePacket(info, &packet.data[0]);
+	_capture.writePacket(info, &packet.data[0]);
+}
+
+/*
+ * Method Overview: Sends the trainee a video feedback message
+ * Parameters: Frames lost on the network since the last one
+ * Return: None
+ */
+void VideoManager::sendCongestionFeedback(unsigned int lostFrames)
+{
+	double nowSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	CongestionEstimator::Estimate estimate;
+	{
+		std::lock_guard<std::mutex> lock(_congestionMutex);
+		estimate = _congestionEstimator.estimate(nowSeconds);
+	}
+
+	//Nothing arrived lately, so there is nothing to say
+	if (!estimate.valid) {
+		return;
+	}
+
+	Json::Value message;
+
+	message[COMMAND] = VIDEO_FEEDBACK_COMMAND;
+	message[FEEDBACK_THROUGHPUT] = estimate.throughputBitsPerSecond;
+	message[FEEDBACK_FRAME_RATE] = estimate.packetsPerSecond;
+	message[FEEDBACK_QUEUEING_DELAY] = estimate.hasQueueingDelay ? estimate.queueingDelaySeconds * 1000.0 : -1.0;
+	message[FEEDBACK_RECEIVE_BACKLOG] = estimate.receiveBacklogSeconds * 1000.0;
+	message[FEEDBACK_LOST_FRAMES] = lostFrames;
+	message[FEEDBACK_RECOMMENDED_BITRATE] = estimate.recommendedBitsPerSecond;
+
+	switch (estimate.state)
+	{
+		case CONGESTION_OVERUSE:
+			message[FEEDBACK_CONGESTION] = "overuse";
+			break;
+
+		case CONGESTION_UNDERUSE:
+			message[FEEDBACK_CONGESTION] = "underuse";
+			break;
+
+		default:
+			message[FEEDBACK_CONGESTION] = "normal";
+			break;
+	}
+
+	Json::StreamWriterBuilder wbuilder;
+	wbuilder[INDENTATION] = NO_INDENTATION;
+
+	//One message per line, like the annotation messages
+	std::string to_send = Json::writeString(wbuilder, message) + "\n";
+
+	//Only to this session's trainee; a report still waiting is out of date once the next one comes
+	myServer->sendActionPackets(to_send.c_str(), JSON_NETWORK_CODE, _session, "feedback");
+}
+
+/*
+ * Method Overview: Checks the stream for a complete waiting packet
+ * Parameters: None
+ * Return: Whether the length and the whole packet are already there (or a frame is due from the jitter buffer, or a replayed packet)
+ */
+bool VideoManager::completePacketWaiting()
+{
+	if (this->_replaying) {
+		return _replaySource.isPacketDue();
+	}
+
+	//A new trainee's header is left for receivePacket, outside the backlog of the last one
+	if (_streamRestarted) {
+		return false;
+	}
+
+	if (this->_datagramTransport) {
+		return _datagramReceiver.isFrameDue();
+	}
+
+	//Takes in whatever else has come, in one read
+	fillStreamReader();
+
+	if (_streamRestarted) {
+		return false;
+	}
+
+	int available = _streamReader.size();
+
+	//Anything but a valid header in front is left for receivePacket to resync on
+	if (this->_frameHeaders) {
+		VideoFrameHeader frameHeader;
+
+		if (available < VIDEO_FRAME_HEADER_SIZE
+			|| !VideoDecoder::parseFrameHeader(_streamReader.view(VIDEO_FRAME_HEADER_SIZE), VIDEO_FRAME_HEADER_SIZE, frameHeader)) {
+			return false;
+		}
+
+		return available - VIDEO_FRAME_HEADER_SIZE >= frameHeader.payloadSize;
+	}
+
+	if (available < BYTES_FOR_LENGTH_MESSAGE) {
+		return false;
+	}
+
+	const unsigned char* lengthBytes = (const unsigned char*)_streamReader.view(BYTES_FOR_LENGTH_MESSAGE);
+	int packetSizeInBytes = (lengthBytes[3] << 24) | (lengthBytes[2] << 16) | (lengthBytes[1] << 8) | lengthBytes[0];
+
+	return packetSizeInBytes > 0 && available - BYTES_FOR_LENGTH_MESSAGE >= packetSizeInBytes;
+}
+
+/*
+ * Method Overview: Gives packets back to the pool unused
+ * Parameters: Handles of the packets to drop (cleared on return)
+ * Return: None
+ */
+void VideoManager::dropPackets(std::vector<int>& packetHandles)
+{
+	for (int i = 0; i < (int)packetHandles.size(); i++)
+	{
+		_packetPool.release(packetHandles[i]);
+	}
+
+	_droppedFrameCount += (unsigned int)packetHandles.size();
+	packetHandles.clear();
+}
+
+/*
+ * Method Overview: Holds the stream back after a lost frame, until its next keyframe
+ * Parameters: Packet just received
+ * Return: Whether to drop the packet (the frames that depend on a lost one only decode into garbage)
+ */
+bool VideoManager::waitsForKeyframe(const VideoPacket& packet)
+{
+	if (!_waitingForKeyframe) {
+		return false;
+	}
+
+	if (VideoDecoder::canDetectKeyframes(_receivedCodecId, _receivedStreamFlags)
+		&& !VideoDecoder::isKeyframe(_receivedCodecId, _receivedStreamFlags, &packet.data[0], packet.size)) {
+		return true;
+	}
+
+	_waitingForKeyframe = false;
+	return false;
+}
+
+/*
+ * Method Overview: Skips a backlog ahead to its newest keyframe
+ * Parameters: Handles of the queued packets, oldest first
+ * Return: None
+ */
+void VideoManager::skipToNewestKeyframe(std::vector<int>& packetHandles)
+{
+	for (int i = (int)packetHandles.size() - 1; i > 0; i--)
+	{
+		VideoPacket& packet = _packetPool.get(packetHandles[i]);
+
+		if (_videoDecoder.isKeyframe(&packet.data[0], packet.size)) {
+			std::vector<int> stale(packetHandles.begin(), packetHandles.begin() + i);
+			dropPackets(stale);
+			packetHandles.erase(packetHandles.begin(), packetHandles.begin() + i);
+			return;
+		}
+	}
+}
+
+/*
+ * Method Overview: Takes the next frame out of a stage queue
+ * Parameters (1): Queue to pop from, pool its frames belong to
+ * Parameters (2): Handle of the frame that was popped
+ * Return: Whether there was a frame in the queue
+ */
+bool VideoManager::popNewestFrame(SPSCQueue<int>& queue, BufferPool<cv::Mat>& pool, int& handle)
+{
+	if (!queue.pop(handle)) {
+		return false;
+	}
+
+	if (_lowLatencyMode) {
+		//Anything behind the newest frame would only add latency
+		int newerHandle;
+		while (queue.pop(newerHandle))
+		{
+			pool.release(handle);
+			_droppedFrameCount++;
+			handle = newerHandle;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Method Overview: Discards a packet that is larger than a buffer
+ * Parameters: Size of the packet
+ * Return: None
+ */
+void VideoManager::skipPacket(int packetSizeInBytes)
+{
+	int remaining = packetSizeInBytes;
+
+	//Consumed as it comes, since it may not fit in the stream buffer (and not past the end of the trainee that sent it)
+	while (remaining > 0 && _pipelineRunning && !_streamRestarted)
+	{
+		if (!bufferStream(1)) {
+			waitForVideoData();
+			continue;
+		}
+
+		int chunk = min(remaining, _streamReader.size());
+		_streamReader.consume(chunk);
+		remaining -= chunk;
+	}
+}
+
+/*
+ * Method Overview: Decode stage, turns packets into frames
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::decodeStage()
+{
+	//Packets to decode in this iteration, oldest first
+	std::vector<int> packetHandles;
+
+	StageTracer::setThreadName(stageThreadName("video decode").c_str());
+
+	while (_pipelineRunning)
+	{
+		int packetHandle;
+		if (!_packetQueue.pop(packetHandle)) {
+			idleWait();
+			continue;
+		}
+
+		packetHandles.clear();
+		packetHandles.push_back(packetHandle);
+
+		//If packets are piling up in front of the decoder, jump to the newest keyframe
+		if (_lowLatencyMode && this->_usingVideoDecoder) {
+			while (_packetQueue.pop(packetHandle))
+			{
+				packetHandles.push_back(packetHandle);
+			}
+			skipToNewestKeyframe(packetHandles);
+		}
+
+		//Waits for a free frame buffer; the composite stage gives them back
+		int frameHandle;
+		while ((frameHandle = _decodedFramePool.acquire()) == BufferPool<cv::Mat>::INVALID_HANDLE) {
+			if (!_pipelineRunning) {
+				return;
+			}
+			idleWait();
+		}
+
+		cv::Mat& imageFromTrainee = _decodedFramePool.get(frameHandle);
+
+		//Every packet after a keyframe has to be decoded, but only the last picture is shown
+		int framesDecoded = 0;
+
+		for (int i = 0; i < (int)packetHandles.size(); i++)
+		{
+			VideoPacket& packet = _packetPool.get(packetHandles[i]);
+
+			bool receivedNewFrame = false;
+
+			if (packet.startsStream) {
+				restartDecoder();
+			}
+			else if (this->_usingVideoDecoder && !_decoderReady) {
+				//The trainee whose stream the decoder could not take is being closed; what it sent until then is dropped
+			}
+			else if (this->_usingVideoDecoder) {
+				//Follows the stream's resolution, which the previous packet may have changed
+				this->_videoDecoder.prepareOutput(&imageFromTrainee, &_decodedFrameStorage[frameHandle]);
+
+				// then decode the packet
+				TRACE_ZONE("decode");
+				receivedNewFrame = this->_videoDecoder.decode(&packet.data[0], packet.size, &imageFromTrainee);
+				//std::cout << "received new frame? " << receivedNewFrame << std::endl;
+
+				if (receivedNewFrame) {
+					recordDecodeTime(this->_videoDecoder.getLastDecodeMilliseconds());
+					_decodedFramesFullRange = this->_videoDecoder.isLastFrameFullRange();
+				}
+			}
+			else {
+				//Creates an image from the just obtained data stream
+				Mat img(rescamY, rescamX, CV_8UC3, &packet.data[0]);
+				img.copyTo(imageFromTrainee);
+
+				receivedNewFrame = true;
+			}
+
+			_packetPool.release(packetHandles[i]);
+
+			if (receivedNewFrame) {
+				framesDecoded++;
+			}
+		}
+
+		if (framesDecoded > 0) {
+			_droppedFrameCount += (unsigned int)(framesDecoded - 1);
+			_decodedFrameQueue.push(frameHandle);
+		}
+		else {
+			_decodedFramePool.release(frameHandle);
+		}
+	}
+}
 
 /*
- * Method Overview: Constructor of the class
- * Parameters (1): Instance of the Communication Manager server
- * Parameters (2): Instance of the Command Center
- * Return: Instance of the class
+ * Method Overview: Decode stage used with several MJPEG decoders
+ * Parameters: None
+ * Return: None
  */
-VideoManager::VideoManager(CommunicationManager* server, CommandCenter* pCommander, GUIManager* pGUI, CameraManager* pCamera) 
+void VideoManager::parallelDecodeStage()
 {
-	//Sets the given instance as the one that will be used
-	myServer = server;
+	//Packets to decode in this iteration, oldest first
+	std::vector<int> packetHandles;
 
-	myCamera = pCamera;
+	StageTracer::setThreadName(stageThreadName("video decode").c_str());
 
-	//Image constants
-	rescamX = 640;
-	rescamY = 400; //Tablet resolution
-	//rescamY = 480; //Webcam resolution
+	while (_pipelineRunning)
+	{
+		collectParallelDecodes();
 
-	this->_usingVideoDecoder = true;
+		int packetHandle;
+		if (!_packetQueue.pop(packetHandle)) {
+			idleWait();
+			continue;
+		}
 
-	std::cout << "TODO: set up the correct resolution for incoming frames" << std::endl;
+		packetHandles.clear();
+		packetHandles.push_back(packetHandle);
 
-	//Screen constants
-	rescompX = 1920;
-	rescompY = 1080;
+		//Every MJPEG packet is a keyframe, so this leaves just the newest one
+		if (_lowLatencyMode) {
+			while (_packetQueue.pop(packetHandle))
+			{
+				packetHandles.push_back(packetHandle);
+			}
+			skipToNewestKeyframe(packetHandles);
+		}
 
-	//determined by the resolution of the camera
-	aspectRatioX = 16;
-	aspectRatioY = 9;
+		//Each packet gets its own frame buffer, since they are decoded at the same time
+		for (int i = 0; i < (int)packetHandles.size(); i++)
+		{
+			//A new trainee's stream: the last one's frames come out first (nothing is queued behind it)
+			if (_packetPool.get(packetHandles[i]).startsStream) {
+				while (_parallelDecoder.numInFlight() > 0 && _pipelineRunning) {
+					collectParallelDecodes();
+					idleWait();
+				}
+				_packetPool.release(packetHandles[i]);
+				restartDecoder();
+
+				//Only MJPEG frames decode on their own; anything else goes through the one decoder from now on
+				if (_decoderReady && _videoDecoder.getCodecId() != AV_CODEC_ID_MJPEG) {
+					std::cout << "decoding on one decoder, since the new stream is not MJPEG" << std::endl;
+					_parallelDecoder.stop();
+					decodeStage();
+					return;
+				}
+				continue;
+			}
 
-	//determined by the user
-	panStep = 10;
-	zoomScale = 2;
-	rotationDegree = 0.0;
+			//The trainee whose stream the decoder could not take is being closed; what it sent until then is dropped
+			if (!_decoderReady) {
+				_packetPool.release(packetHandles[i]);
+				continue;
+			}
 
-	//Create the region of interest
-	tl = Point(0,0);
-	br = Point(rescamX,rescamY);
-	roi= Rect(tl,br);
+			ParallelVideoDecoder::Job job;
+			job.packetHandle = packetHandles[i];
+			job.data = &_packetPool.get(job.packetHandle).data[0];
+			job.size = _packetPool.get(job.packetHandle).size;
 
-	//Inits the GUI Manager
-	GUIcreator = pGUI;
+			while ((job.frameHandle = _decodedFramePool.acquire()) == BufferPool<cv::Mat>::INVALID_HANDLE) {
+				if (!_pipelineRunning) {
+					return;
+				}
+				collectParallelDecodes();
+				idleWait();
+			}
+			job.out = &_decodedFramePool.get(job.frameHandle);
+			job.storage = &_decodedFrameStorage[job.frameHandle];
+
+			while (!_parallelDecoder.submit(job)) {
+				if (!_pipelineRunning) {
+					return;
+				}
+				collectParallelDecodes();
+				idleWait();
+			}
+		}
+	}
 }
 
 /*
- * Method Overview: Calls the methods to obtain and create an image
+ * Method Overview: Forwards finished parallel decodes in arrival order
  * Parameters: None
  * Return: None
  */
-void VideoManager::initWindow()
+void VideoManager::collectParallelDecodes()
+{
+	ParallelVideoDecoder::Result result;
+
+	while (_parallelDecoder.collect(result))
+	{
+		_packetPool.release(result.job.packetHandle);
+
+		if (result.gotFrame) {
+			recordDecodeTime(result.decodeMilliseconds);
+			_decodedFramesFullRange = result.fullRange;
+			_decodedFrameQueue.push(result.job.frameHandle);
+		}
+		else {
+			_decodedFramePool.release(result.job.frameHandle);
+		}
+	}
+}
+
+/*
+ * Method Overview: Sets the decoder up for a new trainee's stream
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::restartDecoder()
+{
+	//Whatever the last trainee's decoder held back (references, the parser's half frame) belongs to its stream
+	_videoDecoder.destroyDecoder();
+	_decoderReady = _videoDecoder.initDecoder(_streamHeader, _decoderThreading);
+
+	//The header passed, but ffmpeg would not take the stream (e.g. its extradata)
+	if (!_decoderReady) {
+		rejectVideoClient(_streamHeaderClient);
+	}
+
+	_decoderRestartPending = false;
+}
+
+/*
+ * Method Overview: Accumulates the decode time statistics
+ * Parameters: Time it took to decode one frame
+ * Return: None
+ */
+void VideoManager::recordDecodeTime(double milliseconds)
+{
+	_decodedFrameCount++;
+	_decodeMicroseconds += (unsigned long long)(milliseconds * 1000.0);
+}
+
+/*
+ * Method Overview: Composite stage, transforms the decoded frames
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::compositeStage()
 {
 	//The size of the window to create
 	Size size = Size(rescompX,rescompY);
 
-	//Image matrices that will be used to create the final image
-	Mat temp, rotated, flippedImage, show;
-	Mat flippedResizedImage;
-
-	//Creates a matrix of zeros. 
-	//The size of it will be the size of the obtained webcam image
-	Mat imageFromTrainee = Mat::zeros(rescamY, rescamX, CV_8UC3);
-	//Calculates the total size of image matriz recently created
-	int imageFromTraineeSize = (int)(imageFromTrainee.total()*imageFromTrainee.elemSize());
-	//Buffer to store the receieve data stream in
-	char* sockData;
-	//Character where we will store the message sent from the gesture client
-	char* gestureData;
-	//Buffer size of message from gesture client
-	int gestureBuffSize = 1;
-	//Allocates enough memory for the buffer.
-	sockData = (char *)malloc(sizeof(char)*imageFromTraineeSize +1);
-	//Allocates enough memory for the buffer.
-	gestureData = (char *)malloc(sizeof(char));
+	StageTracer::setThreadName(stageThreadName("video composite").c_str());
 
+	while (_pipelineRunning)
+	{
+		//Shown full screen, or as a thumbnail while another trainee is
+		bool focused = myServer->getFocusedSession() == _session;
 
+		//Nobody would show a new frame yet: the render thread has not taken the last one (or has not started).
+		//The decoded frames wait (stale ones are dropped by popNewestFrame), so the newest is composited once it will be shown
+		if (focused ? isBackgroundFramePending() : isSessionThumbnailPending(_session)) {
+			idleWait();
+			continue;
+		}
 
-	if (this->_usingVideoDecoder) {
-		_videoDecoder.initDecoder(rescamX, rescamY);
-	}
+		int decodedHandle;
+		if (!popNewestFrame(_decodedFrameQueue, _decodedFramePool, decodedHandle)) {
+			idleWait();
+			continue;
+		}
 
+		//Waits for a free screen-sized buffer; the hand-off stage gives them back
+		int compositedHandle;
+		while ((compositedHandle = _compositedFramePool.acquire()) == BufferPool<cv::Mat>::INVALID_HANDLE) {
+			if (!_pipelineRunning) {
+				return;
+			}
+			idleWait();
+		}
 
-	LARGE_INTEGER time_start_video_loop, time_end_video_loop, freq;
-	QueryPerformanceFrequency(&freq);
+		TRACE_ZONE("composite");
 
-	//Infinite loop to obtain and create an image to be displayed
-	while(1)
-	{	
-		QueryPerformanceCounter(&time_start_video_loop);
-		
+		cv::Mat& imageFromTrainee = _decodedFramePool.get(decodedHandle);
+		cv::Mat& show = _compositedFramePool.get(compositedHandle);
+		cv::Mat& showStorage = _compositedFrameStorage[compositedHandle];
+
+		//Every frame brings its own size, since the trainee can switch resolution at any time
+		int frameWidth = imageFromTrainee.cols;
+		int frameHeight = this->_yuvNativePath ? imageFromTrainee.rows * 2 / 3 : imageFromTrainee.rows;
 
 		/*
-		LARGE_INTEGER time_start_receive_frame;
-		QueryPerformanceCounter(&time_start_receive_frame);
+		LARGE_INTEGER time_start_manipulate_image;
+		QueryPerformanceCounter(&time_start_manipulate_image);
 		*/
 
-		//Remove the /**/ when using video streaming
-		//Comment with /**/ when using an image as the background
-		//Add or remove the /**/ right before and after the ///////
-		///////////////////////////////////////////////////////////
-		
-		bool receivedNewFrame = false;
-
-		if (this->_usingVideoDecoder) {
-
-			int BYTES_FOR_LENGTH_MESSAGE = 4;
+		//std::cout << "received new frame, dimensions are: " << img.size().width << ", " << img.size().height << std::endl;
 
-			// first, get the size of the packet (sent as a 4-byte int before the packet)
-			int numBytesReadForPacketSizeReceipt = myServer->receiveFromClients(sockData, BYTES_FOR_LENGTH_MESSAGE, VIDEO_NETWORK_CODE);
-			//std::cout << "read in " << numBytesReadForPacketSizeReceipt << " bytes, telling us how many bytes the packet is" << std::endl;
+		/*
+		* Comment when using video streaming
+		* Uncomment when using an image as the background
+		*/
+		//img = imread("../images/surgical_room.jpg");
 
-			if (numBytesReadForPacketSizeReceipt == BYTES_FOR_LENGTH_MESSAGE) {
-				int packetSizeInBytes = ((unsigned char)sockData[3] << 24) | ((unsigned char)sockData[2] << 16) | ((unsigned char)sockData[1] << 8) | ((unsigned char)sockData[0]); // assumes big-endian
+		// transform the image based on homography
+		cv::Mat homography = myCamera->getHomography();
 
-				//std::cout << "packetSizeInBytes: " << packetSizeInBytes << std::endl;
+		//Annotations are only drawn over the focused trainee
+		bool spriteAnnotations = focused && GUIcreator->hasSpriteAnnotations();
 
-				// then, get the packet itself
-				int numBytesReadForPacket = myServer->receiveFromClients(sockData, packetSizeInBytes, VIDEO_NETWORK_CODE);
-				//std::cout << "read in " << numBytesReadForPacket << " bytes, containing the packet" << std::endl;
+		//Without sprites to draw at screen resolution, OpenGL scales the frame and applies the homography
+		//(thumbnails are only scaled down, so they always stay at camera resolution)
+		bool inWorldSpace = (this->_glHomography || !focused) && !spriteAnnotations;
 
-				if (numBytesReadForPacket == packetSizeInBytes) {
-					// then decode the packet
+		if (inWorldSpace) {
+			//Only the colour conversion and the flip (to fit OpenGL window) are left, at camera resolution
+			fitFrameBuffer(show, showStorage, frameHeight, frameWidth, CV_8UC3);
 
-					receivedNewFrame = this->_videoDecoder.decode(sockData, packetSizeInBytes, &imageFromTrainee);
-					//std::cout << "received new frame? " << receivedNewFrame << std::endl;
-				}
-				else {
-					std::cout << "error: didn't read the right number of bytes for the packet; read in " << numBytesReadForPacket << " instead of " << packetSizeInBytes << std::endl;
-				}
+			if (this->_yuvNativePath) {
+				_yuvConverter.convertFlipScale(imageFromTrainee, _decodedFramesFullRange, show);
 			}
 			else {
-				std::cout << "error: didn't read in the right number of bytes for the packet length" << std::endl;
+				flip(imageFromTrainee, show, 0);
 			}
+
+			_decodedFramePool.release(decodedHandle);
+		}
+		else if (this->_yuvNativePath && !spriteAnnotations) {
+			//Colour conversion, flip, resize and homography in one pass, sampling the decoded frame directly
+			fitFrameBuffer(show, showStorage, rescompY, rescompX, CV_8UC3);
+			_yuvConverter.convertAffine(imageFromTrainee, _decodedFramesFullRange, sourceToScreenTransform(homography, frameWidth, frameHeight), show);
+
+			_decodedFramePool.release(decodedHandle);
 		}
 		else {
-			// original method of sending frames -- uncompressed bitmaps
+			//Sprite annotations live in world space, so they are drawn before the homography is applied
+			if (this->_yuvNativePath) {
+				//Colour conversion, flip (to fit OpenGL window) and resize to our display resolution in one pass
+				_yuvConverter.convertFlipScale(imageFromTrainee, _decodedFramesFullRange, _flippedResizedImage);
 
-			//Receives the image data stream from the client
-			int data_length = myServer->receiveFromClients(sockData, imageFromTraineeSize, VIDEO_NETWORK_CODE);
+				_decodedFramePool.release(decodedHandle);
+			}
+			else {
+				//Flips the image around both axis (to fit OpenGL window)
+				flip(imageFromTrainee, _flippedImage, 0);
 
-			if (data_length <= 0)
-			{
-				//nodata or incomplete data
-				continue;
+				//The decoded frame is no longer needed once it has been flipped
+				_decodedFramePool.release(decodedHandle);
+
+				// resize the image to our display resolution
+				resize(_flippedImage, _flippedResizedImage, size);
 			}
 
-			//Creates an image from the just obtained data stream
-			Mat img(rescamY, rescamX, CV_8UC3, sockData);
+			Mat imageWithSpriteAnnotations;
+			{
+				TRACE_ZONE("sprite annotations");
+				imageWithSpriteAnnotations = GUIcreator->overlaySpriteAnnotations(_flippedResizedImage);
+			}
 
-			receivedNewFrame = true;
+			//Applies the homography matrix to every pixel on the image
+			fitFrameBuffer(show, showStorage, rescompY, rescompX, CV_8UC3);
+			warpAffine(imageWithSpriteAnnotations, show, homography(cv::Rect(0,0,3,2)), imageWithSpriteAnnotations.size());
 		}
 
 		/*
-		LARGE_INTEGER time_end_receive_frame;
-		QueryPerformanceCounter(&time_end_receive_frame);
+		LARGE_INTEGER time_end_manipulate_image;
+		QueryPerformanceCounter(&time_end_manipulate_image);
 		{
-			auto durationSeconds = ((time_end_receive_frame.QuadPart - time_start_receive_frame.QuadPart) / (double)freq.QuadPart);
-			std::cout << "receive_frame duration: " << durationSeconds << " sec" << std::endl;
+			auto durationSeconds = ((time_end_manipulate_image.QuadPart - time_start_manipulate_image.QuadPart) / (double)freq.QuadPart);
+			std::cout << "manipulate image duration: " << durationSeconds << " sec" << std::endl;
 		}
 		*/
 
+		_compositedFrameInWorldSpace[compositedHandle] = inWorldSpace;
 
+		_compositedFrameQueue.push(compositedHandle);
+	}
+}
 
+/*
+ * Method Overview: Maps decoded frame pixels straight to the screen
+ * Parameters: Camera homography (world space to screen space), size of the decoded frame
+ * Return: 2x3 affine transform from the decoded frame to the screen
+ */
+cv::Mat VideoManager::sourceToScreenTransform(const cv::Mat& homography, int frameWidth, int frameHeight)
+{
+	//Flip and resize to the display resolution, lining up pixel centres like resize() does
+	double scaleX = (double)rescompX / frameWidth;
+	double scaleY = (double)rescompY / frameHeight;
 
-		if (receivedNewFrame) {
-
-			LARGE_INTEGER time_start_manipulate_image;
-			QueryPerformanceCounter(&time_start_manipulate_image);
+	cv::Mat flipAndResize = cv::Mat::eye(3, 3, CV_64F);
+	flipAndResize.at<double>(0, 0) = scaleX;
+	flipAndResize.at<double>(0, 2) = 0.5 * scaleX - 0.5;
+	flipAndResize.at<double>(1, 1) = -scaleY;
+	flipAndResize.at<double>(1, 2) = (frameHeight - 0.5) * scaleY - 0.5;
 
-			//std::cout << "received new frame, dimensions are: " << img.size().width << ", " << img.size().height << std::endl;
-			///////////////////////////////////////////////////////////
+	cv::Mat sourceToScreen = homography * flipAndResize;
 
-			/*
-			* Comment when using video streaming
-			* Uncomment when using an image as the background
-			*/
-			//img = imread("../images/surgical_room.jpg");
+	return sourceToScreen(cv::Rect(0,0,3,2));
+}
 
-			//Flips the image around both axis (to fit OpenGL window)
-			flip(imageFromTrainee, flippedImage, 0);
+/*
+ * Method Overview: Hand-off stage, adds the GUI and passes to OpenGL
+ * Parameters: None
+ * Return: None
+ */
+void VideoManager::handOffStage()
+{
+	StageTracer::setThreadName(stageThreadName("video hand-off").c_str());
 
-			// resize the image to our display resolution
-			resize(flippedImage, flippedResizedImage, size);
+	while (_pipelineRunning)
+	{
+		int compositedHandle;
+		if (!popNewestFrame(_compositedFrameQueue, _compositedFramePool, compositedHandle)) {
+			idleWait();
+			continue;
+		}
 
-			// transform the image based on homography
-			cv::Mat homography = myCamera->getHomography();
+		TRACE_ZONE("hand-off");
 
+		cv::Mat& show = _compositedFramePool.get(compositedHandle);
 
-			Mat imageWithSpriteAnnotations = GUIcreator->overlaySpriteAnnotations(flippedResizedImage);
+		//Another trainee fills the screen, so this one becomes a thumbnail
+		//(a frame made for the screen just before the focus moved is dropped)
+		if (myServer->getFocusedSession() != _session) {
+			if (_compositedFrameInWorldSpace[compositedHandle]) {
+				updateSessionThumbnail(_session, show);
+			}
 
+			_compositedFramePool.release(compositedHandle);
+			continue;
+		}
 
-			//Applies the homography matrix to every pixel on the image
-			warpAffine(imageWithSpriteAnnotations, show, homography(cv::Rect(0,0,3,2)), imageWithSpriteAnnotations.size());
+		std::lock_guard<std::mutex> focusedLock(_focusedHandOffMutex);
 
-			/*
-			LARGE_INTEGER time_end_manipulate_image;
-			QueryPerformanceCounter(&time_end_manipulate_image);
+		if (_compositedFrameInWorldSpace[compositedHandle]) {
+			//OpenGL draws the GUI over the transformed frame, so it is only redrawn (and uploaded) when it changes
 			{
-				auto durationSeconds = ((time_end_manipulate_image.QuadPart - time_start_manipulate_image.QuadPart) / (double)freq.QuadPart);
-				std::cout << "manipulate image duration: " << durationSeconds << " sec" << std::endl;
+				TraceZone guiZone("GUI overlay");
+				if (GUIcreator->createGUIOverlay(_guiOverlayImage)) {
+					updateGUIOverlayImage(_guiOverlayImage);
+				}
+				else {
+					guiZone.cancel();
+				}
 			}
-			*/
-		}
-		
-		//Enables the image to be controlled by keyboard events
-		keyboardInteractions();
-
-		if(!show.empty())
-		{	
-			//OpenGL Call
 
-			/*
-			LARGE_INTEGER time_start_create_gui;
-			QueryPerformanceCounter(&time_start_create_gui);
-			*/
-
-			Mat backgroundWithGUI = GUIcreator->createGUI(show);
+			updateBackgroundOpenCVImage(show, true);
 
-			/*
-			LARGE_INTEGER time_end_create_gui;
-			QueryPerformanceCounter(&time_end_create_gui);
-			{
-				auto durationSeconds = ((time_end_create_gui.QuadPart - time_start_create_gui.QuadPart) / (double)freq.QuadPart);
-				std::cout << "create_gui duration: " << durationSeconds << " sec" << std::endl;
-			}
-			*/
+			_compositedFramePool.release(compositedHandle);
+			continue;
+		}
 
-			/*
-			LARGE_INTEGER time_start_set_image;
-			QueryPerformanceCounter(&time_start_set_image);
-			*/
+		//OpenGL Call
 
-			updateBackgroundOpenCVImage(backgroundWithGUI);
+		/*
+		LARGE_INTEGER time_start_create_gui;
+		QueryPerformanceCounter(&time_start_create_gui);
+		*/
 
-			/*
-			LARGE_INTEGER time_end_set_image;
-			QueryPerformanceCounter(&time_end_set_image);
-			{
-				auto durationSeconds = ((time_end_set_image.QuadPart - time_start_set_image.QuadPart) / (double)freq.QuadPart);
-				std::cout << "set_image duration: " << durationSeconds << " sec" << std::endl;
-			}
-			*/
+		Mat backgroundWithGUI;
+		{
+			TRACE_ZONE("GUI overlay");
+			backgroundWithGUI = GUIcreator->createGUI(show);
 		}
-		
+
 		/*
-		QueryPerformanceCounter(&time_end_video_loop);
+		LARGE_INTEGER time_end_create_gui;
+		QueryPerformanceCounter(&time_end_create_gui);
 		{
-			auto durationSeconds = ((time_end_video_loop.QuadPart - time_start_video_loop.QuadPart) / (double)freq.QuadPart);
-			std::cout << "video loop duration: " << durationSeconds << " sec" << std::endl;
+			auto durationSeconds = ((time_end_create_gui.QuadPart - time_start_create_gui.QuadPart) / (double)freq.QuadPart);
+			std::cout << "create_gui duration: " << durationSeconds << " sec" << std::endl;
 		}
 		*/
 
-		//// Read Gesture client data
-		//cout << "BEFORE READING FROM GESTURE CLIENT" << endl;
-		int gesture_data_length = myServer->receiveFromClients(gestureData, gestureBuffSize, GESTURE_NETWORK_CODE);
-		//cout << "AFTER READOMG FROM GESTURE CLIENT" << endl;
-		if (gesture_data_length <= 0){
-			//nodata or incomplete data
-			continue;
-		}else{
-			myCamera->handleKey(*gestureData);
-		}
-
-	}
+		//createGUI draws into its own images, so the composited frame can be reused now
+		_compositedFramePool.release(compositedHandle);
 
-	if (this->_usingVideoDecoder) {
-		_videoDecoder.destroyDecoder();
-	}
+		/*
+		LARGE_INTEGER time_start_set_image;
+		QueryPerformanceCounter(&time_start_set_image);
+		*/
 
+		updateBackgroundOpenCVImage(backgroundWithGUI);
 
+		/*
+		LARGE_INTEGER time_end_set_image;
+		QueryPerformanceCounter(&time_end_set_image);
+		{
+			auto durationSeconds = ((time_end_set_image.QuadPart - time_start_set_image.QuadPart) / (double)freq.QuadPart);
+			std::cout << "set_image duration: " << durationSeconds << " sec" << std::endl;
+		}
+		*/
+	}
 }
 
 /*
@@ -402,117 +2042,4 @@ void VideoManager::OpenCVtouchControls(int command, long double x, long double y
 		}
 		break;
 	}
-}
-
-/*
- * Method Overview: Applies transformation based on keyboard events
- * Parameters: None
- * Return: None
- */
-void VideoManager::keyboardInteractions()
-{
-	//Wait for a keyboard event to happen
-	key = waitKey(40);
-
-	//Zooms
-	if ( key=='i' )//Zoom in
-	{
-		//Evaluates if the image can zoomed in
-		if (tl.x+(aspectRatioX*zoomScale)<((br.x-tl.x)/2.0f)+tl.x)
-		{
-			//Modifies the region of interest
-			tl = Point(tl.x+(aspectRatioX*zoomScale),tl.y+(aspectRatioY*zoomScale));
-			br = Point(br.x-(aspectRatioX*zoomScale),br.y-(aspectRatioY*zoomScale));
-			roi= Rect(tl,br);
-		}
-	}
-
-	if ( key=='o' )//Zoom out
-	{
-		//Evaluates if the image can zoomed out
-		if (br.x+(aspectRatioX*zoomScale)<=rescamX && br.y+(aspectRatioY*zoomScale)<=rescamY
-			&& tl.x-(aspectRatioX*zoomScale)>=0 && tl.y-(aspectRatioY*zoomScale)>=0)//ojo?
-		{
-			//Modifies the region of interest
-			tl = Point(tl.x-(aspectRatioX*zoomScale),tl.y-(aspectRatioY*zoomScale));
-			br = Point(br.x+(aspectRatioX*zoomScale),br.y+(aspectRatioY*zoomScale));
-			roi= Rect(tl,br); 
-		}
-	}
-
-	//Rotations
-	if ( key=='z' )//Rotate clockwise
-	{
-		//Change the degree by which the image is being rotated
-		rotationDegree += 2;
-	}
-
-	if ( key=='x' )//Rotate counter-clockwise
-	{
-		//Change the degree by which the image is being rotated
-		rotationDegree -= 2;
-	}
-
-	/*
-	 * PANS AND ZOOMS ARE "UNITED"
-	 * e.g if you want to zoom out, you need to set into a 
-	 * "zoom out-able" position in the image
-	 */
-
-	//Pans
-	if ( key=='w' )//up
-	{
-		//Evaluates if the can be translated up
-		if (tl.y-panStep>0)
-		{
-			tl = Point(tl.x,tl.y-panStep);
-			br = Point(br.x,br.y-panStep);
-			roi= Rect(tl,br); 
-		}
-	}
-
-	if ( key=='s' )//down
-	{
-		//Evaluates if the can be translated down
-		if (br.y+panStep<rescamY)
-		{
-			//Modifies the region of interest
-			tl = Point(tl.x,tl.y+panStep);
-			br = Point(br.x,br.y+panStep);
-			roi= Rect(tl,br); 
-		}
-	}
-
-	if ( key=='d' )//left
-	{
-		//Evaluates if the can be translated left
-		if (tl.x-panStep>0)
-		{
-			//Modifies the region of interest
-			tl = Point(tl.x-panStep,tl.y);
-			br = Point(br.x-panStep,br.y);
-			roi= Rect(tl,br); 
-		}
-	}
-
-	if ( key=='a' )//right
-	{
-		//Evaluates if the can be translated right
-		if (br.x+panStep<rescamX)
-		{
-			//Modifies the region of interest
-			tl = Point(tl.x+panStep,tl.y);
-			br = Point(br.x+panStep,br.y);
-			roi= Rect(tl,br); 
-		}
-	}
-
-	if ( key=='r' ) //Reverts to original
-	{
-		//Resets region of interest and rotation degree
-		rotationDegree = 0.0;
-		tl = Point(0,0);
-		br = Point(rescamX,rescamY);
-		roi= Rect(tl,br); 
-	}
 }
\ No newline at end of file
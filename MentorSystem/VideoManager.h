@@ -18,6 +18,11 @@
  * some geometrical transformations methods. The image then is sent 
  * to the AnnotationManager, the one in charge of drawing it on the
  * screen.
+ * The work is split into pipeline stages (receive, decode, composite
+ * and hand-off), each on its own thread. The stages are linked by
+ * bounded single-producer/single-consumer queues that carry handles
+ * into fixed pools of packet and frame buffers, so a slow stage
+ * backs up its own queue instead of stalling the socket reads.
  */
 ///////////////////////////////////////////////////////////////////
 
@@ -34,14 +39,97 @@
 #include "touchCommands.h"//Touch events standard commands
 #include "communicationDefinitions.h"//Socket-related definitions
 #include "VideoDecoder.h"	// used for decoding FFMPEG frames from trainee system
+#include "ParallelVideoDecoder.h"//Several MJPEG decoders side by side
+#include "YUVConverter.h"//Fused YUV to BGR, flip and resize
+#include "SPSCQueue.h"//Lock-free queues linking the pipeline stages
+#include "BufferPool.h"//Preallocated packet and frame buffers
+#include "FrameBuffer.h"//Frame buffers that keep their memory across resolution changes
+#include "CongestionEstimator.h"//Throughput and queueing delay of the video link
+#include "DatagramVideoReceiver.h"//Video packets over UDP, through a jitter buffer
+#include "VideoRecorder.h"//Session recordings of the compressed video
+#include "PacketReplaySource.h"//Captured video played back instead of the trainee's
+#include "StreamReader.h"//Video connection read in large chunks, parsed in place
+#include "StageTracer.h"//Per-thread stage timings for Chrome traces
+#include "json.h"//Video feedback messages
+#include "JSONDefinitions.h"//Video feedback keywords
+#include <mutex>//Congestion estimator shared by the receive stage and the feedback
+#include <thread>//Pipeline stage threads
+#include <atomic>//Pipeline running flag
+#include <chrono>//Video loop deadlines
+#include "Config.h"//Video low-latency mode setting
 
 using namespace cv;//OpenCV Standard
 
+//A compressed video packet as read from the video socket
+struct VideoPacket
+{
+	//Storage for the packet, allocated once with room for decoder padding
+	std::vector<char> data;
+
+	//Number of valid bytes in data
+	int size;
+
+	//From the frame header or the datagrams, when the stream has them (0 otherwise)
+	unsigned int sequence;
+	long long captureTimestamp;
+
+	//Not a packet but the start of a new trainee's stream: the decode stage sets the decoder up again for it
+	bool startsStream;
+};
+
+//Snapshot of how many items are waiting between each pair of stages
+struct VideoPipelineStatus
+{
+	int receiveToDecode;
+	int decodeToComposite;
+	int compositeToHandOff;
+
+	//Frames dropped so far to keep the display fresh (low-latency mode)
+	unsigned int droppedFrames;
+
+	//Frames lost or corrupted on the way from the trainee (gaps in the frame sequence numbers),
+	//and how often the receiver had to scan for the next frame header
+	unsigned int networkDroppedFrames;
+	unsigned int resyncs;
+
+	//Loss, reordering and jitter of the video datagrams, when the stream sends them
+	JitterBufferStatistics datagrams;
+
+	//Packets written to the session recording and the packet capture, and dropped because the disk fell behind
+	VideoRecorderStatistics recording;
+	VideoRecorderStatistics capture;
+
+	//Frames decoded so far, and the total time spent decoding them
+	unsigned int decodedFrames;
+	unsigned long long decodeMicroseconds;
+
+	//Frames uploaded to the background texture so far, and the render thread time spent on them
+	unsigned int uploadedFrames;
+	unsigned long long uploadMicroseconds;
+
+	//Frames handed to the render thread but replaced by a newer one before it took them
+	unsigned int overwrittenFrames;
+
+	//Wake-ups of the video loop (and how many came from gestures), and the time it spent asleep
+	unsigned int loopWakeUps;
+	unsigned int loopGestureWakeUps;
+	unsigned long long loopIdleMicroseconds;
+
+	//Wake-ups of the communication thread, and the time it spent asleep
+	unsigned long long communicationWakeUps;
+	unsigned long long communicationIdleMicroseconds;
+
+	//Packets received so far, and the reads of the video connection it took (and the bytes they brought)
+	unsigned int receivedPackets;
+	unsigned long long streamReads;
+	unsigned long long streamBytesRead;
+};
+
 class VideoManager
 {
 public:
 	//-------------------------Methods---------------------------//
-	VideoManager(CommunicationManager* server, CommandCenter* pCommander, GUIManager* pGUI, CameraManager* pCamera);//Class Constructor
+	VideoManager(CommunicationManager* server, CommandCenter* pCommander, GUIManager* pGUI, CameraManager* pCamera, int session = 0);//Class Constructor
 
 	//Apply geometrical transformations based on touch events
 	/*CURRENTLY NOT BEING USED*/
@@ -50,20 +138,145 @@ public:
 	//Starts the execution of the methods
 	void initWindow();
 
+	//Returns the current depth of every queue in the video pipeline
+	VideoPipelineStatus getPipelineStatus();
+
+	//Enables or disables dropping stale frames when the pipeline falls behind
+	void setLowLatencyMode(bool enabled);
+
+	//Returns how many frames were dropped in low-latency mode
+	unsigned int getDroppedFrameCount();
+
 	//------------------------Variables--------------------------//
 	//None
 
 private:
 
 	//-------------------------Methods---------------------------//
-	//Handles the keyborad received events
-	void keyboardInteractions();
+	//Sleeps until the gesture client sends something, or until deadline
+	void waitForLoopEvent(std::chrono::steady_clock::time_point deadline);
 
-	//------------------------Variables--------------------------//
-	//Key for keybord inputs
-	int key;
+	//Name of a stage thread, telling the trainee apart when there are several
+	std::string stageThreadName(const char* stage);
+
+	//Allocates the buffer pools and starts the pipeline stage threads
+	void startPipeline();
+
+	//Pipeline stage: reads compressed packets from the video socket
+	void receiveStage();
+
+	//Pipeline stage: decodes packets into frames at camera resolution
+	void decodeStage();
+
+	//Pipeline stage: decodes packets on several MJPEG decoders, keeping their order
+	void parallelDecodeStage();
+
+	//Passes the frames the parallel decoders have finished on to the composite stage
+	void collectParallelDecodes();
+
+	//Adds one decoded frame to the decode time statistics
+	void recordDecodeTime(double milliseconds);
+
+	//Pipeline stage: flips, scales, overlays sprites and applies the camera homography
+	//(or only converts and flips, when OpenGL does the rest)
+	void compositeStage();
+
+	//Combines the flip, the resize and the camera homography into one transform
+	cv::Mat sourceToScreenTransform(const cv::Mat& homography, int frameWidth, int frameHeight);
+
+	//Pipeline stage: overlays the GUI and hands the frame to the OpenGL thread
+	void handOffStage();
+
+	//Reads the codec, resolution and extradata the trainee sends first
+	void receiveStreamHeader(VideoStreamHeader& header);
+
+	//Takes the stream header out of the stream once all of it has come (false after waiting for more of it otherwise)
+	bool takeStreamHeader(VideoStreamHeader& header);
+
+	//Sets the transport flags from a stream header, and opens (or restarts, or closes) the datagram receiver.
+	//Returns false if the datagram port cannot be opened
+	bool useStreamTransport(const VideoStreamHeader& header);
+
+	//Closes a trainee's video client whose stream cannot be shown, leaving the other sessions alone
+	void rejectVideoClient(unsigned int client);
+
+	//Reads the header of a trainee that replaced the last one, resets what the receive stage kept
+	//of the last one's session, and turns the packet into the start of the new stream
+	bool restartStream(VideoPacket& packet);
+
+	//Decode stage: sets the decoder up for the stream the receive stage started (and turns the trainee away if it cannot)
+	void restartDecoder();
+
+	//Reads one packet (length-prefixed, with a frame header, or a raw bitmap) from the video socket
+	bool receivePacket(VideoPacket& packet);
+
+	//Reads one length-prefixed packet
+	bool receiveLengthPrefixedPacket(VideoPacket& packet);
+
+	//Reads one packet that comes with a frame header, checking its checksum and sequence number
+	bool receiveFramedPacket(VideoPacket& packet);
+
+	//Finds the next frame header, first skipping anything in front of it, and leaves it at the front of the stream
+	bool findFrameHeader(VideoFrameHeader& frameHeader);
+
+	//Reads whatever the trainee has sent into _streamReader, without waiting
+	int fillStreamReader();
+
+	//Reads until the stream has the given number of bytes buffered, without waiting: whether it has
+	bool bufferStream(int bytes);
+
+	//Takes the next frame the jitter buffer has put together from the video datagrams
+	bool receiveDatagramPacket(VideoPacket& packet);
+
+	//Takes the next packet of the capture being replayed, once it is due
+	bool receiveReplayPacket(VideoPacket& packet);
+
+	//Counts the frames missing between the last sequence number and this one
+	void recordFrameSequence(unsigned int sequence);
+
+	//Feeds the arrival of a packet to the congestion estimator
+	void recordPacketArrival(const VideoPacket& packet);
+
+	//Starts recording (and capturing) the session into VIDEO_RECORDING_DIRECTORY (and VIDEO_CAPTURE_DIRECTORY), if set,
+	//finishing the files of the last trainee
+	void startRecording(const VideoStreamHeader& header);
+
+	//Path of a new file in the given folder, named after when the session started
+	std::string sessionFilePath(const char* directory, const char* extension);
+
+	//Hands a copy of a packet to the session recording and capture, without waiting for the disk
+	void teePacketToRecording(const VideoPacket& packet);
+
+	//Tells the trainee, on the JSON channel, how the video link is doing
+	void sendCongestionFeedback(unsigned int lostFrames);
 
-	//Received image constants
+	//Reads (and discards) a packet that does not fit in a pool buffer
+	void skipPacket(int packetSizeInBytes);
+
+	//Checks if a whole length-prefixed (or frame header) packet has already come,
+	//or a frame is due from the jitter buffer
+	bool completePacketWaiting();
+
+	//Returns packets to the pool without decoding them
+	void dropPackets(std::vector<int>& packetHandles);
+
+	//After a lost frame, whether a packet has to be dropped because it is not the keyframe the stream waits for
+	bool waitsForKeyframe(const VideoPacket& packet);
+
+	//Drops the packets queued before the newest one that decodes on its own
+	void skipToNewestKeyframe(std::vector<int>& packetHandles);
+
+	//Pops the oldest frame, or in low-latency mode the newest one (dropping the rest)
+	bool popNewestFrame(SPSCQueue<int>& queue, BufferPool<cv::Mat>& pool, int& handle);
+
+	//Backs off briefly when a stage has nothing to do
+	void idleWait();
+
+	//Sleeps until more of the video stream comes (once everything that came has been read)
+	void waitForVideoData();
+
+	//------------------------Variables--------------------------//
+	//Received image size, from the stream header (frames can change it later)
 	int rescamX;
 	int rescamY;
 
@@ -93,6 +306,13 @@ private:
 	//Instance of the communication server
 	CommunicationManager* myServer;
 
+	//Trainee session whose video this pipeline shows (0 also reads the gesture client)
+	int _session;
+
+	//The focused session's hand-off stage owns the GUI and the background texture;
+	//held while handing off, since the focus can move between two of its frames
+	static std::mutex _focusedHandOffMutex;
+
 	CameraManager* myCamera;
 
 	//Instance of the GUI creator
@@ -100,6 +320,156 @@ private:
 
 	VideoDecoder _videoDecoder;
 	bool _usingVideoDecoder;
+
+	//Used instead of _videoDecoder when MJPEG frames are decoded in parallel
+	ParallelVideoDecoder _parallelDecoder;
+
+	//Whether decoded frames are I420, converted by _yuvConverter in the composite stage
+	bool _yuvNativePath;
+	YUVConverter _yuvConverter;
+
+	//Whether every packet comes with a frame header (see VIDEO_STREAM_FLAG_FRAME_HEADERS).
+	//Like the two below, set by the receive stage for every trainee, and read by the status report
+	std::atomic<bool> _frameHeaders;
+
+	//Whether packets come as UDP datagrams (see VIDEO_STREAM_FLAG_DATAGRAMS), read by _datagramReceiver
+	std::atomic<bool> _datagramTransport;
+	DatagramVideoReceiver _datagramReceiver;
+
+	//Whether packets carry frame numbers and capture times (frame headers, datagrams, or a capture of either)
+	std::atomic<bool> _packetsNumbered;
+
+	//Writes the packets the receive stage reads to a file, on its own thread, for watching and for replaying
+	VideoRecorder _recorder;
+	VideoRecorder _capture;
+
+	//Whether packets come from a capture (see VIDEO_REPLAY_FILE) instead of the trainee
+	bool _replaying;
+	PacketReplaySource _replaySource;
+
+	//The video connection, buffered by the receive stage (and by receiveStreamHeader before it starts),
+	//and the client it was read from, to drop what is left of a trainee that was replaced
+	StreamReader _streamReader;
+	unsigned int _streamClient;
+
+	//Set when another trainee starts sending: its stream header comes first, and the packet reads stop until it has been read
+	bool _streamRestarted;
+
+	//Header of the newest stream, written by the receive stage before it queues the packet that starts it
+	//(the queue hands it over to the decode stage), and how the decoder is threaded
+	VideoStreamHeader _streamHeader;
+	unsigned int _streamHeaderClient;
+	DecoderThreadingConfig _decoderThreading;
+
+	//Whether the decoder is set up (only the decode stage uses it); packets of a stream it could not take are dropped
+	bool _decoderReady;
+
+	//Codec and header flags of the stream the receive stage reads, for telling its keyframes apart without the decoder
+	AVCodecID _receivedCodecId;
+	int _receivedStreamFlags;
+
+	//Set while the decode stage sets the decoder up again from _streamHeader; the receive stage waits, so the next trainee cannot overwrite it
+	std::atomic<bool> _decoderRestartPending;
+
+	//Packets the receive stage has read
+	std::atomic<unsigned int> _receivedPacketCount;
+
+	//Reads of the video connection, and the bytes they brought, copied out of _streamReader for the status report
+	std::atomic<unsigned long long> _streamReadCount;
+	std::atomic<unsigned long long> _streamBytesRead;
+
+	//Receive stage state for frame headers: scanning for the next one after losing track,
+	//the sequence number expected next, and skipping to a keyframe after a lost frame
+	bool _frameSyncLost;
+	bool _frameSequenceKnown;
+	unsigned int _expectedFrameSequence;
+	bool _waitingForKeyframe;
+
+	//Whether OpenGL scales frames and applies the camera homography (see VIDEO_GL_HOMOGRAPHY)
+	bool _glHomography;
+
+	//Number of buffers in each pool (and capacity of each queue)
+	static const int NUM_PACKET_BUFFERS = 8;
+	static const int NUM_DECODED_FRAME_BUFFERS = 4;
+	static const int NUM_COMPOSITED_FRAME_BUFFERS = 3;
+
+	//Seconds between pipeline status reports on the console
+	static const int PIPELINE_STATUS_INTERVAL_SECONDS = 5;
+
+	//Longest the video loop sleeps, since trace requests do not wake it
+	static const int LOOP_MAX_WAIT_MILLISECONDS = 100;
+
+	//Longest the receive stage waits for the trainee before it checks whether the pipeline still runs
+	static const int RECEIVE_WAIT_MILLISECONDS = 100;
+
+	//Buffer pools shared by the stages, passed around by handle
+	BufferPool<VideoPacket> _packetPool;
+	BufferPool<cv::Mat> _decodedFramePool;
+	BufferPool<cv::Mat> _compositedFramePool;
+
+	//Queues of handles linking receive -> decode -> composite -> hand-off
+	SPSCQueue<int> _packetQueue;
+	SPSCQueue<int> _decodedFrameQueue;
+	SPSCQueue<int> _compositedFrameQueue;
+
+	//Scratch images owned by the composite stage, reused for every frame
+	cv::Mat _flippedImage;
+	cv::Mat _flippedResizedImage;
+
+	//Memory behind the decoded and composited frames, only ever grown (see fitFrameBuffer)
+	cv::Mat _decodedFrameStorage[NUM_DECODED_FRAME_BUFFERS];
+	cv::Mat _compositedFrameStorage[NUM_COMPOSITED_FRAME_BUFFERS];
+
+	//Whether each composited frame is still at camera resolution, for OpenGL to transform
+	bool _compositedFrameInWorldSpace[NUM_COMPOSITED_FRAME_BUFFERS];
+
+	//The GUI on its own, drawn by the hand-off stage for frames OpenGL transforms
+	cv::Mat _guiOverlayImage;
+
+	std::thread _receiveThread;
+	std::thread _decodeThread;
+	std::thread _compositeThread;
+	std::thread _handOffThread;
+
+	std::atomic<bool> _pipelineRunning;
+
+	//Latest-frame-wins: drain backlogs and only show the newest frame
+	std::atomic<bool> _lowLatencyMode;
+
+	//Frames received but never shown because a newer one replaced them
+	std::atomic<unsigned int> _droppedFrameCount;
+
+	//Throughput and queueing delay of the video link, fed by the receive stage
+	CongestionEstimator _congestionEstimator;
+	std::mutex _congestionMutex;
+
+	//Frames lost on the network (or unusable without one that was), and resyncs, counted by the receive stage
+	std::atomic<unsigned int> _networkDropCount;
+	std::atomic<unsigned int> _resyncCount;
+
+	//Decode statistics, written by the decode stage
+	std::atomic<unsigned int> _decodedFrameCount;
+	std::atomic<unsigned long long> _decodeMicroseconds;
+
+	//Colour range of the decoded I420 frames, set by the decode stage
+	std::atomic<bool> _decodedFramesFullRange;
+
+	//Wake-ups of the video loop, the ones the gesture client caused, and the time it slept (read from the loop itself)
+	unsigned int _loopWakeUps;
+	unsigned int _loopGestureWakeUps;
+	unsigned long long _loopIdleMicroseconds;
+
+	//Size of the little-endian length sent before every packet
+	static const int BYTES_FOR_LENGTH_MESSAGE = 4;
+
+	//Bytes looked at in one go when scanning for the next frame header
+	static const int FRAME_RESYNC_WINDOW = 4096;
+
+	//Video connection buffered at most: the largest packet and its header, with room for the next ones to come in behind it
+	static const int STREAM_BUFFER_SIZE = 2 * MAX_PACKET_SIZE;
+
+	//Longest the receive stage waits for the jitter buffer (or a replayed packet) before checking whether the pipeline still runs
+	static const int DATAGRAM_WAIT_MILLISECONDS = 10;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "VideoRecorder.h"
+#include <chrono>
+#include <iostream>
+#include <cstring>
+
+// Timestamps are handed in as microseconds
+static const AVRational MICROSECONDS = { 1, 1000000 };
+
+static std::string errorString(int error)
+{
+	char message[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+	av_strerror(error, message, sizeof(message));
+	return message;
+}
+
+VideoRecorder::VideoRecorder()
+	: _format(RECORDING_FORMAT_CONTAINER)
+	, _packetPool(NUM_QUEUED_PACKETS)
+	, _packetQueue(NUM_QUEUED_PACKETS)
+	, _recording(false)
+	, _waitingForKeyframe(true)
+	, _keyframeSeen(false)
+	, _formatContext(NULL)
+	, _stream(NULL)
+	, _firstTimestampKnown(false)
+	, _firstTimestampMicroseconds(0)
+	, _lastDts(AV_NOPTS_VALUE)
+	, _recordedPackets(0)
+	, _recordedBytes(0)
+	, _droppedPackets(0)
+	, _longestWriteMicroseconds(0)
+	, _fileFirstPacket(0)
+	, _fileFirstDrop(0)
+{
+}
+
+VideoRecorder::~VideoRecorder()
+{
+	stop();
+}
+
+bool VideoRecorder::start(const std::string& path, const VideoStreamHeader& header, VideoRecordingFormat format)
+{
+	stop();
+
+	// the muxer needs whole frames; pieces of an elementary stream would first have to be parsed
+	if (format == RECORDING_FORMAT_CONTAINER && (header.flags & VIDEO_STREAM_FLAG_FRAMED) == 0) {
+		std::cout << "error: cannot record a video stream that is not sent as whole frames" << std::endl;
+		return false;
+	}
+
+	// packets queued after the last recording stopped
+	int handle;
+	while (_packetQueue.pop(handle)) {
+		_packetPool.release(handle);
+	}
+
+	_path = path;
+	_header = header;
+	_format = format;
+
+	_waitingForKeyframe = true;
+	_keyframeSeen = false;
+	_firstTimestampKnown = false;
+	_lastDts = AV_NOPTS_VALUE;
+
+	// the statistics go on from the last file (e.g. of the trainee this one replaced); the file's own counts start here
+	_fileFirstPacket = _recordedPackets;
+	_fileFirstDrop = _droppedPackets;
+
+	_recording = true;
+	_writerThread = std::thread(&VideoRecorder::writerLoop, this);
+
+	return true;
+}
+
+void VideoRecorder::stop()
+{
+	_recording = false;
+
+	if (_writerThread.joinable()) {
+		_writerThread.join();
+	}
+}
+
+bool VideoRecorder::isRecording() const
+{
+	return _recording;
+}
+
+void VideoRecorder::writePacket(const CapturedPacketInfo& info, const char* data)
+{
+	if (!_recording) {
+		return;
+	}
+
+	// the file starts at a keyframe, and starts again at one after a gap
+	// (a capture keeps everything: it is replayed as it came, gaps included)
+	if (_format == RECORDING_FORMAT_CONTAINER && _waitingForKeyframe && !info.keyframe) {
+		if (_keyframeSeen) {
+			_droppedPackets++;
+		}
+		return;
+	}
+
+	int handle = _packetPool.acquire();
+	if (handle == BufferPool<QueuedPacket>::INVALID_HANDLE) {
+		_droppedPackets++;
+		_waitingForKeyframe = true;
+		return;
+	}
+
+	QueuedPacket& packet = _packetPool.get(handle);
+
+	if ((int)packet.data.size() < info.size) {
+		packet.data.resize(info.size);
+	}
+	memcpy(&packet.data[0], data, info.size);
+	packet.info = info;
+
+	// the queue holds as many handles as the pool has buffers, so this cannot fail
+	_packetQueue.push(handle);
+
+	_waitingForKeyframe = false;
+	_keyframeSeen = true;
+}
+
+void VideoRecorder::writerLoop()
+{
+	bool opened = openOutput();
+
+	if (!opened) {
+		_recording = false;
+	}
+
+	while (_recording || !_packetQueue.empty())
+	{
+		int handle;
+		if (!_packetQueue.pop(handle)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		if (opened) {
+			writeQueuedPacket(_packetPool.get(handle));
+		}
+		_packetPool.release(handle);
+	}
+
+	if (opened) {
+		closeOutput();
+	}
+}
+
+bool VideoRecorder::openOutput()
+{
+	if (_format == RECORDING_FORMAT_CAPTURE) {
+		if (!_captureWriter.open(_path, _header)) {
+			return false;
+		}
+
+		std::cout << "capturing the video stream to " << _path << std::endl;
+		return true;
+	}
+
+	av_register_all();
+
+	// the container follows the file extension
+	int error = avformat_alloc_output_context2(&_formatContext, NULL, NULL, _path.c_str());
+	if (error < 0 || _formatContext == NULL) {
+		std::cout << "error: cannot record to " << _path << ": " << errorString(error) << std::endl;
+		_formatContext = NULL;
+		return false;
+	}
+
+	_stream = avformat_new_stream(_formatContext, NULL);
+	if (_stream == NULL) {
+		std::cout << "error: cannot add the video to " << _path << std::endl;
+		avformat_free_context(_formatContext);
+		_formatContext = NULL;
+		return false;
+	}
+
+	_stream->time_base = MICROSECONDS;
+
+	// codec parameters, as the muxer reads them from the stream's codec context
+	AVCodecContext* codec = _stream->codec;
+	codec->codec_type = AVMEDIA_TYPE_VIDEO;
+	codec->codec_id = _header.codecId;
+	codec->width = _header.width;
+	codec->height = _header.height;
+	codec->time_base = MICROSECONDS;
+
+	if (!_header.extradata.empty()) {
+		codec->extradata = (uint8_t*)av_mallocz(_header.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+		memcpy(codec->extradata, &_header.extradata[0], _header.extradata.size());
+		codec->extradata_size = (int)_header.extradata.size();
+	}
+
+	if (_formatContext->oformat->flags & AVFMT_GLOBALHEADER) {
+		codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+
+	if ((_formatContext->oformat->flags & AVFMT_NOFILE) == 0) {
+		error = avio_open(&_formatContext->pb, _path.c_str(), AVIO_FLAG_WRITE);
+		if (error < 0) {
+			std::cout << "error: cannot open " << _path << " for recording: " << errorString(error) << std::endl;
+			avformat_free_context(_formatContext);
+			_formatContext = NULL;
+			return false;
+		}
+	}
+
+	error = avformat_write_header(_formatContext, NULL);
+	if (error < 0) {
+		std::cout << "error: cannot start the recording in " << _path << ": " << errorString(error) << std::endl;
+		avio_closep(&_formatContext->pb);
+		avformat_free_context(_formatContext);
+		_formatContext = NULL;
+		return false;
+	}
+
+	std::cout << "recording the video stream to " << _path << std::endl;
+
+	return true;
+}
+
+void VideoRecorder::writeQueuedPacket(const QueuedPacket& packet)
+{
+	std::chrono::steady_clock::time_point writeStart = std::chrono::steady_clock::now();
+	int error = 0;
+
+	if (_format == RECORDING_FORMAT_CAPTURE) {
+		error = _captureWriter.write(packet.info, &packet.data[0]) ? 0 : AVERROR(EIO);
+	}
+	else {
+		long long timestampMicroseconds = packet.info.captureMicroseconds >= 0 ? packet.info.captureMicroseconds : packet.info.arrivalMicroseconds;
+
+		if (!_firstTimestampKnown) {
+			_firstTimestampMicroseconds = timestampMicroseconds;
+			_firstTimestampKnown = true;
+		}
+
+		// the muxer may have picked a coarser time base; timestamps must still go up
+		int64_t dts = av_rescale_q(timestampMicroseconds - _firstTimestampMicroseconds, MICROSECONDS, _stream->time_base);
+		if (_lastDts != AV_NOPTS_VALUE && dts <= _lastDts) {
+			dts = _lastDts + 1;
+		}
+		_lastDts = dts;
+
+		AVPacket avPacket;
+		av_init_packet(&avPacket);
+		avPacket.data = (uint8_t*)&packet.data[0];
+		avPacket.size = packet.info.size;
+		avPacket.stream_index = _stream->index;
+		avPacket.flags = packet.info.keyframe ? AV_PKT_FLAG_KEY : 0;
+		avPacket.pts = dts;
+		avPacket.dts = dts;
+
+		// a single stream needs no interleaving, and the packet data stays ours
+		error = av_write_frame(_formatContext, &avPacket);
+	}
+
+	unsigned long long writeMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - writeStart).count();
+	if (writeMicroseconds > _longestWriteMicroseconds) {
+		_longestWriteMicroseconds = writeMicroseconds;
+	}
+
+	if (error < 0) {
+		std::cout << "error: writing to the recording failed: " << errorString(error) << std::endl;
+		return;
+	}
+
+	_recordedPackets++;
+	_recordedBytes += packet.info.size;
+}
+
+void VideoRecorder::closeOutput()
+{
+	if (_format == RECORDING_FORMAT_CAPTURE) {
+		_captureWriter.close();
+
+		std::cout << "packet capture saved to " << _path << ": " << (_recordedPackets - _fileFirstPacket) << " packets, "
+			<< (_droppedPackets - _fileFirstDrop) << " dropped" << std::endl;
+		return;
+	}
+
+	int error = av_write_trailer(_formatContext);
+	if (error < 0) {
+		std::cout << "error: cannot finish the recording in " << _path << ": " << errorString(error) << std::endl;
+	}
+
+	if ((_formatContext->oformat->flags & AVFMT_NOFILE) == 0) {
+		avio_closep(&_formatContext->pb);
+	}
+
+	avformat_free_context(_formatContext);
+	_formatContext = NULL;
+	_stream = NULL;
+
+	std::cout << "recording saved to " << _path << ": " << (_recordedPackets - _fileFirstPacket) << " packets, "
+		<< (_droppedPackets - _fileFirstDrop) << " dropped" << std::endl;
+}
+
+VideoRecorderStatistics VideoRecorder::getStatistics() const
+{
+	VideoRecorderStatistics statistics;
+
+	statistics.recordedPackets = _recordedPackets;
+	statistics.recordedBytes = _recordedBytes;
+	statistics.droppedPackets = _droppedPackets;
+	statistics.longestWriteMilliseconds = _longestWriteMicroseconds / 1000.0;
+
+	return statistics;
+}
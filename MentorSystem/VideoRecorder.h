@@ -0,0 +1,135 @@
+#pragma once
+
+/*
+
+VideoRecorder writes the compressed video packets, as they come from the
+trainee, into a Matroska or MP4 file for reviewing the session later. The
+packets are muxed as they are (no re-encoding), so recording costs a copy
+of each packet on the receive path and nothing else.
+
+The receive stage hands packets over through a bounded SPSCQueue of
+handles into a BufferPool, like the pipeline stages do. A background
+thread takes them off the queue and does everything that touches the
+disk, opening and finishing the file included. When the disk stalls and
+the queue fills up, packets are dropped (and counted) instead of holding
+up the receive stage; the recording then waits for the next keyframe, so
+what is written after a gap still decodes.
+
+Timestamps are capture times from the trainee when the stream has them,
+otherwise arrival times. Packets are taken to be whole frames in decode
+order with no reordering (pts = dts), which is what the trainee sends
+for live video.
+
+It can also write a packet capture (see PacketCapture.h) instead, which
+keeps the arrival times and frame numbers for replaying the stream. A
+capture does not wait for keyframes: it keeps every packet that was not
+dropped, so a replay goes through the same gaps.
+
+writePacket() is called from one thread (the receive stage); start(),
+stop() and the statistics from another.
+
+*/
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SPSCQueue.h"
+#include "BufferPool.h"
+#include "VideoDecoder.h"
+#include "PacketCapture.h"
+
+enum VideoRecordingFormat
+{
+	// Muxed into a container by libavformat, for watching
+	RECORDING_FORMAT_CONTAINER,
+
+	// A packet capture, for PacketReplaySource
+	RECORDING_FORMAT_CAPTURE
+};
+
+// Counted over every file the recorder has written, so they only go up
+struct VideoRecorderStatistics
+{
+	unsigned int recordedPackets;
+	unsigned long long recordedBytes;
+
+	// Packets dropped because the queue to the writer was full
+	unsigned int droppedPackets;
+
+	// Slowest single write so far
+	double longestWriteMilliseconds;
+};
+
+class VideoRecorder
+{
+public:
+	VideoRecorder();
+	~VideoRecorder();
+
+	// Starts recording a stream with the given header into a new file. A container
+	// follows the extension (.mkv, .mp4, ...). Returns false if recording cannot start
+	bool start(const std::string& path, const VideoStreamHeader& header, VideoRecordingFormat format = RECORDING_FORMAT_CONTAINER);
+
+	// Writes what is still queued, finishes the file and stops the writer thread
+	void stop();
+
+	bool isRecording() const;
+
+	// Receive stage: queues a copy of a packet to be written, or drops it if the queue is full.
+	// Never waits. info.arrivalMicroseconds is on any clock that does not jump back;
+	// info.captureMicroseconds is negative when the stream has no capture times
+	void writePacket(const CapturedPacketInfo& info, const char* data);
+
+	VideoRecorderStatistics getStatistics() const;
+
+	// Packets that can wait for the writer at once
+	static const int NUM_QUEUED_PACKETS = 64;
+
+private:
+	struct QueuedPacket
+	{
+		// Grown to the largest packet seen, then reused
+		std::vector<char> data;
+		CapturedPacketInfo info;
+	};
+
+	// Writer thread: opens the file, writes packets as they are queued, finishes the file
+	void writerLoop();
+
+	bool openOutput();
+	void writeQueuedPacket(const QueuedPacket& packet);
+	void closeOutput();
+
+	std::string _path;
+	VideoStreamHeader _header;
+	VideoRecordingFormat _format;
+
+	BufferPool<QueuedPacket> _packetPool;
+	SPSCQueue<int> _packetQueue;
+
+	std::thread _writerThread;
+	std::atomic<bool> _recording;
+
+	// Receive stage side: nothing is queued until a keyframe, at the start and after a drop.
+	// start() resets them from the caller's thread, possibly while a packet is being written
+	std::atomic<bool> _waitingForKeyframe;
+	std::atomic<bool> _keyframeSeen;
+
+	// Writer thread side
+	PacketCaptureWriter _captureWriter;
+	AVFormatContext* _formatContext;
+	AVStream* _stream;
+	bool _firstTimestampKnown;
+	long long _firstTimestampMicroseconds;
+	int64_t _lastDts;
+
+	std::atomic<unsigned int> _recordedPackets;
+	std::atomic<unsigned long long> _recordedBytes;
+	std::atomic<unsigned int> _droppedPackets;
+	std::atomic<unsigned long long> _longestWriteMicroseconds;
+
+	// The statistics when the current file was started
+	unsigned int _fileFirstPacket;
+	unsigned int _fileFirstDrop;
+};
@@ -0,0 +1,608 @@
+#include "YUVConverter.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define YUV_CONVERTER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets any function use any intrinsic; gcc/clang need to be told per function
+#if defined(YUV_CONVERTER_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+	// Full range (JPEG): Y is used as is
+	const YUVCoefficients FULL_RANGE_COEFFICIENTS = { 0, 64, 90, 22, 46, 113 };
+
+	// Limited range: Y spans 16..235 and chroma 16..240
+	const YUVCoefficients LIMITED_RANGE_COEFFICIENTS = { 16, 75, 102, 25, 52, 129 };
+
+	const int FIXED_SHIFT = 16;
+	const double FIXED_ONE = 65536.0;
+
+	inline int32_t toFixed(double value)
+	{
+		return (int32_t)std::floor(value * FIXED_ONE + 0.5);
+	}
+
+	// Narrows [lower, upper) to the x where min <= start + step * x < max
+	void clipInterval(double start, double step, double min, double max, double& lower, double& upper)
+	{
+		if (step == 0.0) {
+			if (start < min || start >= max) {
+				upper = lower;
+			}
+			return;
+		}
+
+		double atMin = (min - start) / step;
+		double atMax = (max - start) / step;
+
+		if (step > 0.0) {
+			lower = std::max(lower, atMin);
+			upper = std::min(upper, atMax);
+		}
+		else {
+			lower = std::max(lower, atMax);
+			upper = std::min(upper, atMin);
+		}
+	}
+
+	// Where a 16.16 position already clamped to a plane falls: the two
+	// columns and rows around it and the 8-bit weights of the second ones
+	struct BilinearTap
+	{
+		int offset00;
+		int offset01;
+		int offset10;
+		int offset11;
+		int fx;
+		int fy;
+	};
+
+	inline void makeTap(int32_t x, int32_t y, int stride, int width, int height, BilinearTap& tap)
+	{
+		int x0 = x >> FIXED_SHIFT;
+		int y0 = y >> FIXED_SHIFT;
+		int x1 = x0 + (x0 + 1 < width ? 1 : 0);
+		int row0 = y0 * stride;
+		int row1 = (y0 + 1 < height) ? row0 + stride : row0;
+
+		tap.offset00 = row0 + x0;
+		tap.offset01 = row0 + x1;
+		tap.offset10 = row1 + x0;
+		tap.offset11 = row1 + x1;
+		tap.fx = (x >> (FIXED_SHIFT - 8)) & 0xFF;
+		tap.fy = (y >> (FIXED_SHIFT - 8)) & 0xFF;
+	}
+
+	inline uint8_t sampleTap(const uint8_t* plane, const BilinearTap& tap)
+	{
+		int top = plane[tap.offset00] * (256 - tap.fx) + plane[tap.offset01] * tap.fx;
+		int bottom = plane[tap.offset10] * (256 - tap.fx) + plane[tap.offset11] * tap.fx;
+
+		return (uint8_t)((top * (256 - tap.fy) + bottom * tap.fy + 32768) >> 16);
+	}
+
+	inline int32_t clampFixed(int32_t value, int32_t max)
+	{
+		return value < 0 ? 0 : (value > max ? max : value);
+	}
+
+	inline uint8_t clampToByte(int value)
+	{
+		return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+	}
+
+	//------------------------------Scalar------------------------------//
+
+	void blendRowsScalar(const uint8_t* row0, const uint8_t* row1, int weight1, uint8_t* out, int width)
+	{
+		int weight0 = 256 - weight1;
+
+		for (int x = 0; x < width; x++) {
+			out[x] = (uint8_t)((row0[x] * weight0 + row1[x] * weight1 + 128) >> 8);
+		}
+	}
+
+	void convertRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, const YUVCoefficients& c, uint8_t* bgr, int width)
+	{
+		for (int x = 0; x < width; x++) {
+			int luma = (y[x] - c.yOffset) * c.yScale + 32;
+			int cb = u[x] - 128;
+			int cr = v[x] - 128;
+
+			bgr[3*x + 0] = clampToByte((luma + c.uToB * cb) >> 6);
+			bgr[3*x + 1] = clampToByte((luma - c.uToG * cb - c.vToG * cr) >> 6);
+			bgr[3*x + 2] = clampToByte((luma + c.vToR * cr) >> 6);
+		}
+	}
+
+#ifdef YUV_CONVERTER_X86
+
+	//-------------------------------SSE2-------------------------------//
+
+	TARGET_SSE2 void blendRowsSSE2(const uint8_t* row0, const uint8_t* row1, int weight1, uint8_t* out, int width)
+	{
+		// the products reach 255 * 256, so they are kept as unsigned 16-bit values
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i w0 = _mm_set1_epi16((short)(256 - weight1));
+		const __m128i w1 = _mm_set1_epi16((short)weight1);
+		const __m128i round = _mm_set1_epi16(128);
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x));
+
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+
+			_mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(lo, hi));
+		}
+
+		blendRowsScalar(row0 + x, row1 + x, weight1, out + x, width - x);
+	}
+
+	// Converts 8 pixels held as 16-bit lanes. Saturating adds clamp the same
+	// way the scalar version does, since anything past 32767 >> 6 is > 255.
+	TARGET_SSE2 inline void convertPixelsSSE2(__m128i y, __m128i u, __m128i v, const YUVCoefficients& c, __m128i& b, __m128i& g, __m128i& r)
+	{
+		const __m128i round = _mm_set1_epi16(32);
+		const __m128i bias = _mm_set1_epi16(128);
+
+		__m128i luma = _mm_adds_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(c.yOffset)), _mm_set1_epi16(c.yScale)), round);
+		__m128i cb = _mm_sub_epi16(u, bias);
+		__m128i cr = _mm_sub_epi16(v, bias);
+
+		b = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(c.uToB))), 6);
+		g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(c.uToG))), _mm_mullo_epi16(cr, _mm_set1_epi16(c.vToG))), 6);
+		r = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cr, _mm_set1_epi16(c.vToR))), 6);
+	}
+
+	TARGET_SSE2 void convertRowSSE2(const uint8_t* y, const uint8_t* u, const uint8_t* v, const YUVCoefficients& c, uint8_t* bgr, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		// SSE2 has no byte shuffle, so the channels are interleaved from a small buffer
+		uint8_t planar[3][16];
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m128i y8 = _mm_loadu_si128((const __m128i*)(y + x));
+			__m128i u8 = _mm_loadu_si128((const __m128i*)(u + x));
+			__m128i v8 = _mm_loadu_si128((const __m128i*)(v + x));
+
+			__m128i bLo, gLo, rLo, bHi, gHi, rHi;
+			convertPixelsSSE2(_mm_unpacklo_epi8(y8, zero), _mm_unpacklo_epi8(u8, zero), _mm_unpacklo_epi8(v8, zero), c, bLo, gLo, rLo);
+			convertPixelsSSE2(_mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi8(u8, zero), _mm_unpackhi_epi8(v8, zero), c, bHi, gHi, rHi);
+
+			_mm_storeu_si128((__m128i*)planar[0], _mm_packus_epi16(bLo, bHi));
+			_mm_storeu_si128((__m128i*)planar[1], _mm_packus_epi16(gLo, gHi));
+			_mm_storeu_si128((__m128i*)planar[2], _mm_packus_epi16(rLo, rHi));
+
+			uint8_t* out = bgr + 3*x;
+			for (int i = 0; i < 16; i++) {
+				out[3*i + 0] = planar[0][i];
+				out[3*i + 1] = planar[1][i];
+				out[3*i + 2] = planar[2][i];
+			}
+		}
+
+		convertRowScalar(y + x, u + x, v + x, c, bgr + 3*x, width - x);
+	}
+
+	//-------------------------------AVX2-------------------------------//
+
+	TARGET_AVX2 void blendRowsAVX2(const uint8_t* row0, const uint8_t* row1, int weight1, uint8_t* out, int width)
+	{
+		const __m256i w0 = _mm256_set1_epi16((short)(256 - weight1));
+		const __m256i w1 = _mm256_set1_epi16((short)weight1);
+		const __m256i round = _mm256_set1_epi16(128);
+
+		int x = 0;
+		for (; x + 32 <= width; x += 32) {
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x + 16));
+
+			__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(a0), w0), _mm256_mullo_epi16(_mm256_cvtepu8_epi16(b0), w1));
+			__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(a1), w0), _mm256_mullo_epi16(_mm256_cvtepu8_epi16(b1), w1));
+
+			lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+			hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+
+			// packus works per 128-bit lane; put the quadwords back in order
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+			_mm256_storeu_si256((__m256i*)(out + x), packed);
+		}
+
+		blendRowsScalar(row0 + x, row1 + x, weight1, out + x, width - x);
+	}
+
+	TARGET_AVX2 void convertRowAVX2(const uint8_t* y, const uint8_t* u, const uint8_t* v, const YUVCoefficients& c, uint8_t* bgr, int width)
+	{
+		const __m256i round = _mm256_set1_epi16(32);
+		const __m256i bias = _mm256_set1_epi16(128);
+		const __m256i yOffset = _mm256_set1_epi16(c.yOffset);
+		const __m256i yScale = _mm256_set1_epi16(c.yScale);
+		const __m256i uToB = _mm256_set1_epi16(c.uToB);
+		const __m256i uToG = _mm256_set1_epi16(c.uToG);
+		const __m256i vToG = _mm256_set1_epi16(c.vToG);
+		const __m256i vToR = _mm256_set1_epi16(c.vToR);
+
+		// byte shuffles that interleave 16 B, G and R values into 48 bytes of BGR
+		const __m128i shuffleB0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+		const __m128i shuffleG0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+		const __m128i shuffleR0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+		const __m128i shuffleB1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+		const __m128i shuffleG1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+		const __m128i shuffleR1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+		const __m128i shuffleB2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+		const __m128i shuffleG2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+		const __m128i shuffleR2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m256i y16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x)));
+			__m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u + x))), bias);
+			__m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(v + x))), bias);
+
+			__m256i luma = _mm256_adds_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y16, yOffset), yScale), round);
+
+			__m256i b16 = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, uToB)), 6);
+			__m256i g16 = _mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(luma, _mm256_mullo_epi16(cb, uToG)), _mm256_mullo_epi16(cr, vToG)), 6);
+			__m256i r16 = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cr, vToR)), 6);
+
+			// 16 clamped bytes per channel
+			__m128i b = _mm_packus_epi16(_mm256_castsi256_si128(b16), _mm256_extracti128_si256(b16, 1));
+			__m128i g = _mm_packus_epi16(_mm256_castsi256_si128(g16), _mm256_extracti128_si256(g16, 1));
+			__m128i r = _mm_packus_epi16(_mm256_castsi256_si128(r16), _mm256_extracti128_si256(r16, 1));
+
+			__m128i* out = (__m128i*)(bgr + 3*x);
+			_mm_storeu_si128(out + 0, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, shuffleB0), _mm_shuffle_epi8(g, shuffleG0)), _mm_shuffle_epi8(r, shuffleR0)));
+			_mm_storeu_si128(out + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, shuffleB1), _mm_shuffle_epi8(g, shuffleG1)), _mm_shuffle_epi8(r, shuffleR1)));
+			_mm_storeu_si128(out + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, shuffleB2), _mm_shuffle_epi8(g, shuffleG2)), _mm_shuffle_epi8(r, shuffleR2)));
+		}
+
+		convertRowScalar(y + x, u + x, v + x, c, bgr + 3*x, width - x);
+	}
+
+#endif
+
+}
+
+YUVConverter::YUVConverter()
+	: _srcWidth(0)
+	, _srcHeight(0)
+	, _dstWidth(0)
+	, _dstHeight(0)
+	, _affineSrcWidth(0)
+	, _affineSrcHeight(0)
+	, _affineDstWidth(0)
+	, _affineDstHeight(0)
+	, _affineStepX(0)
+	, _affineStepY(0)
+{
+	for (int i = 0; i < 6; i++) {
+		_affineTransform[i] = 0.0;
+	}
+
+	setSimdLevel(SIMD_AVX2);
+}
+
+SimdLevel YUVConverter::detectSimdLevel()
+{
+#if defined(YUV_CONVERTER_X86) && defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	// AVX2 also needs the OS to save the YMM registers on context switches
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	return avx2 ? SIMD_AVX2 : (sse2 ? SIMD_SSE2 : SIMD_NONE);
+#elif defined(YUV_CONVERTER_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return SIMD_AVX2;
+	}
+	return __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_NONE;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+const char* YUVConverter::simdLevelName(SimdLevel level)
+{
+	switch (level) {
+	case SIMD_AVX2:
+		return "AVX2";
+	case SIMD_SSE2:
+		return "SSE2";
+	default:
+		return "scalar";
+	}
+}
+
+void YUVConverter::setSimdLevel(SimdLevel level)
+{
+	SimdLevel supported = detectSimdLevel();
+	_simdLevel = (level < supported) ? level : supported;
+
+	_blendRows = blendRowsScalar;
+	_convertRow = convertRowScalar;
+
+#ifdef YUV_CONVERTER_X86
+	if (_simdLevel == SIMD_AVX2) {
+		_blendRows = blendRowsAVX2;
+		_convertRow = convertRowAVX2;
+	}
+	else if (_simdLevel == SIMD_SSE2) {
+		_blendRows = blendRowsSSE2;
+		_convertRow = convertRowSSE2;
+	}
+#endif
+}
+
+SimdLevel YUVConverter::getSimdLevel() const
+{
+	return _simdLevel;
+}
+
+void YUVConverter::buildAxis(int srcSize, int dstSize, bool flip, AxisTable& table)
+{
+	table.index0.resize(dstSize);
+	table.index1.resize(dstSize);
+	table.weight1.resize(dstSize);
+
+	for (int d = 0; d < dstSize; d++) {
+		int mirrored = flip ? (dstSize - 1 - d) : d;
+
+		// pixel centres line up, as in cv::resize with INTER_LINEAR
+		double position = (mirrored + 0.5) * srcSize / dstSize - 0.5;
+
+		int index0 = (int)std::floor(position);
+		int weight1 = (int)((position - index0) * 256.0 + 0.5);
+
+		if (weight1 == 256) {
+			index0++;
+			weight1 = 0;
+		}
+
+		if (index0 < 0) {
+			index0 = 0;
+			weight1 = 0;
+		}
+		if (index0 >= srcSize - 1) {
+			index0 = srcSize - 1;
+			weight1 = 0;
+		}
+
+		table.index0[d] = index0;
+		table.index1[d] = (index0 + 1 < srcSize) ? index0 + 1 : index0;
+		table.weight1[d] = weight1;
+	}
+}
+
+void YUVConverter::buildTables(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+	buildAxis(srcWidth, dstWidth, false, _lumaColumns);
+	buildAxis(srcHeight, dstHeight, true, _lumaRows);
+	buildAxis(srcWidth / 2, dstWidth, false, _chromaColumns);
+	buildAxis(srcHeight / 2, dstHeight, true, _chromaRows);
+
+	_blendedY.resize(srcWidth);
+	_blendedU.resize(srcWidth / 2);
+	_blendedV.resize(srcWidth / 2);
+
+	_lineY.resize(std::max((int)_lineY.size(), dstWidth));
+	_lineU.resize(std::max((int)_lineU.size(), dstWidth));
+	_lineV.resize(std::max((int)_lineV.size(), dstWidth));
+
+	_srcWidth = srcWidth;
+	_srcHeight = srcHeight;
+	_dstWidth = dstWidth;
+	_dstHeight = dstHeight;
+}
+
+void YUVConverter::resampleLine(const uint8_t* line, const AxisTable& table, uint8_t* out, int width)
+{
+	const int* index0 = &table.index0[0];
+	const int* index1 = &table.index1[0];
+	const int* weight1 = &table.weight1[0];
+
+	for (int x = 0; x < width; x++) {
+		out[x] = (uint8_t)((line[index0[x]] * (256 - weight1[x]) + line[index1[x]] * weight1[x] + 128) >> 8);
+	}
+}
+
+void YUVConverter::convertFlipScale(const cv::Mat& i420, bool fullRange, cv::Mat& out)
+{
+	int srcWidth = i420.cols;
+	int srcHeight = i420.rows * 2 / 3;
+	int chromaWidth = srcWidth / 2;
+	int chromaHeight = srcHeight / 2;
+
+	int dstWidth = out.cols;
+	int dstHeight = out.rows;
+
+	if (srcWidth != _srcWidth || srcHeight != _srcHeight || dstWidth != _dstWidth || dstHeight != _dstHeight) {
+		buildTables(srcWidth, srcHeight, dstWidth, dstHeight);
+	}
+
+	const uint8_t* planeY = i420.data;
+	const uint8_t* planeU = planeY + srcWidth * srcHeight;
+	const uint8_t* planeV = planeU + chromaWidth * chromaHeight;
+
+	const YUVCoefficients& coefficients = fullRange ? FULL_RANGE_COEFFICIENTS : LIMITED_RANGE_COEFFICIENTS;
+
+	for (int y = 0; y < dstHeight; y++) {
+		int lumaRow0 = _lumaRows.index0[y];
+		int lumaRow1 = _lumaRows.index1[y];
+		int chromaRow0 = _chromaRows.index0[y];
+		int chromaRow1 = _chromaRows.index1[y];
+
+		_blendRows(planeY + lumaRow0 * srcWidth, planeY + lumaRow1 * srcWidth, _lumaRows.weight1[y], &_blendedY[0], srcWidth);
+		_blendRows(planeU + chromaRow0 * chromaWidth, planeU + chromaRow1 * chromaWidth, _chromaRows.weight1[y], &_blendedU[0], chromaWidth);
+		_blendRows(planeV + chromaRow0 * chromaWidth, planeV + chromaRow1 * chromaWidth, _chromaRows.weight1[y], &_blendedV[0], chromaWidth);
+
+		resampleLine(&_blendedY[0], _lumaColumns, &_lineY[0], dstWidth);
+		resampleLine(&_blendedU[0], _chromaColumns, &_lineU[0], dstWidth);
+		resampleLine(&_blendedV[0], _chromaColumns, &_lineV[0], dstWidth);
+
+		_convertRow(&_lineY[0], &_lineU[0], &_lineV[0], coefficients, out.ptr<uint8_t>(y), dstWidth);
+	}
+}
+
+void YUVConverter::buildAffineTable(int srcWidth, int srcHeight, int dstWidth, int dstHeight, const cv::Mat& sourceToOutput)
+{
+	cv::Mat outputToSource;
+	cv::invertAffineTransform(sourceToOutput, outputToSource);
+
+	// source = (a b c; d e f) * output
+	double a = outputToSource.at<double>(0, 0);
+	double b = outputToSource.at<double>(0, 1);
+	double c = outputToSource.at<double>(0, 2);
+	double d = outputToSource.at<double>(1, 0);
+	double e = outputToSource.at<double>(1, 1);
+	double f = outputToSource.at<double>(1, 2);
+
+	_affineStepX = toFixed(a);
+	_affineStepY = toFixed(d);
+
+	_affineRows.resize(dstHeight);
+
+	for (int y = 0; y < dstHeight; y++) {
+		double rowX = b * y + c;
+		double rowY = e * y + f;
+
+		// output pixels whose centre falls on a source pixel
+		double lower = 0.0;
+		double upper = dstWidth;
+		clipInterval(rowX, a, -0.5, srcWidth - 0.5, lower, upper);
+		clipInterval(rowY, d, -0.5, srcHeight - 0.5, lower, upper);
+
+		RowSpan& span = _affineRows[y];
+		span.first = std::min(std::max((int)std::ceil(lower), 0), dstWidth);
+		span.last = std::min(std::max((int)std::ceil(upper), span.first), dstWidth);
+
+		// computed per row from the doubles, so stepping errors never add up over the frame
+		span.sourceX = toFixed(rowX + a * span.first);
+		span.sourceY = toFixed(rowY + d * span.first);
+	}
+
+	for (int i = 0; i < 6; i++) {
+		_affineTransform[i] = sourceToOutput.at<double>(i / 3, i % 3);
+	}
+	_affineSrcWidth = srcWidth;
+	_affineSrcHeight = srcHeight;
+	_affineDstWidth = dstWidth;
+	_affineDstHeight = dstHeight;
+
+	_lineY.resize(std::max((int)_lineY.size(), dstWidth));
+	_lineU.resize(std::max((int)_lineU.size(), dstWidth));
+	_lineV.resize(std::max((int)_lineV.size(), dstWidth));
+}
+
+void YUVConverter::convertAffine(const cv::Mat& i420, bool fullRange, const cv::Mat& sourceToOutput, cv::Mat& out)
+{
+	int srcWidth = i420.cols;
+	int srcHeight = i420.rows * 2 / 3;
+	int chromaWidth = srcWidth / 2;
+	int chromaHeight = srcHeight / 2;
+
+	int dstWidth = out.cols;
+	int dstHeight = out.rows;
+
+	bool changed = srcWidth != _affineSrcWidth || srcHeight != _affineSrcHeight || dstWidth != _affineDstWidth || dstHeight != _affineDstHeight;
+	for (int i = 0; i < 6 && !changed; i++) {
+		changed = sourceToOutput.at<double>(i / 3, i % 3) != _affineTransform[i];
+	}
+
+	if (changed) {
+		buildAffineTable(srcWidth, srcHeight, dstWidth, dstHeight, sourceToOutput);
+	}
+
+	const uint8_t* planeY = i420.data;
+	const uint8_t* planeU = planeY + srcWidth * srcHeight;
+	const uint8_t* planeV = planeU + chromaWidth * chromaHeight;
+
+	const YUVCoefficients& coefficients = fullRange ? FULL_RANGE_COEFFICIENTS : LIMITED_RANGE_COEFFICIENTS;
+
+	int32_t maxLumaX = (srcWidth - 1) << FIXED_SHIFT;
+	int32_t maxLumaY = (srcHeight - 1) << FIXED_SHIFT;
+	int32_t maxChromaX = (chromaWidth - 1) << FIXED_SHIFT;
+	int32_t maxChromaY = (chromaHeight - 1) << FIXED_SHIFT;
+
+	// chroma samples sit between pairs of luma samples: c = l / 2 - 0.25
+	const int32_t chromaOffset = 1 << (FIXED_SHIFT - 2);
+
+	uint8_t* lineY = &_lineY[0];
+	uint8_t* lineU = &_lineU[0];
+	uint8_t* lineV = &_lineV[0];
+	const int32_t stepX = _affineStepX;
+	const int32_t stepY = _affineStepY;
+
+	for (int y = 0; y < dstHeight; y++) {
+		const RowSpan& span = _affineRows[y];
+		uint8_t* outRow = out.ptr<uint8_t>(y);
+
+		// outside the source stays black
+		memset(outRow, 0, 3 * span.first);
+		memset(outRow + 3 * span.last, 0, 3 * (dstWidth - span.last));
+
+		int32_t sourceX = span.sourceX;
+		int32_t sourceY = span.sourceY;
+
+		for (int x = span.first; x < span.last; x++) {
+			int32_t lumaX = clampFixed(sourceX, maxLumaX);
+			int32_t lumaY = clampFixed(sourceY, maxLumaY);
+			int32_t chromaX = clampFixed((lumaX >> 1) - chromaOffset, maxChromaX);
+			int32_t chromaY = clampFixed((lumaY >> 1) - chromaOffset, maxChromaY);
+
+			BilinearTap lumaTap;
+			BilinearTap chromaTap;
+			makeTap(lumaX, lumaY, srcWidth, srcWidth, srcHeight, lumaTap);
+			makeTap(chromaX, chromaY, chromaWidth, chromaWidth, chromaHeight, chromaTap);
+
+			lineY[x] = sampleTap(planeY, lumaTap);
+			lineU[x] = sampleTap(planeU, chromaTap);
+			lineV[x] = sampleTap(planeV, chromaTap);
+
+			sourceX += stepX;
+			sourceY += stepY;
+		}
+
+		if (span.last > span.first) {
+			_convertRow(lineY + span.first, lineU + span.first, lineV + span.first, coefficients, outRow + 3 * span.first, span.last - span.first);
+		}
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+
+YUVConverter turns a planar YUV 4:2:0 frame (I420) into a BGR image of any
+size in a single pass over the output. For every output row it blends the
+two source rows the row falls between, resamples them to the output width
+and converts them to BGR straight into the output image. The image is
+flipped vertically on the way, which is what the OpenGL background expects.
+
+This replaces sws_scale (to RGB), flip() and resize(), which each wrote a
+full copy of the frame.
+
+convertAffine() goes one step further and also applies an affine transform
+(the camera homography), sampling the source directly for every output
+pixel that lands inside it and filling the rest with black. Because the
+transform is affine, the source position moves by a constant step along an
+output row, so its cached table only holds the span of valid pixels and a
+fixed-point start position per row. The table is rebuilt only when the
+transform or the frame sizes change.
+
+The row blending and colour conversion run on AVX2 or SSE2 when the CPU has
+them (checked at run time), and in plain C++ otherwise. All paths use the
+same fixed-point arithmetic, so they give identical results. Horizontal
+resampling uses lookup tables that are only rebuilt when the source or
+output size changes.
+
+The I420 frame is a CV_8UC1 Mat of height * 3/2 rows: the Y plane followed
+by the U and V planes at half resolution. Width and height must be even.
+Colours are BT.601, either full range (JPEG/MJPEG) or limited range (most
+video codecs).
+
+Not thread-safe; each thread that converts frames needs its own instance.
+
+*/
+
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+enum SimdLevel
+{
+	SIMD_NONE = 0,
+	SIMD_SSE2 = 1,
+	SIMD_AVX2 = 2
+};
+
+// Fixed-point BT.601 coefficients, scaled by 64
+struct YUVCoefficients
+{
+	int16_t yOffset;
+	int16_t yScale;
+	int16_t vToR;
+	int16_t uToG;
+	int16_t vToG;
+	int16_t uToB;
+};
+
+class YUVConverter
+{
+public:
+	YUVConverter();
+
+	// Converts an I420 frame into out, flipping it vertically and scaling it
+	// bilinearly to the size of out. out must already be allocated as CV_8UC3.
+	void convertFlipScale(const cv::Mat& i420, bool fullRange, cv::Mat& out);
+
+	// Converts an I420 frame into out through a 2x3 (CV_64F) transform from
+	// source pixel coordinates to output pixel coordinates, like warpAffine
+	// with bilinear sampling and a black border. out must be allocated as CV_8UC3.
+	void convertAffine(const cv::Mat& i420, bool fullRange, const cv::Mat& sourceToOutput, cv::Mat& out);
+
+	// Limits the code path used, e.g. to compare them. Clamped to what the CPU supports.
+	void setSimdLevel(SimdLevel level);
+	SimdLevel getSimdLevel() const;
+
+	// Highest instruction set this CPU (and OS) supports
+	static SimdLevel detectSimdLevel();
+
+	static const char* simdLevelName(SimdLevel level);
+
+	// Signatures of the per-row kernels, one version per SimdLevel
+	typedef void (*BlendRowsFunction)(const uint8_t* row0, const uint8_t* row1, int weight1, uint8_t* out, int width);
+	typedef void (*ConvertRowFunction)(const uint8_t* y, const uint8_t* u, const uint8_t* v, const YUVCoefficients& coefficients, uint8_t* bgr, int width);
+
+private:
+	// Source sample pairs and weights (out of 256) for every output column or row
+	struct AxisTable
+	{
+		std::vector<int> index0;
+		std::vector<int> index1;
+		std::vector<int> weight1;
+	};
+
+	static void buildAxis(int srcSize, int dstSize, bool flip, AxisTable& table);
+
+	// Part of an output row that samples the source, and where it starts in the source (16.16 fixed point)
+	struct RowSpan
+	{
+		int first;
+		int last;
+		int32_t sourceX;
+		int32_t sourceY;
+	};
+
+	void buildAffineTable(int srcWidth, int srcHeight, int dstWidth, int dstHeight, const cv::Mat& sourceToOutput);
+
+	void buildTables(int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+	// Resamples one blended source line to the output width
+	static void resampleLine(const uint8_t* line, const AxisTable& table, uint8_t* out, int width);
+
+	SimdLevel _simdLevel;
+	BlendRowsFunction _blendRows;
+	ConvertRowFunction _convertRow;
+
+	// Sizes the tables were built for
+	int _srcWidth;
+	int _srcHeight;
+	int _dstWidth;
+	int _dstHeight;
+
+	AxisTable _lumaColumns;
+	AxisTable _lumaRows;
+	AxisTable _chromaColumns;
+	AxisTable _chromaRows;
+
+	// Transform, sizes and per-row spans of the cached affine table
+	double _affineTransform[6];
+	int _affineSrcWidth;
+	int _affineSrcHeight;
+	int _affineDstWidth;
+	int _affineDstHeight;
+	std::vector<RowSpan> _affineRows;
+	int32_t _affineStepX;
+	int32_t _affineStepY;
+
+	// One source-width line per plane after blending the two source rows
+	std::vector<uint8_t> _blendedY;
+	std::vector<uint8_t> _blendedU;
+	std::vector<uint8_t> _blendedV;
+
+	// The same lines resampled to the output width
+	std::vector<uint8_t> _lineY;
+	std::vector<uint8_t> _lineU;
+	std::vector<uint8_t> _lineV;
+};
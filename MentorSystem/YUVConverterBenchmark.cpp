@@ -0,0 +1,170 @@
+#include "YUVConverterBenchmark.h"
+#include "YUVConverter.h"
+#include "VideoDecoder.h"
+#include "Config.h"
+
+#include <iostream>
+#include <chrono>
+
+namespace {
+
+	const int WARMUP_ITERATIONS = 5;
+	const int TIMED_ITERATIONS = 100;
+
+	// Gradients plus noise, so neither path gets an unrealistically easy frame
+	void fillTestFrame(cv::Mat& i420, int width, int height)
+	{
+		cv::RNG rng(12345);
+
+		for (int y = 0; y < height; y++) {
+			uint8_t* row = i420.ptr<uint8_t>(y);
+			for (int x = 0; x < width; x++) {
+				row[x] = (uint8_t)((x * 255 / width + y * 64 / height + rng.uniform(0, 16)) & 0xFF);
+			}
+		}
+
+		uint8_t* chroma = i420.ptr<uint8_t>(height);
+		int chromaSize = (width / 2) * (height / 2);
+		for (int i = 0; i < 2 * chromaSize; i++) {
+			chroma[i] = (uint8_t)(64 + (i % (width / 2)) * 128 / (width / 2) + rng.uniform(0, 8));
+		}
+	}
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+}
+
+int runYUVConverterBenchmark()
+{
+	int dstWidth = SERVER_RESOLUTION_X;
+	int dstHeight = SERVER_RESOLUTION_Y;
+
+	int sourceSizes[][2] = { { 640, 400 }, { 1280, 720 }, { 1920, 1080 } };
+	int numSourceSizes = sizeof(sourceSizes) / sizeof(sourceSizes[0]);
+
+	SimdLevel detected = YUVConverter::detectSimdLevel();
+	std::cout << "YUV conversion benchmark, output " << dstWidth << "x" << dstHeight
+		<< ", CPU supports " << YUVConverter::simdLevelName(detected) << std::endl;
+
+	for (int s = 0; s < numSourceSizes; s++) {
+		int width = sourceSizes[s][0];
+		int height = sourceSizes[s][1];
+
+		cv::Mat i420(height * 3 / 2, width, CV_8UC1);
+		fillTestFrame(i420, width, height);
+
+		uint8_t* srcPlanes[3] = { i420.data, i420.data + width * height, i420.data + width * height + (width / 2) * (height / 2) };
+		int srcLinesizes[3] = { width, width / 2, width / 2 };
+
+		// the chain the composite stage used before: convert, flip, resize
+		SwsContext* sws = sws_getContext(width, height, AV_PIX_FMT_YUVJ420P, width, height, AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR, 0, 0, 0);
+
+		cv::Mat packed(height, width, CV_8UC3);
+		cv::Mat flipped(height, width, CV_8UC3);
+		cv::Mat reference(dstHeight, dstWidth, CV_8UC3);
+
+		uint8_t* packedPlanes[1] = { packed.data };
+		int packedLinesizes[1] = { (int)packed.step };
+
+		std::chrono::steady_clock::time_point start;
+		for (int i = 0; i < WARMUP_ITERATIONS + TIMED_ITERATIONS; i++) {
+			if (i == WARMUP_ITERATIONS) {
+				start = std::chrono::steady_clock::now();
+			}
+			sws_scale(sws, srcPlanes, srcLinesizes, 0, height, packedPlanes, packedLinesizes);
+			cv::flip(packed, flipped, 0);
+			cv::resize(flipped, reference, reference.size());
+		}
+		double chainMilliseconds = millisecondsSince(start) / TIMED_ITERATIONS;
+
+		std::cout << width << "x" << height << ": sws_scale + flip + resize " << chainMilliseconds << " ms/frame" << std::endl;
+
+		cv::Mat scalarOutput;
+
+		for (int level = SIMD_NONE; level <= detected; level++) {
+			YUVConverter converter;
+			converter.setSimdLevel((SimdLevel)level);
+
+			cv::Mat fused(dstHeight, dstWidth, CV_8UC3);
+
+			for (int i = 0; i < WARMUP_ITERATIONS + TIMED_ITERATIONS; i++) {
+				if (i == WARMUP_ITERATIONS) {
+					start = std::chrono::steady_clock::now();
+				}
+				converter.convertFlipScale(i420, true, fused);
+			}
+			double fusedMilliseconds = millisecondsSince(start) / TIMED_ITERATIONS;
+
+			// the fused kernel rounds differently from swscale, so small differences are expected
+			cv::Mat difference;
+			cv::absdiff(fused, reference, difference);
+			double maxDifference;
+			cv::minMaxLoc(difference.reshape(1), NULL, &maxDifference);
+			cv::Scalar meanDifference = cv::mean(difference);
+
+			std::cout << "  fused " << YUVConverter::simdLevelName((SimdLevel)level) << ": " << fusedMilliseconds << " ms/frame ("
+				<< (chainMilliseconds / fusedMilliseconds) << "x), difference to old chain max " << maxDifference
+				<< ", mean " << (meanDifference[0] + meanDifference[1] + meanDifference[2]) / 3.0;
+
+			// every SIMD path must give exactly what the scalar one gives
+			if (level == SIMD_NONE) {
+				fused.copyTo(scalarOutput);
+			}
+			else {
+				std::cout << ", matches scalar: " << (cv::countNonZero(cv::Mat(fused != scalarOutput).reshape(1)) == 0 ? "yes" : "NO");
+			}
+			std::cout << std::endl;
+		}
+
+		// with a moved camera: the old chain warps the resized frame, the fused kernel samples the source
+		cv::Mat homography = cv::getRotationMatrix2D(cv::Point2f(dstWidth / 2.0f, dstHeight / 2.0f), 10.0, 1.2);
+		cv::Mat warped(dstHeight, dstWidth, CV_8UC3);
+
+		for (int i = 0; i < WARMUP_ITERATIONS + TIMED_ITERATIONS; i++) {
+			if (i == WARMUP_ITERATIONS) {
+				start = std::chrono::steady_clock::now();
+			}
+			sws_scale(sws, srcPlanes, srcLinesizes, 0, height, packedPlanes, packedLinesizes);
+			cv::flip(packed, flipped, 0);
+			cv::resize(flipped, reference, reference.size());
+			cv::warpAffine(reference, warped, homography, warped.size());
+		}
+		double warpChainMilliseconds = millisecondsSince(start) / TIMED_ITERATIONS;
+
+		// source pixel -> flipped and resized pixel -> screen, as VideoManager builds it
+		double scaleX = (double)dstWidth / width;
+		double scaleY = (double)dstHeight / height;
+		cv::Mat flipAndResize = (cv::Mat_<double>(3, 3) << scaleX, 0, 0.5 * scaleX - 0.5, 0, -scaleY, (height - 0.5) * scaleY - 0.5, 0, 0, 1);
+		cv::Mat homography3x3 = cv::Mat::eye(3, 3, CV_64F);
+		homography.copyTo(homography3x3(cv::Rect(0, 0, 3, 2)));
+		cv::Mat sourceToScreen = (homography3x3 * flipAndResize)(cv::Rect(0, 0, 3, 2));
+
+		YUVConverter converter;
+		cv::Mat fusedWarped(dstHeight, dstWidth, CV_8UC3);
+
+		for (int i = 0; i < WARMUP_ITERATIONS + TIMED_ITERATIONS; i++) {
+			if (i == WARMUP_ITERATIONS) {
+				start = std::chrono::steady_clock::now();
+			}
+			converter.convertAffine(i420, true, sourceToScreen, fusedWarped);
+		}
+		double fusedWarpMilliseconds = millisecondsSince(start) / TIMED_ITERATIONS;
+
+		cv::Mat difference;
+		cv::absdiff(fusedWarped, warped, difference);
+		cv::Scalar meanDifference = cv::mean(difference);
+
+		std::cout << "  with camera transform: sws_scale + flip + resize + warpAffine " << warpChainMilliseconds << " ms/frame, fused "
+			<< YUVConverter::simdLevelName(converter.getSimdLevel()) << " " << fusedWarpMilliseconds << " ms/frame ("
+			<< (warpChainMilliseconds / fusedWarpMilliseconds) << "x), mean difference "
+			<< (meanDifference[0] + meanDifference[1] + meanDifference[2]) / 3.0 << std::endl;
+
+		sws_freeContext(sws);
+	}
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+
+Micro-benchmark for YUVConverter. Times the old per-frame chain
+(sws_scale to packed colour, flip(), resize()) against the fused kernel on
+every SIMD level this CPU supports, for a few trainee resolutions scaled to
+the screen resolution, and reports how far the fused output is from the
+old one.
+
+Run the mentor with --benchmark-yuv to print the results and exit.
+
+*/
+
+// Returns 0 (the process exit code)
+int runYUVConverterBenchmark();
@@ -45,6 +45,22 @@
 #define GESTURE_PORT "8987"
 #endif
 
+//UDP port the video packets come in on, when the stream sends them as datagrams
+#ifndef VIDEO_DATAGRAM_PORT
+#define VIDEO_DATAGRAM_PORT "8986"
+#endif
+
+//-------------------------Video Sessions------------------------//
+//Most trainees whose video the mentor can watch at once
+#ifndef MAX_VIDEO_SESSIONS
+#define MAX_VIDEO_SESSIONS 4
+#endif
+
+//Stands for the session the mentor is looking at, where a message is addressed to a session
+#ifndef FOCUSED_VIDEO_SESSION
+#define FOCUSED_VIDEO_SESSION -1
+#endif
+
 //-------------------------Network Types-------------------------//
 //Code of the video network
 #ifndef VIDEO_NETWORK_CODE
@@ -61,4 +77,40 @@
 #define GESTURE_NETWORK_CODE 3
 #endif
 
+//-------------------------Video Stream--------------------------//
+//First bytes of a video stream that starts with a stream header
+#ifndef VIDEO_STREAM_HEADER_MAGIC
+#define VIDEO_STREAM_HEADER_MAGIC "MSVH"
+#endif
+
+//Size of the stream header without its codec extradata
+#ifndef VIDEO_STREAM_HEADER_SIZE
+#define VIDEO_STREAM_HEADER_SIZE 24
+#endif
+
+//Largest codec extradata (e.g. H.264 SPS/PPS) accepted in the header
+#ifndef VIDEO_STREAM_MAX_EXTRADATA_SIZE
+#define VIDEO_STREAM_MAX_EXTRADATA_SIZE 65536
+#endif
+
+//Largest width or height accepted in the header (frame buffers are sized from them)
+#ifndef VIDEO_STREAM_MAX_DIMENSION
+#define VIDEO_STREAM_MAX_DIMENSION 8192
+#endif
+
+//First bytes of the header in front of every packet, when the stream uses them
+#ifndef VIDEO_FRAME_HEADER_MAGIC
+#define VIDEO_FRAME_HEADER_MAGIC "MSVF"
+#endif
+
+//Size of the header in front of every packet
+#ifndef VIDEO_FRAME_HEADER_SIZE
+#define VIDEO_FRAME_HEADER_SIZE 28
+#endif
+
+//Version of the frame header this mentor understands
+#ifndef VIDEO_FRAME_HEADER_VERSION
+#define VIDEO_FRAME_HEADER_VERSION 1
+#endif
+
 #endif
\ No newline at end of file